@@ -0,0 +1,708 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "bootfs.h"
+#include "cfe_nvram.h"
+#include "emit.h"
+#include "flashmap.h"
+#include "image.h"
+#include "libcfenvram.h"
+#include "partition.h"
+#include "report.h"
+#include "scan.h"
+#include "secboot.h"
+#include "stats.h"
+#include "stream.h"
+
+#define BATCH_MAX_JOBS 256
+#define BATCH_OUTPUT_CHUNK (64 * 1024)
+
+enum {
+    BATCH_OK = 0,
+    BATCH_BAD,		// nvram not valid
+    BATCH_ERROR,	// cannot read/write file
+};
+
+static const char *batch_status_name[] = { "OK", "BAD", "ERROR" };
+
+static pthread_mutex_t macs_lock = PTHREAD_MUTEX_INITIALIZER;	// opts->macs and ledger, shared by edit workers
+
+typedef struct batch_result {
+    int		status;
+    size_t	offset;
+    size_t	copies;		// scan: number of valid blocks
+    uint32_t	crc;
+    int		vendor_type;
+    int		fwcrc;		// firmware crc mismatches, -1 - not checked
+    int		overlap;	// message is owner of overlapped mac range
+    uint64_t	map_blocks;	// --map: erase blocks of image
+    uint64_t	map_used;
+    int		boot;		// --boot: booted rootfs index, -1 - none
+    int		boot_cferam;
+    int		secboot;	// --secboot: status of booted cferam
+    char	msg[128];	// message text built per file (partition overlap, --secboot)
+    uint64_t	basemac;
+    uint32_t	mac_num;
+    const char	*message;
+    char	*record;	// json/csv record, rendered by worker
+    size_t	record_len;
+} batch_result_t;
+
+typedef struct batch_list {
+    char	**paths;
+    size_t	count;
+    size_t	alloc;
+} batch_list_t;
+
+typedef struct batch_ctx {
+    const batch_opts_t	*opts;
+    batch_list_t	*list;
+    batch_result_t	*results;
+    size_t		next;		// next file index, taken atomically by workers
+} batch_ctx_t;
+
+static int list_add(batch_list_t *list, const char *path)
+{
+    if (list->count == list->alloc) {
+	size_t alloc = list->alloc ? list->alloc * 2 : 1024;
+	char **paths = realloc(list->paths, alloc * sizeof(*paths));
+	if (!paths)
+	    return 1;
+	list->paths = paths;
+	list->alloc = alloc;
+    }
+    list->paths[list->count] = strdup(path);
+    if (!list->paths[list->count])
+	return 1;
+    list->count++;
+    return 0;
+}
+
+static void list_free(batch_list_t *list)
+{
+    size_t i;
+
+    for (i = 0; i < list->count; i++)
+	free(list->paths[i]);
+    free(list->paths);
+}
+
+static batch_list_t *walk_list; // nftw() has no user context
+
+static int walk_cb(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+    (void)st; (void)ftw;
+    if (type == FTW_F)
+	return list_add(walk_list, path);
+    return 0;
+}
+
+static int load_list(batch_list_t *list, const char *name)
+{
+    struct stat st;
+
+    if (strcmp(name, "-") && !stat(name, &st) && S_ISDIR(st.st_mode)) {
+	walk_list = list;
+	return nftw(name, walk_cb, 32, FTW_PHYS) ? 1 : 0;
+    }
+
+    FILE *f = strcmp(name, "-") ? fopen(name, "r") : stdin;
+    if (!f)
+	return 1;
+
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t n;
+    int retcode = 0;
+    while ((n = getline(&line, &line_size, f)) > 0) {
+	while (n && (line[n - 1] == '\n' || line[n - 1] == '\r'))
+	    line[--n] = 0;
+	if (n && list_add(list, line)) {
+	    retcode++;
+	    break;
+	}
+    }
+    free(line);
+    if (f != stdin)
+	fclose(f);
+    return retcode;
+}
+
+char **batch_load_list(const char *name, size_t *count)
+{
+    batch_list_t list = { 0 };
+
+    if (load_list(&list, name)) {
+	list_free(&list);
+	return NULL;
+    }
+    if (!list.paths)
+	list.paths = calloc(1, sizeof(*list.paths));
+    *count = list.count;
+    return list.paths;
+}
+
+void batch_free_list(char **paths, size_t count)
+{
+    batch_list_t list = { paths, count, count };
+
+    list_free(&list);
+}
+
+static int pread_full(int fd, void *buf, size_t size, off_t ofs)
+{
+    size_t done = 0;
+
+    while (done < size) {
+	ssize_t n = pread(fd, (char *)buf + done, size - done, ofs + done);
+	stats_io(STAT_BYTES_READ, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buf, size_t size, off_t ofs)
+{
+    size_t done = 0;
+
+    while (done < size) {
+	ssize_t n = pwrite(fd, (const char *)buf + done, size - done, ofs + done);
+	stats_io(STAT_BYTES_WRITTEN, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    return 0;
+}
+
+static void result_from_block(batch_result_t *res, const unsigned char *block, int vendor_type)
+{
+    const bcm68380_nvram_t *bcm_nvram = (const bcm68380_nvram_t *)block;
+
+    res->crc = bcm_nvram->crc;
+    res->mac_num = ntohl(bcm_nvram->mac_num);
+    for (int i = 0; i < 6; i++)
+	res->basemac = (res->basemac << 8) | bcm_nvram->basemac[i];
+    res->vendor_type = vendor_type >= 0 ? vendor_type : detect_cfe_nvram_vendor(block);
+}
+
+/* same checks as cfe_edit -v (libcfenvram), returns non-zero if block is not valid */
+static int result_verify(batch_result_t *res, const unsigned char *block, int vendor_type)
+{
+    cfenvram_verify_t v;
+
+    cfenvram_verify(block, sizeof(bcm68380_nvram_t), vendor_type, &v);
+    if (!v.errors)
+	return 0;
+    res->status = BATCH_BAD;
+    if (v.version != NVRAM_VERSION || !v.crc_ok || v.oldcksum_state == CFENVRAM_CKSUM_BAD) {
+	res->message = "version or checksum mismatch";
+    } else if (v.part_overlap) {
+	cfe_part_t parts[PART_NUM];
+
+	cfe_nvram_partitions(block, parts);
+	snprintf(res->msg, sizeof(res->msg), "partitions %s and %s overlap", parts[v.part_a].name, parts[v.part_b].name);
+	res->message = res->msg;
+    } else {
+	res->message = "bootline not terminated";
+    }
+    return 1;
+}
+
+/* firmware is in the same image, threads are already used per file */
+static void result_fwcrc(const batch_opts_t *opts, batch_result_t *res, const unsigned char *image, size_t size)
+{
+    fwcrc_result_t fw[2];
+
+    if (!opts->fwcrc || res->status != BATCH_OK)
+	return;
+#ifdef ENABLE_VENDOR_ELTX
+    if (res->vendor_type != VENDOR_TYPE_ELTX)
+#endif
+    {
+	res->status = BATCH_BAD;
+	res->message = "no firmware CRC in nvram layout";
+	return;
+    }
+    res->fwcrc = check_firmware_crc(image, size, NULL, image + res->offset, 1, fw);
+    if (!cfe_part_valid(&fw[0].part, size) || !cfe_part_valid(&fw[1].part, size)) {
+	res->status = BATCH_BAD;
+	res->message = "firmware partition outside of image";
+    } else if (fw[0].match == FWCRC_UNKNOWN || fw[1].match == FWCRC_UNKNOWN) {
+	res->status = BATCH_BAD;
+	res->message = fw[0].match == FWCRC_UNKNOWN ? "primary firmware CRC: unknown convention or damaged partition" :
+	    "backup firmware CRC: unknown convention or damaged partition";
+    }
+}
+
+/* --map record replaces the nvram one in json/csv output */
+static void result_map(const batch_opts_t *opts, emit_t *e, batch_result_t *res, const char *path,
+    const unsigned char *image, size_t size, const unsigned char *block)
+{
+    flash_part_usage_t usage[PART_NUM];
+    flash_map_t m;
+    int i;
+
+    if (!opts->map || res->status != BATCH_OK)
+	return;
+    if (flash_map_build(&m, image, size, NULL, opts->map)) {
+	res->status = BATCH_ERROR;
+	res->message = "cannot build flash map";
+	return;
+    }
+    flash_map_partitions(&m, image, NULL, block, usage);
+    res->map_blocks = m.blocks;
+    res->map_used = m.used_blocks;
+    for (i = 0; i < PART_NUM; i++)
+	if (usage[i].outside) {
+	    res->status = BATCH_BAD;
+	    res->message = "partition ends beyond end of image (truncated dump?)";
+	    break;
+	}
+
+    if (e->format != FORMAT_TEXT) {
+	emit_reset(e);
+	report_flash_map(e, path, &m, usage);
+	if (!e->error && (res->record = malloc(e->len))) {
+	    memcpy(res->record, e->buf, e->len);
+	    res->record_len = e->len;
+	}
+    }
+    flash_map_free(&m);
+}
+
+/* --boot record replaces the nvram one in json/csv output; files are already spread over workers, one thread per file */
+static void result_boot(const batch_opts_t *opts, emit_t *e, batch_result_t *res, const char *path,
+    const unsigned char *image, size_t size, const unsigned char *block)
+{
+    bootfs_result_t boot;
+
+    if (!opts->boot || res->status != BATCH_OK)
+	return;
+    if (bootfs_analyze(image, size, NULL, block, opts->boot, 0, &boot)) {
+	res->status = BATCH_BAD;
+	res->message = boot.reason;
+    } else if (boot.rootfs[0].outside || boot.rootfs[1].outside) {
+	res->status = BATCH_BAD;
+	res->message = "rootfs ends beyond end of image (truncated dump?)";
+    }
+    res->boot = boot.boot;
+    res->boot_cferam = boot.boot >= 0 ? boot.rootfs[boot.boot].cferam : -1;
+
+    if (e->format != FORMAT_TEXT) {
+	emit_reset(e);
+	report_boot(e, path, &boot);
+	if (!e->error && (res->record = malloc(e->len))) {
+	    memcpy(res->record, e->buf, e->len);
+	    res->record_len = e->len;
+	}
+    }
+}
+
+/* --secboot record replaces the nvram one in json/csv output; files are already spread over workers */
+static void result_secboot(const batch_opts_t *opts, emit_t *e, batch_result_t *res, const char *path,
+    const unsigned char *image, size_t size, const unsigned char *block)
+{
+    secboot_result_t sb;
+    int k, first;
+
+    if (!opts->secboot || res->status != BATCH_OK)
+	return;
+    secboot_check(opts->secboot_key, image, size, NULL, block, opts->secboot, 0, &sb);
+    res->boot = sb.boot.boot;
+    res->boot_cferam = sb.boot.boot >= 0 ? sb.boot.rootfs[sb.boot.boot].cferam : -1;
+    res->secboot = sb.boot.boot >= 0 ? sb.rootfs[sb.boot.boot].status : SECBOOT_NOIMAGE;
+    if (sb.boot.boot < 0) {
+	res->status = BATCH_BAD;
+	res->message = sb.boot.reason;
+    }
+    // booted cferam reported first (that is what CFEROM prints), then the other one
+    first = sb.boot.boot > 0;
+    for (k = 0; k < 2 && res->status == BATCH_OK; k++) {
+	int i = k ? !first : first;
+	const secboot_image_t *img = &sb.rootfs[i];
+
+	if (sb.boot.rootfs[i].cferam < 0 || img->status == SECBOOT_PASS)
+	    continue;
+	if (img->status == SECBOOT_NOIMAGE)
+	    snprintf(res->msg, sizeof(res->msg), "%s cferam.%03d cannot be read: %s", sb.boot.rootfs[i].part.name,
+		sb.boot.rootfs[i].cferam, img->reason);
+	else
+	    snprintf(res->msg, sizeof(res->msg), "%s cferam.%03d: %s %s", sb.boot.rootfs[i].part.name,
+		sb.boot.rootfs[i].cferam, secboot_code(img->status), secboot_desc(img->status));
+	res->status = BATCH_BAD;
+	res->message = res->msg;
+    }
+
+    if (e->format != FORMAT_TEXT) {
+	emit_reset(e);
+	report_secboot(e, path, &sb);
+	if (!e->error && (res->record = malloc(e->len))) {
+	    memcpy(res->record, e->buf, e->len);
+	    res->record_len = e->len;
+	}
+    }
+}
+
+/* machine-readable output: keep rendered record, printed later in input order */
+static void result_record(emit_t *e, batch_result_t *res, const char *path, const unsigned char *block)
+{
+    if (e->format == FORMAT_TEXT || res->record)
+	return;
+
+    uint64_t t = stats_begin();
+    emit_reset(e);
+    report_cfe_nvram(e, path, res->offset, block, res->vendor_type >= 0 ? res->vendor_type : detect_cfe_nvram_vendor(block));
+    stats_end(STAT_VERIFY, t);
+    if (e->error)
+	return;
+    res->record = malloc(e->len);
+    if (res->record) {
+	memcpy(res->record, e->buf, e->len);
+	res->record_len = e->len;
+    }
+}
+
+static void process_scan(const batch_opts_t *opts, emit_t *e, const char *path, batch_result_t *res)
+{
+    cfe_image_t image;
+    nvram_hit_t hit;
+
+    uint64_t t = stats_begin();
+    if (image_open(&image, path, 0)) {
+	res->status = BATCH_ERROR;
+	res->message = "cannot open";
+	return;
+    }
+    stats_end(STAT_OPEN, t);
+
+    res->copies = scan_cfe_nvram(image.mem, image.size, &hit, 1, NULL);
+    if (res->copies) {
+	res->offset = hit.offset;
+	result_from_block(res, image.mem + hit.offset, opts->vendor_type >= 0 ? opts->vendor_type : hit.vendor_type);
+	result_verify(res, image.mem + hit.offset, res->vendor_type);
+	result_fwcrc(opts, res, image.mem, image.size);
+	result_map(opts, e, res, path, image.mem, image.size, image.mem + hit.offset);
+	result_boot(opts, e, res, path, image.mem, image.size, image.mem + hit.offset);
+	result_secboot(opts, e, res, path, image.mem, image.size, image.mem + hit.offset);
+	result_record(e, res, path, image.mem + hit.offset);
+    } else {
+	res->status = BATCH_BAD;
+	res->message = "no valid nvram found";
+    }
+    image_close(&image);
+}
+
+/*
+ * edit: changed basemac/mac_num must not overlap assigned ranges, checked before
+ * the block is written; accepted range is appended to ledger like cfe_edit -e
+ */
+static int claim_mac_range(const batch_opts_t *opts, const char *path, batch_result_t *res,
+    const bcm68380_nvram_t *orig, const bcm68380_nvram_t *bcm_nvram)
+{
+    uint64_t base = macpool_mac_value(bcm_nvram->basemac);
+    uint32_t num = ntohl(bcm_nvram->mac_num), other;
+    int retcode = 1, ret;
+
+    if (!memcmp(orig->basemac, bcm_nvram->basemac, sizeof(orig->basemac)) && orig->mac_num == bcm_nvram->mac_num)
+	return 0; // range not changed, already accounted
+
+    pthread_mutex_lock(&macs_lock);
+    ret = macpool_add(opts->macs, base, num, macpool_owner(opts->macs, path), &other);
+    if (ret > 0) {
+	// owner names may move on later additions, keep a copy
+	snprintf(res->msg, sizeof(res->msg), "%s", macpool_owner_name(opts->macs, other));
+	res->status = BATCH_BAD;
+	res->message = res->msg;
+	res->overlap = 1;
+    } else if (ret < 0) {
+	res->status = BATCH_ERROR;
+	res->message = "out of memory";
+    } else if (opts->ledger && macpool_append_ledger(opts->ledger, base, num, path)) {
+	res->status = BATCH_ERROR;
+	res->message = "cannot append to ledger";
+    } else {
+	retcode = 0;
+    }
+    pthread_mutex_unlock(&macs_lock);
+    return retcode;
+}
+
+/* only the nvram block is read (and written back on edit), the rest of image is not touched */
+static void process_block(const batch_opts_t *opts, emit_t *e, const char *path, batch_result_t *res)
+{
+    unsigned char block[sizeof(bcm68380_nvram_t)];
+    bcm68380_nvram_t *bcm_nvram = (bcm68380_nvram_t *)block, orig;
+    int fd;
+
+    res->offset = opts->nvram_offset;
+    uint64_t t = stats_begin();
+    fd = open(path, opts->edit ? O_RDWR : O_RDONLY);
+    stats_syscall();
+    stats_end(STAT_OPEN, t);
+    if (fd < 0) {
+	res->status = BATCH_ERROR;
+	res->message = "cannot open";
+	return;
+    }
+
+    t = stats_begin();
+    if (pread_full(fd, block, sizeof(block), opts->nvram_offset)) {
+	res->status = BATCH_ERROR;
+	res->message = "nvram offset outside of file";
+	goto exit;
+    }
+    stats_end(STAT_READ, t);
+
+    if (opts->edit) {
+	memcpy(&orig, block, sizeof(orig));
+	if (opts->edit(block, opts->edit_ctx)) {
+	    res->status = BATCH_BAD;
+	    res->message = "edit failed";
+	    goto exit;
+	}
+	if (ntohl(bcm_nvram->version) != NVRAM_VERSION) {
+	    res->status = BATCH_BAD;
+	    res->message = "wrong nvram version, not edited";
+	    goto exit;
+	}
+	t = stats_begin();
+	bcm_nvram->crc = htonl(calc_cfe_nvram_crc(block));
+	stats_end(STAT_CHECK, t);
+    }
+
+    res->vendor_type = opts->vendor_type;
+    t = stats_begin();
+    // edited block is written back after version and checksum check only, like cfe_edit -e
+    if (opts->edit && check_cfe_nvram(block)) {
+	res->status = BATCH_BAD;
+	res->message = "version or checksum mismatch";
+	result_record(e, res, path, block);
+	goto exit;
+    }
+    if (!opts->edit && result_verify(res, block, opts->vendor_type)) {
+	result_record(e, res, path, block);
+	goto exit;
+    }
+    stats_end(STAT_VERIFY, t);
+    result_from_block(res, block, opts->vendor_type);
+    res->copies = 1;
+
+    if (opts->edit && opts->macs && claim_mac_range(opts, path, res, &orig, bcm_nvram)) {
+	result_record(e, res, path, block);
+	goto exit;
+    }
+    if (opts->edit) {
+	t = stats_begin();
+	stats_syscall(); // fdatasync
+	if (pwrite_full(fd, block, sizeof(block), opts->nvram_offset) || fdatasync(fd)) {
+	    res->status = BATCH_ERROR;
+	    res->message = "cannot write nvram block";
+	    goto exit;
+	}
+	stats_end(STAT_WRITE, t);
+    }
+    if (opts->fwcrc || opts->map || opts->boot || opts->secboot) {
+	cfe_image_t image;
+
+	if (image_open(&image, path, 0)) {
+	    res->status = BATCH_ERROR;
+	    res->message = "cannot map image";
+	    goto exit;
+	}
+	t = stats_begin();
+	result_fwcrc(opts, res, image.mem, image.size);
+	stats_end(STAT_FWCRC, t);
+	t = stats_begin();
+	result_map(opts, e, res, path, image.mem, image.size, block);
+	result_boot(opts, e, res, path, image.mem, image.size, block);
+	result_secboot(opts, e, res, path, image.mem, image.size, block);
+	stats_end(STAT_VERIFY, t);
+	image_close(&image);
+    }
+    result_record(e, res, path, block);
+
+    exit:
+    close(fd);
+    stats_syscall();
+}
+
+/* compressed dump: read-only, decompressed up to the nvram block (first valid one with scan) */
+static void process_stream(const batch_opts_t *opts, emit_t *e, const char *path, batch_result_t *res)
+{
+    unsigned char block[sizeof(bcm68380_nvram_t)];
+    size_t offset;
+
+    if (opts->edit || opts->fwcrc || opts->map || opts->boot || opts->secboot) {
+	res->status = BATCH_ERROR;
+	res->message = opts->edit ? "compressed image is read-only" : "compressed image: only nvram is decompressed";
+	return;
+    }
+    uint64_t t = stats_begin();
+    if (stream_read_nvram(path, opts->nvram_offset, opts->scan, block, &offset)) {
+	res->status = opts->scan ? BATCH_BAD : BATCH_ERROR;
+	res->message = opts->scan ? "no valid nvram found" : "cannot decompress nvram block";
+	return;
+    }
+    stats_end(STAT_READ, t);
+    res->offset = offset;
+    if (result_verify(res, block, opts->vendor_type)) {
+	res->vendor_type = opts->vendor_type;
+    } else {
+	result_from_block(res, block, opts->vendor_type);
+	res->copies = 1;
+    }
+    result_record(e, res, path, block);
+}
+
+static void *batch_worker(void *arg)
+{
+    batch_ctx_t *ctx = arg;
+    emit_t e;
+    size_t i;
+
+    emit_init(&e, ctx->opts->format);
+    while ((i = __atomic_fetch_add(&ctx->next, 1, __ATOMIC_RELAXED)) < ctx->list->count) {
+	uint64_t t = stats_begin();
+
+	ctx->results[i].fwcrc = -1;
+	if (stream_type(ctx->list->paths[i]) != STREAM_NONE)
+	    process_stream(ctx->opts, &e, ctx->list->paths[i], &ctx->results[i]);
+	else if (ctx->opts->scan)
+	    process_scan(ctx->opts, &e, ctx->list->paths[i], &ctx->results[i]);
+	else
+	    process_block(ctx->opts, &e, ctx->list->paths[i], &ctx->results[i]);
+	stats_end(STAT_FILE, t);
+    }
+    emit_free(&e);
+    return NULL;
+}
+
+int batch_run(const char *list_name, const batch_opts_t *opts)
+{
+    batch_list_t list = { 0 };
+    batch_ctx_t ctx;
+    pthread_t threads[BATCH_MAX_JOBS];
+    size_t counts[3] = { 0 }, i;
+    struct timespec start, stop;
+    int jobs = opts->jobs, started;
+
+    if (load_list(&list, list_name)) {
+	fprintf(stderr, "Cannot read file list %s\n", list_name);
+	list_free(&list);
+	return 1;
+    }
+
+    if (jobs <= 0)
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs <= 0)
+	jobs = 1;
+    if (jobs > BATCH_MAX_JOBS)
+	jobs = BATCH_MAX_JOBS;
+    if ((size_t)jobs > list.count)
+	jobs = list.count ? list.count : 1;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.opts = opts;
+    ctx.list = &list;
+    ctx.results = calloc(list.count ? list.count : 1, sizeof(*ctx.results));
+    if (!ctx.results) {
+	list_free(&list);
+	return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (started = 0; started < jobs; started++)
+	if (pthread_create(&threads[started], NULL, batch_worker, &ctx))
+	    break;
+    if (!started)
+	batch_worker(&ctx);
+    for (i = 0; i < (size_t)started; i++)
+	pthread_join(threads[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    emit_t out;
+    emit_init(&out, opts->format);
+    if (opts->format == FORMAT_CSV && opts->map)
+	report_flash_map_header(&out);
+    else if (opts->format == FORMAT_CSV && opts->boot)
+	report_boot_header(&out);
+    else if (opts->format == FORMAT_CSV && opts->secboot)
+	report_secboot_header(&out);
+    else if (opts->format == FORMAT_CSV)
+	report_cfe_nvram_header(&out);
+
+    for (i = 0; i < list.count; i++) {
+	batch_result_t *res = &ctx.results[i];
+	uint32_t other;
+
+	// verify: ranges are added in input order, later image of overlapping pair is flagged
+	if (opts->macs && !opts->edit && res->status == BATCH_OK &&
+	    macpool_add(opts->macs, res->basemac, res->mac_num, macpool_owner(opts->macs, list.paths[i]), &other) > 0) {
+	    res->status = BATCH_BAD;
+	    res->message = macpool_owner_name(opts->macs, other);
+	    res->overlap = 1;
+	}
+	counts[res->status]++;
+	if (opts->format != FORMAT_TEXT) {
+	    // records are written in large chunks, problems without nvram data go to stderr
+	    if (res->record) {
+		emit_bytes_raw(&out, res->record, res->record_len);
+		free(res->record);
+	    }
+	    if (!res->record || res->overlap)
+		fprintf(stderr, "%s %s: %s%s\n", batch_status_name[res->status], list.paths[i],
+		    res->overlap ? "MAC range overlaps " : "", res->message);
+	    if (out.len >= BATCH_OUTPUT_CHUNK)
+		emit_flush(&out, STDOUT_FILENO);
+	    continue;
+	}
+
+	if (res->status != BATCH_OK) {
+	    printf("%-5s %s: %s%s\n", batch_status_name[res->status], list.paths[i],
+		res->overlap ? "MAC range overlaps " : "", res->message);
+	    continue;
+	}
+	printf("%-5s %s: offset %#zx, copies %zu, CRC %#08x, layout %s%s", batch_status_name[res->status],
+	    list.paths[i], res->offset, res->copies, res->crc, cfe_nvram_vendor_name(res->vendor_type),
+	    res->fwcrc == 0 ? ", firmware CRC ok" : "");
+	if (opts->map)
+	    printf(", used %" PRIu64 " of %" PRIu64 " blocks (%.1f%%)", res->map_used, res->map_blocks,
+		res->map_blocks ? 100.0 * res->map_used / res->map_blocks : 0.0);
+	if (opts->boot)
+	    printf(", boots %s cferam.%03d", res->boot ? "rootfs2" : "rootfs1", res->boot_cferam);
+	if (opts->secboot)
+	    printf(", %s cferam.%03d %s", res->boot ? "rootfs2" : "rootfs1", res->boot_cferam, secboot_code(res->secboot));
+	printf("\n");
+    }
+
+    emit_flush(&out, STDOUT_FILENO);
+    emit_free(&out);
+
+    double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf(opts->format == FORMAT_TEXT ? stdout : stderr, "> batch %s: %zu files, %zu ok, %zu bad, %zu errors, %d jobs, %.3f s\n", opts->edit ? "edit" : "verify",
+	list.count, counts[BATCH_OK], counts[BATCH_BAD], counts[BATCH_ERROR], started ? started : 1, elapsed);
+
+    free(ctx.results);
+    list_free(&list);
+    return counts[BATCH_BAD] + counts[BATCH_ERROR];
+}
@@ -0,0 +1,39 @@
+#ifndef CFE_BATCH_H
+#define CFE_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macpool.h"
+#include "secboot.h"
+
+typedef struct batch_opts {
+    int		jobs;			// worker threads, 0 - number of online cpus
+    int		nvram_offset;
+    int		scan;			// locate nvram blocks instead of using nvram_offset
+    int		vendor_type;		// -1 - detect
+    int		format;			// FORMAT_TEXT, FORMAT_JSON or FORMAT_CSV
+    int		fwcrc;			// check eltex firmware crcs of fullflash images
+    uint64_t	map;			// erase block size of --map (erased/used blocks, partition occupancy), 0 - no map
+    uint64_t	boot;			// erase block size of --boot (rootfs/cferam CFEROM would boot), 0 - no analysis
+    uint64_t	secboot;		// erase block size of --secboot (cferam.### authentication), 0 - no check
+    const secboot_key_t *secboot_key;
+    macpool_t	*macs;			// assigned mac ranges: verify adds every image range, edit changed ones before write
+    const char	*ledger;		// edit: changed ranges are appended here, NULL - none
+    /* edit callback, NULL - verify only; called with nvram block in memory */
+    int		(*edit)(unsigned char *nvram, void *ctx);
+    void	*edit_ctx;
+} batch_opts_t;
+
+/*
+ * process every file from list (one path per line, "-" - stdin) or every
+ * regular file under directory, print one result line per file and summary.
+ * Returns number of failed files.
+ */
+int batch_run(const char *list, const batch_opts_t *opts);
+
+/* paths from list file ("-" - stdin) or regular files under directory, NULL on error */
+char **batch_load_list(const char *list, size_t *count);
+void batch_free_list(char **paths, size_t count);
+
+#endif
@@ -0,0 +1,461 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+
+#include "cfe_nvram.h"
+#include "crc32.h"
+#include "emit.h"
+#include "hexdump.h"
+#include "image.h"
+#include "libcfenvram.h"
+#include "sha256.h"
+
+/*
+ * microbenchmarks of cfe_edit hot paths: crc and sha256 engines, verify/edit/crc of
+ * the nvram samples and open/verify/edit/write of synthetic cferom and
+ * fullflash images. cfe_edit.c is linked with main() renamed.
+ */
+
+/* cfe_edit.c */
+void hexDump(char *desc, void *addr, int len);
+int verify_cfe_nvram(const unsigned char *src_mem, int vendor_type);
+int replace_cfe_nvram_crc(unsigned char *src_mem);
+int edit_cfe_nvram(void *src_mem, const cfenvram_edit_t *edits, size_t num);
+
+/* heap allocations made by linked code, counted through -Wl,--wrap */
+static unsigned long allocs;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocs++;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    allocs++;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocs++;
+    return __real_realloc(ptr, size);
+}
+
+static const char *samples[] = { "nvram.eltx", "nvram.mgts", "nvram.rt", "nvram.uf" };
+
+/* synthetic images: erased flash with sample nvram at default offset */
+static const struct {
+    const char	*name;
+    size_t	size;
+} images[] = {
+    { "cferom-64k", 64 << 10 },
+    { "fullflash-16m", 16 << 20 },
+    { "fullflash-256m", 256 << 20 },
+};
+
+#define BENCH_NVRAM_OFFSET 0x580
+
+typedef struct bench {
+    const char		*name;
+    size_t		bytes;		// processed per op, 0 - no MB/s
+    int			(*fn)(struct bench *b);
+    unsigned char	*buf;
+    const char		*path;
+    const char		*out;
+    crc32_fn_t		crc;
+    sha256_fn_t		sha;
+    uint32_t		sink;
+} bench_t;
+
+#define BENCH_MAX_RESULTS 256
+
+static struct {
+    char	name[64];
+    double	ns;
+} results[BENCH_MAX_RESULTS];
+static int results_num;
+
+static double min_time = 0.2;	// seconds per case
+static emit_t out;
+static int out_fd;
+/* -M A8F94B010203 -S ELTX02010203 --set mem_tm=0x2C */
+static const cfenvram_edit_t edits[] = {
+    { "basemac", "A8F94B010203" },
+    { "gponsn", "ELTX02010203" },
+    { NULL, "mem_tm=0x2C" },
+};
+
+static int bench_crc(bench_t *b)
+{
+    b->sink += b->crc(b->buf, b->bytes, 0xFFFFFFFF);
+    return 0;
+}
+
+/* --secboot cferam hashing, whole blocks only */
+static int bench_sha256(bench_t *b)
+{
+    uint32_t state[8] = { 0 };
+
+    b->sha(state, b->buf, b->bytes / SHA256_BLOCK_LEN);
+    b->sink += state[0];
+    return 0;
+}
+
+static int bench_verify(bench_t *b)
+{
+    verify_cfe_nvram(b->buf, detect_cfe_nvram_vendor(b->buf));
+    return 0;
+}
+
+static int bench_edit(bench_t *b)
+{
+    return edit_cfe_nvram(b->buf, edits, sizeof(edits) / sizeof(edits[0]));
+}
+
+static int bench_replace_crc(bench_t *b)
+{
+    return replace_cfe_nvram_crc(b->buf);
+}
+
+static int bench_hexdump(bench_t *b)
+{
+    hexDump("nvram", b->buf, b->bytes);
+    return 0;
+}
+
+/* --dump path: rendered into one buffer, written to stdout (/dev/null) */
+static int bench_dump(bench_t *b)
+{
+    return hexdump_fd(STDOUT_FILENO, b->buf, b->bytes, 0, 8);
+}
+
+static int bench_open_verify(bench_t *b)
+{
+    cfe_image_t image;
+    int retcode;
+
+    if (image_open(&image, b->path, 0))
+	return 1;
+    retcode = verify_cfe_nvram(image.mem + BENCH_NVRAM_OFFSET, detect_cfe_nvram_vendor(image.mem + BENCH_NVRAM_OFFSET));
+    image_close(&image);
+    return retcode;
+}
+
+static int bench_edit_write(bench_t *b)
+{
+    cfe_image_t image;
+    int retcode;
+
+    if (image_open(&image, b->path, 0))
+	return 1;
+    retcode = edit_cfe_nvram(image.mem + BENCH_NVRAM_OFFSET, edits, sizeof(edits) / sizeof(edits[0]));
+    retcode += replace_cfe_nvram_crc(image.mem + BENCH_NVRAM_OFFSET);
+    if (!retcode)
+	retcode += image_write_patched(&image, b->out, BENCH_NVRAM_OFFSET, sizeof(bcm68380_nvram_t));
+    image_close(&image);
+    return retcode;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* run until min_time passed (at least one op), emit result record */
+static int run(bench_t *b)
+{
+    unsigned long ops = 0, batch = 1, start_allocs;
+    double start, elapsed;
+
+    // warm up caches and page cache
+    if (b->fn(b)) {
+	fprintf(stderr, "%s failed\n", b->name);
+	return 1;
+    }
+    fflush(stdout);
+
+    start_allocs = allocs;
+    start = now();
+    do {
+	unsigned long i;
+
+	for (i = 0; i < batch; i++)
+	    b->fn(b);
+	ops += batch;
+	batch *= 2;
+	elapsed = now() - start;
+    } while (elapsed < min_time);
+    fflush(stdout);
+
+    double ns = elapsed * 1e9 / ops;
+    double mbs = b->bytes ? b->bytes / (ns / 1e9) / 1e6 : 0.0;
+    double allocs_per_op = (double)(allocs - start_allocs) / ops;
+
+    if (results_num < BENCH_MAX_RESULTS) {
+	snprintf(results[results_num].name, sizeof(results[0].name), "%s", b->name);
+	results[results_num++].ns = ns;
+    }
+
+    if (out.format == FORMAT_TEXT) {
+	dprintf(out_fd, "%-34s %12.1f ns/op %10.1f MB/s %8.2f allocs/op  (%lu ops)\n", b->name, ns, mbs, allocs_per_op, ops);
+	return 0;
+    }
+    emit_begin(&out);
+    emit_str(&out, "name", b->name, strlen(b->name));
+    emit_uint(&out, "bytes", b->bytes);
+    emit_uint(&out, "ops", ops);
+    emit_double(&out, "ns_per_op", ns);
+    emit_double(&out, "mb_per_s", mbs);
+    emit_double(&out, "allocs_per_op", allocs_per_op);
+    emit_end(&out);
+    emit_flush(&out, out_fd);
+    return 0;
+}
+
+static int write_file(const char *path, const unsigned char *buf, size_t size)
+{
+    FILE *f = fopen(path, "w");
+
+    if (!f || fwrite(buf, 1, size, f) != size) {
+	perror("Cannot write synthetic image");
+	if (f)
+	    fclose(f);
+	return 1;
+    }
+    return fclose(f) != 0;
+}
+
+static int read_sample(const char *dir, const char *name, unsigned char *block)
+{
+    char path[4096];
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "r");
+    if (!f)
+	return 1;
+    size_t n = fread(block, 1, sizeof(bcm68380_nvram_t), f);
+    fclose(f);
+    return n != sizeof(bcm68380_nvram_t);
+}
+
+/* baseline from --format json run: fail if any case got slower than tolerance */
+static int compare(const char *name, double tolerance)
+{
+    char *line = NULL, *p, case_name[128];
+    size_t line_size = 0;
+    double base_ns;
+    int retcode = 0, i;
+
+    FILE *f = fopen(name, "r");
+    if (!f) {
+	perror("Cannot open baseline");
+	return 1;
+    }
+    while (getline(&line, &line_size, f) > 0) {
+	if (sscanf(line, "{\"name\":\"%127[^\"]\"", case_name) != 1 || !(p = strstr(line, "\"ns_per_op\":")) ||
+	    sscanf(p, "\"ns_per_op\":%lf", &base_ns) != 1)
+	    continue;
+	for (i = 0; i < results_num && strcmp(results[i].name, case_name); i++);
+	if (i == results_num)
+	    continue;
+	if (results[i].ns > base_ns * (1 + tolerance / 100)) {
+	    fprintf(stderr, "REGRESSION %s: %.1f ns/op, baseline %.1f ns/op (+%.1f%%)\n",
+		case_name, results[i].ns, base_ns, (results[i].ns / base_ns - 1) * 100);
+	    retcode++;
+	}
+    }
+    free(line);
+    fclose(f);
+    fprintf(stderr, "> %d regression(s) over %.0f%% against %s\n", retcode, tolerance, name);
+    return retcode;
+}
+
+int main(int argc, char **argv)
+{
+    const char *sample_dir = ".", *tmp_dir = "/tmp", *baseline = NULL;
+    unsigned char block[sizeof(bcm68380_nvram_t)], first[sizeof(bcm68380_nvram_t)];
+    char path[4096], out_path[4096], name[64];
+    double tolerance = 10;
+    int format = FORMAT_TEXT, retcode = 0, have_first = 0, c, count, i;
+    size_t k;
+
+    static const struct option options[] = {
+	{ "format",    required_argument, NULL, 'f' },
+	{ "compare",   required_argument, NULL, 'C' },
+	{ "tolerance", required_argument, NULL, 'T' },
+	{ NULL, 0, NULL, 0 }
+    };
+    while ((c = getopt_long(argc, argv, "s:d:t:", options, NULL)) != -1) {
+	switch (c) {
+	    case 's':  // nvram samples
+		sample_dir = optarg;
+		break;
+	    case 'd':  // synthetic images
+		tmp_dir = optarg;
+		break;
+	    case 't':  // seconds per case
+		min_time = atof(optarg);
+		break;
+	    case 'f':
+		if ((format = emit_format(optarg)) < 0) goto print_usage;
+		break;
+	    case 'C':
+		baseline = optarg;
+		break;
+	    case 'T':
+		tolerance = atof(optarg);
+		break;
+	    default:
+		goto print_usage;
+	}
+    }
+
+    crc32_init();
+    if (crc32_selftest_full())
+	retcode = 1;
+    sha256_init();
+    emit_init(&out, format);
+
+    // benchmarked code prints to stdout: results go to original stdout, the rest to /dev/null
+    out_fd = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (out_fd < 0 || null_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) {
+	perror("Cannot redirect stdout");
+	return 1;
+    }
+    close(null_fd);
+    static char stdout_buf[64 * 1024];
+    setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+
+    if (format == FORMAT_CSV) {
+	out.header = 1;
+	emit_begin(&out);
+	emit_str(&out, "name", NULL, 0);
+	emit_uint(&out, "bytes", 0);
+	emit_uint(&out, "ops", 0);
+	emit_double(&out, "ns_per_op", 0);
+	emit_double(&out, "mb_per_s", 0);
+	emit_double(&out, "allocs_per_op", 0);
+	emit_end(&out);
+	out.header = 0;
+	emit_flush(&out, out_fd);
+    }
+
+    // crc engines over image sizes
+    unsigned char *buf = malloc(images[2].size);
+    if (!buf) {
+	perror("Cannot allocate image buffer");
+	return 1;
+    }
+    for (k = 0; k < images[2].size; k++)
+	buf[k] = (unsigned char)(k * 131 + (k >> 9));
+
+    const crc32_engine_t *engines = crc32_engines(&count);
+    for (i = 0; i < count; i++) {
+	if (!engines[i].usable)
+	    continue;
+	for (k = 0; k < sizeof(images) / sizeof(images[0]); k++) {
+	    bench_t b = { .name = name, .fn = bench_crc, .buf = buf, .bytes = images[k].size, .crc = engines[i].fn };
+	    snprintf(name, sizeof(name), "crc32-%s/%s", engines[i].name, images[k].name);
+	    retcode += run(&b);
+	}
+    }
+    const sha256_engine_t *sha_engines = sha256_engines(&count);
+    for (i = 0; i < count; i++) {
+	if (!sha_engines[i].usable)
+	    continue;
+	// cferam images are a few hundred KB, 256 MB adds nothing but time
+	for (k = 0; k < 2; k++) {
+	    bench_t b = { .name = name, .fn = bench_sha256, .buf = buf, .bytes = images[k].size, .sha = sha_engines[i].fn };
+	    snprintf(name, sizeof(name), "sha256-%s/%s", sha_engines[i].name, images[k].name);
+	    retcode += run(&b);
+	}
+    }
+    {
+	bench_t b = { .name = "crc32-ssh/nvram", .fn = bench_crc, .buf = buf, .bytes = sizeof(bcm68380_nvram_t), .crc = ssh_crc32 };
+	retcode += run(&b);
+    }
+    {
+	bench_t b = { .name = "dump/fullflash-16m", .fn = bench_dump, .buf = buf, .bytes = images[1].size };
+	retcode += run(&b);
+    }
+
+    // nvram samples
+    for (k = 0; k < sizeof(samples) / sizeof(samples[0]); k++) {
+	if (read_sample(sample_dir, samples[k], block)) {
+	    fprintf(stderr, "Sample %s/%s not found, skipped\n", sample_dir, samples[k]);
+	    continue;
+	}
+	if (!have_first++)
+	    memcpy(first, block, sizeof(first));
+
+	bench_t b = { .name = name, .buf = block };
+	snprintf(name, sizeof(name), "verify/%s", samples[k]);
+	b.fn = bench_verify;
+	retcode += run(&b);
+	snprintf(name, sizeof(name), "edit/%s", samples[k]);
+	b.fn = bench_edit;
+	retcode += run(&b);
+	snprintf(name, sizeof(name), "replace_crc/%s", samples[k]);
+	b.fn = bench_replace_crc;
+	b.bytes = sizeof(block);
+	retcode += run(&b);
+	snprintf(name, sizeof(name), "hexdump/%s", samples[k]);
+	b.fn = bench_hexdump;
+	retcode += run(&b);
+    }
+
+    // whole command path on synthetic images
+    for (k = 0; have_first && k < sizeof(images) / sizeof(images[0]); k++) {
+	memset(buf, 0xFF, images[k].size);
+	memcpy(buf + BENCH_NVRAM_OFFSET, first, sizeof(first));
+	snprintf(path, sizeof(path), "%s/cfe_bench.%s.bin", tmp_dir, images[k].name);
+	snprintf(out_path, sizeof(out_path), "%s/cfe_bench.%s.out", tmp_dir, images[k].name);
+	if (write_file(path, buf, images[k].size)) {
+	    retcode++;
+	    continue;
+	}
+
+	bench_t b = { .name = name, .path = path, .out = out_path };
+	snprintf(name, sizeof(name), "open_verify/%s", images[k].name);
+	b.fn = bench_open_verify;
+	retcode += run(&b);
+	snprintf(name, sizeof(name), "edit_write/%s", images[k].name);
+	b.fn = bench_edit_write;
+	b.bytes = images[k].size;
+	retcode += run(&b);
+	unlink(path);
+	unlink(out_path);
+    }
+    free(buf);
+
+    if (baseline)
+	retcode += compare(baseline, tolerance);
+    emit_free(&out);
+    return retcode ? 1 : 0;
+
+    print_usage:
+    fprintf(stderr, "Usage for %s:\n"
+    " -s <dir>     directory with nvram.* samples (default .)\n"
+    " -d <dir>     directory for synthetic 64 KB, 16 MB and 256 MB images (default /tmp)\n"
+    " -t <sec>     minimum time per case (default 0.2)\n"
+    " --format <text|json|csv>  result records: name, bytes, ops, ns_per_op, mb_per_s, allocs_per_op\n"
+    " --compare <results.json> [--tolerance <percent>]  exit 1 if any case is slower than baseline (default 10%%)\n"
+    "\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,404 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "cfe_nvram.h"
+#include "bootfs.h"
+
+#define JFFS2_MAGIC		0x1985
+#define JFFS2_NODETYPE_DIRENT	0xE001
+#define JFFS2_NODETYPE_INODE	0xE002
+#define JFFS2_HDR_LEN		12
+#define JFFS2_DIRENT_NAME	40	// name after fixed dirent fields
+#define JFFS2_INODE_DATA	68	// data after fixed inode fields
+#define JFFS2_COMPR_NONE	0x00
+#define JFFS2_COMPR_ZERO	0x01	// hole, dsize zero bytes
+
+#define UBI_EC_MAGIC		"UBI#"
+#define UBI_VID_MAGIC		"UBI!"
+#define UBI_HDR_LEN		64
+#define UBI_INTERNAL_VOL_START	0x7FFFEFFF
+#define UBIFS_MAGIC		0x06101831
+#define UBIFS_CH_LEN		24
+#define UBIFS_DATA_NODE		1
+#define UBIFS_DENT_NODE		2
+#define UBIFS_DENT_NAME		56
+#define UBIFS_DATA_HDR		48	// data after common header, key, size and compression fields
+#define UBIFS_DATA_KEY		1	// key type in top 3 bits of second key word
+#define UBIFS_BLOCK_SIZE	4096
+#define UBIFS_COMPR_NONE	0
+
+#define CFERAM_NAME_LEN		10	// "cferam.###"
+#define BOOTFS_NAMES		16
+
+/* payload of one data node of the file being read */
+typedef struct file_node {
+    uint64_t	version;	// jffs2 inode version or ubifs sqnum: later node wins for its range
+    uint64_t	offset;		// payload (logical)
+    uint64_t	file_ofs;
+    uint32_t	len;
+    int		zero;		// jffs2 hole: len zero bytes, no payload
+} file_node_t;
+
+/* bootfs_read_cferam(): data nodes of ino collected during partition walk */
+typedef struct file_read {
+    uint64_t	ino;
+    file_node_t	*nodes;
+    size_t	num;
+    size_t	alloc;
+    uint64_t	size;		// file size (latest jffs2 isize, end of last ubifs block)
+    uint64_t	size_version;
+    int		compressed;	// nodes CFEROM cannot read
+    int		error;		// out of memory
+} file_read_t;
+
+/* one rootfs partition scan, own thread */
+typedef struct part_scan {
+    const unsigned char	*image;
+    uint64_t		size;		// logical
+    const nand_geom_t	*geom;
+    uint64_t		block;
+    bootfs_part_t	*res;
+    struct {
+	int		seq;
+	uint64_t	version;	// jffs2 dirent version or ubifs sqnum: latest entry of a name wins
+	int		exists;		// latest entry is not a deletion (ino/inum 0)
+	uint64_t	offset;
+	uint64_t	ino;
+    } names[BOOTFS_NAMES];
+    int			names_num;
+    file_read_t		*file;		// not NULL - also collect data nodes of file->ino
+} part_scan_t;
+
+static const char *fs_names[] = { "empty", "jffs2", "ubi" };
+
+const char *bootfs_name(int fs)
+{
+    return fs >= BOOTFS_EMPTY && fs <= BOOTFS_UBI ? fs_names[fs] : "?";
+}
+
+static inline uint32_t get_be32(const unsigned char *p) { return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+static inline uint32_t get_le32(const unsigned char *p) { return (uint32_t)p[3] << 24 | p[2] << 16 | p[1] << 8 | p[0]; }
+static inline uint16_t get_be16(const unsigned char *p) { return p[0] << 8 | p[1]; }
+static inline uint16_t get_le16(const unsigned char *p) { return p[1] << 8 | p[0]; }
+static inline uint64_t get_le64(const unsigned char *p) { return (uint64_t)get_le32(p + 4) << 32 | get_le32(p); }
+static inline uint32_t get_32(int be, const unsigned char *p) { return be ? get_be32(p) : get_le32(p); }
+
+/* logical [ofs, ofs + len) inside of image: pointer into mapped dump, or gathered into buf for raw nand */
+static const unsigned char *fetch(part_scan_t *s, uint64_t ofs, unsigned char *buf, size_t len)
+{
+    s->res->bytes_read += len;
+    if (!s->geom)
+	return s->image + ofs;
+    nand_gather(s->geom, s->image, ofs, buf, len);
+    return buf;
+}
+
+static int cferam_seq(const unsigned char *name)
+{
+    if (memcmp(name, "cferam.", 7) || name[7] < '0' || name[7] > '9' || name[8] < '0' || name[8] > '9' || name[9] < '0' || name[9] > '9')
+	return -1;
+    return (name[7] - '0') * 100 + (name[8] - '0') * 10 + name[9] - '0';
+}
+
+static void cferam_seen(part_scan_t *s, int seq, uint64_t version, uint64_t ino, uint64_t offset)
+{
+    int i;
+
+    for (i = 0; i < s->names_num && s->names[i].seq != seq; i++);
+    if (i == s->names_num) {
+	if (s->names_num == BOOTFS_NAMES)
+	    return;
+	s->names_num++;
+    } else if (s->names[i].version > version)
+	return;
+    s->names[i].seq = seq;
+    s->names[i].version = version;
+    s->names[i].exists = ino != 0;
+    s->names[i].offset = offset;
+    s->names[i].ino = ino;
+}
+
+static void file_node(file_read_t *f, uint64_t version, uint64_t offset, uint64_t file_ofs, uint32_t len, int zero)
+{
+    if (f->num == f->alloc) {
+	size_t alloc = f->alloc ? f->alloc * 2 : 256;
+	file_node_t *nodes = realloc(f->nodes, alloc * sizeof(*nodes));
+	if (!nodes) {
+	    f->error = 1;
+	    return;
+	}
+	f->nodes = nodes;
+	f->alloc = alloc;
+    }
+    f->nodes[f->num++] = (file_node_t){ version, offset, file_ofs, len, zero };
+}
+
+/* node headers of one erase block, payloads skipped by totlen */
+static void scan_jffs2_block(part_scan_t *s, uint64_t ofs, uint64_t end)
+{
+    unsigned char buf[JFFS2_INODE_DATA];
+
+    while (ofs + JFFS2_HDR_LEN <= end) {
+	const unsigned char *h = fetch(s, ofs, buf, JFFS2_HDR_LEN);
+	int be = get_be16(h) == JFFS2_MAGIC, le = get_le16(h) == JFFS2_MAGIC;
+
+	if (h[0] == 0xFF && h[1] == 0xFF)
+	    break; // free space up to end of block
+	if (!be && !le) {
+	    ofs += 4; // garbage or obsolete data, nodes are 4-byte aligned
+	    continue;
+	}
+	uint32_t totlen = get_32(be, h + 4);
+	uint16_t type = be ? get_be16(h + 2) : get_le16(h + 2);
+	if (totlen < JFFS2_HDR_LEN || totlen > end - ofs) {
+	    ofs += 4;
+	    continue;
+	}
+	if (type == JFFS2_NODETYPE_DIRENT && totlen >= JFFS2_DIRENT_NAME + CFERAM_NAME_LEN) {
+	    const unsigned char *d = fetch(s, ofs, buf, JFFS2_DIRENT_NAME + CFERAM_NAME_LEN);
+	    int seq = d[28] == CFERAM_NAME_LEN ? cferam_seq(d + JFFS2_DIRENT_NAME) : -1;
+
+	    if (seq >= 0)
+		cferam_seen(s, seq, get_32(be, d + 16), get_32(be, d + 20), ofs);
+	} else if (type == JFFS2_NODETYPE_INODE && s->file && totlen >= JFFS2_INODE_DATA) {
+	    const unsigned char *d = fetch(s, ofs, buf, JFFS2_INODE_DATA);
+	    uint32_t version = get_32(be, d + 16), csize = get_32(be, d + 48), dsize = get_32(be, d + 52);
+
+	    if (get_32(be, d + 12) == s->file->ino) {
+		if (version >= s->file->size_version) {
+		    s->file->size = get_32(be, d + 28);
+		    s->file->size_version = version;
+		}
+		if (d[56] == JFFS2_COMPR_ZERO)
+		    file_node(s->file, version, 0, get_32(be, d + 44), dsize, 1);
+		else if (d[56] != JFFS2_COMPR_NONE || csize != dsize)
+		    s->file->compressed++;
+		else if (csize <= totlen - JFFS2_INODE_DATA)
+		    file_node(s->file, version, ofs + JFFS2_INODE_DATA, get_32(be, d + 44), csize, 0);
+	    }
+	}
+	ofs += (totlen + 3) & ~3u;
+    }
+}
+
+/* ubifs nodes of one data volume leb, 8-byte aligned */
+static void scan_ubi_block(part_scan_t *s, uint64_t ofs, uint64_t end)
+{
+    unsigned char buf[UBIFS_DENT_NAME + CFERAM_NAME_LEN];
+    const unsigned char *ec = fetch(s, ofs, buf, UBI_HDR_LEN);
+    uint32_t vid_ofs = get_be32(ec + 16), data_ofs = get_be32(ec + 20);
+
+    if (vid_ofs > end - ofs - UBI_HDR_LEN || data_ofs >= end - ofs)
+	return;
+    const unsigned char *vid = fetch(s, ofs + vid_ofs, buf, UBI_HDR_LEN);
+    if (memcmp(vid, UBI_VID_MAGIC, 4) || get_be32(vid + 8) >= UBI_INTERNAL_VOL_START)
+	return; // unmapped block or volume table
+
+    for (ofs += data_ofs; ofs + UBIFS_CH_LEN <= end; ) {
+	const unsigned char *ch = fetch(s, ofs, buf, UBIFS_CH_LEN);
+	uint32_t len = get_le32(ch + 16);
+
+	if (get_le32(ch) != UBIFS_MAGIC || len < UBIFS_CH_LEN || len > end - ofs)
+	    break;
+	if (ch[20] == UBIFS_DENT_NODE && len >= sizeof(buf)) {
+	    const unsigned char *d = fetch(s, ofs, buf, sizeof(buf));
+	    int seq = get_le16(d + 50) == CFERAM_NAME_LEN ? cferam_seq(d + UBIFS_DENT_NAME) : -1;
+
+	    if (seq >= 0)
+		cferam_seen(s, seq, get_le64(d + 8), get_le64(d + 40), ofs);
+	} else if (ch[20] == UBIFS_DATA_NODE && s->file && len >= UBIFS_DATA_HDR) {
+	    const unsigned char *d = fetch(s, ofs, buf, UBIFS_DATA_HDR);
+	    uint32_t key = get_le32(d + 28), size = get_le32(d + 40);
+	    uint64_t file_ofs = (uint64_t)(key & 0x1FFFFFFF) * UBIFS_BLOCK_SIZE;
+
+	    if (get_le32(d + 24) == (uint32_t)s->file->ino && key >> 29 == UBIFS_DATA_KEY) {
+		if (get_le16(d + 44) != UBIFS_COMPR_NONE || size != len - UBIFS_DATA_HDR)
+		    s->file->compressed++;
+		else {
+		    file_node(s->file, get_le64(d + 8), ofs + UBIFS_DATA_HDR, file_ofs, size, 0);
+		    if (file_ofs + size > s->file->size)
+			s->file->size = file_ofs + size;
+		}
+	    }
+	}
+	ofs += (len + 7) & ~7u;
+    }
+}
+
+static void *scan_part(void *arg)
+{
+    part_scan_t *s = arg;
+    bootfs_part_t *r = s->res;
+    uint64_t ofs, end, jffs2 = 0, ubi = 0;
+    unsigned char buf[4];
+    int i;
+
+    r->cferam = -1;
+    r->outside = !cfe_part_valid(&r->part, s->size);
+    if (!r->part.size || r->part.offset >= s->size)
+	return NULL;
+    end = r->part.size > s->size - r->part.offset ? s->size : r->part.offset + r->part.size;
+
+    for (ofs = r->part.offset; ofs < end; ofs += s->block) {
+	uint64_t block_end = end - ofs < s->block ? end : ofs + s->block;
+	const unsigned char *h;
+
+	r->blocks++;
+	if (block_end - ofs < UBI_HDR_LEN)
+	    continue;
+	h = fetch(s, ofs, buf, sizeof(buf));
+	if (get_be16(h) == JFFS2_MAGIC || get_le16(h) == JFFS2_MAGIC) {
+	    jffs2++;
+	    scan_jffs2_block(s, ofs, block_end);
+	} else if (!memcmp(h, UBI_EC_MAGIC, 4)) {
+	    ubi++;
+	    scan_ubi_block(s, ofs, block_end);
+	}
+    }
+    r->fs = ubi > jffs2 ? BOOTFS_UBI : jffs2 ? BOOTFS_JFFS2 : BOOTFS_EMPTY;
+    r->fs_blocks = ubi > jffs2 ? ubi : jffs2;
+
+    // highest existing sequence number in partition
+    for (i = 0; i < s->names_num; i++)
+	if (s->names[i].exists && s->names[i].seq > r->cferam) {
+	    r->cferam = s->names[i].seq;
+	    r->cferam_offset = s->names[i].offset;
+	    r->cferam_ino = s->names[i].ino;
+	}
+    return NULL;
+}
+
+/* 000 follows 999 */
+static int seq_newer(int a, int b)
+{
+    if (a == 0 && b == 999)
+	return 1;
+    if (a == 999 && b == 0)
+	return 0;
+    return a > b;
+}
+
+/* bootline "p=": 0 - latest image, 1 - previous */
+static int bootline_previous(const unsigned char *nvram)
+{
+    const bcm68380_nvram_t *bcm_nvram = (const bcm68380_nvram_t *)nvram;
+    const char *b = bcm_nvram->bootline;
+    size_t i, len = strnlen(b, sizeof(bcm_nvram->bootline));
+
+    for (i = 0; i + 2 < len; i++)
+	if ((i == 0 || b[i - 1] == ' ') && b[i] == 'p' && b[i + 1] == '=')
+	    return b[i + 2] == '1';
+    return 0;
+}
+
+int bootfs_analyze(const unsigned char *image, uint64_t size, const nand_geom_t *geom, const unsigned char *nvram,
+    uint64_t block, int parallel, bootfs_result_t *res)
+{
+    part_scan_t scans[2];
+    cfe_part_t parts[PART_NUM];
+    pthread_t thread;
+    int i, threaded = 0;
+
+    memset(res, 0, sizeof(*res));
+    memset(scans, 0, sizeof(scans));
+    cfe_nvram_partitions(nvram, parts);
+    res->previous = bootline_previous(nvram);
+    for (i = 0; i < 2; i++) {
+	res->rootfs[i].part = parts[PART_ROOTFS1 + i];
+	scans[i] = (part_scan_t){ .image = image, .size = geom ? nand_logical_size(geom, size) : size,
+	    .geom = geom, .block = block, .res = &res->rootfs[i] };
+    }
+
+    // partitions are independent, the second one is scanned in its own thread
+    if (parallel)
+	threaded = !pthread_create(&thread, NULL, scan_part, &scans[1]);
+    scan_part(&scans[0]);
+    if (threaded)
+	pthread_join(thread, NULL);
+    else
+	scan_part(&scans[1]);
+
+    int seq1 = res->rootfs[0].cferam, seq2 = res->rootfs[1].cferam;
+    if (seq1 < 0 && seq2 < 0) {
+	res->boot = -1;
+	res->reason = "no cferam.### in rootfs1 or rootfs2, CFEROM stops with DIE0";
+	return 1;
+    }
+    if (seq1 < 0 || seq2 < 0) {
+	res->boot = seq1 < 0;
+	res->reason = "only rootfs with cferam.###";
+    } else if (seq1 == seq2) {
+	res->boot = 0;
+	res->reason = "same sequence number in both rootfs, first one taken";
+    } else {
+	int latest = seq_newer(seq2, seq1);
+	res->boot = res->previous ? !latest : latest;
+	res->reason = res->previous ? "previous image (lower sequence number), bootline p=1" : "latest image (higher sequence number), bootline p=0";
+    }
+    return 0;
+}
+
+static int node_cmp(const void *a, const void *b)
+{
+    const file_node_t *x = a, *y = b;
+
+    return x->version < y->version ? -1 : x->version > y->version;
+}
+
+int bootfs_read_cferam(const unsigned char *image, uint64_t size, const nand_geom_t *geom, uint64_t block,
+    const bootfs_part_t *r, unsigned char **data, uint64_t *len, const char **reason)
+{
+    file_read_t f = { .ino = r->cferam_ino };
+    bootfs_part_t part = { .part = r->part };
+    part_scan_t s = { .image = image, .size = geom ? nand_logical_size(geom, size) : size, .geom = geom,
+	.block = block, .res = &part, .file = &f };
+    unsigned char *buf = NULL;
+    size_t i;
+
+    *data = NULL;
+    *len = 0;
+    if (r->cferam < 0) {
+	*reason = "no cferam.### in partition";
+	return 1;
+    }
+    scan_part(&s);
+
+    if (f.error)
+	*reason = "out of memory";
+    else if (f.compressed)
+	*reason = "compressed cferam data node, CFEROM reads uncompressed nodes only";
+    else if (!f.num)
+	*reason = "no data nodes of cferam inode";
+    else if (f.size > r->part.size)
+	*reason = "cferam size is beyond partition size";
+    else if (!(buf = calloc(1, f.size ? f.size : 1)))
+	*reason = "out of memory";
+    if (!buf) {
+	free(f.nodes);
+	return 1;
+    }
+
+    // nodes replayed in version order, later writes of a range win
+    qsort(f.nodes, f.num, sizeof(*f.nodes), node_cmp);
+    for (i = 0; i < f.num; i++) {
+	file_node_t *n = &f.nodes[i];
+	uint64_t copy;
+
+	if (n->file_ofs >= f.size)
+	    continue;
+	copy = n->len < f.size - n->file_ofs ? n->len : f.size - n->file_ofs;
+	if (n->zero)
+	    memset(buf + n->file_ofs, 0, copy);
+	else if (geom)
+	    nand_gather(geom, image, n->offset, buf + n->file_ofs, copy);
+	else
+	    memcpy(buf + n->file_ofs, image + n->offset, copy);
+    }
+    free(f.nodes);
+    *data = buf;
+    *len = f.size;
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef CFE_BOOTFS_H
+#define CFE_BOOTFS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nand.h"
+#include "partition.h"
+
+enum {
+    BOOTFS_EMPTY = 0,	// erased or unknown data
+    BOOTFS_JFFS2,
+    BOOTFS_UBI,
+};
+
+/* what CFEROM finds in one rootfs partition */
+typedef struct bootfs_part {
+    cfe_part_t	part;
+    int		fs;		// BOOTFS_*
+    int		cferam;		// cferam.### sequence number, -1 - not found
+    uint64_t	cferam_offset;	// directory entry node (logical offset)
+    uint64_t	cferam_ino;	// inode number of cferam.### (jffs2 ino, ubifs inum)
+    uint64_t	blocks;		// erase blocks of partition inside of image
+    uint64_t	fs_blocks;	// blocks starting with jffs2 node or ubi ec header
+    uint64_t	bytes_read;	// node headers read, payloads are skipped
+    int		outside;	// partition (partially) beyond end of image
+} bootfs_part_t;
+
+typedef struct bootfs_result {
+    int			previous;	// bootline p=1: boot previous image instead of latest
+    bootfs_part_t	rootfs[2];
+    int			boot;		// booted rootfs index (0 - rootfs1), -1 - none (DIE0)
+    const char		*reason;
+} bootfs_result_t;
+
+/*
+ * CFEROM boot search over fullflash dump (raw nand dump if geom is not NULL,
+ * size is raw size): rootfs1/rootfs2 from nvram partition table are scanned
+ * block by block for jffs2 nodes or ubi/ubifs nodes with cferam.### directory
+ * entries (in two threads if parallel), then latest/previous image selected
+ * by sequence numbers and bootline p=. Returns 0 if something boots.
+ */
+int bootfs_analyze(const unsigned char *image, uint64_t size, const nand_geom_t *geom, const unsigned char *nvram,
+    uint64_t block, int parallel, bootfs_result_t *res);
+
+const char *bootfs_name(int fs);
+
+/*
+ * contents of cferam.### found in r by bootfs_analyze(), gathered the way
+ * CFEROM reads it: jffs2 inode / ubifs data nodes of its inode, latest
+ * version of every range. Only uncompressed nodes (CFEROM has no
+ * decompressor for them). *data is malloc()ed; returns 0 or 1 with *reason.
+ */
+int bootfs_read_cferam(const unsigned char *image, uint64_t size, const nand_geom_t *geom, uint64_t block,
+    const bootfs_part_t *r, unsigned char **data, uint64_t *len, const char **reason);
+
+#endif
@@ -0,0 +1,366 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "bootlog.h"
+
+/* what a code tells about the boot outcome */
+enum {
+    EV_NONE = 0,
+    EV_JFFS2,		// boot partition is jffs2
+    EV_UBI,		// ubi processing
+    EV_PART,		// partition # searched
+    EV_CFERAM,		// cferam.### searched
+    EV_AUTH,		// cfe ram authentication started, PASS or ERRx follows
+    EV_PASS,		// DRAM test or authentication passed
+    EV_FAIL,		// memory size detection failed (after SIZX)
+    EV_SIGNATURE,	// secure boot signature check error (ERRA..ERRM)
+    EV_ERROR,
+};
+
+/* transcribed from cfe_debug_prints.txt */
+static const bootlog_code_t codes[] = {
+    { "NDCK", 0, BOOTLOG_INFO,  EV_NONE,   "apply the NAND phase bump patch" },
+    { "NONE", 0, BOOTLOG_WARN,  EV_NONE,   "jffs2 magic not found in partition" },
+    { "NAN6", 0, BOOTLOG_WARN,  EV_NONE,   "NVRAM_DATA fields for this rootfs are not valid" },
+    { "NAN7", 0, BOOTLOG_WARN,  EV_NONE,   "file system info cannot be found for either rootfs, NVRAM_DATA may not be set, default values used" },
+    { "NAN8", 0, BOOTLOG_ERROR, EV_ERROR,  "cfe_launch(pucEntry) failed or (pucEntry && isize <= 0) == FALSE" },
+    { "PAR#", 1, BOOTLOG_INFO,  EV_PART,   "searching partition" },
+    { "U###", 3, BOOTLOG_INFO,  EV_UBI,    "successfully retrieved UBIFS sequence number" },
+    { "COM0", 0, BOOTLOG_INFO,  EV_UBI,    "copy of UBIFS metadata is uncommitted" },
+    { "COM1", 0, BOOTLOG_INFO,  EV_UBI,    "copy of UBIFS metadata is committed" },
+    { "UBI#", 0, BOOTLOG_INFO,  EV_UBI,    "end of UBI processing" },
+    { "BT##", 2, BOOTLOG_INFO,  EV_NONE,   "position of bootblock (stored in nvram)" },
+    { "NAN9", 0, BOOTLOG_WARN,  EV_NONE,   "bootblock position is not stored in NVRAM" },
+    { "JFFS", 0, BOOTLOG_INFO,  EV_NONE,   "NAND_FULL_PARTITION_SEARCH is done" },
+    { "J###", 3, BOOTLOG_INFO,  EV_CFERAM, "search for cferam.###" },
+    { "OVRD", 0, BOOTLOG_WARN,  EV_NONE,   "software debug is on, boot priority override" },
+    { "TRY#", 1, BOOTLOG_INFO,  EV_PART,   "searching partition for CFERAM" },
+    { "NAN3", 0, BOOTLOG_INFO,  EV_NONE,   "beginning of partition search" },
+    { "JFS2", 0, BOOTLOG_INFO,  EV_JFFS2,  "NVRAM says boot partition is JFFS2" },
+    { "RFS#", 1, BOOTLOG_INFO,  EV_PART,   "secure boot: compressed, encrypted CFE RAM is authenticated within internal memory" },
+    { "ERR1", 0, BOOTLOG_ERROR, EV_ERROR,  "nand_read_buf() <= 0 (end of flash or read error)" },
+    { "UBI!", 0, BOOTLOG_INFO,  EV_UBI,    "process UBI load (also if jffs2 not found)" },
+    { "BTL?", 0, BOOTLOG_INFO,  EV_NONE,   "authenticate the CFE RAM bootloader (boot_secure)" },
+    { "BTLA", 0, BOOTLOG_INFO,  EV_AUTH,   "authenticate the CFE RAM bootloader (boot_secure)" },
+    { "PASS", 0, BOOTLOG_INFO,  EV_PASS,   "DRAM test pass" },
+    { "NAN5", 0, BOOTLOG_INFO,  EV_NONE,   "rootfs partition CFE RAM boots from saved before CFE RAM load address" },
+    { "DIE0", 0, BOOTLOG_ERROR, EV_ERROR,  "cferam is not found, internal memory cleaned up, JTAG access enabled" },
+    { "LINX", 0, BOOTLOG_INFO,  EV_NONE,   "directly start linux from ROM" },
+    { "CMPF", 0, BOOTLOG_ERROR, EV_ERROR,  "decompression failed" },
+    { "PLLI", 0, BOOTLOG_INFO,  EV_NONE,   "pll_init() starting" },
+    { "PMCB", 0, BOOTLOG_INFO,  EV_NONE,   "WaitPmc(kPMCRunStateAVSCompleteWaitingForImage) finished" },
+    { "ERRA", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the expected message is larger than we can sign using SHA-256" },
+    { "ERRB", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the signature block provided is the wrong size" },
+    { "ERRC", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the SHA-256 digest we were passed was the wrong size" },
+    { "ERRD", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the public key modulus provided is the wrong size" },
+    { "ERRE", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the encoded message is too small to hold the required information" },
+    { "ERRF", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the seed length is not the length of a SHA-256 digest" },
+    { "ERRG", 0, BOOTLOG_ERROR, EV_SIGNATURE, "an MP division operation has failed" },
+    { "ERRH", 0, BOOTLOG_ERROR, EV_SIGNATURE, "we cannot generate a mask of the requested length" },
+    { "ERRI", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the message representative is too short to hold the required information" },
+    { "ERRJ", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the message representative did not end with the required byte 0xbc" },
+    { "ERRK", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the recovered message MB' is not null (but should have been)" },
+    { "ERRL", 0, BOOTLOG_ERROR, EV_SIGNATURE, "the computed hash does not match the recovered hash" },
+    { "ERRM", 0, BOOTLOG_ERROR, EV_SIGNATURE, "unknown SHA-256 error" },
+    { "MMU0", 0, BOOTLOG_INFO,  EV_NONE,   "armv8_mmuinit()" },
+    { "MER0", 0, BOOTLOG_INFO,  EV_NONE,   "armv8_mmuinit()" },
+    { "DRE0", 0, BOOTLOG_ERROR, EV_ERROR,  "DRAM test error" },
+    { "DRAM", 0, BOOTLOG_INFO,  EV_NONE,   "DDR init" },
+    { "SIZ#", 1, BOOTLOG_INFO,  EV_NONE,   "memory size detect (x+1 for each 2gb)" },
+    { "SIZX", 0, BOOTLOG_ERROR, EV_ERROR,  "memory size cannot be detected" },
+    { "FAIL", 0, BOOTLOG_ERROR, EV_FAIL,   "memory size cannot be detected" },
+    { "CKLP", 0, BOOTLOG_INFO,  EV_NONE,   "GPIO check loop" },
+    { "PMCE", 0, BOOTLOG_ERROR, EV_ERROR,  "PMC error" },
+    { "PMCD", 0, BOOTLOG_INFO,  EV_NONE,   "PMC done" },
+};
+
+#define CODES_NUM (sizeof(codes) / sizeof(codes[0]))
+
+/* other 4-char upper case lines (HELO, CPUI, L1CD...) are codes too, they do not end a boot */
+static const bootlog_code_t undocumented = { "????", 0, BOOTLOG_INFO, EV_NONE, "not documented in cfe_debug_prints.txt" };
+
+/*
+ * perfect hash: top 8 bits of code (4 chars as little-endian word) times
+ * multiplier, found offline for the table above; bootlog_init() rejects
+ * a table edit that makes it collide
+ */
+#define BOOTLOG_HASH_MUL 0x3328ad09u
+#define BOOTLOG_HASH_BITS 8
+
+static uint8_t slots[1 << BOOTLOG_HASH_BITS];	// codes index + 1, 0 - empty
+static uint32_t slot_keys[1 << BOOTLOG_HASH_BITS];
+static int initialized;
+
+static inline uint32_t code_key(const char *code)
+{
+    uint32_t key;
+
+    memcpy(&key, code, sizeof(key));
+    return key;
+}
+
+static inline unsigned code_hash(uint32_t key)
+{
+    return (key * BOOTLOG_HASH_MUL) >> (32 - BOOTLOG_HASH_BITS);
+}
+
+int bootlog_init(void)
+{
+    size_t i;
+
+    if (initialized)
+	return 0;
+    for (i = 0; i < CODES_NUM; i++) {
+	uint32_t key = code_key(codes[i].code);
+	unsigned h = code_hash(key);
+
+	if (slots[h]) {
+	    fprintf(stderr, "bootlog: codes %s and %s collide, new BOOTLOG_HASH_MUL needed\n", codes[slots[h] - 1].code, codes[i].code);
+	    memset(slots, 0, sizeof(slots));
+	    return 1;
+	}
+	slots[h] = i + 1;
+	slot_keys[h] = key;
+    }
+    initialized = 1;
+    return 0;
+}
+
+static inline const bootlog_code_t *lookup_key(uint32_t key)
+{
+    unsigned h = code_hash(key);
+
+    return slots[h] && slot_keys[h] == key ? &codes[slots[h] - 1] : NULL;
+}
+
+const bootlog_code_t *bootlog_lookup(const char code[4])
+{
+    const bootlog_code_t *c = lookup_key(code_key(code));
+    char pattern[4];
+    int i, digits = 0;
+
+    if (c)
+	return c;
+    // parameterized code: digits replaced by '#'
+    for (i = 0; i < 4; i++) {
+	int digit = code[i] >= '0' && code[i] <= '9';
+	pattern[i] = digit ? '#' : code[i];
+	digits += digit;
+    }
+    if (!digits || !(c = lookup_key(code_key(pattern))))
+	return NULL;
+    // exact codes with '#' (UBI#) do not take digits
+    return c->params == digits ? c : NULL;
+}
+
+/* code of line [p, end) without CR/trailing blanks and "[timestamp]" prefix, NULL if not 4 chars */
+static const char *line_code(const unsigned char *p, const unsigned char *end)
+{
+    while (end > p && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+	end--;
+    if (end - p > 4 && *p == '[') {
+	const unsigned char *close = memchr(p, ']', end - p);
+	if (!close)
+	    return NULL;
+	for (p = close + 1; p < end && (*p == ' ' || *p == '\t'); p++);
+    }
+    return end - p == 4 ? (const char *)p : NULL;
+}
+
+static int code_chars(const char *code)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+	if (!((code[i] >= 'A' && code[i] <= 'Z') || (code[i] >= '0' && code[i] <= '9') ||
+	    code[i] == '#' || code[i] == '!' || code[i] == '?'))
+	    return 0;
+    return 1;
+}
+
+static int param_value(const bootlog_code_t *c, const char *code)
+{
+    int i, value = -1;
+
+    for (i = 0; c->params && i < 4; i++)
+	if (c->code[i] == '#')
+	    value = (value < 0 ? 0 : value * 10) + code[i] - '0';
+    return value;
+}
+
+static const char *level_names[] = { "", "warning: ", "ERROR: " };
+
+static int boot_failed(const bootlog_boot_t *b)
+{
+    return b->error_code[0] != 0;
+}
+
+static void boot_report(const char *unit, size_t num, const bootlog_boot_t *b, const bootlog_opts_t *opts)
+{
+    const char *secure = b->secure > 0 ? "authenticated" : b->secure < 0 ? "failed" : "";
+
+    if (opts->format == FORMAT_TEXT) {
+	printf(">> boot %zu (lines %" PRIu64 "-%" PRIu64 ", %u codes): %s", num, b->first_line, b->last_line, b->codes,
+	    b->fs ? b->fs : "fs not reported");
+	if (b->partition >= 0)
+	    printf(", partition %d", b->partition);
+	if (b->cferam >= 0)
+	    printf(", cferam.%03d", b->cferam);
+	if (b->secure)
+	    printf(", secure boot %s", secure);
+	if (b->warnings)
+	    printf(", %u warning(s)", b->warnings);
+	if (boot_failed(b))
+	    printf(": FAILED %s %s\n", b->error_code, b->error);
+	else
+	    printf(": ok\n");
+	return;
+    }
+
+    emit_t *e = opts->out;
+    emit_begin(e);
+    emit_str(e, "unit", unit, unit ? strlen(unit) : 0);
+    emit_uint(e, "boot", num);
+    emit_uint(e, "first_line", b->first_line);
+    emit_uint(e, "last_line", b->last_line);
+    emit_uint(e, "codes", b->codes);
+    emit_uint(e, "warnings", b->warnings);
+    if (b->fs)
+	emit_str(e, "fs", b->fs, strlen(b->fs));
+    else
+	emit_null(e, "fs");
+    if (b->partition >= 0)
+	emit_uint(e, "partition", b->partition);
+    else
+	emit_null(e, "partition");
+    if (b->cferam >= 0)
+	emit_uint(e, "cferam", b->cferam);
+    else
+	emit_null(e, "cferam");
+    emit_str(e, "secure_boot", secure, strlen(secure));
+    emit_bool(e, "ok", !boot_failed(b));
+    emit_str(e, "error_code", b->error_code, strlen(b->error_code));
+    emit_str(e, "error", b->error ? b->error : "", b->error ? strlen(b->error) : 0);
+    emit_end(e);
+    if (e->len >= 64 * 1024)
+	emit_flush(e, STDOUT_FILENO);
+}
+
+void bootlog_header(emit_t *e)
+{
+    static const bootlog_boot_t empty = { .partition = -1, .cferam = -1 };
+    bootlog_opts_t opts = { .format = FORMAT_CSV, .out = e };
+
+    e->header = 1;
+    boot_report(NULL, 0, &empty, &opts);
+    e->header = 0;
+}
+
+int bootlog_decode(const char *unit, const unsigned char *log, size_t size, const bootlog_opts_t *opts, size_t *boots)
+{
+    const unsigned char *p = log, *end = log + size;
+    bootlog_boot_t boot;
+    uint64_t line = 0;
+    size_t num = 0;
+    int failed = 0, in_boot = 0, prev_event = EV_NONE;
+
+    if (bootlog_init())
+	return -1;
+    if (opts->format == FORMAT_TEXT)
+	printf("> decode-log: %s (%zu bytes)\n", unit, size);
+
+    while (p < end) {
+	const unsigned char *eol = memchr(p, '\n', end - p);
+	const bootlog_code_t *c = NULL;
+	const char *code;
+
+	if (!eol)
+	    eol = end;
+	line++;
+	if (eol == p || (eol == p + 1 && *p == '\r')) {
+	    p = eol + 1;
+	    continue; // empty lines do not end a boot
+	}
+	code = line_code(p, eol);
+	if (code && !(c = bootlog_lookup(code)) && code_chars(code))
+	    c = &undocumented;
+	p = eol + 1;
+
+	if (!c) {
+	    if (in_boot) {
+		boot_report(unit, ++num, &boot, opts);
+		failed += boot_failed(&boot);
+		in_boot = 0;
+	    }
+	    continue;
+	}
+
+	if (!in_boot) {
+	    memset(&boot, 0, sizeof(boot));
+	    boot.first_line = line;
+	    boot.partition = boot.cferam = -1;
+	    prev_event = EV_NONE;
+	    in_boot = 1;
+	}
+	boot.last_line = line;
+	boot.codes++;
+
+	int level = c->level, value = param_value(c, code);
+	const char *desc = c->desc;
+
+	switch (c->event) {
+	    case EV_JFFS2:
+		boot.fs = "jffs2";
+		break;
+	    case EV_UBI:
+		boot.fs = "ubi";
+		break;
+	    case EV_PART:
+		boot.partition = value;
+		break;
+	    case EV_CFERAM:
+		boot.cferam = value;
+		break;
+	    case EV_PASS:
+		// BTL? -> BTLA -> PASS
+		if (prev_event == EV_AUTH) {
+		    boot.secure = 1;
+		    desc = "CFE RAM bootloader authenticated (boot_secure)";
+		}
+		break;
+	    case EV_FAIL:
+		// SIZX -> FAIL, error already recorded
+		break;
+	    case EV_SIGNATURE:
+		boot.secure = -1;
+		break;
+	}
+	if (level == BOOTLOG_WARN)
+	    boot.warnings++;
+	if (level == BOOTLOG_ERROR && !boot.error_code[0]) {
+	    memcpy(boot.error_code, code, 4);
+	    boot.error = desc;
+	}
+	prev_event = c->event;
+
+	if (opts->format == FORMAT_TEXT) {
+	    printf("%8" PRIu64 ": %.4s  %s%s", line, code, level_names[level], desc);
+	    if (value >= 0)
+		printf(" (%d)", value);
+	    printf("\n");
+	}
+    }
+    if (in_boot) {
+	boot_report(unit, ++num, &boot, opts);
+	failed += boot_failed(&boot);
+    }
+    if (opts->format == FORMAT_TEXT)
+	printf("> %s: %zu boot(s), %zu ok, %d failed\n", unit, num, num - failed, failed);
+    if (boots)
+	*boots = num;
+    return failed;
+}
@@ -0,0 +1,63 @@
+#ifndef CFE_BOOTLOG_H
+#define CFE_BOOTLOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "emit.h"
+
+/*
+ * CFEROM console status codes (cfe_debug_prints.txt): 4 characters on a
+ * line of their own, optionally after a "[timestamp]" of the capture tool.
+ * A boot is a run of consecutive code lines (empty lines skipped), it ends
+ * at the first other line (CFE RAM or linux output).
+ */
+enum {
+    BOOTLOG_INFO = 0,
+    BOOTLOG_WARN,
+    BOOTLOG_ERROR,
+};
+
+typedef struct bootlog_code {
+    char	code[5];	// '#' - any digit of parameterized code
+    int		params;		// digits of parameterized code, 0 - exact code
+    int		level;		// BOOTLOG_*
+    int		event;		// what it says about boot outcome (bootlog.c)
+    const char	*desc;
+} bootlog_code_t;
+
+/* one boot of a unit */
+typedef struct bootlog_boot {
+    uint64_t	first_line;
+    uint64_t	last_line;
+    unsigned	codes;
+    unsigned	warnings;
+    const char	*fs;		// "jffs2", "ubi" or NULL
+    int		partition;	// last searched/booted partition, -1 - not reported
+    int		cferam;		// cferam.### sequence number, -1 - not reported
+    int		secure;		// 1 - cfe ram authenticated (BTLA -> PASS), -1 - failed, 0 - not reported
+    char	error_code[5];	// first error, empty - none
+    const char	*error;
+} bootlog_boot_t;
+
+typedef struct bootlog_opts {
+    int		format;		// FORMAT_TEXT: annotated code lines and summaries; json/csv: one record per boot
+    emit_t	*out;		// json/csv records, flushed per chunk by caller
+} bootlog_opts_t;
+
+/* 0 on success; perfect hash of all codes is built and checked for collisions once */
+int bootlog_init(void);
+
+/* exact code or parameterized pattern, NULL if line is not a known code */
+const bootlog_code_t *bootlog_lookup(const char code[4]);
+
+/*
+ * decode log of one unit, print annotations (text) or boot records,
+ * returns number of failed boots, -1 on error; *boots - boots found
+ */
+int bootlog_decode(const char *unit, const unsigned char *log, size_t size, const bootlog_opts_t *opts, size_t *boots);
+
+/* csv header line matching bootlog_decode() records */
+void bootlog_header(emit_t *e);
+
+#endif
@@ -0,0 +1,160 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+/* client of cfe_edit --serve: one request from arguments, or one per line from stdin */
+
+static char reply[SERVER_MAX_LINE * 4];
+static size_t reply_len;
+
+static int write_all(int fd, const char *buf, size_t size)
+{
+    while (size) {
+	ssize_t n = write(fd, buf, size);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	buf += n;
+	size -= n;
+    }
+    return 0;
+}
+
+/* append argument to request line, quoted if needed */
+static int add_arg(char *line, size_t size, size_t *len, const char *arg)
+{
+    int quote = !*arg || strpbrk(arg, " \t\"\\") != NULL;
+    size_t need = strlen(arg) * 2 + 4;
+
+    if (*len + need >= size)
+	return 1;
+    if (*len)
+	line[(*len)++] = ' ';
+    if (quote)
+	line[(*len)++] = '"';
+    for (; *arg; arg++) {
+	if (quote && (*arg == '"' || *arg == '\\'))
+	    line[(*len)++] = '\\';
+	line[(*len)++] = *arg;
+    }
+    if (quote)
+	line[(*len)++] = '"';
+    line[*len] = 0;
+    return 0;
+}
+
+/* send one request line, print payload to stdout; 0 - OK, 1 - ERR, -1 - connection error */
+static int request(int fd, const char *line)
+{
+    struct timespec start, stop;
+    size_t len = strlen(line);
+    char *eol;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (write_all(fd, line, len) || (line[len - 1] != '\n' && write_all(fd, "\n", 1))) {
+	perror("Cannot send request");
+	return -1;
+    }
+
+    while (1) {
+	while ((eol = memchr(reply, '\n', reply_len))) {
+	    size_t n = eol - reply + 1;
+	    int status = !strncmp(reply, "OK ", 3) ? 0 : !strncmp(reply, "ERR ", 4) ? 1 : -1;
+
+	    if (status < 0) {
+		fwrite(reply, 1, n, stdout);
+	    } else {
+		*eol = 0;
+		long usec = strtol(reply + 3 + status, NULL, 10);
+		char *msg = strchr(reply + 3 + status, ' ');
+
+		clock_gettime(CLOCK_MONOTONIC, &stop);
+		fflush(stdout);
+		fprintf(stderr, "> %s: server %ld us, round trip %ld us%s%s\n", status ? "ERR" : "OK", usec,
+		    (stop.tv_sec - start.tv_sec) * 1000000L + (stop.tv_nsec - start.tv_nsec) / 1000,
+		    msg ? ", " : "", msg ? msg + 1 : "");
+	    }
+	    reply_len -= n;
+	    memmove(reply, reply + n, reply_len);
+	    if (status >= 0)
+		return status;
+	}
+	if (reply_len == sizeof(reply)) {
+	    // very long payload line, pass it through
+	    fwrite(reply, 1, reply_len, stdout);
+	    reply_len = 0;
+	}
+
+	ssize_t n = read(fd, reply + reply_len, sizeof(reply) - reply_len);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0) {
+	    fprintf(stderr, "Server closed connection\n");
+	    return -1;
+	}
+	reply_len += n;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    char line[SERVER_MAX_LINE];
+    int fd, retcode = 0, i;
+
+    if (argc < 2 || strlen(argv[1]) >= sizeof(addr.sun_path)) {
+	fprintf(stderr, "Usage for %s:\n"
+	" %s <socket> <verify|get|set|stamp> <args>...  send one request\n"
+	" %s <socket>  send request lines from stdin\n"
+	"\n"
+	"   verify <image>\n"
+	"   get <image> <name|all>...\n"
+	"   set <image> <name=value>...\n"
+	"   stamp <template> <output> [name=value]...\n"
+	"\n", argv[0], argv[0], argv[0]);
+	return 1;
+    }
+    strcpy(addr.sun_path, argv[1]);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+	perror("Cannot connect to server");
+	return 1;
+    }
+
+    if (argc > 2) {
+	size_t len = 0;
+
+	line[0] = 0;
+	for (i = 2; i < argc; i++) {
+	    if (add_arg(line, sizeof(line), &len, argv[i])) {
+		fprintf(stderr, "Request is too long\n");
+		close(fd);
+		return 1;
+	    }
+	}
+	retcode = request(fd, line) != 0;
+    } else {
+	while (fgets(line, sizeof(line), stdin)) {
+	    if (line[0] == '\n' || line[0] == '#')
+		continue;
+	    int ret = request(fd, line);
+	    if (ret < 0) {
+		retcode++;
+		break;
+	    }
+	    retcode += ret;
+	}
+    }
+    close(fd);
+    return retcode ? 1 : 0;
+}
@@ -6,219 +6,67 @@
 #include <inttypes.h>
 
 #include <getopt.h>
-
-typedef struct  bcm68380_nvram {	// default offset in flash: 0x580
-    uint32_t    version;		// 0x6
-    char        bootline[0x100];	/* "e=192.168.1.1:ffffff00 h=192.168.1.100 r=f f=vmlinux i=bcm963xx_fs_kernel d=1 p=0 " */
-    char        board_id[0x10];		/* RV6699, NTU1402: 968380GERG; UFIBER NANO G: UBNT_SFU */
-    uint32_t    main_thread;		/* 0 (or 1) */
-    uint32_t    psi_size;		// 0x18
-    uint32_t    mac_num;		// 0x0A or 0x10
-    unsigned char basemac[6];		/* 0xA8F94B010203 */
-    char        salign;		// reserved?
-    uint8_t	backup_psi;		// Backup PSI: 0 disable, 1 - enable
-    uint32_t    oldcksum;		// old BROADCOM CRC (not used)
-    char        gponsn[13];		// "ELTX02010203", null-terminated
-    char        gponpass[11];		// "00000000" or "        ", null-terminated
-    char        wpspin[8];
-    char        wlanparams[0xFF];
-    uint8_t	wlan_feature;		// default 0, only ubnt bootloader has this
-    uint32_t    syslog_size;		// 0
-    uint32_t    nandpart_ofs[5];	// boot, rootfs1, rootfs2, data, bbt
-    uint32_t    nandpart_size[5];
-    char        voice_id[0x10];		// LE9530
-    char        afe_id[8];
-    char        salign1[65];
-    uint8_t	aux_percent;		// Auxilary filesystem size percent: 0
-    char	salign1a[6];
-    uint8_t	mem_tm;			// TM memory allocation RV6699-MGTS, UFIBER NANO G: 0x14; RV6699-RT: 0x2C | flow memory allocation
-    uint8_t	mem_mc;			// MC memory allocation: 0x04 | buffer memory allocation
-
-    char        salign2[10];		// Only UBNT has mappings?
-    uint8_t	part0_size;		// Partition 1 Size
-    uint8_t	part1_size;		// Partition 2 Size
-    uint8_t	part2_size;		// Partition 3 Size
-    uint8_t	part3_size;		// Partition 4 Size (DATA)
-
-    // Broadcom dongle host driver (dhd_linux.c)
-    uint8_t	mem_dhd0;		// DHD0 memory allocation RV6699-MGTS: 0; RV6699-RT: 14
-    uint8_t	mem_dhd1;		// DHD1 memory allocation
-    uint8_t	mem_dhd2;		// DHD2 memory allocation
-
-    char        salign2a;	// ??
-
-    char        vendor_params[272];
-
-    uint32_t    crc;			/* common CRC */
-} bcm68380_nvram_t;
-
-#ifdef ENABLE_VENDOR_ELTX
-#define VENDOR_TYPE_ELTX 1
-typedef struct vendor_params_eltx {
-    char	primary_version[12];	// Version of primary firmware in flash
-    char        salign2b[52];
-    char	backup_version[12];	// Version of backup firmware in flash
-    char        salign2c[52];
-    uint32_t	primary_crc;		// CRC of primary
-    uint32_t	backup_crc;		// CRC of backup
-    char        reserved[134];
-} vendor_params_eltx_t;
-#endif
-
-#ifdef ENABLE_VENDOR_UBNT
-#define VENDOR_TYPE_UBNT 2
-typedef struct vendor_params_ubnt {
-    uint8_t	olt_mode;		// UFIBER: OLT Vendor ID: 1 - UBNT, 2 - HUAWEI
-    char        salign2b;
-    uint8_t	onu_mode;		// UFIBER: ONU work mode: 0 - ENFORCE_BY_OLT, 1 - BRIDGE, 2 - ROUTER; default 0xFF
-    char        reserved[269];
-} vendor_params_ubnt_t;
-#endif
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "bootfs.h"
+#include "bootlog.h"
+#include "cfe_nvram.h"
+#include "crc32.h"
+#include "emit.h"
+#include "flashmap.h"
+#include "hexdump.h"
+#include "image.h"
+#include "index.h"
+#include "libcfenvram.h"
+#include "macpool.h"
+#include "mtd.h"
+#include "nand.h"
+#include "partition.h"
+#include "report.h"
+#include "scan.h"
+#include "secboot.h"
+#include "server.h"
+#include "stats.h"
+#include "stamp.h"
+#include "store.h"
+#include "stream.h"
 
 void hexDump (char *desc, void *addr, int len) {
-    int i;
-    unsigned char buff[17];
-    unsigned char *pc = (unsigned char*)addr;
-
     // Output description if given.
     if (desc != NULL)
         printf ("%s:\n", desc);
-
-    // Process every byte in the data.
-    for (i = 0; i < len; i++) {
-        // Multiple of 16 means new line (with line offset).
-
-        if ((i % 16) == 0) {
-            // Just don't print ASCII for the zeroth line.
-            if (i != 0)
-                printf ("  %s\n", buff);
-
-            // Output the offset.
-            printf ("  %04x ", i);
-        }
-
-        // Now the hex code for the specific character.
-        printf (" %02x", pc[i]);
-
-        // And store a printable ASCII character for later.
-        if ((pc[i] < 0x20) || (pc[i] > 0x7e))
-            buff[i % 16] = '.';
-        else
-            buff[i % 16] = pc[i];
-        buff[(i % 16) + 1] = '\0';
-    }
-
-    // Pad out last line if not exactly 16 characters.
-    while ((i % 16) != 0) {
-        printf ("   ");
-        i++;
-    }
-
-    // And print the final ASCII bit.
-    printf ("  %s\n", buff);
+    hexdump_file(stdout, addr, len, 0, hexdump_digits(len ? len - 1 : 0, 4));
 }
 
 void hexdump_nonempty(char *name, void *ptr, int size, uint8_t emptychar) {
-    void *emptyarray = malloc(size);
-    memset(emptyarray, emptychar, size);
-    if (memcmp(emptyarray, ptr, size)) {
+    const uint8_t *p = ptr;
+
+    // all bytes equal to the first one and the first one is emptychar
+    if (size && (p[0] != emptychar || memcmp(p, p + 1, size - 1))) {
 	hexDump(name, ptr, size);
     } else {
 	printf("%s is empty! (0x%02x)\n", name, emptychar);
     }
-    free (emptyarray);
 }
 
-/* реализация crc32 из openssh */
-static const uint32_t crc32tab[] = {
-        0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL,
-        0x076dc419L, 0x706af48fL, 0xe963a535L, 0x9e6495a3L,
-        0x0edb8832L, 0x79dcb8a4L, 0xe0d5e91eL, 0x97d2d988L,
-        0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L, 0x90bf1d91L,
-        0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
-        0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L,
-        0x136c9856L, 0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL,
-        0x14015c4fL, 0x63066cd9L, 0xfa0f3d63L, 0x8d080df5L,
-        0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L, 0xa2677172L,
-        0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
-        0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L,
-        0x32d86ce3L, 0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L,
-        0x26d930acL, 0x51de003aL, 0xc8d75180L, 0xbfd06116L,
-        0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L, 0xb8bda50fL,
-        0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
-        0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL,
-        0x76dc4190L, 0x01db7106L, 0x98d220bcL, 0xefd5102aL,
-        0x71b18589L, 0x06b6b51fL, 0x9fbfe4a5L, 0xe8b8d433L,
-        0x7807c9a2L, 0x0f00f934L, 0x9609a88eL, 0xe10e9818L,
-        0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
-        0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL,
-        0x6c0695edL, 0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L,
-        0x65b0d9c6L, 0x12b7e950L, 0x8bbeb8eaL, 0xfcb9887cL,
-        0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L, 0xfbd44c65L,
-        0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
-        0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL,
-        0x4369e96aL, 0x346ed9fcL, 0xad678846L, 0xda60b8d0L,
-        0x44042d73L, 0x33031de5L, 0xaa0a4c5fL, 0xdd0d7cc9L,
-        0x5005713cL, 0x270241aaL, 0xbe0b1010L, 0xc90c2086L,
-        0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
-        0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L,
-        0x59b33d17L, 0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL,
-        0xedb88320L, 0x9abfb3b6L, 0x03b6e20cL, 0x74b1d29aL,
-        0xead54739L, 0x9dd277afL, 0x04db2615L, 0x73dc1683L,
-        0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
-        0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L,
-        0xf00f9344L, 0x8708a3d2L, 0x1e01f268L, 0x6906c2feL,
-        0xf762575dL, 0x806567cbL, 0x196c3671L, 0x6e6b06e7L,
-        0xfed41b76L, 0x89d32be0L, 0x10da7a5aL, 0x67dd4accL,
-        0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
-        0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L,
-        0xd1bb67f1L, 0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL,
-        0xd80d2bdaL, 0xaf0a1b4cL, 0x36034af6L, 0x41047a60L,
-        0xdf60efc3L, 0xa867df55L, 0x316e8eefL, 0x4669be79L,
-        0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
-        0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL,
-        0xc5ba3bbeL, 0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L,
-        0xc2d7ffa7L, 0xb5d0cf31L, 0x2cd99e8bL, 0x5bdeae1dL,
-        0x9b64c2b0L, 0xec63f226L, 0x756aa39cL, 0x026d930aL,
-        0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
-        0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L,
-        0x92d28e9bL, 0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L,
-        0x86d3d2d4L, 0xf1d4e242L, 0x68ddb3f8L, 0x1fda836eL,
-        0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L, 0x18b74777L,
-        0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
-        0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L,
-        0xa00ae278L, 0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L,
-        0xa7672661L, 0xd06016f7L, 0x4969474dL, 0x3e6e77dbL,
-        0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L, 0x37d83bf0L,
-        0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
-        0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L,
-        0xbad03605L, 0xcdd70693L, 0x54de5729L, 0x23d967bfL,
-        0xb3667a2eL, 0xc4614ab8L, 0x5d681b02L, 0x2a6f2b94L,
-        0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL, 0x2d02ef8dL
-};
-
-uint32_t ssh_crc32(const uint8_t *buf, uint32_t size, uint32_t crc)
-{
-        uint32_t i;
-
-        for (i = 0;  i < size;  i++)
-                crc = crc32tab[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
-        return crc;
-}
-
-int verify_cfe_nvram(unsigned char *src_mem, int vendor_type)
+/* checks done by libcfenvram, fields printed from aligned copy */
+int verify_cfe_nvram(const unsigned char *src_mem, int vendor_type)
 {
-    uint32_t calc_crc;
     bcm68380_nvram_t bcm_nvram;
-    int retcode = 0;
+    cfenvram_verify_t v;
 
+    uint64_t t = stats_begin();
+    cfenvram_verify(src_mem, sizeof(bcm_nvram), vendor_type, &v);
+    stats_end(STAT_CHECK, t);
     memcpy(&bcm_nvram, src_mem, sizeof(bcm_nvram));
 
     printf("> broadcom nvram\n");
-    printf(">> header version    : %#x ", ntohl(bcm_nvram.version));
-    if (ntohl(bcm_nvram.version) != 6) {
+    printf(">> header version    : %#x ", v.version);
+    if (v.version != NVRAM_VERSION) {
 	printf("UNKNOWN!!!\n");
-	retcode++;
     } else {
 	printf("(OK)\n");
     }
@@ -230,21 +78,14 @@ int verify_cfe_nvram(unsigned char *src_mem, int vendor_type)
     printf(">> syslog size (KB)  : %u\n", ntohl(bcm_nvram.syslog_size));
     printf(">> AUX FS percent    : %u\n", bcm_nvram.aux_percent);
 
-    if (memchr(&bcm_nvram.bootline, 0, sizeof(bcm_nvram.bootline))) {
+    if (v.bootline_end == CFENVRAM_STR_NUL) {
 	printf(">> bootline          : \"%s\"\n", bcm_nvram.bootline);
-    } else {
+    } else if (v.bootline_end == CFENVRAM_STR_FF) {
 	// string terminated with 0xFF
-	char *bootline_cleared = malloc(sizeof(bcm_nvram.bootline));
-	memcpy(bootline_cleared, &bcm_nvram.bootline, sizeof(bcm_nvram.bootline));
-	char *end_ptr = memchr(bootline_cleared, 0xFF, sizeof(bcm_nvram.bootline));
-	if (end_ptr) {
-	    memset(end_ptr, 0, 1); //null-terminate
-	    printf(">> bootline (0xFF end) : \"%s\"\n", bootline_cleared);
-	} else {
-	    hexDump (">> bootline structure dump (unknown)", &bcm_nvram.bootline, sizeof(bcm_nvram.bootline));
-	    retcode++;
-	}
-	free(bootline_cleared);
+	printf(">> bootline (0xFF end) : \"%.*s\"\n",
+	    (int)((char *)memchr(bcm_nvram.bootline, 0xFF, sizeof(bcm_nvram.bootline)) - bcm_nvram.bootline), bcm_nvram.bootline);
+    } else {
+	hexDump (">> bootline structure dump (unknown)", &bcm_nvram.bootline, sizeof(bcm_nvram.bootline));
     }
 
     printf(">> board_id          : \"%s\"\n", bcm_nvram.board_id);
@@ -265,7 +106,6 @@ int verify_cfe_nvram(unsigned char *src_mem, int vendor_type)
     printf(">> DHD1 memory (MB)  : %u\n", bcm_nvram.mem_dhd1);
     printf(">> DHD2 memory (MB)  : %u\n", bcm_nvram.mem_dhd2);
 
-    // TODO: check offsets
     printf(">>> Nand partitions list (size in kilobytes):\n");
     printf(">>> boot,    offset: %#x,\tsize: %#x\n", ntohl(bcm_nvram.nandpart_ofs[0]), ntohl(bcm_nvram.nandpart_size[0]));
     printf(">>> rootfs1, offset: %#x,\tsize: %#x\n", ntohl(bcm_nvram.nandpart_ofs[1]), ntohl(bcm_nvram.nandpart_size[1]));
@@ -273,6 +113,13 @@ int verify_cfe_nvram(unsigned char *src_mem, int vendor_type)
     printf(">>> data,    offset: %#x,\tsize: %#x\n", ntohl(bcm_nvram.nandpart_ofs[3]), ntohl(bcm_nvram.nandpart_size[3]));
     printf(">>> bbt,     offset: %#x,\tsize: %#x\n", ntohl(bcm_nvram.nandpart_ofs[4]), ntohl(bcm_nvram.nandpart_size[4]));
 
+    // image size is not known here, see --extract for checks against it
+    if (v.part_overlap) {
+	cfe_part_t parts[PART_NUM];
+	cfe_nvram_partitions(src_mem, parts);
+	printf("***!!!*** partitions %s and %s overlap\n", parts[v.part_a].name, parts[v.part_b].name);
+    }
+
 
     switch (vendor_type) {
 #ifdef ENABLE_VENDOR_ELTX
@@ -317,27 +164,19 @@ int verify_cfe_nvram(unsigned char *src_mem, int vendor_type)
     }
 
     // old broadcom CRC (not used in V6, but need to check)
-    if (bcm_nvram.oldcksum == 0xFFFFFFFF) {
-	printf(">> oldcksum: %#08x (empty, not verified)\n", bcm_nvram.oldcksum);
+    if (v.oldcksum_state == CFENVRAM_CKSUM_EMPTY) {
+	printf(">> oldcksum: %#08x (empty, not verified)\n", v.oldcksum);
+    } else if (v.oldcksum_state == CFENVRAM_CKSUM_OK) {
+	printf(">> oldcksum: %#08x (no mismatch)\n", v.oldcksum);
     } else {
-	calc_crc = htonl(ssh_crc32(src_mem, 0x126, 0xFFFFFFFF));
-	if (calc_crc == bcm_nvram.oldcksum) {
-    	    printf(">> oldcksum: %#08x (no mismatch)\n", bcm_nvram.oldcksum);
-	} else {
-	    printf("***!!!*** calculated oldcksum mismatch: %#08x, %#08x\n", bcm_nvram.oldcksum, calc_crc);
-	    retcode++;
-	}
+	printf("***!!!*** calculated oldcksum mismatch: %#08x, %#08x\n", v.oldcksum, v.calc_oldcksum);
     }
 
     // new CRC
-    memset(src_mem + sizeof(bcm_nvram) - sizeof(bcm_nvram.crc), 0, sizeof(bcm_nvram.crc));
-    calc_crc = htonl(ssh_crc32(src_mem, sizeof(bcm_nvram), 0xFFFFFFFF));
-
-    if (calc_crc == bcm_nvram.crc) {
-        printf(">> CRC     : %#08x (no mismatch)\n", bcm_nvram.crc);
+    if (v.crc_ok) {
+        printf(">> CRC     : %#08x (no mismatch)\n", v.crc);
     } else {
-	printf("***!!!*** calculated CRC mismatch: %#08x, %#08x\n", bcm_nvram.crc, calc_crc);
-	retcode++;
+	printf("***!!!*** calculated CRC mismatch: %#08x, %#08x\n", v.crc, v.calc_crc);
     }
 
     hexdump_nonempty(">> afe_id", &bcm_nvram.afe_id, sizeof(bcm_nvram.afe_id), 0xFF);
@@ -358,117 +197,805 @@ int verify_cfe_nvram(unsigned char *src_mem, int vendor_type)
     hexdump_nonempty(">> salign2 structure", &bcm_nvram.salign2, sizeof(bcm_nvram.salign2) + salign2_extra, 0xFF);
     hexdump_nonempty(">> salign2a structure", &bcm_nvram.salign2a, sizeof(bcm_nvram.salign2a), 0xFF);
 
-    return retcode;
+    t = stats_begin();
+    fflush(stdout); // stdout is fully buffered, one write per image
+    stats_io(STAT_BYTES_WRITTEN, 0);
+    stats_end(STAT_OUTPUT, t);
+    return v.errors;
 }
 
 int replace_cfe_nvram_crc(unsigned char *src_mem)
 {
-    uint32_t calc_crc;
-    bcm68380_nvram_t bcm_nvram;
+    uint32_t old_crc, new_crc;
+
+    uint64_t t = stats_begin();
+    int ret = cfenvram_update_crc(src_mem, sizeof(bcm68380_nvram_t), &old_crc, &new_crc);
+    stats_end(STAT_CHECK, t);
+    if (ret) {
+	fprintf(stderr, "NVRAM version is wrong, dont know how to handle CRC!\n");
+	return 1;
+    }
+
+    printf(">> OLD CRC     : %#08x\n", old_crc);
+    printf(">> NEW CRC     : %#08x\n", new_crc);
+    return 0;
+}
+
+/* zstd support is optional (libzstd), usage lists only what this build decompresses */
+#ifdef ENABLE_ZSTD
+#define USAGE_ZST "/.zst"
+#else
+#define USAGE_ZST ""
+#endif
+
+#define OPT_IN_PLACE 0x100
+#define OPT_SCAN     0x101
+#define OPT_BATCH    0x102
+#define OPT_STAMP    0x103
+#define OPT_FORMAT   0x104
+#define OPT_SET      0x105
+#define OPT_GET      0x106
+#define OPT_MTD      0x107
+#define OPT_ERASESIZE 0x108
+#define OPT_FWCRC    0x109
+#define OPT_EXTRACT  0x10a
+#define OPT_NAND     0x10b
+#define OPT_INDEX    0x10c
+#define OPT_LOOKUP   0x10d
+#define OPT_DUPS     0x10e
+#define OPT_LEDGER   0x10f
+#define OPT_POOL     0x110
+#define OPT_ALLOC    0x111
+#define OPT_OWNER    0x112
+#define OPT_SERVE    0x113
+#define OPT_STATS    0x114
+#define OPT_DUMP     0x115
+#define OPT_MAP      0x116
+#define OPT_DECODE_LOG 0x117
+#define OPT_BOOT     0x118
+#define OPT_STORE    0x119
+#define OPT_RESTORE  0x11a
+#define OPT_SECBOOT  0x11b
+#define OPT_UNIT     0x11c
+
+static const char options_exist[] = "vei:o:p:t:c:j:L:B:M:S:P:V:W:I:N:A:Y:F:"; // short options, edit ones are collected into edit list
+static const struct option long_options[] = {
+    { "in-place", no_argument, NULL, OPT_IN_PLACE },
+    { "scan",     no_argument, NULL, OPT_SCAN },
+    { "batch",    required_argument, NULL, OPT_BATCH },
+    { "jobs",     required_argument, NULL, 'j' },
+    { "stamp",    required_argument, NULL, OPT_STAMP },
+    { "format",   required_argument, NULL, OPT_FORMAT },
+    { "set",      required_argument, NULL, OPT_SET },
+    { "get",      required_argument, NULL, OPT_GET },
+    { "mtd",      required_argument, NULL, OPT_MTD },
+    { "erasesize", required_argument, NULL, OPT_ERASESIZE },
+    { "fwcrc",    no_argument, NULL, OPT_FWCRC },
+    { "extract",  required_argument, NULL, OPT_EXTRACT },
+    { "nand",     required_argument, NULL, OPT_NAND },
+    { "index",    required_argument, NULL, OPT_INDEX },
+    { "lookup",   required_argument, NULL, OPT_LOOKUP },
+    { "dups",     no_argument, NULL, OPT_DUPS },
+    { "ledger",   required_argument, NULL, OPT_LEDGER },
+    { "pool",     required_argument, NULL, OPT_POOL },
+    { "alloc",    required_argument, NULL, OPT_ALLOC },
+    { "owner",    required_argument, NULL, OPT_OWNER },
+    { "serve",    required_argument, NULL, OPT_SERVE },
+    { "stats",    no_argument, NULL, OPT_STATS },
+    { "dump",     required_argument, NULL, OPT_DUMP },
+    { "map",      no_argument, NULL, OPT_MAP },
+    { "decode-log", required_argument, NULL, OPT_DECODE_LOG },
+    { "boot",     no_argument, NULL, OPT_BOOT },
+    { "store",    required_argument, NULL, OPT_STORE },
+    { "restore",  required_argument, NULL, OPT_RESTORE },
+    { "unit",     required_argument, NULL, OPT_UNIT },
+    { "secboot",  required_argument, NULL, OPT_SECBOOT },
+    { NULL, 0, NULL, 0 }
+};
+
+/* short edit options and fields they set */
+static const struct {
+    int		opt;
+    const char	*field;
+} edit_options[] = {
+    { 'L', "bootline" },
+    { 'B', "board_id" },
+    { 'M', "basemac" },
+    { 'S', "gponsn" },
+    { 'P', "gponpass" },
+    { 'V', "voice_id" },
+    { 'W', "wpspin" },
+    { 'I', "psi_size" },
+    { 'N', "mac_num" },
+    { 'A', "backup_psi" },
+    { 'Y', "syslog_size" },
+    { 'F', "wlan_feature" },
+};
+
+#define EDITS_MAX 64
+
+/* edits collected from command line by main(), applied one by one to report every bad one */
+int edit_cfe_nvram(void *src_mem, const cfenvram_edit_t *edits, size_t num)
+{
+    uint64_t t = stats_begin();
     int retcode = 0;
+    size_t i;
+
+    for (i = 0; i < num; i++) {
+	const cfenvram_edit_t *edit = &edits[i];
+	const char *eq = edit->name ? NULL : strchr(edit->value, '=');
+
+	// fields are changed directly in mapped image
+	switch (cfenvram_edit(src_mem, sizeof(bcm68380_nvram_t), edit, 1, NULL)) {
+	    case CFENVRAM_OK:
+		break;
+	    case CFENVRAM_ESYNTAX:
+		fprintf(stderr, "Expected name=value: \"%s\"\n", edit->value);
+		retcode++;
+		break;
+	    case CFENVRAM_EFIELD:
+		fprintf(stderr, "Unknown field \"%.*s\"\n", eq ? (int)(eq - edit->value) : (int)strlen(edit->name),
+		    eq ? edit->value : edit->name);
+		retcode++;
+		break;
+	    default:
+		fprintf(stderr, "Cannot set %.*s to \"%s\"\n", eq ? (int)(eq - edit->value) : (int)strlen(edit->name),
+		    eq ? edit->value : edit->name, eq ? eq + 1 : edit->value);
+		retcode++;
+		break;
+	}
+    }
 
-    memcpy(&bcm_nvram, src_mem, sizeof(bcm_nvram));
+    stats_end(STAT_EDIT, t);
+    return retcode;
+}
 
-    if (ntohl(bcm_nvram.version) != 6) {
-	fprintf(stderr, "NVRAM version is wrong, dont know how to handle CRC!\n");
+
+int get_cfe_nvram_fields(const unsigned char *src_mem, int vendor_type, const char **names, int num)
+{
+    char value[0x200];
+    const char *name;
+    int retcode = 0, i, field_vendor;
+    size_t k;
+
+    for (i = 0; i < num; i++) {
+	if (!strcmp(names[i], "all")) {
+	    // vendor fields only for matching layout
+	    for (k = 0; (name = cfenvram_field(k, &field_vendor)); k++)
+		if ((!field_vendor || field_vendor == vendor_type) &&
+		    !cfenvram_get(src_mem, sizeof(bcm68380_nvram_t), name, value, sizeof(value)))
+		    printf("%s=%s\n", name, value);
+	    continue;
+	}
+	if (cfenvram_get(src_mem, sizeof(bcm68380_nvram_t), names[i], value, sizeof(value))) {
+	    fprintf(stderr, "Unknown field \"%s\"\n", names[i]);
+	    retcode++;
+	    continue;
+	}
+	printf("%s=%s\n", names[i], value);
+    }
+    return retcode;
+}
+
+int verify_firmware_crc(cfe_image_t *image, const nand_geom_t *geom, const unsigned char *nvram, int vendor_type, int jobs)
+{
+    fwcrc_result_t res[2];
+    int retcode, i;
+
+    printf("> firmware CRC (rootfs1 - primary, rootfs2 - backup)\n");
+#ifdef ENABLE_VENDOR_ELTX
+    if (vendor_type != VENDOR_TYPE_ELTX)
+#endif
+    {
+	printf("***!!!*** no firmware CRC in %s nvram layout (eltex only, -t 1)\n", cfe_nvram_vendor_name(vendor_type));
+	fflush(stdout);
+	return 1;
+    }
+
+    uint64_t size = geom ? nand_logical_size(geom, image->size) : image->size;
+
+    retcode = check_firmware_crc(image->mem, image->size, geom, nvram, jobs, res);
+    for (i = 0; i < 2; i++) {
+	if (!res[i].part.size || !cfe_part_valid(&res[i].part, size)) {
+	    printf("***!!!*** %s: %s offset %#" PRIx64 ", size %#" PRIx64 " is outside of image (%" PRIu64 " bytes), not a fullflash dump?\n",
+		res[i].name, res[i].part.name, res[i].part.offset, res[i].part.size, size);
+	    continue;
+	}
+	printf(">> %-7s: %s offset %#" PRIx64 ", size %#" PRIx64 ", used %#" PRIx64 ", stored CRC %#08x ",
+	    res[i].name, res[i].part.name, res[i].part.offset, res[i].part.size, res[i].used, res[i].stored);
+	if (res[i].match == FWCRC_FULL)
+	    printf("(OK, whole partition, %s)\n", res[i].convention);
+	else if (res[i].match == FWCRC_USED)
+	    printf("(OK, without erased tail, %s)\n", res[i].convention);
+	else
+	    printf("\n***!!!*** %s firmware CRC: unknown CRC convention or damaged partition, no cfe crc32/crc-32 match"
+		" (whole partition %#08x, without erased tail %#08x)\n", res[i].name, res[i].calc, res[i].calc_used);
+    }
+    fflush(stdout);
+    return retcode;
+}
+
+#define SCAN_MAX_HITS 256
+
+int report_image(emit_t *e, const char *name, size_t offset, const unsigned char *src_mem, int vendor_type)
+{
+    int retcode = report_cfe_nvram(e, name, offset, src_mem, vendor_type);
+
+    if (emit_flush(e, STDOUT_FILENO)) {
+	perror("Cannot write output");
 	retcode++;
-	goto exit;
     }
+    return retcode;
+}
+
+/* blocks[i] - nvram block of hits[i] */
+int report_scan(const char *name, uint64_t size, const nvram_hit_t *hits, const unsigned char **blocks,
+    size_t found, size_t rejected, int verify, int format)
+{
+    size_t i;
+    int retcode = 0;
 
-    memset(src_mem + sizeof(bcm_nvram) - sizeof(bcm_nvram.crc), 0, sizeof(bcm_nvram.crc));
-    calc_crc = htonl(ssh_crc32(src_mem, sizeof(bcm_nvram), 0xFFFFFFFF));
+    if (format != FORMAT_TEXT) {
+	emit_t e;
+
+	emit_init(&e, format);
+	if (format == FORMAT_CSV)
+	    report_cfe_nvram_header(&e);
+	for (i = 0; i < found && i < SCAN_MAX_HITS; i++)
+	    retcode += report_image(&e, name, hits[i].offset, blocks[i], hits[i].vendor_type);
+	emit_flush(&e, STDOUT_FILENO);
+	emit_free(&e);
+	if (!found) retcode++;
+	return retcode;
+    }
 
-    printf(">> OLD CRC     : %#08x\n", bcm_nvram.crc);
-    printf(">> NEW CRC     : %#08x\n", calc_crc);
+    printf("> nvram scan: %s (%" PRIu64 " bytes)\n", name, size);
+    for (i = 0; i < found && i < SCAN_MAX_HITS; i++) {
+	const bcm68380_nvram_t *bcm_nvram = (const bcm68380_nvram_t *)blocks[i];
 
-    bcm_nvram.crc = calc_crc;
-    memcpy(src_mem, &bcm_nvram, sizeof(bcm_nvram)); // store CRC
+	printf(">> offset %#zx: CRC %#08x, board_id \"%.*s\", layout: %s (-t %d)\n", hits[i].offset,
+	    bcm_nvram->crc, (int)sizeof(bcm_nvram->board_id), bcm_nvram->board_id,
+	    cfe_nvram_vendor_name(hits[i].vendor_type), hits[i].vendor_type);
+	if (verify)
+	    retcode += verify_cfe_nvram((unsigned char *)blocks[i], hits[i].vendor_type);
+    }
+    if (found > SCAN_MAX_HITS)
+	printf(">> ... %zu more not listed\n", found - SCAN_MAX_HITS);
+    printf(">> found %zu nvram block(s), %zu candidate(s) with version %d rejected by checksum\n", found, rejected, NVRAM_VERSION);
 
-    exit:
+    if (!found) retcode++;
     return retcode;
 }
 
-int edit_cfe_nvram(void *src_mem, int argc, char ** argv, char *options_exist) {
+int scan_image(cfe_image_t *image, int verify, int format)
+{
+    nvram_hit_t hits[SCAN_MAX_HITS];
+    const unsigned char *blocks[SCAN_MAX_HITS];
+    size_t found, rejected, i;
+
+    found = scan_cfe_nvram(image->mem, image->size, hits, SCAN_MAX_HITS, &rejected);
+    for (i = 0; i < found && i < SCAN_MAX_HITS; i++)
+	blocks[i] = image->mem + hits[i].offset;
+    return report_scan(image->name, image->size, hits, blocks, found, rejected, verify, format);
+}
 
-    bcm68380_nvram_t bcm_nvram;
+/* compressed dump: decompressed once, window by window, blocks copied out */
+int scan_stream(const char *name, int verify, int format)
+{
+    static unsigned char copies[SCAN_MAX_HITS][sizeof(bcm68380_nvram_t)];
+    nvram_hit_t hits[SCAN_MAX_HITS];
+    const unsigned char *blocks[SCAN_MAX_HITS];
+    size_t found, rejected, i;
+    uint64_t size;
+    cfe_stream_t s;
+    int retcode;
+
+    if (stream_open(&s, name))
+	return 1;
+    found = stream_scan(&s, hits, copies[0], SCAN_MAX_HITS, &rejected, 0, &size);
+    retcode = s.error;
+    stream_close(&s);
+    for (i = 0; i < found && i < SCAN_MAX_HITS; i++)
+	blocks[i] = copies[i];
+    return retcode + report_scan(name, size, hits, blocks, found, rejected, verify, format);
+}
+
+/* --map: erased/used erase block runs and partition occupancy (nvram NULL - not valid, no partitions) */
+int map_image(cfe_image_t *image, const nand_geom_t *geom, const unsigned char *nvram, uint64_t block, int format)
+{
+    flash_part_usage_t usage[PART_NUM];
+    flash_map_t m;
+    size_t i;
     int retcode = 0;
 
-    memcpy(&bcm_nvram, src_mem, sizeof(bcm_nvram));
+    if (flash_map_build(&m, image->mem, image->size, geom, block)) {
+	perror("Cannot build flash map");
+	return 1;
+    }
+    if (nvram)
+	flash_map_partitions(&m, image->mem, geom, nvram, usage);
+    for (i = 0; nvram && i < PART_NUM; i++)
+	retcode += usage[i].outside;
+
+    if (format != FORMAT_TEXT) {
+	emit_t e;
+
+	emit_init(&e, format);
+	if (format == FORMAT_CSV)
+	    report_flash_map_header(&e);
+	report_flash_map(&e, image->name, &m, nvram ? usage : NULL);
+	if (emit_flush(&e, STDOUT_FILENO)) {
+	    perror("Cannot write output");
+	    retcode++;
+	}
+	emit_free(&e);
+	flash_map_free(&m);
+	return retcode;
+    }
 
-    optind = 1; // reset getopt counter
-    int c;
-    while ( 1 ) {
-        c = getopt(argc, argv, options_exist);
+    printf("> flash map: %s (%" PRIu64 " bytes, erase block %#" PRIx64 ", %" PRIu64 " blocks)\n", image->name, m.size, m.block, m.blocks);
+    for (i = 0; i < m.runs_num; i++)
+	printf(">> 0x%08" PRIx64 "-0x%08" PRIx64 "  %-6s %8" PRIu64 " block(s)\n", m.runs[i].offset, m.runs[i].offset + m.runs[i].size - 1,
+	    m.runs[i].used ? "used" : "erased", (m.runs[i].size + m.block - 1) / m.block);
+    printf(">> used %" PRIu64 " of %" PRIu64 " blocks (%.1f%%), trailing erased %#" PRIx64 " bytes\n", m.used_blocks, m.blocks,
+	m.blocks ? 100.0 * m.used_blocks / m.blocks : 0.0, flash_map_trailing_erased(&m));
+
+    if (!nvram)
+	printf(">> nvram is not valid, partition occupancy not shown\n");
+    for (i = 0; nvram && i < PART_NUM; i++) {
+	if (!usage[i].part.size)
+	    continue;
+	printf(">> %-8s 0x%08" PRIx64 " +0x%08" PRIx64 ": %" PRIu64 " of %" PRIu64 " blocks used (%.1f%%)%s\n", usage[i].part.name,
+	    usage[i].part.offset, usage[i].part.size, usage[i].used_blocks, usage[i].blocks,
+	    100.0 * usage[i].used_blocks / usage[i].blocks, usage[i].outside ? ", ends beyond image: truncated dump?" : "");
+    }
+    flash_map_free(&m);
+    return retcode;
+}
 
-        if (c == -1)
-                break;
+/* --boot: which rootfs/cferam.### CFEROM would boot (nvram NULL - not valid, no partition table) */
+int boot_image(cfe_image_t *image, const nand_geom_t *geom, const unsigned char *nvram, uint64_t block, int format)
+{
+    bootfs_result_t res;
+    int i, retcode;
 
-        switch (c) {
-                case 'L':  // bootline
-			memset(bcm_nvram.bootline, 0, sizeof(bcm_nvram.bootline));
-			strncpy((char *)&bcm_nvram.bootline, optarg, 255);
-                        break;
-                case 'B':  // board id
-			memset(bcm_nvram.board_id, 0, sizeof(bcm_nvram.board_id));
-			if (!sscanf(optarg, "%15s", (char *)&bcm_nvram.board_id)) retcode++;
-                        break;
-                case 'M':  // base MAC
-			if (sscanf(optarg, "%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx",
-			    &bcm_nvram.basemac[0], &bcm_nvram.basemac[1], &bcm_nvram.basemac[2], &bcm_nvram.basemac[3], &bcm_nvram.basemac[4], &bcm_nvram.basemac[5]) != 6) retcode++;
-                        break;
-                case 'S':  // GPON SN
-			if (!sscanf(optarg, "%12s", (char *)&bcm_nvram.gponsn)) retcode++;
-			if (strlen(bcm_nvram.gponsn) != (sizeof(bcm_nvram.gponsn) - 1)) retcode++; // check resulting length
-                        break;
-                case 'P':  // GPON PASS
-			if (!sscanf(optarg, "%10s", (char *)&bcm_nvram.gponpass)) retcode++;
-                        break;
-                case 'V':  // VOICE ID
-			if (!sscanf(optarg, "%15s", (char *)&bcm_nvram.voice_id)) retcode++;
-                        break;
-                case 'W':  // WPS PIN
-			if (!sscanf(optarg, "%7s", (char *)&bcm_nvram.wpspin)) retcode++;
-                        break;
-                case 'I':  // psI_size
-			if (!sscanf(optarg, "0x%2hhx", (char *)&bcm_nvram.psi_size)) { retcode++; } else { bcm_nvram.psi_size = htonl(bcm_nvram.psi_size); }
-                        break;
-                case 'N':  // mac_Num
-			if (!sscanf(optarg, "0x%2hhx", (char *)&bcm_nvram.mac_num)) { retcode++; } else { bcm_nvram.mac_num = htonl(bcm_nvram.mac_num); }
-                        break;
-                case 'A':  // bAckup_psi
-			if (!sscanf(optarg, "0x%2hhx", (char *)&bcm_nvram.backup_psi)) retcode++;
-                        break;
-                case 'Y':  // sYslog_size
-			if (!sscanf(optarg, "0x%2hhx", (char *)&bcm_nvram.syslog_size)) { retcode++; } else { bcm_nvram.syslog_size = htonl(bcm_nvram.syslog_size); }
-                        break;
-                case 'F':  // wlan_Feature
-			if (!sscanf(optarg, "0x%2hhx", (char *)&bcm_nvram.wlan_feature)) retcode++;
-                        break;
+    if (!nvram) {
+	fprintf(stderr, "%s: nvram is not valid, partition table cannot be trusted\n", image->name);
+	return 1;
+    }
+    retcode = bootfs_analyze(image->mem, image->size, geom, nvram, block, 1, &res);
+    for (i = 0; i < 2; i++)
+	retcode += res.rootfs[i].outside;
+
+    if (format != FORMAT_TEXT) {
+	emit_t e;
+
+	emit_init(&e, format);
+	if (format == FORMAT_CSV)
+	    report_boot_header(&e);
+	report_boot(&e, image->name, &res);
+	if (emit_flush(&e, STDOUT_FILENO)) {
+	    perror("Cannot write output");
+	    retcode++;
+	}
+	emit_free(&e);
+	return retcode;
+    }
 
-		default:
-                        break;
-                }
+    printf("> boot analysis: %s (erase block %#" PRIx64 ", bootline p=%d)\n", image->name, block, res.previous);
+    for (i = 0; i < 2; i++) {
+	bootfs_part_t *r = &res.rootfs[i];
+
+	printf(">> %-8s 0x%08" PRIx64 " +0x%08" PRIx64 ": %s, %" PRIu64 " of %" PRIu64 " blocks", r->part.name, r->part.offset,
+	    r->part.size, bootfs_name(r->fs), r->fs_blocks, r->blocks);
+	if (r->cferam >= 0)
+	    printf(", cferam.%03d at 0x%08" PRIx64, r->cferam, r->cferam_offset);
+	else
+	    printf(", no cferam");
+	printf("%s\n", r->outside ? ", ends beyond image: truncated dump?" : "");
+    }
+    if (res.boot < 0)
+	printf(">> boot: none, %s\n", res.reason);
+    else
+	printf(">> boot: %s cferam.%03d, %s\n", res.rootfs[res.boot].part.name, res.rootfs[res.boot].cferam, res.reason);
+    printf(">> %" PRIu64 " bytes of node headers read\n", res.rootfs[0].bytes_read + res.rootfs[1].bytes_read);
+    return retcode;
+}
+
+/*
+ * --secboot: authenticate cferam.### of both rootfs like CFEROM secure boot;
+ * nvram NULL (no valid nvram at -p) - input is a cferam.### file itself
+ */
+int secboot_image(cfe_image_t *image, const nand_geom_t *geom, const unsigned char *nvram, const secboot_key_t *key,
+    uint64_t block, int format)
+{
+    secboot_result_t res;
+    uint8_t key_digest[SHA256_DIGEST_LEN];
+    int i;
+
+    if (!nvram) {
+	secboot_image_t img;
+
+	if (geom) {
+	    fprintf(stderr, "%s: nvram is not valid, partition table cannot be trusted\n", image->name);
+	    return 1;
+	}
+	secboot_verify(key, image->mem, image->size, &img);
+	printf("> secure boot: %s (no valid nvram, verified as cferam.### file, %" PRIu64 " bytes)\n", image->name, img.size);
+	printf(">> %s %s\n", secboot_code(img.status), secboot_desc(img.status));
+	return img.status != SECBOOT_PASS;
+    }
+    secboot_check(key, image->mem, image->size, geom, nvram, block, 1, &res);
+
+    if (format != FORMAT_TEXT) {
+	emit_t e;
+
+	emit_init(&e, format);
+	if (format == FORMAT_CSV)
+	    report_secboot_header(&e);
+	report_secboot(&e, image->name, &res);
+	if (emit_flush(&e, STDOUT_FILENO)) {
+	    perror("Cannot write output");
+	    res.errors++;
+	}
+	emit_free(&e);
+	return res.errors;
+    }
+
+    sha256(key->n, key->n_len, key_digest);
+    printf("> secure boot: %s (RSA-%u e=%u, modulus sha256 ", image->name, key->bits, key->e);
+    for (i = 0; i < SHA256_DIGEST_LEN; i++)
+	printf("%02x", key_digest[i]);
+    printf(", sha256 engine %s)\n", sha256_engine_name());
+    for (i = 0; i < 2; i++) {
+	const bootfs_part_t *r = &res.boot.rootfs[i];
+	const secboot_image_t *img = &res.rootfs[i];
+
+	if (r->cferam < 0) {
+	    printf(">> %-8s no cferam\n", r->part.name);
+	    continue;
+	}
+	printf(">> %-8s cferam.%03d: ", r->part.name, r->cferam);
+	if (img->status == SECBOOT_NOIMAGE) {
+	    printf("cannot be read, %s\n", img->reason);
+	    continue;
+	}
+	printf("%" PRIu64 " bytes, payload sha256 ", img->size);
+	for (int k = 0; k < SHA256_DIGEST_LEN; k++)
+	    printf("%02x", img->digest[k]);
+	printf(": %s %s\n", secboot_code(img->status), secboot_desc(img->status));
+    }
+    if (res.boot.boot < 0)
+	printf(">> boot: none, %s\n", res.boot.reason);
+    else {
+	const secboot_image_t *img = &res.rootfs[res.boot.boot];
+
+	printf(">> boot: %s cferam.%03d, %s: %s\n", res.boot.rootfs[res.boot.boot].part.name, res.boot.rootfs[res.boot.boot].cferam,
+	    res.boot.reason, img->status == SECBOOT_PASS ? "PASS" : "FAILED, CFEROM stops");
+    }
+    return res.errors;
+}
+
+/* --decode-log: every log file is one unit, directory - every file under it */
+int decode_logs(const char *name, int format)
+{
+    bootlog_opts_t opts = { .format = format };
+    size_t count = 1, boots, total = 0, i;
+    char **paths = NULL;
+    struct stat st;
+    emit_t e;
+    int failed = 0, retcode = 0;
+
+    if (!stat(name, &st) && S_ISDIR(st.st_mode) && !(paths = batch_load_list(name, &count))) {
+	fprintf(stderr, "Cannot read directory %s\n", name);
+	return 1;
+    }
+    emit_init(&e, format);
+    opts.out = &e;
+    if (format == FORMAT_CSV)
+	bootlog_header(&e);
+
+    for (i = 0; i < count; i++) {
+	const char *path = paths ? paths[i] : name;
+	cfe_image_t log;
+	int r;
+
+	if (image_open(&log, path, 0)) {
+	    retcode++;
+	    continue;
+	}
+	r = bootlog_decode(path, log.mem, log.size, &opts, &boots);
+	image_close(&log);
+	if (r < 0) {
+	    retcode++;
+	    break;
+	}
+	failed += r;
+	total += boots;
     }
+    fflush(stdout);
+    if (emit_flush(&e, STDOUT_FILENO))
+	retcode++;
+    emit_free(&e);
+    if (count > 1)
+	fprintf(format == FORMAT_TEXT ? stdout : stderr, "> decode-log: %zu unit(s), %zu boot(s), %d failed\n", count, total, failed);
+    if (paths)
+	batch_free_list(paths, count);
+    return retcode + failed;
+}
+
+#define DUMP_CHUNK (1 << 20)
+
+/* --dump: hex/ascii of [ofs, ofs + len) with absolute offsets, straight to stdout */
+int dump_image(cfe_image_t *image, const nand_geom_t *geom, uint64_t ofs, uint64_t len)
+{
+    uint64_t size = geom ? nand_logical_size(geom, image->size) : image->size;
+    int digits = hexdump_digits(ofs + len - 1, 8);
+    unsigned char *chunk;
+    int retcode = 0;
 
-    memcpy(src_mem, &bcm_nvram, sizeof(bcm_nvram)); // store changes
+    if (ofs > size || len > size - ofs) {
+	fprintf(stderr, "Dump range %#" PRIx64 ":%#" PRIx64 " is outside of input file (%" PRIu64 " bytes)\n", ofs, len, size);
+	return 1;
+    }
+    fflush(stdout);
+    if (!geom)
+	return hexdump_fd(STDOUT_FILENO, image->mem + ofs, len, ofs, digits);
+
+    // oob stripped chunk by chunk
+    chunk = malloc(DUMP_CHUNK);
+    if (!chunk)
+	return 1;
+    for (; len && !retcode; ofs += DUMP_CHUNK, len -= len < DUMP_CHUNK ? len : DUMP_CHUNK) {
+	size_t n = len < DUMP_CHUNK ? len : DUMP_CHUNK;
+
+	nand_gather(geom, image->mem, ofs, chunk, n);
+	retcode += hexdump_fd(STDOUT_FILENO, chunk, n, ofs, digits);
+    }
+    free(chunk);
     return retcode;
 }
 
+/* compressed dump: decompressed only up to ofs + len */
+int dump_stream(const char *name, uint64_t ofs, uint64_t len)
+{
+    int digits = hexdump_digits(ofs + len - 1, 8);
+    unsigned char *chunk = malloc(DUMP_CHUNK);
+    cfe_stream_t s;
+    int retcode = 0;
+
+    if (!chunk || stream_open(&s, name)) {
+	free(chunk);
+	return 1;
+    }
+    fflush(stdout);
+    for (; len && !retcode; ofs += DUMP_CHUNK, len -= len < DUMP_CHUNK ? len : DUMP_CHUNK) {
+	size_t n = len < DUMP_CHUNK ? len : DUMP_CHUNK;
+
+	if (stream_read(&s, ofs, chunk, n)) {
+	    if (!s.error)
+		fprintf(stderr, "Dump range ends beyond decompressed input (%#" PRIx64 ")\n", s.win_ofs + s.win_len);
+	    retcode++;
+	    break;
+	}
+	retcode += hexdump_fd(STDOUT_FILENO, chunk, n, ofs, digits);
+    }
+    stream_close(&s);
+    free(chunk);
+    return retcode;
+}
+
+typedef struct edit_args {
+    const cfenvram_edit_t	*edits;
+    size_t			num;
+} edit_args_t;
+
+/* edit list is parsed once, batch workers apply it concurrently */
+static int batch_edit(unsigned char *nvram, void *ctx)
+{
+    edit_args_t *args = ctx;
+
+    return edit_cfe_nvram(nvram, args->edits, args->num);
+}
+
+static int load_mac_ranges(macpool_t *macs, const char *ledger_name, const char *index_name)
+{
+    macpool_init(macs);
+    if (ledger_name && macpool_load_ledger(macs, ledger_name, 0))
+	return 1;
+    if (index_name && index_load_macs(index_name, macs, 0) < 0)
+	return 1;
+    return 0;
+}
+
+/* hand out count ranges of num macs from [from, to), record them in ledger */
+int allocate_macs(const char *ledger_name, const char *index_name, uint64_t from, uint64_t to,
+    unsigned int num, unsigned int count, const char *owner)
+{
+    macpool_t macs;
+    uint64_t base;
+    uint32_t other;
+    unsigned int i;
+    int retcode = 0;
+
+    if (load_mac_ranges(&macs, ledger_name, index_name)) {
+	macpool_free(&macs);
+	return 1;
+    }
+    for (i = 0; i < count; i++) {
+	if (macpool_find_free(&macs, from, to, num, &base)) {
+	    fprintf(stderr, "No free range of %u MACs left in pool\n", num);
+	    retcode++;
+	    break;
+	}
+	macpool_add(&macs, base, num, macpool_owner(&macs, owner ? owner : "allocated"), &other);
+	printf("%012" PRIX64 " %u\n", base, num);
+	if (ledger_name && macpool_append_ledger(ledger_name, base, num, owner ? owner : "allocated")) {
+	    retcode++;
+	    break;
+	}
+    }
+    printf("> %u range(s) allocated, %zu assigned interval(s) from %" PRIu64 " range(s)\n", i, macpool_intervals(&macs), macs.ranges);
+    macpool_free(&macs);
+    return retcode;
+}
+
+/*
+ * edit: -e --alloc sets basemac and mac_num from free range of pool,
+ * otherwise changed basemac/mac_num must not overlap ledger ranges;
+ * new range is appended to ledger
+ */
+int assign_mac_range(unsigned char *nvram, const bcm68380_nvram_t *orig, const char *ledger_name,
+    uint64_t from, uint64_t to, unsigned int alloc_num, const char *owner)
+{
+    bcm68380_nvram_t *bcm_nvram = (bcm68380_nvram_t *)nvram;
+    macpool_t macs;
+    uint64_t base = 0;
+    uint32_t num, other;
+    int retcode = 0, i;
+
+    if (load_mac_ranges(&macs, ledger_name, NULL)) {
+	macpool_free(&macs);
+	return 1;
+    }
+
+    if (alloc_num) {
+	if (macpool_find_free(&macs, from, to, alloc_num, &base)) {
+	    fprintf(stderr, "No free range of %u MACs left in pool\n", alloc_num);
+	    retcode++;
+	    goto exit;
+	}
+	for (i = 0; i < 6; i++)
+	    bcm_nvram->basemac[i] = base >> (8 * (5 - i));
+	bcm_nvram->mac_num = htonl(alloc_num);
+    } else if (!memcmp(orig->basemac, bcm_nvram->basemac, sizeof(orig->basemac)) && orig->mac_num == bcm_nvram->mac_num) {
+	goto exit; // range not changed, already accounted
+    }
+
+    for (base = 0, i = 0; i < 6; i++)
+	base = (base << 8) | bcm_nvram->basemac[i];
+    num = ntohl(bcm_nvram->mac_num);
+    if (macpool_add(&macs, base, num, macpool_owner(&macs, owner), &other)) {
+	fprintf(stderr, "MAC range %012" PRIX64 "+%u overlaps range of %s\n", base, num, macpool_owner_name(&macs, other));
+	retcode++;
+	goto exit;
+    }
+    printf(">> MAC range     : %012" PRIX64 "+%u\n", base, num);
+    if (ledger_name)
+	retcode += macpool_append_ledger(ledger_name, base, num, owner);
+
+    exit:
+    macpool_free(&macs);
+    return retcode;
+}
+
+/* scatter edited block into interleaved layout, write back whole raw pages */
+int write_nand_nvram(cfe_image_t *image, const nand_geom_t *geom, size_t nvram_offset, const unsigned char *nvram, const char *output_name)
+{
+    uint64_t raw_ofs, raw_len, page;
+
+    nand_scatter(geom, image->mem, nvram_offset, nvram, sizeof(bcm68380_nvram_t));
+    nand_raw_span(geom, nvram_offset, sizeof(bcm68380_nvram_t), &raw_ofs, &raw_len);
+
+    // ecc algorithm is controller specific, it is not recalculated
+    for (page = raw_ofs; page < raw_ofs + raw_len; page += geom->page + geom->oob) {
+	if (geom->ecc_len)
+	    fprintf(stderr, "Warning: ECC bytes %#" PRIx64 "-%#" PRIx64 " of changed page are stale\n",
+		page + geom->page + geom->ecc_ofs, page + geom->page + geom->ecc_ofs + geom->ecc_len - 1);
+	else
+	    fprintf(stderr, "Warning: spare area (ECC) of changed page at %#" PRIx64 " is not updated\n", page);
+    }
+
+    if (!output_name)
+	return image_patch_in_place(image, raw_ofs, raw_len);
+    return image_write_patched(image, output_name, raw_ofs, raw_len);
+}
+
+/* erase block(s) holding nvram at offset, as in-memory image */
+int mtd_load_image(mtd_dev_t *mtd, cfe_image_t *image, uint64_t offset, uint64_t *start)
+{
+    size_t span;
+
+    memset(image, 0, sizeof(*image));
+    image->fd = -1;
+    image->name = mtd->name;
+
+    if (offset + sizeof(bcm68380_nvram_t) > mtd->size) {
+	fprintf(stderr, "NVRAM offset %#" PRIx64 " is outside of %s (%#" PRIx64 " bytes)\n", offset, mtd->name, mtd->size);
+	return 1;
+    }
+    mtd_block_span(mtd, offset, sizeof(bcm68380_nvram_t), start, &span);
+
+    image->mem = malloc(span);
+    if (!image->mem) {
+	perror("Cannot allocate erase block buffer");
+	return 1;
+    }
+    image->size = span;
+    if (mtd_read(mtd, *start, image->mem, span)) {
+	image_close(image);
+	return 1;
+    }
+    return 0;
+}
+
+/* rewrite changed erase block(s), then read nvram back from flash and check it */
+int mtd_update_nvram(mtd_dev_t *mtd, cfe_image_t *image, uint64_t start, size_t nvram_offset)
+{
+    unsigned char block[sizeof(bcm68380_nvram_t)];
+
+    if (mtd_update(mtd, start, image->mem, image->size))
+	return 1;
+
+    if (mtd_read(mtd, start + nvram_offset, block, sizeof(block)) || check_cfe_nvram(block)) {
+	fprintf(stderr, "NVRAM read back from %s is not valid!\n", mtd->name);
+	return 1;
+    }
+    printf(">> NVRAM read back from %s, CRC %#08x (OK)\n", mtd->name, ((bcm68380_nvram_t *)block)->crc);
+    return 0;
+}
 
 int main(int argc, char ** argv)
 {
 
- int opt_input = 0, opt_output = 0, opt_verify = 0, opt_edit = 0;
+ int opt_input = 0, opt_output = 0, opt_verify = 0, opt_edit = 0, opt_in_place = 0, opt_scan = 0;
  char *input_name = NULL, *output_name = NULL;
 
  int nvram_offset = 0x580; // offset in cferom mtd or fullflash (0x580 - sercomm, 0x540 - ubnt)
- int vendor_type = 0;
-
- static char options_exist[] = "vei:o:p:t:L:B:M:S:P:V:W:I:N:A:Y:F:"; // common options set for both getopt()
+ int vendor_type = 0, opt_vendor = 0;
+ char *crc_engine = NULL;
+ char *batch_list = NULL, *stamp_spec = NULL;
+ int jobs = 0;
+ int format = FORMAT_TEXT;
+ const char *get_names[64];
+ cfenvram_edit_t edits[EDITS_MAX];
+ size_t edits_num = 0;
+ int get_num = 0;
+ char *mtd_name = NULL;
+ int opt_fwcrc = 0;
+ char *extract_dir = NULL;
+ nand_geom_t nand_geom;
+ int opt_nand = 0;
+ char *index_name = NULL;
+ const char *lookups[64];
+ int lookup_num = 0, opt_dups = 0;
+ char *ledger_name = NULL, *owner_name = NULL;
+ char *serve_name = NULL;
+ char *decode_name = NULL;
+ char *store_name = NULL, *restore_name = NULL, *unit_name = NULL;
+ char *secboot_name = NULL;
+ secboot_key_t secboot_key;
+ int opt_stats = 0;
+ int opt_dump = 0, opt_map = 0, opt_boot = 0;
+ uint64_t dump_ofs = 0, dump_len = 0;
+ char *dump_end;
+ uint64_t pool_from = 0, pool_to = 0;
+ unsigned int alloc_num = 0, alloc_count = 1;
+ unsigned int mtd_erasesize = 0;
 
  int c;
  while ( 1 ) {
-        c = getopt(argc, argv, options_exist);
+        c = getopt_long(argc, argv, options_exist, long_options, NULL);
         if (c == -1)
                 break;
 
@@ -492,6 +1019,112 @@ int main(int argc, char ** argv)
                         break;
                 case 't':  // vendor type
                         if (!sscanf(optarg, "%2d", &vendor_type)) goto print_usage;
+                        opt_vendor++;
+                        break;
+                case 'c':  // crc32 engine
+                        crc_engine = optarg;
+                        break;
+                case OPT_IN_PLACE:  // patch input file
+                        opt_in_place++;
+                        break;
+                case OPT_SCAN:  // locate nvram blocks
+                        opt_scan++;
+                        break;
+                case OPT_BATCH:  // file list or directory
+                        batch_list = optarg;
+                        break;
+                case OPT_STAMP:  // per-device images from template
+                        stamp_spec = optarg;
+                        break;
+                case OPT_GET:  // print field
+                        if (get_num == (int)(sizeof(get_names) / sizeof(get_names[0]))) goto print_usage;
+                        get_names[get_num++] = optarg;
+                        break;
+                case OPT_SET:  // name=value, split when applied
+                        if (edits_num == EDITS_MAX) goto print_usage;
+                        edits[edits_num++] = (cfenvram_edit_t){ NULL, optarg };
+                        break;
+                case OPT_MTD:  // mtd device instead of input file
+                        mtd_name = optarg;
+                        break;
+                case OPT_FWCRC:  // eltex firmware crc check
+                        opt_fwcrc++;
+                        break;
+                case OPT_EXTRACT:  // split fullflash into partitions
+                        extract_dir = optarg;
+                        break;
+                case OPT_NAND:  // raw nand dump with oob
+                        if (nand_parse_geom(&nand_geom, optarg)) goto print_usage;
+                        opt_nand++;
+                        break;
+                case OPT_INDEX:  // fleet index file
+                        index_name = optarg;
+                        break;
+                case OPT_LOOKUP:  // index query
+                        if (lookup_num == (int)(sizeof(lookups) / sizeof(lookups[0]))) goto print_usage;
+                        lookups[lookup_num++] = optarg;
+                        break;
+                case OPT_DUPS:  // duplicated identities in index
+                        opt_dups++;
+                        break;
+                case OPT_LEDGER:  // assigned mac ranges
+                        ledger_name = optarg;
+                        break;
+                case OPT_POOL:  // mac range to allocate from
+                        {
+                            char from[13], to[13];
+                            if (sscanf(optarg, "%12[0-9a-fA-F]-%12[0-9a-fA-F]", from, to) != 2 ||
+                                macpool_parse_mac(from, &pool_from) || macpool_parse_mac(to, &pool_to) || pool_from > pool_to) goto print_usage;
+                            pool_to++; // inclusive on command line
+                        }
+                        break;
+                case OPT_ALLOC:  // allocate mac range(s)
+                        if (sscanf(optarg, "%u:%u", &alloc_num, &alloc_count) < 1 || !alloc_num || !alloc_count) goto print_usage;
+                        break;
+                case OPT_OWNER:  // ledger owner of allocated range
+                        owner_name = optarg;
+                        break;
+                case OPT_SERVE:  // provisioning server socket
+                        serve_name = optarg;
+                        break;
+                case OPT_STATS:  // phase timers and i/o counters
+                        opt_stats++;
+                        break;
+                case OPT_DUMP:  // hex dump of image range
+                        dump_ofs = strtoull(optarg, &dump_end, 0);
+                        if (*dump_end != ':' || !(dump_len = strtoull(dump_end + 1, &dump_end, 0)) || *dump_end ||
+                                dump_ofs + dump_len < dump_ofs) goto print_usage;
+                        opt_dump++;
+                        break;
+                case OPT_MAP:  // erased/used blocks and partition occupancy
+                        opt_map++;
+                        break;
+                case OPT_BOOT:  // rootfs/cferam search of cferom
+                        opt_boot++;
+                        break;
+                case OPT_STORE:  // deduplicated image store
+                        store_name = optarg;
+                        break;
+                case OPT_RESTORE:  // unit image from store
+                        restore_name = optarg;
+                        break;
+                case OPT_UNIT:  // store unit name of -i dump
+                        unit_name = optarg;
+                        break;
+                case OPT_SECBOOT:  // cferam signature check with public key
+                        secboot_name = optarg;
+                        break;
+                case OPT_DECODE_LOG:  // cferom boot log(s)
+                        decode_name = optarg;
+                        break;
+                case OPT_ERASESIZE:  // emulated mtd erase block size
+                        if (!sscanf(optarg, "0x%8x", &mtd_erasesize)) goto print_usage;
+                        break;
+                case OPT_FORMAT:  // output format
+                        if ((format = emit_format(optarg)) < 0) goto print_usage;
+                        break;
+                case 'j':  // batch jobs
+                        if (!sscanf(optarg, "%4d", &jobs)) goto print_usage;
                         break;
 		case 'L':
 		case 'B':
@@ -505,67 +1138,330 @@ int main(int argc, char ** argv)
 		case 'A':
 		case 'Y':
 		case 'F':
-			break; // skip options, used in edit function
+			// field of short edit option
+			if (edits_num == EDITS_MAX) goto print_usage;
+			for (size_t k = 0; k < sizeof(edit_options) / sizeof(edit_options[0]); k++)
+			    if (edit_options[k].opt == c)
+				edits[edits_num++] = (cfenvram_edit_t){ edit_options[k].field, optarg };
+			break;
                 default:
                         goto print_usage;
                 }
  }
 
 
-    if (!opt_input)				goto print_usage;
+    if (decode_name && (opt_input || opt_output || opt_verify || opt_edit || opt_scan || batch_list || stamp_spec || get_num ||
+	mtd_name || opt_fwcrc || extract_dir || opt_nand || index_name || ledger_name || alloc_num || serve_name || opt_dump || opt_map || opt_boot ||
+	secboot_name))	goto print_usage;
+    if (store_name && (opt_verify || opt_edit || stamp_spec || get_num || mtd_name || opt_fwcrc || extract_dir || opt_nand ||
+	index_name || ledger_name || alloc_num || serve_name || opt_dump || opt_map || opt_boot || secboot_name))	goto print_usage;
+    if (store_name && (restore_name ? (!opt_output || opt_input || batch_list || opt_scan) : opt_output))	goto print_usage;
+    if (restore_name && !store_name)		goto print_usage;
+    if (unit_name && (!store_name || !opt_input || restore_name))	goto print_usage;
+    if (serve_name && (opt_input || opt_output || opt_verify || opt_edit || opt_scan || batch_list || stamp_spec || get_num ||
+	mtd_name || opt_fwcrc || extract_dir || opt_nand || index_name || ledger_name || alloc_num))	goto print_usage;
+    if (alloc_num && (!pool_to || (opt_edit && alloc_count != 1) || (!opt_edit && (opt_input || mtd_name || opt_verify || batch_list))))	goto print_usage;
+    if (alloc_num && !opt_edit) {
+	// standalone allocation, sources: ledger and/or index
+	int retcode = allocate_macs(ledger_name, index_name, pool_from, pool_to, alloc_num, alloc_count, owner_name);
+	fflush(stdout);
+	return retcode ? 1 : 0;
+    }
+    if (index_name && (opt_input || opt_output || opt_verify || opt_edit || mtd_name || stamp_spec || get_num || extract_dir || opt_fwcrc || opt_nand))	goto print_usage;
+    if (index_name && !(batch_list || lookup_num || opt_dups))	goto print_usage;
+    if ((lookup_num || opt_dups) && (!index_name || batch_list))	goto print_usage;
+    if (!opt_input && !batch_list && !mtd_name && !index_name && !serve_name && !decode_name && !store_name)	goto print_usage;
+    if (ledger_name && !(opt_edit || (batch_list && opt_verify)))	goto print_usage;
+    if (ledger_name && (stamp_spec || index_name))	goto print_usage;
+    if (mtd_name && (opt_input || batch_list || opt_output || opt_in_place || opt_scan || stamp_spec))	goto print_usage;
+    if (batch_list && (opt_input || opt_output))	goto print_usage;
+    if (batch_list && !(opt_verify || opt_edit || opt_fwcrc || opt_map || opt_boot || secboot_name || index_name || store_name))	goto print_usage;
     if (opt_verify && opt_edit)			goto print_usage;
 
-    if (opt_verify && !opt_input)		goto print_usage;
-    if (opt_edit && !(opt_input && opt_output))	goto print_usage;
+    if (opt_edit && !mtd_name && !(opt_output ^ opt_in_place))	goto print_usage;
+    if (opt_in_place && !opt_edit)		goto print_usage;
+    if (opt_scan && opt_edit)			goto print_usage;
+    if (get_num && (opt_verify || opt_edit || opt_scan || stamp_spec || batch_list))	goto print_usage;
+    if (opt_fwcrc && (opt_edit || opt_scan || stamp_spec || get_num || mtd_name || format != FORMAT_TEXT))	goto print_usage;
+    if (extract_dir && (opt_verify || opt_edit || opt_scan || opt_fwcrc || stamp_spec || get_num || batch_list || mtd_name))	goto print_usage;
+    if (opt_nand && (opt_scan || stamp_spec || batch_list || mtd_name))	goto print_usage;
+    if (stamp_spec && (opt_verify || opt_edit || opt_scan || !opt_output))	goto print_usage;
+    if (opt_map && (opt_output || opt_edit || opt_scan || stamp_spec || get_num || extract_dir || opt_fwcrc || opt_dump || mtd_name || index_name))	goto print_usage;
+    if (opt_map && opt_verify && !batch_list)	goto print_usage;
+    if (opt_boot && (opt_map || opt_output || opt_edit || opt_scan || stamp_spec || get_num || extract_dir || opt_fwcrc || opt_dump || mtd_name || index_name))	goto print_usage;
+    if (opt_boot && opt_verify && !batch_list)	goto print_usage;
+    if (secboot_name && (opt_boot || opt_map || opt_output || opt_edit || opt_scan || stamp_spec || get_num || extract_dir || opt_fwcrc ||
+	opt_dump || mtd_name || index_name || serve_name))	goto print_usage;
+    if (secboot_name && opt_verify && !batch_list)	goto print_usage;
+    if (opt_dump && (!opt_input || opt_output || opt_verify || opt_edit || opt_scan || stamp_spec || get_num || extract_dir || opt_fwcrc))	goto print_usage;
 
-    size_t input_size;
     int retcode = 0;
 
-    FILE* source_file = fopen(input_name,"r");
-    if (source_file == 0) {
-        perror("Cannot open file for read");
-        return 1;
+    if (opt_stats)
+	stats_enable(batch_list != NULL);
+
+    static char stdout_buf[64 * 1024];
+    setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+
+    if (decode_name)
+	return decode_logs(decode_name, format) ? 1 : 0;
+
+    uint64_t t = stats_begin();
+    cfenvram_init();
+    stats_end(STAT_INIT, t);
+    if (crc_engine && crc32_select(crc_engine)) {
+	fprintf(stderr, "CRC32 engine \"%s\" is unknown or unavailable\n", crc_engine);
+	return 1;
+    }
+
+    if (secboot_name && (secboot_init() || secboot_load_key(secboot_name, &secboot_key)))
+	return 1;
+
+    if (store_name) {
+	char **paths = input_name ? &input_name : NULL;
+	size_t count = 1;
+
+	if (restore_name)
+	    return store_restore(store_name, restore_name, output_name) ? 1 : 0;
+	if (!input_name && !batch_list)
+	    return store_list(store_name) ? 1 : 0;
+	if (nvram_offset < 0) goto print_usage;
+	if (batch_list && !(paths = batch_load_list(batch_list, &count))) {
+	    fprintf(stderr, "Cannot read file list %s\n", batch_list);
+	    return 1;
+	}
+	retcode = store_ingest(store_name, paths, count, batch_list, unit_name, nvram_offset, opt_scan);
+	if (batch_list)
+	    batch_free_list(paths, count);
+	fflush(stdout);
+	return retcode ? 1 : 0;
+    }
+
+    if (serve_name)
+	return server_run(serve_name, nvram_offset, opt_vendor ? vendor_type : -1) ? 1 : 0;
+
+    if (index_name) {
+	if (batch_list)
+	    return index_update(index_name, batch_list, nvram_offset, opt_scan, jobs) ? 1 : 0;
+	for (int i = 0; i < lookup_num; i++)
+	    retcode += index_lookup(index_name, lookups[i]);
+	if (opt_dups)
+	    retcode += index_dups(index_name);
+	fflush(stdout);
+	return retcode ? 1 : 0;
+    }
+
+    macpool_t macs;
+
+    if (batch_list) {
+	edit_args_t args = { edits, edits_num };
+	batch_opts_t batch = {
+	    .jobs = jobs,
+	    .nvram_offset = nvram_offset,
+	    .scan = opt_scan,
+	    .vendor_type = opt_vendor ? vendor_type : -1,
+	    .format = format,
+	    .fwcrc = opt_fwcrc,
+	    .map = opt_map ? (mtd_erasesize ? mtd_erasesize : MTD_EMU_ERASESIZE) : 0,
+	    .boot = opt_boot ? (mtd_erasesize ? mtd_erasesize : MTD_EMU_ERASESIZE) : 0,
+	    .secboot = secboot_name ? (mtd_erasesize ? mtd_erasesize : MTD_EMU_ERASESIZE) : 0,
+	    .secboot_key = &secboot_key,
+	    .macs = ledger_name ? &macs : NULL,
+	    .ledger = ledger_name,
+	    .edit = opt_edit ? batch_edit : NULL,
+	    .edit_ctx = &args,
+	};
+
+	if (nvram_offset < 0) goto print_usage;
+	macpool_init(&macs);
+	if (ledger_name && macpool_load_ledger(&macs, ledger_name, 0))
+	    return 1;
+	retcode = batch_run(batch_list, &batch);
+	macpool_free(&macs);
+	return retcode ? 1 : 0;
+    }
+
+    cfe_image_t image;
+    mtd_dev_t mtd = { .fd = -1 };
+    uint64_t image_start = 0; // image holds only part of mtd/compressed input from here
+
+    if (input_name && stream_type(input_name) != STREAM_NONE) {
+	// compressed dump: read-only, nvram block decompressed into memory
+	if (mtd_name || opt_edit || opt_in_place || opt_fwcrc || opt_map || opt_boot || secboot_name || extract_dir || stamp_spec || opt_nand) {
+	    fprintf(stderr, "%s: compressed input is read-only (-v, --get, --scan only)\n", input_name);
+	    return 1;
+	}
+	if (opt_scan)
+	    return scan_stream(input_name, opt_verify, format) ? 1 : 0;
+	if (opt_dump)
+	    return dump_stream(input_name, dump_ofs, dump_len) ? 1 : 0;
+    }
+
+    t = stats_begin();
+
+    if (mtd_name) {
+	if (nvram_offset < 0 || mtd_open(&mtd, mtd_name, opt_edit, mtd_erasesize))
+	    return 1;
+	// only erase block(s) holding nvram are read, offsets below are relative to them
+	if (mtd_load_image(&mtd, &image, nvram_offset, &image_start)) {
+	    mtd_close(&mtd);
+	    return 1;
+	}
+	nvram_offset -= image_start;
+	input_name = mtd_name;
+    } else if (stream_type(input_name) != STREAM_NONE) {
+	size_t block_offset;
+
+	image = (cfe_image_t){ .name = input_name, .fd = -1, .size = sizeof(bcm68380_nvram_t) };
+	image.mem = malloc(image.size);
+	if (!image.mem || nvram_offset < 0 || stream_read_nvram(input_name, nvram_offset, 0, image.mem, &block_offset)) {
+	    fprintf(stderr, "Cannot read NVRAM at %#x of compressed input %s\n", nvram_offset, input_name);
+	    image_close(&image);
+	    return 1;
+	}
+	image_start = block_offset;
+	nvram_offset = 0;
+    } else if (image_open(&image, input_name, opt_in_place))
+	return 1;
+    stats_end(STAT_OPEN, t);
+
+    if (opt_scan) {
+	retcode += scan_image(&image, opt_verify, format);
+	goto exit;
+    }
+
+    // raw nand dump: offsets are logical (oob stripped)
+    const nand_geom_t *geom = opt_nand ? &nand_geom : NULL;
+
+    if (opt_dump) {
+	t = stats_begin();
+	retcode += dump_image(&image, geom, dump_ofs, dump_len);
+	stats_end(STAT_OUTPUT, t);
+	goto exit;
     }
+    uint64_t image_size = geom ? nand_logical_size(geom, image.size) : image.size;
 
-    /* будет ли fstat тут более хорош? */
-    fseek(source_file, 0, SEEK_END);
-    input_size = ftell(source_file);
+    if (nvram_offset < 0 || image_size < sizeof(bcm68380_nvram_t) ||
+	(uint64_t)nvram_offset > image_size - sizeof(bcm68380_nvram_t)) {
+	fprintf(stderr, "NVRAM offset %#x is outside of input file (%" PRIu64 " bytes)\n", nvram_offset, image_size);
+	retcode++;
+	goto exit;
+    }
 
-    unsigned char *src_mem = malloc(input_size);
-    memset(src_mem, 0, input_size);
+    unsigned char *src_mem = image.mem;
+    unsigned char *nvram = src_mem + nvram_offset;
+    unsigned char nand_block[sizeof(bcm68380_nvram_t)];
 
-    fseek(source_file, 0, SEEK_SET);
-    fread(src_mem, input_size, 1, source_file);
-    fclose(source_file);
+    // block may straddle spare area: work on gathered copy, scattered back on edit
+    if (geom) {
+	nand_gather(geom, src_mem, nvram_offset, nand_block, sizeof(nand_block));
+	nvram = nand_block;
+    }
 
-    if (opt_verify) {
-        retcode += verify_cfe_nvram(src_mem + nvram_offset, vendor_type);
+    if (opt_map) {
+	t = stats_begin();
+	retcode += map_image(&image, geom, check_cfe_nvram(nvram) ? NULL : nvram,
+	    mtd_erasesize ? mtd_erasesize : MTD_EMU_ERASESIZE, format);
+	stats_end(STAT_VERIFY, t);
+
+    } else if (opt_boot) {
+	t = stats_begin();
+	retcode += boot_image(&image, geom, check_cfe_nvram(nvram) ? NULL : nvram,
+	    mtd_erasesize ? mtd_erasesize : MTD_EMU_ERASESIZE, format);
+	stats_end(STAT_VERIFY, t);
+
+    } else if (secboot_name) {
+	t = stats_begin();
+	retcode += secboot_image(&image, geom, check_cfe_nvram(nvram) ? NULL : nvram, &secboot_key,
+	    mtd_erasesize ? mtd_erasesize : MTD_EMU_ERASESIZE, format);
+	stats_end(STAT_VERIFY, t);
+
+    } else if (get_num) {
+	retcode += get_cfe_nvram_fields(nvram,
+	    opt_vendor ? vendor_type : detect_cfe_nvram_vendor(nvram), get_names, get_num);
+
+    } else if (stamp_spec) {
+	// edit options set template values (start MAC/SN for count:N)
+        retcode += edit_cfe_nvram(nvram, edits, edits_num);
+	if (retcode) {
+	    fprintf(stderr, "Error processing input options!\n");
+	    goto exit;
+	}
+        retcode += replace_cfe_nvram_crc(nvram);
+	if (!retcode)
+	    retcode += stamp_run(&image, nvram_offset, stamp_spec, output_name);
+
+    } else if (extract_dir) {
+	if (check_cfe_nvram(nvram)) {
+	    fprintf(stderr, "NVRAM at %#x is not valid, partition table cannot be trusted\n", nvram_offset);
+	    retcode++;
+	    goto exit;
+	}
+	printf("> extracting partitions of %s into %s\n", input_name, extract_dir);
+	retcode += extract_partitions(&image, geom, nvram, extract_dir);
+
+    } else if (opt_verify && format != FORMAT_TEXT) {
+	emit_t e;
+
+	emit_init(&e, format);
+	if (format == FORMAT_CSV)
+	    report_cfe_nvram_header(&e);
+	t = stats_begin();
+	retcode += report_image(&e, input_name, image_start + nvram_offset, nvram, vendor_type);
+	stats_end(STAT_VERIFY, t);
+	emit_free(&e);
+
+    } else if (opt_verify || opt_fwcrc) {
+	if (opt_verify) {
+	    t = stats_begin();
+	    retcode += verify_cfe_nvram(nvram, vendor_type);
+	    stats_end(STAT_VERIFY, t);
+	}
+	if (opt_fwcrc) {
+	    t = stats_begin();
+	    retcode += verify_firmware_crc(&image, geom, nvram, opt_vendor ? vendor_type : detect_cfe_nvram_vendor(nvram), jobs);
+	    stats_end(STAT_FWCRC, t);
+	}
 
     } else if (opt_edit) {
-        retcode += edit_cfe_nvram(src_mem + nvram_offset, argc, argv, options_exist);
+	bcm68380_nvram_t orig;
+
+	memcpy(&orig, nvram, sizeof(orig));
+        retcode += edit_cfe_nvram(nvram, edits, edits_num);
 	if (retcode) {
 	    fprintf(stderr, "Error processing input options!\n");
 	    goto exit;
 	}
-        retcode += replace_cfe_nvram_crc(src_mem + nvram_offset);
-        retcode += verify_cfe_nvram(src_mem + nvram_offset, vendor_type);
+	if (ledger_name || alloc_num) {
+	    retcode += assign_mac_range(nvram, &orig, ledger_name, pool_from, pool_to, alloc_num,
+		owner_name ? owner_name : opt_in_place ? input_name : output_name);
+	    if (retcode)
+		goto exit;
+	}
+        retcode += replace_cfe_nvram_crc(nvram);
+	t = stats_begin();
+        retcode += verify_cfe_nvram(nvram, vendor_type);
+	stats_end(STAT_VERIFY, t);
 
+	// only the nvram block is written, the rest is copied/cloned or left untouched
+	t = stats_begin();
 	if (!retcode) {
-	    FILE* target_file = fopen(output_name,"w");
-	    if (target_file == 0) {
-    		perror("Cannot open file for write");
-		free(src_mem);
-    		return 1;
-	    }
-
-	    fseek(target_file, 0, SEEK_SET);
-	    fwrite(src_mem, input_size, 1, target_file);
-	    fclose(target_file);
+	    if (mtd_name)
+		retcode += mtd_update_nvram(&mtd, &image, image_start, nvram_offset);
+	    else if (geom)
+		retcode += write_nand_nvram(&image, geom, nvram_offset, nvram, opt_in_place ? NULL : output_name);
+	    else if (opt_in_place)
+		retcode += image_patch_in_place(&image, nvram_offset, sizeof(bcm68380_nvram_t));
+	    else
+		retcode += image_write_patched(&image, output_name, nvram_offset, sizeof(bcm68380_nvram_t));
 	}
+	stats_end(STAT_WRITE, t);
     }
 
     exit:
-    free(src_mem);
+    image_close(&image);
+    if (mtd_name)
+	mtd_close(&mtd);
 
     if (retcode) fprintf(stderr, "Some errors happen.\n");
     return retcode;
@@ -577,7 +1473,46 @@ int main(int argc, char ** argv)
     " -e     nvram edit (if no edit option given, just recalculate checksum)\n"
     " -i     <input file>\n"
     " -o     <output file> (for edit or recalculate options)\n"
+    " --in-place  write edited nvram block back into input file instead of -o\n"
+    " --mtd <device>  use /dev/mtdX (or regular file as emulated mtd) instead of -i: only erase block(s) with nvram are read,\n"
+    "             edit (-e) erases and rewrites them and reads nvram back\n"
+    " --erasesize <hex size>  erase block size of emulated mtd (default 0x20000)\n"
+    " --nand <page>+<oob>[:ecc=<ofs>+<len>]  input is raw nand dump with spare area after every page (e.g. 2048+64, 4096+224);\n"
+    "             -p and partition offsets are logical, verify/edit/--get/--extract/--fwcrc see oob-stripped data\n"
     " -p     <nvram offset> (hex nvram offset in input cferom or fullflash, default 0x580)\n"
+    " --batch <file list | directory>  verify (-v) or edit (-e --in-place) every file, one result line per file\n"
+    " -j, --jobs <n>  batch worker threads (default: number of cpus)\n"
+    " --stamp <count:N | csv file>  write per-device images from template (-i, edit options) into -o <dir>\n"
+    "             count:N increments basemac by mac_num and GPON SN serial; csv columns: basemac,gponsn,gponpass,wpspin\n"
+    " --format <text|json|csv>  output format of verify (-v, --scan, --batch)\n"
+    " --extract <dir>  write boot, rootfs1, rootfs2, data and bbt partitions of fullflash input (-i) into <dir>/<name>.bin\n"
+    " --index <file> --batch <file list | directory>  create or refresh fleet index of nvram identities (unchanged files are not read)\n"
+    " --index <file> --lookup <gponsn=SN | basemac=MAC | mac=MAC>  find images in index (mac=: valid images whose basemac + mac_num range contains it)\n"
+    " --index <file> --dups  list images sharing mac range or GPON SN\n"
+    " --alloc <mac_num>[:count] --pool <MAC>-<MAC> [--ledger <file>] [--index <file>] [--owner <name>]\n"
+    "             hand out next free MAC range(s) not overlapping ledger/index ranges, append them to ledger\n"
+    " -e --alloc <mac_num> --pool <MAC>-<MAC> --ledger <file>  set basemac/mac_num of edited image from free range\n"
+    " --ledger <file>  with -e: changed MAC range must not overlap ledger, recorded there; with --batch -v: flag overlapping images\n"
+    " --serve <socket>  provisioning server: keep images mapped, answer verify/get/set/stamp requests of cfe_client\n"
+    "             over unix socket (-p, -t apply to all requests), one thread per connection\n"
+    " --stats     print time per phase (init, open, read, edit, check, verify, output, write, fwcrc), bytes read/mapped/written\n"
+    "             and syscalls to stderr at exit; --batch adds per-phase latency histograms\n"
+    " --fwcrc     check eltex primary/backup firmware CRC against rootfs1/rootfs2 of fullflash input (-i or --batch, with or without -v)\n"
+    " --dump <offset>:<len>  hex/ascii dump of input range (bootloader, vendor_params, partitions; -i, --nand, compressed)\n"
+    " --map       erased/used runs of erase blocks (--erasesize, default 0x20000) and nvram partition occupancy\n"
+    "             of -i image (or every --batch file), flags partitions beyond end of image\n"
+    " --boot      rootfs1/rootfs2 (nvram partition table) search of CFEROM: jffs2 or ubi/ubifs, cferam.### sequence,\n"
+    "             bootline p=; prints which rootfs/cferam would boot and why (-i, --nand or every --batch file)\n"
+    " --secboot <public key>  authenticate cferam.### of rootfs1/rootfs2 like CFEROM secure boot (RSA-PSS, SHA-256),\n"
+    "             report PASS or ROM error class ERRA..ERRM; key: PEM/DER RSA public key or raw modulus (-i, --nand, --batch)\n"
+    " --store <dir> [-i <file> [--unit <name>] | --batch <file list | directory>] [--scan]  add dumps to deduplicated store:\n"
+    "             every distinct image once (nvram block erased), per unit only nvram block; unit name: --unit, path below\n"
+    "             --batch directory or file name, must be unique per run; without input: list units\n"
+    " --store <dir> --restore <unit> -o <file | ->  rebuild unit image (base cloned/reflinked, nvram written) or stream it\n"
+    " --decode-log <log file | directory>  annotate CFEROM status codes (NAN6, JFS2, BTLA, ERRx, J###...) of serial capture(s),\n"
+    "             one unit per file, summary per boot: fs, partition, cferam, secure boot result, first error\n"
+    " --scan      find all valid nvram blocks in input and detect vendor layout (with -v: verify each)\n"
+    "             .gz/.xz" USAGE_ZST " input is decompressed on the fly (read-only: -v, --get, --scan, --batch, --index)\n"
     " -t     <vendor_structure_type>\n"
     "           0: common (default)\n"
 #ifdef ENABLE_VENDOR_ELTX
@@ -586,6 +1521,7 @@ int main(int argc, char ** argv)
 #ifdef ENABLE_VENDOR_UBNT
     "           2: ubiquiti\n"
 #endif
+    " -c     <crc32 engine> (ssh, slice8, slice16, pclmul, armv8; default: fastest available)\n"
 
     " -L     <bootline>    \"e=192.168.1.1:ffffff00 h=192.168.1.100 g= r=f f=vmlinux i=bcm963xx_fs_kernel d=1 p=0 c= a= \" (255 chars max)\n"
     " -B     <board id>    \"968380GERG\"\n"
@@ -594,11 +1530,13 @@ int main(int argc, char ** argv)
     " -P     <GPON PASS>   \"          \" (10 chars max)\n"
     " -V     <VOICE ID>    \"LE9540\"\n"
     " -W     <WPS PIN>     \"1234567\" (7 chars max)\n"
-    " -I     <PSI size>    \"0x18\"\n"
+    " -I     <PSI size>    \"0x18\" (integers: decimal or 0x-hex, full field width)\n"
     " -N     <MAC num>     \"0x10\"\n"
     " -A     <backup PSI>  \"0x0\" or \"0x1\"\n"
     " -Y     <syslog size> \"0x0\"\n"
     " -F     <WLAN enable> \"0x0\" or \"0x1\"\n"
+    " --set <name=value>   set any field by name (with -e, repeatable), e.g. mem_tm=0x2C, nandpart_data_size=0x1000\n"
+    " --get <name|all>     print field value(s) (repeatable)\n"
 
     "\n (C) [anp/hsw] 2019, GPLv2 license applied\n"
     " crc32 code (C) openssh team\n"
@@ -0,0 +1,329 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <ctype.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <inttypes.h>
+
+#include "cfe_nvram.h"
+#include "crc32.h"
+#include "partition.h"
+
+/* CRC of the whole structure with crc field treated as zero, src_mem is not modified */
+uint32_t calc_cfe_nvram_crc(const unsigned char *src_mem)
+{
+    static const uint8_t zero_crc[sizeof(((bcm68380_nvram_t *)0)->crc)];
+    uint32_t crc;
+
+    crc = cfe_crc32(src_mem, offsetof(bcm68380_nvram_t, crc), 0xFFFFFFFF);
+    return cfe_crc32(zero_crc, sizeof(zero_crc), crc);
+}
+
+uint32_t calc_cfe_nvram_oldcksum(const unsigned char *src_mem)
+{
+    return cfe_crc32(src_mem, NVRAM_OLDCKSUM_LEN, 0xFFFFFFFF);
+}
+
+int check_cfe_nvram(const unsigned char *src_mem)
+{
+    uint32_t version, oldcksum, crc;
+
+    // fields are read with memcpy, src_mem may be unaligned
+    memcpy(&version, src_mem + offsetof(bcm68380_nvram_t, version), sizeof(version));
+    if (ntohl(version) != NVRAM_VERSION)
+	return 1;
+
+    memcpy(&crc, src_mem + offsetof(bcm68380_nvram_t, crc), sizeof(crc));
+    if (crc != htonl(calc_cfe_nvram_crc(src_mem)))
+	return 1;
+
+    memcpy(&oldcksum, src_mem + offsetof(bcm68380_nvram_t, oldcksum), sizeof(oldcksum));
+    if (oldcksum != 0xFFFFFFFF && oldcksum != htonl(calc_cfe_nvram_oldcksum(src_mem)))
+	return 1;
+
+    return 0;
+}
+
+/* partition table helpers live here (not in partition.c) so libcfenvram needs no image i/o */
+static const char *part_names[PART_NUM] = { "boot", "rootfs1", "rootfs2", "data", "bbt" };
+
+void cfe_nvram_partitions(const unsigned char *nvram, cfe_part_t parts[PART_NUM])
+{
+    const bcm68380_nvram_t *bcm_nvram = (const bcm68380_nvram_t *)nvram;
+    int i;
+
+    for (i = 0; i < PART_NUM; i++) {
+	parts[i].name = part_names[i];
+	parts[i].offset = (uint64_t)ntohl(bcm_nvram->nandpart_ofs[i]) * 1024;
+	parts[i].size = (uint64_t)ntohl(bcm_nvram->nandpart_size[i]) * 1024;
+    }
+}
+
+int cfe_part_valid(const cfe_part_t *part, uint64_t image_size)
+{
+    return !part->size || (part->offset < image_size && part->size <= image_size - part->offset);
+}
+
+int cfe_part_overlap(const cfe_part_t parts[PART_NUM], int *a, int *b)
+{
+    int i, j;
+
+    for (i = 0; i < PART_NUM; i++)
+	for (j = i + 1; j < PART_NUM; j++)
+	    if (parts[i].size && parts[j].size &&
+		parts[i].offset < parts[j].offset + parts[j].size && parts[j].offset < parts[i].offset + parts[i].size) {
+		*a = i;
+		*b = j;
+		return 1;
+	    }
+    return 0;
+}
+
+#ifdef ENABLE_VENDOR_ELTX
+/* printable, NUL-terminated and non-empty */
+static int is_version_string(const char *s, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size && s[i]; i++)
+	if (s[i] < 0x20 || s[i] > 0x7e)
+	    return 0;
+    return i > 0 && i < size;
+}
+#endif
+
+int detect_cfe_nvram_vendor(const unsigned char *src_mem)
+{
+    const bcm68380_nvram_t *bcm_nvram = (const bcm68380_nvram_t *)src_mem;
+
+#ifdef ENABLE_VENDOR_UBNT
+    // UFIBER NANO G: board id UBNT_SFU
+    if (!strncmp(bcm_nvram->board_id, "UBNT", 4))
+	return VENDOR_TYPE_UBNT;
+#endif
+
+#ifdef ENABLE_VENDOR_ELTX
+    const vendor_params_eltx_t *eltx = (const vendor_params_eltx_t *)bcm_nvram->vendor_params;
+
+    // NTU1402: firmware versions stored in vendor_params
+    if (!strncmp(bcm_nvram->gponsn, "ELTX", 4) ||
+	is_version_string(eltx->primary_version, sizeof(eltx->primary_version)) ||
+	is_version_string(eltx->backup_version, sizeof(eltx->backup_version)))
+	return VENDOR_TYPE_ELTX;
+#endif
+
+    return 0;
+}
+
+const char *cfe_nvram_vendor_name(int vendor_type)
+{
+    switch (vendor_type) {
+#ifdef ENABLE_VENDOR_ELTX
+	case VENDOR_TYPE_ELTX:
+	    return "eltex";
+#endif
+#ifdef ENABLE_VENDOR_UBNT
+	case VENDOR_TYPE_UBNT:
+	    return "ubiquiti";
+#endif
+	default:
+	    return "common";
+    }
+}
+
+#define NVRAM_FIELD(name, member, type, flags) \
+    { name, offsetof(bcm68380_nvram_t, member), sizeof(((bcm68380_nvram_t *)0)->member), type, flags, 0 }
+#define VENDOR_FIELD(name, vtype, member, type, flags, vendor) \
+    { name, offsetof(bcm68380_nvram_t, vendor_params) + offsetof(vtype, member), sizeof(((vtype *)0)->member), type, flags, vendor }
+
+const cfe_field_t cfe_nvram_fields[] = {
+    NVRAM_FIELD("version",		version,	FIELD_U32BE,	FIELD_F_READONLY),
+    NVRAM_FIELD("oldcksum",		oldcksum,	FIELD_U32,	FIELD_F_READONLY | FIELD_F_HEX),
+    NVRAM_FIELD("crc",			crc,		FIELD_U32,	FIELD_F_READONLY | FIELD_F_HEX),
+
+    NVRAM_FIELD("main_thread",		main_thread,	FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("psi_size",		psi_size,	FIELD_U32BE,	0),
+    NVRAM_FIELD("backup_psi",		backup_psi,	FIELD_U8,	0),
+    NVRAM_FIELD("wlan_feature",		wlan_feature,	FIELD_U8,	FIELD_F_HEX),
+    NVRAM_FIELD("syslog_size",		syslog_size,	FIELD_U32BE,	0),
+    NVRAM_FIELD("aux_percent",		aux_percent,	FIELD_U8,	0),
+    NVRAM_FIELD("bootline",		bootline,	FIELD_STR,	0),
+    NVRAM_FIELD("board_id",		board_id,	FIELD_STR,	0),
+    NVRAM_FIELD("mac_num",		mac_num,	FIELD_U32BE,	0),
+    NVRAM_FIELD("basemac",		basemac,	FIELD_MAC,	0),
+    NVRAM_FIELD("gponsn",		gponsn,		FIELD_STR,	FIELD_F_FIXLEN),
+    NVRAM_FIELD("gponpass",		gponpass,	FIELD_STR,	0),
+    NVRAM_FIELD("wpspin",		wpspin,		FIELD_STR,	0),
+    NVRAM_FIELD("voice_id",		voice_id,	FIELD_STR,	0),
+    NVRAM_FIELD("afe_id",		afe_id,		FIELD_BYTES,	0),
+    NVRAM_FIELD("mem_tm",		mem_tm,		FIELD_U8,	0),
+    NVRAM_FIELD("mem_mc",		mem_mc,		FIELD_U8,	0),
+    NVRAM_FIELD("mem_dhd0",		mem_dhd0,	FIELD_U8,	0),
+    NVRAM_FIELD("mem_dhd1",		mem_dhd1,	FIELD_U8,	0),
+    NVRAM_FIELD("mem_dhd2",		mem_dhd2,	FIELD_U8,	0),
+    NVRAM_FIELD("part0_size",		part0_size,	FIELD_U8,	0),
+    NVRAM_FIELD("part1_size",		part1_size,	FIELD_U8,	0),
+    NVRAM_FIELD("part2_size",		part2_size,	FIELD_U8,	0),
+    NVRAM_FIELD("part3_size",		part3_size,	FIELD_U8,	0),
+    NVRAM_FIELD("nandpart_boot_ofs",	nandpart_ofs[0], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_boot_size",	nandpart_size[0], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_rootfs1_ofs",	nandpart_ofs[1], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_rootfs1_size", nandpart_size[1], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_rootfs2_ofs",	nandpart_ofs[2], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_rootfs2_size", nandpart_size[2], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_data_ofs",	nandpart_ofs[3], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_data_size",	nandpart_size[3], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_bbt_ofs",	nandpart_ofs[4], FIELD_U32BE,	FIELD_F_HEX),
+    NVRAM_FIELD("nandpart_bbt_size",	nandpart_size[4], FIELD_U32BE,	FIELD_F_HEX),
+
+#ifdef ENABLE_VENDOR_ELTX
+    VENDOR_FIELD("eltx_primary_version", vendor_params_eltx_t, primary_version, FIELD_STR, 0, VENDOR_TYPE_ELTX),
+    VENDOR_FIELD("eltx_backup_version",	vendor_params_eltx_t, backup_version, FIELD_STR, 0, VENDOR_TYPE_ELTX),
+    VENDOR_FIELD("eltx_primary_crc",	vendor_params_eltx_t, primary_crc, FIELD_U32, FIELD_F_HEX, VENDOR_TYPE_ELTX),
+    VENDOR_FIELD("eltx_backup_crc",	vendor_params_eltx_t, backup_crc, FIELD_U32, FIELD_F_HEX, VENDOR_TYPE_ELTX),
+#endif
+#ifdef ENABLE_VENDOR_UBNT
+    VENDOR_FIELD("ubnt_olt_mode",	vendor_params_ubnt_t, olt_mode, FIELD_U8, 0, VENDOR_TYPE_UBNT),
+    VENDOR_FIELD("ubnt_onu_mode",	vendor_params_ubnt_t, onu_mode, FIELD_U8, 0, VENDOR_TYPE_UBNT),
+#endif
+};
+
+const size_t cfe_nvram_fields_num = sizeof(cfe_nvram_fields) / sizeof(cfe_nvram_fields[0]);
+
+const cfe_field_t *cfe_nvram_field(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < cfe_nvram_fields_num; i++)
+	if (!strcmp(cfe_nvram_fields[i].name, name))
+	    return &cfe_nvram_fields[i];
+    return NULL;
+}
+
+uint64_t cfe_nvram_get_uint(const unsigned char *nvram, const cfe_field_t *f)
+{
+    const unsigned char *p = nvram + f->offset;
+    uint32_t v;
+
+    switch (f->type) {
+	case FIELD_U8:
+	    return p[0];
+	case FIELD_U32BE:
+	    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+	case FIELD_U32:
+	    memcpy(&v, p, sizeof(v));
+	    return v;
+	default:
+	    return 0;
+    }
+}
+
+int cfe_nvram_get(const unsigned char *nvram, const cfe_field_t *f, char *buf, size_t size)
+{
+    const unsigned char *p = nvram + f->offset;
+    size_t i, len;
+    int n;
+
+    switch (f->type) {
+	case FIELD_STR:
+	    for (len = 0; len < f->size && p[len] && p[len] != 0xFF; len++);
+	    if (len >= size)
+		return -1;
+	    memcpy(buf, p, len);
+	    buf[len] = 0;
+	    return len;
+	case FIELD_MAC:
+	case FIELD_BYTES:
+	    if (f->size * 2 >= size)
+		return -1;
+	    for (i = 0; i < f->size; i++)
+		sprintf(buf + i * 2, f->type == FIELD_MAC ? "%02X" : "%02x", p[i]);
+	    return f->size * 2;
+	default:
+	    n = snprintf(buf, size, f->flags & FIELD_F_HEX ? "%#" PRIx64 : "%" PRIu64, cfe_nvram_get_uint(nvram, f));
+	    return n < 0 || (size_t)n >= size ? -1 : n;
+    }
+}
+
+int cfe_nvram_set(unsigned char *nvram, const cfe_field_t *f, const char *value)
+{
+    unsigned char *p = nvram + f->offset;
+    unsigned long long v;
+    const char *digits;
+    char *end;
+    int base;
+    size_t len;
+    uint32_t v32;
+
+    if (f->flags & FIELD_F_READONLY)
+	return 1;
+
+    switch (f->type) {
+	case FIELD_STR:
+	    len = strlen(value);
+	    if (len > (size_t)f->size - 1u)	// keep null terminator
+		return 1;
+	    if ((f->flags & FIELD_F_FIXLEN) && len != (size_t)f->size - 1u)
+		return 1;
+	    memset(p, 0, f->size);
+	    memcpy(p, value, len);
+	    return 0;
+	case FIELD_MAC:
+	case FIELD_BYTES: {
+	    unsigned char tmp[256];
+	    size_t i;
+
+	    if (strlen(value) != (size_t)f->size * 2 || f->size > sizeof(tmp))
+		return 1;
+	    for (i = 0; i < (size_t)f->size * 2; i++)
+		if (!isxdigit((unsigned char)value[i]))
+		    return 1;
+	    for (i = 0; i < f->size; i++)
+		sscanf(value + i * 2, "%2hhx", &tmp[i]);
+	    memcpy(p, tmp, f->size);
+	    return 0;
+	}
+	default:
+	    break;
+    }
+
+    // decimal or 0x-hex only: no octal on leading 0, no sign or leading whitespace
+    digits = value;
+    base = 10;
+    if (value[0] == '0' && (value[1] == 'x' || value[1] == 'X')) {
+	digits = value + 2;
+	base = 16;
+    }
+    if (base == 16 ? !isxdigit((unsigned char)digits[0]) : !isdigit((unsigned char)digits[0]))
+	return 1;
+    errno = 0;
+    v = strtoull(digits, &end, base);
+    if (errno || *end)
+	return 1;
+
+    switch (f->type) {
+	case FIELD_U8:
+	    if (v > 0xFF)
+		return 1;
+	    p[0] = v;
+	    return 0;
+	case FIELD_U32BE:
+	    if (v > 0xFFFFFFFFULL)
+		return 1;
+	    p[0] = v >> 24;
+	    p[1] = v >> 16;
+	    p[2] = v >> 8;
+	    p[3] = v;
+	    return 0;
+	case FIELD_U32:
+	    if (v > 0xFFFFFFFFULL)
+		return 1;
+	    v32 = v;
+	    memcpy(p, &v32, sizeof(v32));
+	    return 0;
+	default:
+	    return 1;
+    }
+}
@@ -0,0 +1,125 @@
+#ifndef CFE_NVRAM_H
+#define CFE_NVRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct  bcm68380_nvram {	// default offset in flash: 0x580
+    uint32_t    version;		// 0x6
+    char        bootline[0x100];	/* "e=192.168.1.1:ffffff00 h=192.168.1.100 r=f f=vmlinux i=bcm963xx_fs_kernel d=1 p=0 " */
+    char        board_id[0x10];		/* RV6699, NTU1402: 968380GERG; UFIBER NANO G: UBNT_SFU */
+    uint32_t    main_thread;		/* 0 (or 1) */
+    uint32_t    psi_size;		// 0x18
+    uint32_t    mac_num;		// 0x0A or 0x10
+    unsigned char basemac[6];		/* 0xA8F94B010203 */
+    char        salign;		// reserved?
+    uint8_t	backup_psi;		// Backup PSI: 0 disable, 1 - enable
+    uint32_t    oldcksum;		// old BROADCOM CRC (not used)
+    char        gponsn[13];		// "ELTX02010203", null-terminated
+    char        gponpass[11];		// "00000000" or "        ", null-terminated
+    char        wpspin[8];
+    char        wlanparams[0xFF];
+    uint8_t	wlan_feature;		// default 0, only ubnt bootloader has this
+    uint32_t    syslog_size;		// 0
+    uint32_t    nandpart_ofs[5];	// boot, rootfs1, rootfs2, data, bbt
+    uint32_t    nandpart_size[5];
+    char        voice_id[0x10];		// LE9530
+    char        afe_id[8];
+    char        salign1[65];
+    uint8_t	aux_percent;		// Auxilary filesystem size percent: 0
+    char	salign1a[6];
+    uint8_t	mem_tm;			// TM memory allocation RV6699-MGTS, UFIBER NANO G: 0x14; RV6699-RT: 0x2C | flow memory allocation
+    uint8_t	mem_mc;			// MC memory allocation: 0x04 | buffer memory allocation
+
+    char        salign2[10];		// Only UBNT has mappings?
+    uint8_t	part0_size;		// Partition 1 Size
+    uint8_t	part1_size;		// Partition 2 Size
+    uint8_t	part2_size;		// Partition 3 Size
+    uint8_t	part3_size;		// Partition 4 Size (DATA)
+
+    // Broadcom dongle host driver (dhd_linux.c)
+    uint8_t	mem_dhd0;		// DHD0 memory allocation RV6699-MGTS: 0; RV6699-RT: 14
+    uint8_t	mem_dhd1;		// DHD1 memory allocation
+    uint8_t	mem_dhd2;		// DHD2 memory allocation
+
+    char        salign2a;	// ??
+
+    char        vendor_params[272];
+
+    uint32_t    crc;			/* common CRC */
+} bcm68380_nvram_t;
+
+#ifdef ENABLE_VENDOR_ELTX
+#define VENDOR_TYPE_ELTX 1
+typedef struct vendor_params_eltx {
+    char	primary_version[12];	// Version of primary firmware in flash
+    char        salign2b[52];
+    char	backup_version[12];	// Version of backup firmware in flash
+    char        salign2c[52];
+    uint32_t	primary_crc;		// CRC of primary
+    uint32_t	backup_crc;		// CRC of backup
+    char        reserved[134];
+} vendor_params_eltx_t;
+#endif
+
+#ifdef ENABLE_VENDOR_UBNT
+#define VENDOR_TYPE_UBNT 2
+typedef struct vendor_params_ubnt {
+    uint8_t	olt_mode;		// UFIBER: OLT Vendor ID: 1 - UBNT, 2 - HUAWEI
+    char        salign2b;
+    uint8_t	onu_mode;		// UFIBER: ONU work mode: 0 - ENFORCE_BY_OLT, 1 - BRIDGE, 2 - ROUTER; default 0xFF
+    char        reserved[269];
+} vendor_params_ubnt_t;
+#endif
+
+#define NVRAM_VERSION		6
+#define NVRAM_OLDCKSUM_LEN	0x126	// old broadcom checksum covers only the beginning of structure
+
+/* CRC of the whole structure with crc field treated as zero, src_mem is not modified */
+uint32_t calc_cfe_nvram_crc(const unsigned char *src_mem);
+/* old broadcom checksum (host order) */
+uint32_t calc_cfe_nvram_oldcksum(const unsigned char *src_mem);
+
+/* 0 if version is 6, crc matches and oldcksum is empty or matches */
+int check_cfe_nvram(const unsigned char *src_mem);
+
+/* guess vendor_params layout: VENDOR_TYPE_ELTX, VENDOR_TYPE_UBNT or 0 (common) */
+int detect_cfe_nvram_vendor(const unsigned char *src_mem);
+const char *cfe_nvram_vendor_name(int vendor_type);
+
+/* field schema: one table drives --get/--set, edit options and machine-readable output */
+enum {
+    FIELD_U8 = 0,
+    FIELD_U32BE,	// big-endian on flash
+    FIELD_U32,		// stored as is (eltex firmware crc, shown like text output)
+    FIELD_STR,		// null-terminated (or 0xFF-terminated) string
+    FIELD_MAC,		// 6 bytes, "3C9872010203"
+    FIELD_BYTES,	// raw bytes in hex
+};
+
+#define FIELD_F_HEX		0x01	// integer shown in hex
+#define FIELD_F_READONLY	0x02	// header and checksums, maintained by cfe_edit
+#define FIELD_F_FIXLEN		0x04	// string must fill whole field (GPON SN)
+
+typedef struct cfe_field {
+    const char	*name;
+    uint16_t	offset;		// from start of bcm68380_nvram_t
+    uint16_t	size;
+    uint8_t	type;
+    uint8_t	flags;
+    uint8_t	vendor;		// 0 - common, else VENDOR_TYPE_* of vendor_params layout
+} cfe_field_t;
+
+extern const cfe_field_t cfe_nvram_fields[];
+extern const size_t cfe_nvram_fields_num;
+
+const cfe_field_t *cfe_nvram_field(const char *name);
+
+/* fields are read/written directly in nvram (mapped image), no structure copies */
+uint64_t cfe_nvram_get_uint(const unsigned char *nvram, const cfe_field_t *f);
+/* text value into buf, returns length or -1 if buf too small */
+int cfe_nvram_get(const unsigned char *nvram, const cfe_field_t *f, char *buf, size_t size);
+/* parse value (integers: full range, decimal or 0x-hex), 0 on success */
+int cfe_nvram_set(unsigned char *nvram, const cfe_field_t *f, const char *value);
+
+#endif
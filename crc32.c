@@ -0,0 +1,483 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#include <cpuid.h>
+#define HAVE_CRC32_PCLMUL 1
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && defined(__GNUC__)
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define HAVE_CRC32_ARMV8 1
+#endif
+
+#include "crc32.h"
+
+/* реализация crc32 из openssh */
+static const uint32_t crc32tab[] = {
+        0x00000000L, 0x77073096L, 0xee0e612cL, 0x990951baL,
+        0x076dc419L, 0x706af48fL, 0xe963a535L, 0x9e6495a3L,
+        0x0edb8832L, 0x79dcb8a4L, 0xe0d5e91eL, 0x97d2d988L,
+        0x09b64c2bL, 0x7eb17cbdL, 0xe7b82d07L, 0x90bf1d91L,
+        0x1db71064L, 0x6ab020f2L, 0xf3b97148L, 0x84be41deL,
+        0x1adad47dL, 0x6ddde4ebL, 0xf4d4b551L, 0x83d385c7L,
+        0x136c9856L, 0x646ba8c0L, 0xfd62f97aL, 0x8a65c9ecL,
+        0x14015c4fL, 0x63066cd9L, 0xfa0f3d63L, 0x8d080df5L,
+        0x3b6e20c8L, 0x4c69105eL, 0xd56041e4L, 0xa2677172L,
+        0x3c03e4d1L, 0x4b04d447L, 0xd20d85fdL, 0xa50ab56bL,
+        0x35b5a8faL, 0x42b2986cL, 0xdbbbc9d6L, 0xacbcf940L,
+        0x32d86ce3L, 0x45df5c75L, 0xdcd60dcfL, 0xabd13d59L,
+        0x26d930acL, 0x51de003aL, 0xc8d75180L, 0xbfd06116L,
+        0x21b4f4b5L, 0x56b3c423L, 0xcfba9599L, 0xb8bda50fL,
+        0x2802b89eL, 0x5f058808L, 0xc60cd9b2L, 0xb10be924L,
+        0x2f6f7c87L, 0x58684c11L, 0xc1611dabL, 0xb6662d3dL,
+        0x76dc4190L, 0x01db7106L, 0x98d220bcL, 0xefd5102aL,
+        0x71b18589L, 0x06b6b51fL, 0x9fbfe4a5L, 0xe8b8d433L,
+        0x7807c9a2L, 0x0f00f934L, 0x9609a88eL, 0xe10e9818L,
+        0x7f6a0dbbL, 0x086d3d2dL, 0x91646c97L, 0xe6635c01L,
+        0x6b6b51f4L, 0x1c6c6162L, 0x856530d8L, 0xf262004eL,
+        0x6c0695edL, 0x1b01a57bL, 0x8208f4c1L, 0xf50fc457L,
+        0x65b0d9c6L, 0x12b7e950L, 0x8bbeb8eaL, 0xfcb9887cL,
+        0x62dd1ddfL, 0x15da2d49L, 0x8cd37cf3L, 0xfbd44c65L,
+        0x4db26158L, 0x3ab551ceL, 0xa3bc0074L, 0xd4bb30e2L,
+        0x4adfa541L, 0x3dd895d7L, 0xa4d1c46dL, 0xd3d6f4fbL,
+        0x4369e96aL, 0x346ed9fcL, 0xad678846L, 0xda60b8d0L,
+        0x44042d73L, 0x33031de5L, 0xaa0a4c5fL, 0xdd0d7cc9L,
+        0x5005713cL, 0x270241aaL, 0xbe0b1010L, 0xc90c2086L,
+        0x5768b525L, 0x206f85b3L, 0xb966d409L, 0xce61e49fL,
+        0x5edef90eL, 0x29d9c998L, 0xb0d09822L, 0xc7d7a8b4L,
+        0x59b33d17L, 0x2eb40d81L, 0xb7bd5c3bL, 0xc0ba6cadL,
+        0xedb88320L, 0x9abfb3b6L, 0x03b6e20cL, 0x74b1d29aL,
+        0xead54739L, 0x9dd277afL, 0x04db2615L, 0x73dc1683L,
+        0xe3630b12L, 0x94643b84L, 0x0d6d6a3eL, 0x7a6a5aa8L,
+        0xe40ecf0bL, 0x9309ff9dL, 0x0a00ae27L, 0x7d079eb1L,
+        0xf00f9344L, 0x8708a3d2L, 0x1e01f268L, 0x6906c2feL,
+        0xf762575dL, 0x806567cbL, 0x196c3671L, 0x6e6b06e7L,
+        0xfed41b76L, 0x89d32be0L, 0x10da7a5aL, 0x67dd4accL,
+        0xf9b9df6fL, 0x8ebeeff9L, 0x17b7be43L, 0x60b08ed5L,
+        0xd6d6a3e8L, 0xa1d1937eL, 0x38d8c2c4L, 0x4fdff252L,
+        0xd1bb67f1L, 0xa6bc5767L, 0x3fb506ddL, 0x48b2364bL,
+        0xd80d2bdaL, 0xaf0a1b4cL, 0x36034af6L, 0x41047a60L,
+        0xdf60efc3L, 0xa867df55L, 0x316e8eefL, 0x4669be79L,
+        0xcb61b38cL, 0xbc66831aL, 0x256fd2a0L, 0x5268e236L,
+        0xcc0c7795L, 0xbb0b4703L, 0x220216b9L, 0x5505262fL,
+        0xc5ba3bbeL, 0xb2bd0b28L, 0x2bb45a92L, 0x5cb36a04L,
+        0xc2d7ffa7L, 0xb5d0cf31L, 0x2cd99e8bL, 0x5bdeae1dL,
+        0x9b64c2b0L, 0xec63f226L, 0x756aa39cL, 0x026d930aL,
+        0x9c0906a9L, 0xeb0e363fL, 0x72076785L, 0x05005713L,
+        0x95bf4a82L, 0xe2b87a14L, 0x7bb12baeL, 0x0cb61b38L,
+        0x92d28e9bL, 0xe5d5be0dL, 0x7cdcefb7L, 0x0bdbdf21L,
+        0x86d3d2d4L, 0xf1d4e242L, 0x68ddb3f8L, 0x1fda836eL,
+        0x81be16cdL, 0xf6b9265bL, 0x6fb077e1L, 0x18b74777L,
+        0x88085ae6L, 0xff0f6a70L, 0x66063bcaL, 0x11010b5cL,
+        0x8f659effL, 0xf862ae69L, 0x616bffd3L, 0x166ccf45L,
+        0xa00ae278L, 0xd70dd2eeL, 0x4e048354L, 0x3903b3c2L,
+        0xa7672661L, 0xd06016f7L, 0x4969474dL, 0x3e6e77dbL,
+        0xaed16a4aL, 0xd9d65adcL, 0x40df0b66L, 0x37d83bf0L,
+        0xa9bcae53L, 0xdebb9ec5L, 0x47b2cf7fL, 0x30b5ffe9L,
+        0xbdbdf21cL, 0xcabac28aL, 0x53b39330L, 0x24b4a3a6L,
+        0xbad03605L, 0xcdd70693L, 0x54de5729L, 0x23d967bfL,
+        0xb3667a2eL, 0xc4614ab8L, 0x5d681b02L, 0x2a6f2b94L,
+        0xb40bbe37L, 0xc30c8ea1L, 0x5a05df1bL, 0x2d02ef8dL
+};
+
+uint32_t ssh_crc32(const uint8_t *buf, uint32_t size, uint32_t crc)
+{
+        uint32_t i;
+
+        for (i = 0;  i < size;  i++)
+                crc = crc32tab[(crc ^ buf[i]) & 0xff] ^ (crc >> 8);
+        return crc;
+}
+
+/* slicing tables, generated from crc32tab at init */
+static uint32_t crc32slice[16][256];
+
+static void crc32_slice_tables(void)
+{
+    int i, j;
+
+    for (i = 0; i < 256; i++)
+	crc32slice[0][i] = crc32tab[i];
+    for (i = 0; i < 256; i++)
+	for (j = 1; j < 16; j++)
+	    crc32slice[j][i] = (crc32slice[j - 1][i] >> 8) ^ crc32tab[crc32slice[j - 1][i] & 0xff];
+}
+
+/* little-endian load, independent of host byte order (cfe_edit also runs on MIPS/ARM BE targets) */
+static inline uint32_t load_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t crc32_slice8(const uint8_t *buf, uint32_t size, uint32_t crc)
+{
+    while (size >= 8) {
+	uint32_t lo = load_le32(buf) ^ crc;
+	uint32_t hi = load_le32(buf + 4);
+
+	crc = crc32slice[7][lo & 0xff] ^ crc32slice[6][(lo >> 8) & 0xff] ^
+	      crc32slice[5][(lo >> 16) & 0xff] ^ crc32slice[4][lo >> 24] ^
+	      crc32slice[3][hi & 0xff] ^ crc32slice[2][(hi >> 8) & 0xff] ^
+	      crc32slice[1][(hi >> 16) & 0xff] ^ crc32slice[0][hi >> 24];
+	buf += 8;
+	size -= 8;
+    }
+    return ssh_crc32(buf, size, crc);
+}
+
+static uint32_t crc32_slice16(const uint8_t *buf, uint32_t size, uint32_t crc)
+{
+    while (size >= 16) {
+	uint32_t w0 = load_le32(buf) ^ crc;
+	uint32_t w1 = load_le32(buf + 4);
+	uint32_t w2 = load_le32(buf + 8);
+	uint32_t w3 = load_le32(buf + 12);
+
+	crc = crc32slice[15][w0 & 0xff] ^ crc32slice[14][(w0 >> 8) & 0xff] ^
+	      crc32slice[13][(w0 >> 16) & 0xff] ^ crc32slice[12][w0 >> 24] ^
+	      crc32slice[11][w1 & 0xff] ^ crc32slice[10][(w1 >> 8) & 0xff] ^
+	      crc32slice[9][(w1 >> 16) & 0xff] ^ crc32slice[8][w1 >> 24] ^
+	      crc32slice[7][w2 & 0xff] ^ crc32slice[6][(w2 >> 8) & 0xff] ^
+	      crc32slice[5][(w2 >> 16) & 0xff] ^ crc32slice[4][w2 >> 24] ^
+	      crc32slice[3][w3 & 0xff] ^ crc32slice[2][(w3 >> 8) & 0xff] ^
+	      crc32slice[1][(w3 >> 16) & 0xff] ^ crc32slice[0][w3 >> 24];
+	buf += 16;
+	size -= 16;
+    }
+    return crc32_slice8(buf, size, crc);
+}
+
+#ifdef HAVE_CRC32_PCLMUL
+/*
+ * Carry-less multiplication folding for the reflected 0xEDB88320 polynomial
+ * (Intel "Fast CRC Computation Using PCLMULQDQ", same constants as zlib/chromium).
+ */
+static const uint64_t __attribute__((aligned(16))) k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+static const uint64_t __attribute__((aligned(16))) k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+static const uint64_t __attribute__((aligned(16))) k5k0[] = { 0x0163cd6124, 0x0000000000 };
+static const uint64_t __attribute__((aligned(16))) poly[] = { 0x01db710641, 0x01f7011641 };
+
+static int crc32_pclmul_supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+	return 0;
+    return (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1);
+}
+
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_fold(const uint8_t *buf, uint32_t size, uint32_t crc)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    // size >= 64 and multiple of 16
+    x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+    x0 = _mm_load_si128((const __m128i *)k1k2);
+    buf += 64;
+    size -= 64;
+
+    // fold 512 bits per iteration
+    while (size >= 64) {
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+	x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+	x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+	x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+	y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+	y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+	y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+	y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+	x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+	x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+	x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+	buf += 64;
+	size -= 64;
+    }
+
+    // fold 4x128 into 128 bits
+    x0 = _mm_load_si128((const __m128i *)k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // remaining 16 byte blocks
+    while (size >= 16) {
+	x2 = _mm_loadu_si128((const __m128i *)buf);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	buf += 16;
+	size -= 16;
+    }
+
+    // 128 -> 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+    x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i *)poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_pclmul(const uint8_t *buf, uint32_t size, uint32_t crc)
+{
+    if (size >= 64) {
+	uint32_t chunk = size & ~15U;
+
+	crc = crc32_pclmul_fold(buf, chunk, crc);
+	buf += chunk;
+	size -= chunk;
+    }
+    return crc32_slice8(buf, size, crc);
+}
+#endif
+
+#ifdef HAVE_CRC32_ARMV8
+static int crc32_armv8_supported(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+__attribute__((target("arch=armv8-a+crc")))
+static uint32_t crc32_armv8(const uint8_t *buf, uint32_t size, uint32_t crc)
+{
+    while (size && ((uintptr_t)buf & 7)) {
+	crc = __crc32b(crc, *buf++);
+	size--;
+    }
+    while (size >= 8) {
+	uint64_t v;
+
+	memcpy(&v, buf, sizeof(v));
+	crc = __crc32d(crc, v);
+	buf += 8;
+	size -= 8;
+    }
+    while (size--)
+	crc = __crc32b(crc, *buf++);
+    return crc;
+}
+#endif
+
+/*
+ * CRC32 is linear over GF(2): crc(A ^ B) = crc(A) ^ crc(B) for zero initial value,
+ * and appending n zero bytes multiplies register by x^(8n) mod P (zlib crc32_combine).
+ */
+#define CRC32_POLY 0xedb88320
+
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t m = (uint32_t)1 << 31, p = 0;
+
+    for (;;) {
+	if (a & m) {
+	    p ^= b;
+	    if ((a & (m - 1)) == 0)
+		break;
+	}
+	m >>= 1;
+	b = b & 1 ? (b >> 1) ^ CRC32_POLY : b >> 1;
+    }
+    return p;
+}
+
+static uint32_t x2n_table[32];	// x^(2^n) mod P
+
+static void crc32_x2n_table(void)
+{
+    uint32_t p = (uint32_t)1 << 30;	// x^1
+    int n;
+
+    x2n_table[0] = p;
+    for (n = 1; n < 32; n++)
+	x2n_table[n] = p = multmodp(p, p);
+}
+
+/* x^(n * 2^k) mod P */
+static uint32_t x2nmodp(uint64_t n, unsigned int k)
+{
+    uint32_t p = (uint32_t)1 << 31;	// x^0
+
+    while (n) {
+	if (n & 1)
+	    p = multmodp(x2n_table[k & 31], p);
+	n >>= 1;
+	k++;
+    }
+    return p;
+}
+
+uint32_t crc32_shift(uint32_t crc, uint64_t len)
+{
+    return multmodp(x2nmodp(len, 3), crc);
+}
+
+uint32_t crc32_patch(uint32_t crc, uint64_t total, uint64_t ofs, const uint8_t *old, const uint8_t *new, uint32_t len)
+{
+    uint32_t delta = 0, i;
+
+    for (i = 0; i < len; i++)
+	delta = crc32tab[(delta ^ old[i] ^ new[i]) & 0xff] ^ (delta >> 8);
+    return crc ^ crc32_shift(delta, total - ofs - len);
+}
+
+static crc32_engine_t engines[] = {
+    // best engine last
+    { "ssh",     ssh_crc32,     NULL, 0 },
+    { "slice8",  crc32_slice8,  NULL, 0 },
+    { "slice16", crc32_slice16, NULL, 0 },
+#ifdef HAVE_CRC32_ARMV8
+    { "armv8",   crc32_armv8,   crc32_armv8_supported, 0 },
+#endif
+#ifdef HAVE_CRC32_PCLMUL
+    { "pclmul",  crc32_pclmul,  crc32_pclmul_supported, 0 },
+#endif
+};
+
+#define ENGINES_NUM (int)(sizeof(engines) / sizeof(engines[0]))
+
+static crc32_fn_t crc32_impl = ssh_crc32;
+static const char *crc32_impl_name = "ssh";
+
+/* lengths around every fold/slice/tail boundary of the engines, checked at process start */
+static const uint32_t selftest_lens[] = { 0, 1, 3, 7, 8, 9, 15, 16, 17, 31, 63, 64, 65, 127, 128, 129, 255, 256, 1027 };
+
+/* full sweep: all lengths 0..SELFTEST_LEN at several misalignments, cfe_bench only */
+#define SELFTEST_LEN 1100
+
+static uint8_t selftest_pattern[SELFTEST_LEN + 8];
+
+static int crc32_selftest_one(crc32_fn_t fn, uint32_t align, uint32_t len)
+{
+    uint32_t init = len & 1 ? 0xFFFFFFFF : len * 0x9E3779B9U;
+
+    return fn(selftest_pattern + align, len, init) != ssh_crc32(selftest_pattern + align, len, init);
+}
+
+static int crc32_selftest(crc32_fn_t fn, int full)
+{
+    uint32_t len, align, i;
+
+    for (align = 0; align < 8; align += 3) {
+	if (full) {
+	    for (len = 0; len <= SELFTEST_LEN; len++)
+		if (crc32_selftest_one(fn, align, len))
+		    return 1;
+	} else {
+	    for (i = 0; i < sizeof(selftest_lens) / sizeof(selftest_lens[0]); i++)
+		if (crc32_selftest_one(fn, align, selftest_lens[i]))
+		    return 1;
+	}
+    }
+    return 0;
+}
+
+static void crc32_selftest_pattern(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(selftest_pattern); i++)
+	selftest_pattern[i] = (uint8_t)(i * 131 + (i >> 3) + 7);
+}
+
+int crc32_init(void)
+{
+    int i, failed = 0;
+
+    crc32_slice_tables();
+    crc32_x2n_table();
+    crc32_selftest_pattern();
+
+    for (i = 0; i < ENGINES_NUM; i++) {
+	engines[i].usable = 0;
+	if (engines[i].supported && !engines[i].supported())
+	    continue;
+	if (crc32_selftest(engines[i].fn, 0)) {
+	    fprintf(stderr, "crc32 engine \"%s\" failed self-test, disabled\n", engines[i].name);
+	    failed++;
+	    continue;
+	}
+	engines[i].usable = 1;
+	crc32_impl = engines[i].fn;
+	crc32_impl_name = engines[i].name;
+    }
+
+    return failed;
+}
+
+int crc32_selftest_full(void)
+{
+    int i, failed = 0;
+
+    for (i = 0; i < ENGINES_NUM; i++) {
+	if (!engines[i].usable || !crc32_selftest(engines[i].fn, 1))
+	    continue;
+	fprintf(stderr, "crc32 engine \"%s\" failed full self-test\n", engines[i].name);
+	failed++;
+    }
+    return failed;
+}
+
+int crc32_select(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ENGINES_NUM; i++) {
+	if (strcmp(engines[i].name, name) || !engines[i].usable)
+	    continue;
+	crc32_impl = engines[i].fn;
+	crc32_impl_name = engines[i].name;
+	return 0;
+    }
+    return 1;
+}
+
+const char *crc32_engine_name(void)
+{
+    return crc32_impl_name;
+}
+
+const crc32_engine_t *crc32_engines(int *count)
+{
+    *count = ENGINES_NUM;
+    return engines;
+}
+
+uint32_t cfe_crc32(const uint8_t *buf, uint32_t size, uint32_t crc)
+{
+    return crc32_impl(buf, size, crc);
+}
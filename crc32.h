@@ -0,0 +1,42 @@
+#ifndef CFE_CRC32_H
+#define CFE_CRC32_H
+
+#include <stdint.h>
+
+typedef uint32_t (*crc32_fn_t)(const uint8_t *buf, uint32_t size, uint32_t crc);
+
+typedef struct crc32_engine {
+    const char	*name;
+    crc32_fn_t	fn;
+    int		(*supported)(void);	// NULL - always available
+    int		usable;			// set by crc32_init(): supported and passed self-test
+} crc32_engine_t;
+
+/* reference byte-at-a-time implementation, all other engines must match it */
+uint32_t ssh_crc32(const uint8_t *buf, uint32_t size, uint32_t crc);
+
+/* select fastest usable engine, short self-test of every engine against ssh_crc32 */
+int crc32_init(void);
+
+/* every usable engine against ssh_crc32 on all lengths 0..1100, returns number failed */
+int crc32_selftest_full(void);
+
+/* force engine by name ("ssh", "slice8", "slice16", "pclmul", "armv8"), returns 0 on success */
+int crc32_select(const char *name);
+
+const char *crc32_engine_name(void);
+const crc32_engine_t *crc32_engines(int *count);
+
+/* same semantics as ssh_crc32: no pre/post inversion, caller passes initial value */
+uint32_t cfe_crc32(const uint8_t *buf, uint32_t size, uint32_t crc);
+
+/* advance crc register over len zero bytes (zero initial value contribution only) */
+uint32_t crc32_shift(uint32_t crc, uint64_t len);
+
+/*
+ * update crc of total bytes when [ofs, ofs + len) changed from old to new,
+ * cost depends on len and log(total), not on total
+ */
+uint32_t crc32_patch(uint32_t crc, uint64_t total, uint64_t ofs, const uint8_t *old, const uint8_t *new, uint32_t len);
+
+#endif
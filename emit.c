@@ -0,0 +1,246 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "emit.h"
+#include "stats.h"
+
+static const char hexdigits[] = "0123456789abcdef";
+
+int emit_format(const char *name)
+{
+    if (!strcmp(name, "text"))
+	return FORMAT_TEXT;
+    if (!strcmp(name, "json"))
+	return FORMAT_JSON;
+    if (!strcmp(name, "csv"))
+	return FORMAT_CSV;
+    return -1;
+}
+
+void emit_init(emit_t *e, int format)
+{
+    memset(e, 0, sizeof(*e));
+    e->format = format;
+}
+
+void emit_free(emit_t *e)
+{
+    free(e->buf);
+    e->buf = NULL;
+    e->len = e->alloc = 0;
+}
+
+void emit_reset(emit_t *e)
+{
+    e->len = 0;
+    e->nfields = 0;
+}
+
+/* make room for n more bytes */
+static char *reserve(emit_t *e, size_t n)
+{
+    if (e->len + n > e->alloc) {
+	size_t alloc = e->alloc ? e->alloc : 4096;
+	char *buf;
+
+	while (alloc < e->len + n)
+	    alloc *= 2;
+	buf = realloc(e->buf, alloc);
+	if (!buf) {
+	    e->error = 1;
+	    return NULL;
+	}
+	e->buf = buf;
+	e->alloc = alloc;
+    }
+    return e->buf + e->len;
+}
+
+static void put(emit_t *e, const char *s, size_t n)
+{
+    char *p = reserve(e, n);
+    if (!p)
+	return;
+    memcpy(p, s, n);
+    e->len += n;
+}
+
+static void putc_(emit_t *e, char c)
+{
+    char *p = reserve(e, 1);
+    if (!p)
+	return;
+    *p = c;
+    e->len++;
+}
+
+static void put_uint(emit_t *e, uint64_t v)
+{
+    char tmp[20];
+    int n = 0;
+
+    do {
+	tmp[sizeof(tmp) - ++n] = '0' + v % 10;
+	v /= 10;
+    } while (v);
+    put(e, tmp + sizeof(tmp) - n, n);
+}
+
+/* separator and field name; returns 0 if value must be skipped (csv header) */
+static int field(emit_t *e, const char *name)
+{
+    if (e->nfields++)
+	putc_(e, ',');
+
+    if (e->format == FORMAT_JSON) {
+	putc_(e, '"');
+	put(e, name, strlen(name));
+	put(e, "\":", 2);
+    } else if (e->header) {
+	put(e, name, strlen(name));
+	return 0;
+    }
+    return 1;
+}
+
+void emit_begin(emit_t *e)
+{
+    e->nfields = 0;
+    if (e->format == FORMAT_JSON)
+	putc_(e, '{');
+}
+
+void emit_end(emit_t *e)
+{
+    if (e->format == FORMAT_JSON)
+	putc_(e, '}');
+    putc_(e, '\n');
+}
+
+void emit_str(emit_t *e, const char *name, const char *s, size_t size)
+{
+    size_t i;
+
+    if (!field(e, name))
+	return;
+
+    putc_(e, '"');
+    for (i = 0; i < size && s[i] && (unsigned char)s[i] != 0xFF; i++) {
+	unsigned char c = s[i];
+
+	if (c == '"') {
+	    // json: \" csv: ""
+	    putc_(e, e->format == FORMAT_JSON ? '\\' : '"');
+	    putc_(e, '"');
+	} else if (c == '\\' && e->format == FORMAT_JSON) {
+	    put(e, "\\\\", 2);
+	} else if (c < 0x20 || c > 0x7e) {
+	    char esc[6] = { '\\', 'u', '0', '0', hexdigits[c >> 4], hexdigits[c & 15] };
+	    if (e->format == FORMAT_JSON) {
+		put(e, esc, 6);
+	    } else {
+		esc[1] = 'x';
+		put(e, esc, 2);
+		put(e, esc + 4, 2);
+	    }
+	} else {
+	    putc_(e, c);
+	}
+    }
+    putc_(e, '"');
+}
+
+void emit_uint(emit_t *e, const char *name, uint64_t value)
+{
+    if (field(e, name))
+	put_uint(e, value);
+}
+
+void emit_hex32(emit_t *e, const char *name, uint32_t value)
+{
+    char tmp[12] = { '"', '0', 'x' };
+    int i;
+
+    if (!field(e, name))
+	return;
+    for (i = 0; i < 8; i++)
+	tmp[3 + i] = hexdigits[(value >> (28 - 4 * i)) & 15];
+    tmp[11] = '"';
+    put(e, tmp, sizeof(tmp));
+}
+
+void emit_bool(emit_t *e, const char *name, int value)
+{
+    if (!field(e, name))
+	return;
+    if (value)
+	put(e, "true", 4);
+    else
+	put(e, "false", 5);
+}
+
+void emit_double(emit_t *e, const char *name, double value)
+{
+    char tmp[32];
+    int n;
+
+    if (!field(e, name))
+	return;
+    n = snprintf(tmp, sizeof(tmp), "%.3f", value);
+    put(e, tmp, n);
+}
+
+void emit_bytes(emit_t *e, const char *name, const void *ptr, size_t size)
+{
+    const unsigned char *p = ptr;
+    size_t i;
+
+    if (!field(e, name))
+	return;
+    char *dst = reserve(e, size * 2 + 2);
+    if (!dst)
+	return;
+    *dst++ = '"';
+    for (i = 0; i < size; i++) {
+	*dst++ = hexdigits[p[i] >> 4];
+	*dst++ = hexdigits[p[i] & 15];
+    }
+    *dst = '"';
+    e->len += size * 2 + 2;
+}
+
+void emit_null(emit_t *e, const char *name)
+{
+    if (field(e, name) && e->format == FORMAT_JSON)
+	put(e, "null", 4);
+}
+
+void emit_bytes_raw(emit_t *e, const char *s, size_t len)
+{
+    put(e, s, len);
+}
+
+int emit_flush(emit_t *e, int fd)
+{
+    uint64_t t = stats_begin();
+    size_t done = 0;
+
+    if (e->error)
+	return 1;
+    while (done < e->len) {
+	ssize_t n = write(fd, e->buf + done, e->len - done);
+	stats_io(STAT_BYTES_WRITTEN, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    emit_reset(e);
+    stats_end(STAT_OUTPUT, t);
+    return 0;
+}
@@ -0,0 +1,52 @@
+#ifndef CFE_EMIT_H
+#define CFE_EMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+    FORMAT_TEXT = 0,
+    FORMAT_JSON,	// one object per image (per line in batch mode)
+    FORMAT_CSV,		// header line from the same emit calls, one row per image
+};
+
+/*
+ * Record emitter: fields are appended to one growing buffer,
+ * caller writes it out with a single emit_flush() per image.
+ */
+typedef struct emit {
+    char	*buf;
+    size_t	len;
+    size_t	alloc;
+    int		format;
+    int		header;		// csv: emit field names instead of values
+    int		nfields;	// fields in current record
+    int		error;		// allocation failed
+} emit_t;
+
+int emit_format(const char *name);	// -1 if unknown
+
+void emit_init(emit_t *e, int format);
+void emit_free(emit_t *e);
+void emit_reset(emit_t *e);
+
+void emit_begin(emit_t *e);
+void emit_end(emit_t *e);
+
+/* string up to first NUL or 0xFF (erased flash) within size bytes */
+void emit_str(emit_t *e, const char *name, const char *s, size_t size);
+void emit_uint(emit_t *e, const char *name, uint64_t value);
+void emit_hex32(emit_t *e, const char *name, uint32_t value);
+void emit_bool(emit_t *e, const char *name, int value);
+/* fixed 3 decimals */
+void emit_double(emit_t *e, const char *name, double value);
+void emit_bytes(emit_t *e, const char *name, const void *ptr, size_t size);
+void emit_null(emit_t *e, const char *name);
+
+/* append already rendered records */
+void emit_bytes_raw(emit_t *e, const char *s, size_t len);
+
+/* write buffer to fd with one write() call (loops only on short write), then reset */
+int emit_flush(emit_t *e, int fd);
+
+#endif
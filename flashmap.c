@@ -0,0 +1,183 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_MAP_X86 1
+#endif
+
+#include "flashmap.h"
+
+/* 1 if all len bytes are 0xFF */
+typedef int (*erased_fn)(const unsigned char *p, size_t len);
+
+static int erased_generic(const unsigned char *p, size_t len)
+{
+    for (; len >= 8; p += 8, len -= 8) {
+	uint64_t w;
+
+	memcpy(&w, p, sizeof(w));
+	if (w != ~(uint64_t)0)
+	    return 0;
+    }
+    while (len--)
+	if (*p++ != 0xFF)
+	    return 0;
+    return 1;
+}
+
+#ifdef HAVE_MAP_X86
+static int erased_sse2(const unsigned char *p, size_t len)
+{
+    const __m128i ones = _mm_set1_epi8(-1);
+
+    for (; len >= 64; p += 64, len -= 64) {
+	__m128i a = _mm_and_si128(_mm_and_si128(_mm_loadu_si128((const __m128i *)p), _mm_loadu_si128((const __m128i *)(p + 16))),
+				  _mm_and_si128(_mm_loadu_si128((const __m128i *)(p + 32)), _mm_loadu_si128((const __m128i *)(p + 48))));
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, ones)) != 0xFFFF)
+	    return 0;
+    }
+    return erased_generic(p, len);
+}
+
+__attribute__((target("avx2")))
+static int erased_avx2(const unsigned char *p, size_t len)
+{
+    const __m256i ones = _mm256_set1_epi8(-1);
+
+    for (; len >= 128; p += 128, len -= 128) {
+	__m256i a = _mm256_and_si256(_mm256_and_si256(_mm256_loadu_si256((const __m256i *)p), _mm256_loadu_si256((const __m256i *)(p + 32))),
+				     _mm256_and_si256(_mm256_loadu_si256((const __m256i *)(p + 64)), _mm256_loadu_si256((const __m256i *)(p + 96))));
+	// all ones: no bit of ~a set
+	if (!_mm256_testc_si256(a, ones))
+	    return 0;
+    }
+    return erased_sse2(p, len);
+}
+#endif
+
+static erased_fn select_erased(void)
+{
+#ifdef HAVE_MAP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	return erased_avx2;
+    return erased_sse2;
+#else
+    return erased_generic;
+#endif
+}
+
+/* logical range, page by page for raw nand dumps (spare areas skipped) */
+static int range_erased(erased_fn erased, const unsigned char *image, const nand_geom_t *geom, uint64_t ofs, uint64_t len)
+{
+    if (!geom)
+	return erased(image + ofs, len);
+
+    while (len) {
+	uint64_t n = geom->page - ofs % geom->page;
+
+	if (n > len)
+	    n = len;
+	if (!erased(image + nand_raw_offset(geom, ofs), n))
+	    return 0;
+	ofs += n;
+	len -= n;
+    }
+    return 1;
+}
+
+static int add_run(flash_map_t *m, uint64_t offset, uint64_t size, int used, size_t *alloc)
+{
+    if (m->runs_num && m->runs[m->runs_num - 1].used == used) {
+	m->runs[m->runs_num - 1].size += size;
+	return 0;
+    }
+    if (m->runs_num == *alloc) {
+	size_t n = *alloc ? *alloc * 2 : 64;
+	flash_run_t *runs = realloc(m->runs, n * sizeof(*runs));
+	if (!runs)
+	    return 1;
+	m->runs = runs;
+	*alloc = n;
+    }
+    m->runs[m->runs_num++] = (flash_run_t){ offset, size, used };
+    return 0;
+}
+
+int flash_map_build(flash_map_t *m, const unsigned char *image, uint64_t size, const nand_geom_t *geom, uint64_t block)
+{
+    erased_fn erased = select_erased();
+    size_t alloc = 0;
+    uint64_t i;
+
+    memset(m, 0, sizeof(*m));
+    if (!block)
+	return 1;
+    m->size = geom ? nand_logical_size(geom, size) : size;
+    m->block = block;
+    m->blocks = (m->size + block - 1) / block;
+    m->used = malloc(m->blocks ? m->blocks : 1);
+    if (!m->used)
+	return 1;
+
+    for (i = 0; i < m->blocks; i++) {
+	uint64_t ofs = i * block;
+	uint64_t len = m->size - ofs < block ? m->size - ofs : block;
+
+	m->used[i] = !range_erased(erased, image, geom, ofs, len);
+	m->used_blocks += m->used[i];
+	if (add_run(m, ofs, len, m->used[i], &alloc)) {
+	    flash_map_free(m);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+void flash_map_free(flash_map_t *m)
+{
+    free(m->used);
+    free(m->runs);
+    m->used = NULL;
+    m->runs = NULL;
+    m->runs_num = 0;
+}
+
+void flash_map_partitions(const flash_map_t *m, const unsigned char *image, const nand_geom_t *geom,
+    const unsigned char *nvram, flash_part_usage_t usage[PART_NUM])
+{
+    erased_fn erased = select_erased();
+    cfe_part_t parts[PART_NUM];
+    int i;
+
+    cfe_nvram_partitions(nvram, parts);
+    for (i = 0; i < PART_NUM; i++) {
+	flash_part_usage_t *u = &usage[i];
+	uint64_t ofs, end, b;
+
+	memset(u, 0, sizeof(*u));
+	u->part = parts[i];
+	u->outside = !cfe_part_valid(&parts[i], m->size);
+	u->blocks = (parts[i].size + m->block - 1) / m->block;
+	if (!parts[i].size || parts[i].offset >= m->size)
+	    continue;
+
+	end = parts[i].size > m->size - parts[i].offset ? m->size : parts[i].offset + parts[i].size;
+	if (!(parts[i].offset % m->block)) {
+	    // aligned to erase blocks: taken from the map
+	    for (b = parts[i].offset / m->block; b * m->block < end; b++)
+		u->used_blocks += m->used[b];
+	    continue;
+	}
+	for (ofs = parts[i].offset; ofs < end; ofs += m->block)
+	    u->used_blocks += !range_erased(erased, image, geom, ofs, end - ofs < m->block ? end - ofs : m->block);
+    }
+}
+
+uint64_t flash_map_trailing_erased(const flash_map_t *m)
+{
+    return m->runs_num && !m->runs[m->runs_num - 1].used ? m->runs[m->runs_num - 1].size : 0;
+}
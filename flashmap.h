@@ -0,0 +1,49 @@
+#ifndef CFE_FLASHMAP_H
+#define CFE_FLASHMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nand.h"
+#include "partition.h"
+
+/* run of erase blocks that are all erased (0xFF) or all hold programmed data */
+typedef struct flash_run {
+    uint64_t	offset;
+    uint64_t	size;
+    int		used;
+} flash_run_t;
+
+typedef struct flash_map {
+    uint64_t		size;		// logical image size (oob stripped)
+    uint64_t		block;		// erase block size
+    uint64_t		blocks;		// partial last block included
+    uint64_t		used_blocks;
+    unsigned char	*used;		// per block: 1 - not erased
+    flash_run_t		*runs;
+    size_t		runs_num;
+} flash_map_t;
+
+/* partition occupancy, blocks counted from partition offset */
+typedef struct flash_part_usage {
+    cfe_part_t	part;
+    uint64_t	blocks;
+    uint64_t	used_blocks;
+    int		outside;	// partition lies (partially) beyond end of image
+} flash_part_usage_t;
+
+/*
+ * classify every erase block of image (raw nand dump if geom is not NULL,
+ * size is raw size) with vectorized 0xFF compares, 0 on success
+ */
+int flash_map_build(flash_map_t *m, const unsigned char *image, uint64_t size, const nand_geom_t *geom, uint64_t block);
+void flash_map_free(flash_map_t *m);
+
+/* occupancy of nvram partitions, the part inside of image for truncated dumps */
+void flash_map_partitions(const flash_map_t *m, const unsigned char *image, const nand_geom_t *geom,
+    const unsigned char *nvram, flash_part_usage_t usage[PART_NUM]);
+
+/* trailing erased bytes: large value on a short image usually means a bad read */
+uint64_t flash_map_trailing_erased(const flash_map_t *m);
+
+#endif
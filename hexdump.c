@@ -0,0 +1,119 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "hexdump.h"
+#include "stats.h"
+
+#define HEXDUMP_CHUNK_LINES 64		// hexdump_file(): ~5 KB on stack
+#define HEXDUMP_FD_LINES (64 << 10)	// hexdump_fd(): 1 MB of input, ~5 MB of text per write()
+
+static const char hex_digits[] = "0123456789abcdef";
+
+int hexdump_digits(uint64_t last, int min_digits)
+{
+    int digits = 1;
+
+    while (digits < 16 && last >> (digits * 4))
+	digits++;
+    return digits > min_digits ? digits : min_digits;
+}
+
+/* one line of up to 16 bytes, no per-byte branches or format parsing */
+static char *render_line(char *o, const unsigned char *p, size_t n, uint64_t ofs, int digits)
+{
+    size_t i;
+    int d;
+
+    o[0] = o[1] = ' ';
+    o += 2;
+    for (d = digits - 1; d >= 0; d--, ofs >>= 4)
+	o[d] = hex_digits[ofs & 15];
+    o += digits;
+    *o++ = ' ';
+
+    for (i = 0; i < n; i++, o += 3) {
+	o[0] = ' ';
+	o[1] = hex_digits[p[i] >> 4];
+	o[2] = hex_digits[p[i] & 15];
+    }
+    memset(o, ' ', (16 - n) * 3 + 2);
+    o += (16 - n) * 3 + 2;
+
+    for (i = 0; i < n; i++)
+	o[i] = (unsigned char)(p[i] - 0x20) < 0x5f ? p[i] : '.';
+    o += n;
+    *o++ = '\n';
+    return o;
+}
+
+size_t hexdump_render(char *out, const unsigned char *p, size_t len, uint64_t ofs, int digits)
+{
+    char *o = out;
+
+    for (; len >= 16; p += 16, len -= 16, ofs += 16)
+	o = render_line(o, p, 16, ofs, digits);
+    if (len)
+	o = render_line(o, p, len, ofs, digits);
+    return o - out;
+}
+
+int hexdump_file(FILE *f, const void *p, size_t len, uint64_t ofs, int digits)
+{
+    char buf[HEXDUMP_CHUNK_LINES * HEXDUMP_LINE_MAX];
+    const unsigned char *src = p;
+
+    while (len) {
+	size_t n = len < HEXDUMP_CHUNK_LINES * 16 ? len : HEXDUMP_CHUNK_LINES * 16;
+	size_t out = hexdump_render(buf, src, n, ofs, digits);
+
+	if (fwrite(buf, 1, out, f) != out)
+	    return 1;
+	src += n;
+	ofs += n;
+	len -= n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const char *buf, size_t size)
+{
+    while (size) {
+	ssize_t n = write(fd, buf, size);
+	stats_io(STAT_BYTES_WRITTEN, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	buf += n;
+	size -= n;
+    }
+    return 0;
+}
+
+int hexdump_fd(int fd, const void *p, size_t len, uint64_t ofs, int digits)
+{
+    size_t lines = (len + 15) / 16 < HEXDUMP_FD_LINES ? (len + 15) / 16 : HEXDUMP_FD_LINES;
+    const unsigned char *src = p;
+    char *buf;
+    int retcode = 0;
+
+    if (!len)
+	return 0;
+    buf = malloc(lines * HEXDUMP_LINE_MAX);
+    if (!buf)
+	return 1;
+    while (len && !retcode) {
+	size_t n = len < lines * 16 ? len : lines * 16;
+
+	retcode += write_full(fd, buf, hexdump_render(buf, src, n, ofs, digits));
+	src += n;
+	ofs += n;
+	len -= n;
+    }
+    free(buf);
+    return retcode;
+}
@@ -0,0 +1,23 @@
+#ifndef CFE_HEXDUMP_H
+#define CFE_HEXDUMP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* "  <offset>  xx xx .. xx  <ascii>\n", 16 bytes per line, offset up to 16 digits */
+#define HEXDUMP_LINE_MAX (2 + 16 + 1 + 16 * 3 + 2 + 16 + 1)
+
+/* hex digits needed for offsets up to last, at least min_digits */
+int hexdump_digits(uint64_t last, int min_digits);
+
+/* render len bytes (line offsets counted from ofs) into out, returns bytes rendered */
+size_t hexdump_render(char *out, const unsigned char *p, size_t len, uint64_t ofs, int digits);
+
+/* rendered in stack-sized chunks, one fwrite() each */
+int hexdump_file(FILE *f, const void *p, size_t len, uint64_t ofs, int digits);
+
+/* large dumps: rendered into one big buffer, written with a write() per MBs of output */
+int hexdump_fd(int fd, const void *p, size_t len, uint64_t ofs, int digits);
+
+#endif
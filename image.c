@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "image.h"
+#include "stats.h"
+
+#define COPY_CHUNK (1 << 20)
+#define CLONE_ALIGN 4096
+
+static int read_all(int fd, unsigned char *buf, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size) {
+	ssize_t n = pread(fd, buf + done, size - done, done);
+	stats_io(STAT_BYTES_READ, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    return 0;
+}
+
+static int pwrite_all(int fd, const unsigned char *buf, size_t size, off_t ofs)
+{
+    size_t done = 0;
+
+    while (done < size) {
+	ssize_t n = pwrite(fd, buf + done, size - done, ofs + done);
+	stats_io(STAT_BYTES_WRITTEN, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    return 0;
+}
+
+/* pipe or other unseekable input: read until EOF into growing buffer */
+static int read_stream(int fd, unsigned char **buf, size_t *size)
+{
+    size_t alloc = COPY_CHUNK, done = 0;
+    unsigned char *p = malloc(alloc);
+
+    while (p) {
+	if (done == alloc) {
+	    unsigned char *n = realloc(p, alloc * 2);
+	    if (!n)
+		break;
+	    p = n;
+	    alloc *= 2;
+	}
+	ssize_t n = read(fd, p + done, alloc - done);
+	stats_io(STAT_BYTES_READ, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0)
+	    break;
+	if (!n) {
+	    *buf = p;
+	    *size = done;
+	    return 0;
+	}
+	done += n;
+    }
+    free(p);
+    return 1;
+}
+
+/* size of block/char device (st_size is 0 for them), -1 if input cannot seek */
+static off_t device_size(int fd, const struct stat *st)
+{
+#ifdef BLKGETSIZE64
+    uint64_t bytes;
+
+    stats_syscall();
+    if (S_ISBLK(st->st_mode) && !ioctl(fd, BLKGETSIZE64, &bytes))
+	return bytes;
+#endif
+    stats_syscall();
+    return lseek(fd, 0, SEEK_END);
+}
+
+int image_open(cfe_image_t *img, const char *name, int writable)
+{
+    struct stat st;
+
+    memset(img, 0, sizeof(*img));
+    img->name = name;
+    img->fd = open(name, writable ? O_RDWR : O_RDONLY);
+    stats_syscall();
+    if (img->fd < 0) {
+	perror("Cannot open file for read");
+	return 1;
+    }
+
+    stats_syscall();
+    if (fstat(img->fd, &st)) {
+	perror("Cannot stat input file");
+	goto error;
+    }
+    img->size = st.st_size;
+
+    if (S_ISREG(st.st_mode) && img->size) {
+	// private mapping: edits stay in memory until explicitly written back
+	img->mem = mmap(NULL, img->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, img->fd, 0);
+	if (img->mem != MAP_FAILED) {
+	    stats_io(STAT_BYTES_MAPPED, img->size);
+	    img->mapped = 1;
+	    return 0;
+	}
+	img->mem = NULL;
+    }
+
+    if (!S_ISREG(st.st_mode)) {
+	off_t size = device_size(img->fd, &st);
+
+	if (size <= 0) {
+	    // pipe (or device without size): whatever it delivers
+	    if (read_stream(img->fd, &img->mem, &img->size)) {
+		perror("Cannot read input file");
+		goto error;
+	    }
+	    return 0;
+	}
+	img->size = size;
+    }
+
+    // not mappable (device or empty file), read whole input
+    img->mem = calloc(1, img->size ? img->size : 1);
+    if (!img->mem) {
+	perror("Cannot allocate input buffer");
+	goto error;
+    }
+    if (read_all(img->fd, img->mem, img->size)) {
+	perror("Cannot read input file");
+	goto error;
+    }
+    return 0;
+
+    error:
+    image_close(img);
+    return 1;
+}
+
+void image_close(cfe_image_t *img)
+{
+    if (img->mem) {
+	if (img->mapped) {
+	    munmap(img->mem, img->size);
+	    stats_syscall();
+	}
+	else
+	    free(img->mem);
+    }
+    if (img->fd >= 0) {
+	close(img->fd);
+	stats_syscall();
+    }
+    img->mem = NULL;
+    img->fd = -1;
+}
+
+int image_patch_in_place(cfe_image_t *img, size_t ofs, size_t len)
+{
+    if (ofs + len > img->size)
+	return 1;
+
+    if (pwrite_all(img->fd, img->mem + ofs, len, ofs)) {
+	perror("Cannot write changes to input file");
+	return 1;
+    }
+    stats_syscall();
+    if (fdatasync(img->fd)) {
+	perror("Cannot sync input file");
+	return 1;
+    }
+    return 0;
+}
+
+/* copy [in_ofs, in_ofs + size) of input to start of output without passing data through userspace if possible */
+static int copy_range(int in_fd, off_t in_ofs, int out_fd, size_t size)
+{
+    off_t out_ofs = 0;
+
+#ifdef FICLONE
+    // reflink: O(1) on btrfs/xfs/bcachefs, clones whole input so only for copy of all of it
+    struct stat st;
+    if (!in_ofs && !fstat(in_fd, &st) && S_ISREG(st.st_mode) && (off_t)size == st.st_size && !ioctl(out_fd, FICLONE, in_fd)) {
+	stats_io(STAT_BYTES_WRITTEN, size);
+	return 0;
+    }
+#endif
+#ifdef FICLONERANGE
+    // block aligned part of image (partitions), tail is copied below
+    struct file_clone_range range = { .src_fd = in_fd, .src_offset = in_ofs, .src_length = size & ~(size_t)(CLONE_ALIGN - 1) };
+    if (!(in_ofs % CLONE_ALIGN) && range.src_length && !ioctl(out_fd, FICLONERANGE, &range)) {
+	stats_io(STAT_BYTES_WRITTEN, range.src_length);
+	in_ofs += range.src_length;
+	out_ofs += range.src_length;
+	size -= range.src_length;
+    }
+#endif
+
+    size_t left = size;
+
+#ifdef __linux__
+    while (left) {
+	ssize_t n = copy_file_range(in_fd, &in_ofs, out_fd, &out_ofs, left, 0);
+	stats_io(STAT_BYTES_WRITTEN, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	left -= n;
+    }
+    // different filesystems on old kernels, block devices: sendfile still stays in kernel
+    while (left && lseek(out_fd, out_ofs, SEEK_SET) == out_ofs) {
+	ssize_t n = sendfile(out_fd, in_fd, &in_ofs, left);
+	stats_io(STAT_BYTES_WRITTEN, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	out_ofs += n;
+	left -= n;
+    }
+    if (!left)
+	return 0;
+#endif
+
+    // fallback: plain read/write of the rest
+    unsigned char *buf = malloc(COPY_CHUNK);
+    if (!buf)
+	return 1;
+    while (left) {
+	size_t chunk = left < COPY_CHUNK ? left : COPY_CHUNK;
+	ssize_t n = pread(in_fd, buf, chunk, in_ofs);
+	stats_io(STAT_BYTES_READ, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0 || pwrite_all(out_fd, buf, n, out_ofs)) {
+	    free(buf);
+	    return 1;
+	}
+	in_ofs += n;
+	out_ofs += n;
+	left -= n;
+    }
+    free(buf);
+    return 0;
+}
+
+int image_extract(cfe_image_t *img, const char *output_name, uint64_t ofs, uint64_t len)
+{
+    int retcode = 0;
+
+    if (ofs > img->size || len > img->size - ofs)
+	return 1;
+
+    int out_fd = open(output_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    stats_syscall();
+    if (out_fd < 0) {
+	perror("Cannot open file for write");
+	return 1;
+    }
+
+    if (img->mapped ? copy_range(img->fd, ofs, out_fd, len) : pwrite_all(out_fd, img->mem + ofs, len, 0)) {
+	perror("Cannot write output file");
+	retcode++;
+    }
+    stats_syscall();
+    if (close(out_fd))
+	retcode++;
+    return retcode;
+}
+
+int image_write_patched(cfe_image_t *img, const char *output_name, size_t ofs, size_t len)
+{
+    return image_write_block(img, output_name, ofs, img->mem + ofs, len);
+}
+
+int image_write_block(cfe_image_t *img, const char *output_name, size_t ofs, const void *block, size_t len)
+{
+    int retcode = 0;
+
+    if (ofs + len > img->size)
+	return 1;
+
+    struct stat in_st, out_st;
+    if (!fstat(img->fd, &in_st) && !stat(output_name, &out_st) &&
+	in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+	fprintf(stderr, "Output file is the input file, use --in-place\n");
+	return 1;
+    }
+
+    int out_fd = open(output_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    stats_syscall();
+    if (out_fd < 0) {
+	perror("Cannot open file for write");
+	return 1;
+    }
+
+    if (img->mapped) {
+	if (copy_range(img->fd, 0, out_fd, img->size)) {
+	    perror("Cannot copy input file");
+	    retcode++;
+	} else if (pwrite_all(out_fd, block, len, ofs)) {
+	    perror("Cannot write output file");
+	    retcode++;
+	}
+    } else if (pwrite_all(out_fd, img->mem, img->size, 0) || pwrite_all(out_fd, block, len, ofs)) {
+	perror("Cannot write output file");
+	retcode++;
+    }
+
+    stats_syscall();
+    if (close(out_fd))
+	retcode++;
+    return retcode;
+}
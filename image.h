@@ -0,0 +1,34 @@
+#ifndef CFE_IMAGE_H
+#define CFE_IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* cferom or fullflash image, mapped read-only/copy-on-write or read into memory */
+typedef struct cfe_image {
+    const char		*name;
+    int			fd;
+    unsigned char	*mem;
+    size_t		size;
+    int			mapped;		// 1 - mmap()ed (MAP_PRIVATE), 0 - malloc()ed
+} cfe_image_t;
+
+/* writable != 0 opens the file O_RDWR for image_patch_in_place() */
+int image_open(cfe_image_t *img, const char *name, int writable);
+void image_close(cfe_image_t *img);
+
+/* write changed region [ofs, ofs + len) of img->mem back to the input file and fsync it */
+int image_patch_in_place(cfe_image_t *img, size_t ofs, size_t len);
+
+/*
+ * create output file: clone/copy_file_range the unchanged input bytes
+ * (no data through userspace when supported), then pwrite changed region
+ */
+int image_write_patched(cfe_image_t *img, const char *output_name, size_t ofs, size_t len);
+/* same, with region [ofs, ofs + len) taken from block instead of img->mem */
+int image_write_block(cfe_image_t *img, const char *output_name, size_t ofs, const void *block, size_t len);
+
+/* write [ofs, ofs + len) of input into new file, data stays in kernel (reflink/copy_file_range/sendfile) if possible */
+int image_extract(cfe_image_t *img, const char *output_name, uint64_t ofs, uint64_t len);
+
+#endif
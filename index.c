@@ -0,0 +1,575 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "cfe_nvram.h"
+#include "image.h"
+#include "index.h"
+#include "macpool.h"
+#include "scan.h"
+#include "stream.h"
+
+#define INDEX_MAX_JOBS 256
+
+_Static_assert(sizeof(index_entry_t) % 8 == 0, "index entry must keep 8-byte alignment");
+_Static_assert(sizeof(index_header_t) % 8 == 0, "index header must keep 8-byte alignment");
+
+typedef struct index_map {
+    const unsigned char		*mem;
+    size_t			size;
+    const index_header_t	*hdr;
+    const index_entry_t		*entries;
+    const uint32_t		*mac_sorted;
+    const uint32_t		*sn_hash;
+    const char			*strings;
+} index_map_t;
+
+static uint32_t fnv1a(const char *s, size_t size)
+{
+    uint32_t h = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < size && s[i]; i++)
+	h = (h ^ (unsigned char)s[i]) * 16777619u;
+    return h;
+}
+
+static int index_open(index_map_t *idx, const char *name, int quiet)
+{
+    struct stat st;
+    int fd;
+
+    memset(idx, 0, sizeof(*idx));
+    fd = open(name, O_RDONLY);
+    if (fd < 0) {
+	if (!quiet)
+	    perror("Cannot open index");
+	return 1;
+    }
+    if (fstat(fd, &st) || (size_t)st.st_size < sizeof(index_header_t)) {
+	fprintf(stderr, "Index %s is too short\n", name);
+	close(fd);
+	return 1;
+    }
+    idx->size = st.st_size;
+    idx->mem = mmap(NULL, idx->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (idx->mem == MAP_FAILED) {
+	perror("Cannot map index");
+	idx->mem = NULL;
+	return 1;
+    }
+
+    const index_header_t *hdr = idx->hdr = (const index_header_t *)idx->mem;
+    if (memcmp(hdr->magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) || hdr->version != INDEX_VERSION ||
+	hdr->byte_order != 0x01020304 || hdr->file_size != idx->size ||
+	hdr->entries_ofs + (uint64_t)hdr->count * sizeof(index_entry_t) > idx->size ||
+	hdr->mac_sorted_ofs + (uint64_t)hdr->count * sizeof(uint32_t) > idx->size ||
+	hdr->sn_hash_ofs + (uint64_t)hdr->sn_hash_size * sizeof(uint32_t) > idx->size ||
+	hdr->strings_ofs > idx->size || !hdr->sn_hash_size || hdr->sn_hash_size & (hdr->sn_hash_size - 1)) {
+	fprintf(stderr, "Index %s is damaged or from another version\n", name);
+	munmap((void *)idx->mem, idx->size);
+	idx->mem = NULL;
+	return 1;
+    }
+    idx->entries = (const index_entry_t *)(idx->mem + hdr->entries_ofs);
+    idx->mac_sorted = (const uint32_t *)(idx->mem + hdr->mac_sorted_ofs);
+    idx->sn_hash = (const uint32_t *)(idx->mem + hdr->sn_hash_ofs);
+    idx->strings = (const char *)(idx->mem + hdr->strings_ofs);
+    return 0;
+}
+
+static void index_close(index_map_t *idx)
+{
+    if (idx->mem)
+	munmap((void *)idx->mem, idx->size);
+    idx->mem = NULL;
+}
+
+static const char *entry_path(const index_map_t *idx, const index_entry_t *e)
+{
+    // string pool is NUL separated, last string terminated by file end check
+    if (idx->hdr->strings_ofs + e->path >= idx->size)
+	return "?";
+    return idx->strings + e->path;
+}
+
+/* read nvram block of one image: pread at fixed offset, or map and scan */
+static void index_read_entry(index_entry_t *e, const char *path, int nvram_offset, int scan)
+{
+    unsigned char block[sizeof(bcm68380_nvram_t)];
+    const bcm68380_nvram_t *bcm_nvram = (const bcm68380_nvram_t *)block;
+
+    e->status = INDEX_ERROR;
+    if (stream_type(path) != STREAM_NONE) {
+	size_t offset;
+
+	if (stream_read_nvram(path, nvram_offset, scan, block, &offset))
+	    return;
+	e->offset = offset;
+    } else if (scan) {
+	cfe_image_t image;
+	nvram_hit_t hit;
+
+	if (image_open(&image, path, 0))
+	    return;
+	if (!scan_cfe_nvram(image.mem, image.size, &hit, 1, NULL)) {
+	    image_close(&image);
+	    return;
+	}
+	e->offset = hit.offset;
+	memcpy(block, image.mem + e->offset, sizeof(block));
+	image_close(&image);
+    } else {
+	int fd = open(path, O_RDONLY);
+	ssize_t n;
+
+	if (fd < 0)
+	    return;
+	do {
+	    n = pread(fd, block, sizeof(block), nvram_offset);
+	} while (n < 0 && errno == EINTR);
+	close(fd);
+	if (n != sizeof(block))
+	    return;
+	e->offset = nvram_offset;
+    }
+
+    e->status = check_cfe_nvram(block) ? INDEX_BAD : INDEX_OK;
+    e->crc = bcm_nvram->crc;
+    e->mac_num = ntohl(bcm_nvram->mac_num);
+    e->vendor_type = detect_cfe_nvram_vendor(block);
+    memcpy(e->basemac, bcm_nvram->basemac, sizeof(e->basemac));
+    // 0xFF-terminated (erased) strings are stored NUL-terminated, board_id and voice_id
+    // fill all 16 bytes (no terminator) like in nvram
+    memcpy(e->gponsn, bcm_nvram->gponsn, sizeof(e->gponsn) - 1);
+    memcpy(e->board_id, bcm_nvram->board_id, sizeof(e->board_id));
+    memcpy(e->voice_id, bcm_nvram->voice_id, sizeof(e->voice_id));
+    char *fields[] = { e->gponsn, e->board_id, e->voice_id };
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+	char *ff = memchr(fields[i], 0xFF, strnlen(fields[i], 16));
+	if (ff)
+	    *ff = 0;
+    }
+}
+
+typedef struct index_build {
+    char		**paths;
+    size_t		count;
+    index_entry_t	*entries;
+    unsigned char	*reused;
+    int			nvram_offset;
+    int			scan;
+    size_t		next;		// next file, taken atomically by workers
+} index_build_t;
+
+static void *index_worker(void *arg)
+{
+    index_build_t *b = arg;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&b->next, 1, __ATOMIC_RELAXED)) < b->count)
+	if (!b->reused[i])
+	    index_read_entry(&b->entries[i], b->paths[i], b->nvram_offset, b->scan);
+    return NULL;
+}
+
+static const index_entry_t *sort_entries; // qsort() has no user context
+
+static int mac_cmp(const void *a, const void *b)
+{
+    uint64_t ma = macpool_mac_value(sort_entries[*(const uint32_t *)a].basemac);
+    uint64_t mb = macpool_mac_value(sort_entries[*(const uint32_t *)b].basemac);
+
+    return ma < mb ? -1 : ma > mb;
+}
+
+static int write_full(int fd, const void *buf, size_t size)
+{
+    size_t done = 0;
+
+    while (done < size) {
+	ssize_t n = write(fd, (const char *)buf + done, size - done);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    return 0;
+}
+
+static int index_write(const char *name, index_build_t *b)
+{
+    index_header_t hdr;
+    uint32_t *mac_sorted, *sn_hash, max_mac_num = 0, hash_size = 16;
+    size_t strings_size = 0, i;
+    char tmp_name[PATH_MAX];
+    int retcode = 0, fd;
+
+    while (hash_size < b->count * 2)
+	hash_size *= 2;
+    mac_sorted = malloc((b->count ? b->count : 1) * sizeof(*mac_sorted));
+    sn_hash = calloc(hash_size, sizeof(*sn_hash));
+    if (!mac_sorted || !sn_hash) {
+	free(mac_sorted);
+	free(sn_hash);
+	return 1;
+    }
+
+    for (i = 0; i < b->count; i++) {
+	index_entry_t *e = &b->entries[i];
+
+	e->path = strings_size;
+	strings_size += strlen(b->paths[i]) + 1;
+	mac_sorted[i] = i;
+	if (e->mac_num > max_mac_num && e->status == INDEX_OK)
+	    max_mac_num = e->mac_num;
+	if (e->status != INDEX_ERROR && e->gponsn[0]) {
+	    uint32_t slot = fnv1a(e->gponsn, sizeof(e->gponsn)) & (hash_size - 1);
+	    while (sn_hash[slot])
+		slot = (slot + 1) & (hash_size - 1);
+	    sn_hash[slot] = i + 1;
+	}
+    }
+    sort_entries = b->entries;
+    qsort(mac_sorted, b->count, sizeof(*mac_sorted), mac_cmp);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    hdr.version = INDEX_VERSION;
+    hdr.byte_order = 0x01020304;
+    hdr.count = b->count;
+    hdr.sn_hash_size = hash_size;
+    hdr.nvram_offset = b->scan ? -1 : b->nvram_offset;
+    hdr.max_mac_num = max_mac_num;
+    hdr.entries_ofs = sizeof(hdr);
+    hdr.mac_sorted_ofs = hdr.entries_ofs + b->count * sizeof(index_entry_t);
+    hdr.sn_hash_ofs = hdr.mac_sorted_ofs + ((b->count * sizeof(uint32_t) + 7) & ~(size_t)7);
+    hdr.strings_ofs = hdr.sn_hash_ofs + hash_size * sizeof(uint32_t);
+    hdr.file_size = hdr.strings_ofs + strings_size;
+
+    // new index replaces old one atomically, readers keep their mapping
+    snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", name);
+    fd = open(tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+	perror("Cannot create index");
+	retcode++;
+	goto exit;
+    }
+    static const uint32_t zero;
+    retcode += write_full(fd, &hdr, sizeof(hdr));
+    retcode += write_full(fd, b->entries, b->count * sizeof(index_entry_t));
+    retcode += write_full(fd, mac_sorted, b->count * sizeof(uint32_t));
+    if (b->count & 1)
+	retcode += write_full(fd, &zero, sizeof(zero));
+    retcode += write_full(fd, sn_hash, hash_size * sizeof(uint32_t));
+    for (i = 0; i < b->count; i++)
+	retcode += write_full(fd, b->paths[i], strlen(b->paths[i]) + 1);
+    if (fsync(fd))
+	retcode++;
+    if (close(fd))
+	retcode++;
+    if (retcode || rename(tmp_name, name)) {
+	perror("Cannot write index");
+	unlink(tmp_name);
+	retcode++;
+    }
+
+    exit:
+    free(mac_sorted);
+    free(sn_hash);
+    return retcode;
+}
+
+int index_update(const char *index_name, const char *list, int nvram_offset, int scan, int jobs)
+{
+    index_build_t b;
+    index_map_t old;
+    pthread_t threads[INDEX_MAX_JOBS];
+    struct timespec start, stop;
+    size_t reused = 0, errors = 0, i;
+    uint32_t *path_hash = NULL, path_hash_size = 16;
+    int have_old, started, retcode = 0;
+
+    memset(&b, 0, sizeof(b));
+    b.nvram_offset = nvram_offset;
+    b.scan = scan;
+    b.paths = batch_load_list(list, &b.count);
+    if (!b.paths) {
+	fprintf(stderr, "Cannot read file list %s\n", list);
+	return 1;
+    }
+    b.entries = calloc(b.count ? b.count : 1, sizeof(*b.entries));
+    b.reused = calloc(b.count ? b.count : 1, 1);
+    if (!b.entries || !b.reused) {
+	retcode++;
+	goto exit;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // old entries by path; whole index is rebuilt when nvram location setting changed
+    have_old = !index_open(&old, index_name, 1);
+    if (have_old && old.hdr->nvram_offset == (scan ? -1 : nvram_offset)) {
+	while (path_hash_size < old.hdr->count * 2)
+	    path_hash_size *= 2;
+	path_hash = calloc(path_hash_size, sizeof(*path_hash));
+	for (i = 0; path_hash && i < old.hdr->count; i++) {
+	    const char *path = entry_path(&old, &old.entries[i]);
+	    uint32_t slot = fnv1a(path, SIZE_MAX) & (path_hash_size - 1);
+	    while (path_hash[slot])
+		slot = (slot + 1) & (path_hash_size - 1);
+	    path_hash[slot] = i + 1;
+	}
+    }
+
+    for (i = 0; i < b.count; i++) {
+	index_entry_t *e = &b.entries[i];
+	struct stat st;
+
+	if (stat(b.paths[i], &st)) {
+	    e->status = INDEX_ERROR;
+	    b.reused[i] = 1; // nothing to read
+	    continue;
+	}
+	e->mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+	e->size = st.st_size;
+	if (!path_hash)
+	    continue;
+
+	uint32_t slot = fnv1a(b.paths[i], SIZE_MAX) & (path_hash_size - 1);
+	for (; path_hash[slot]; slot = (slot + 1) & (path_hash_size - 1)) {
+	    const index_entry_t *o = &old.entries[path_hash[slot] - 1];
+	    if (!strcmp(entry_path(&old, o), b.paths[i])) {
+		if (o->mtime_ns == e->mtime_ns && o->size == e->size) {
+		    *e = *o;
+		    b.reused[i] = 1;
+		    reused++;
+		}
+		break;
+	    }
+	}
+    }
+    free(path_hash);
+    if (have_old)
+	index_close(&old);
+
+    if (jobs <= 0)
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs <= 0)
+	jobs = 1;
+    if (jobs > INDEX_MAX_JOBS)
+	jobs = INDEX_MAX_JOBS;
+    for (started = 0; started < jobs; started++)
+	if (pthread_create(&threads[started], NULL, index_worker, &b))
+	    break;
+    if (!started)
+	index_worker(&b);
+    for (i = 0; i < (size_t)started; i++)
+	pthread_join(threads[i], NULL);
+
+    for (i = 0; i < b.count; i++)
+	if (b.entries[i].status == INDEX_ERROR)
+	    errors++;
+
+    retcode += index_write(index_name, &b);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    printf("> index %s: %zu files, %zu unchanged, %zu read, %zu unreadable, %.3f s\n", index_name,
+	b.count, reused, b.count - reused, errors, elapsed);
+
+    exit:
+    free(b.entries);
+    free(b.reused);
+    batch_free_list(b.paths, b.count);
+    return retcode;
+}
+
+static const char *status_name[] = { "OK", "BAD", "ERROR" };
+
+static void print_entry(const index_map_t *idx, const index_entry_t *e)
+{
+    if (e->status == INDEX_ERROR) {
+	printf("%-5s %s\n", status_name[e->status], entry_path(idx, e));
+	return;
+    }
+    printf("%-5s %s: offset %#" PRIx64 ", basemac %02X%02X%02X%02X%02X%02X, mac_num %u, gponsn \"%.12s\", board_id \"%.16s\", voice_id \"%.16s\", CRC %#08x\n",
+	status_name[e->status > INDEX_ERROR ? INDEX_ERROR : e->status], entry_path(idx, e), e->offset,
+	e->basemac[0], e->basemac[1], e->basemac[2], e->basemac[3], e->basemac[4], e->basemac[5],
+	e->mac_num, e->gponsn, e->board_id, e->voice_id, e->crc);
+}
+
+/* first position in mac_sorted with basemac >= mac */
+static size_t mac_lower_bound(const index_map_t *idx, uint64_t mac)
+{
+    size_t lo = 0, hi = idx->hdr->count;
+
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+	if (macpool_mac_value(idx->entries[idx->mac_sorted[mid]].basemac) < mac)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+int index_lookup(const char *index_name, const char *query)
+{
+    index_map_t idx;
+    struct timespec start, stop;
+    const char *value = strchr(query, '=');
+    size_t found = 0, i;
+    uint64_t mac;
+
+    if (!value) {
+	fprintf(stderr, "Expected name=value: \"%s\"\n", query);
+	return 1;
+    }
+    value++;
+    if (index_open(&idx, index_name, 0))
+	return 1;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!strncmp(query, "gponsn=", 7)) {
+	uint32_t mask = idx.hdr->sn_hash_size - 1, slot = fnv1a(value, SIZE_MAX) & mask;
+
+	for (; idx.sn_hash[slot]; slot = (slot + 1) & mask) {
+	    const index_entry_t *e = &idx.entries[idx.sn_hash[slot] - 1];
+	    if (!strncmp(e->gponsn, value, sizeof(e->gponsn))) {
+		print_entry(&idx, e);
+		found++;
+	    }
+	}
+    } else if (!strncmp(query, "basemac=", 8) && !macpool_parse_mac(value, &mac)) {
+	for (i = mac_lower_bound(&idx, mac); i < idx.hdr->count; i++) {
+	    const index_entry_t *e = &idx.entries[idx.mac_sorted[i]];
+	    if (macpool_mac_value(e->basemac) != mac)
+		break;
+	    print_entry(&idx, e);
+	    found++;
+	}
+    } else if (!strncmp(query, "mac=", 4) && !macpool_parse_mac(value, &mac)) {
+	// ranges starting at most max_mac_num - 1 below mac may contain it (mac_num 0 is one mac)
+	uint32_t span = idx.hdr->max_mac_num ? idx.hdr->max_mac_num : 1;
+	uint64_t from = mac >= span ? mac - span + 1 : 0;
+	for (i = mac_lower_bound(&idx, from); i < idx.hdr->count; i++) {
+	    const index_entry_t *e = &idx.entries[idx.mac_sorted[i]];
+	    uint64_t base = macpool_mac_value(e->basemac);
+	    if (base > mac)
+		break;
+	    // max_mac_num covers valid entries only, mac_num of bad ones may be garbage
+	    if (e->status == INDEX_OK && mac < base + (e->mac_num ? e->mac_num : 1)) {
+		print_entry(&idx, e);
+		found++;
+	    }
+	}
+    } else {
+	fprintf(stderr, "Unknown query \"%s\" (gponsn=, basemac= or mac=)\n", query);
+	index_close(&idx);
+	return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    printf("> %zu match(es) of %u images, %.1f us\n", found, idx.hdr->count,
+	((stop.tv_sec - start.tv_sec) * 1e9 + (stop.tv_nsec - start.tv_nsec)) / 1e3);
+    index_close(&idx);
+    return found ? 0 : 1;
+}
+
+int index_dups(const char *index_name)
+{
+    index_map_t idx;
+    size_t dups = 0, i, widest = 0;
+    uint64_t widest_end = 0;
+
+    if (index_open(&idx, index_name, 0))
+	return 1;
+
+    // sorted by basemac: range overlaps the widest range seen so far
+    for (i = 0; i < idx.hdr->count; i++) {
+	const index_entry_t *e = &idx.entries[idx.mac_sorted[i]];
+	uint64_t base = macpool_mac_value(e->basemac), end = base + (e->mac_num ? e->mac_num : 1);
+
+	if (e->status != INDEX_OK)
+	    continue;
+	if (i && widest_end > base) {
+	    const index_entry_t *w = &idx.entries[idx.mac_sorted[widest]];
+	    printf("MAC   %s (%02X%02X%02X%02X%02X%02X+%u) overlaps %s (%02X%02X%02X%02X%02X%02X+%u)\n",
+		entry_path(&idx, e), e->basemac[0], e->basemac[1], e->basemac[2], e->basemac[3], e->basemac[4], e->basemac[5], e->mac_num,
+		entry_path(&idx, w), w->basemac[0], w->basemac[1], w->basemac[2], w->basemac[3], w->basemac[4], w->basemac[5], w->mac_num);
+	    dups++;
+	}
+	if (end > widest_end) {
+	    widest_end = end;
+	    widest = i;
+	}
+    }
+
+    // equal serial numbers share hash chain, report each pair once
+    for (i = 0; i < idx.hdr->count; i++) {
+	const index_entry_t *e = &idx.entries[i];
+	uint32_t mask = idx.hdr->sn_hash_size - 1, slot;
+
+	if (e->status != INDEX_OK || !e->gponsn[0])
+	    continue;
+	for (slot = fnv1a(e->gponsn, sizeof(e->gponsn)) & mask; idx.sn_hash[slot]; slot = (slot + 1) & mask) {
+	    const index_entry_t *o = &idx.entries[idx.sn_hash[slot] - 1];
+	    if (o < e && o->status == INDEX_OK && !strncmp(o->gponsn, e->gponsn, sizeof(e->gponsn))) {
+		printf("SN    %s and %s share gponsn \"%.12s\"\n", entry_path(&idx, o), entry_path(&idx, e), e->gponsn);
+		dups++;
+		break;
+	    }
+	}
+    }
+
+    printf("> %zu duplicate(s) in %u images\n", dups, idx.hdr->count);
+    index_close(&idx);
+    return dups ? 1 : 0;
+}
+
+int index_load_macs(const char *index_name, macpool_t *pool, int report_overlaps)
+{
+    index_map_t idx;
+    int overlaps = 0;
+    uint32_t i;
+
+    if (index_open(&idx, index_name, 0))
+	return -1;
+    for (i = 0; i < idx.hdr->count; i++) {
+	const index_entry_t *e = &idx.entries[i];
+	uint32_t owner, other;
+	int ret;
+
+	if (e->status != INDEX_OK)
+	    continue;
+	owner = macpool_owner(pool, entry_path(&idx, e));
+	ret = macpool_add(pool, macpool_mac_value(e->basemac), e->mac_num, owner, &other);
+	if (ret < 0) {
+	    overlaps = -1;
+	    break;
+	}
+	if (ret && report_overlaps)
+	    printf("OVERLAP %s (%02X%02X%02X%02X%02X%02X+%u) with %s\n", entry_path(&idx, e),
+		e->basemac[0], e->basemac[1], e->basemac[2], e->basemac[3], e->basemac[4], e->basemac[5],
+		e->mac_num, macpool_owner_name(pool, other));
+	overlaps += ret;
+    }
+    index_close(&idx);
+    return overlaps;
+}
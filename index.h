@@ -0,0 +1,71 @@
+#ifndef CFE_INDEX_H
+#define CFE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macpool.h"
+
+#define INDEX_MAGIC	"CFEIDX1"
+#define INDEX_VERSION	2
+
+enum {
+    INDEX_OK = 0,
+    INDEX_BAD,		// nvram version or checksum mismatch, fields may be garbage
+    INDEX_ERROR,	// image too short or unreadable
+};
+
+/*
+ * on-disk layout (host byte order, mapped as is):
+ * header, entries[count], mac_sorted[count] (entry numbers sorted by basemac),
+ * sn_hash[sn_hash_size] (entry number + 1, 0 - empty slot), path strings
+ */
+typedef struct index_header {
+    char	magic[8];
+    uint32_t	version;
+    uint32_t	byte_order;	// 0x01020304 as written
+    uint32_t	count;
+    uint32_t	sn_hash_size;	// power of 2
+    int64_t	nvram_offset;	// -1 - located with --scan
+    uint32_t	max_mac_num;	// widest mac range, bounds mac= range search
+    uint32_t	reserved;
+    uint64_t	entries_ofs;
+    uint64_t	mac_sorted_ofs;
+    uint64_t	sn_hash_ofs;
+    uint64_t	strings_ofs;
+    uint64_t	file_size;
+} index_header_t;
+
+typedef struct index_entry {
+    int64_t	mtime_ns;
+    uint64_t	size;
+    uint64_t	offset;		// nvram offset in image
+    uint32_t	path;		// offset in string pool
+    uint32_t	crc;		// as on flash, like text output
+    uint32_t	mac_num;
+    uint8_t	basemac[6];
+    uint8_t	status;		// INDEX_*
+    uint8_t	vendor_type;
+    char	gponsn[13];
+    char	board_id[16];	// not NUL-terminated when all 16 bytes are used
+    char	voice_id[16];
+    char	pad[7];
+} index_entry_t;
+
+/*
+ * build or refresh index from file list or directory: entries of files with
+ * unchanged path, mtime and size are taken from existing index, other files
+ * are read (nvram block at nvram_offset, or first valid block if scan) by jobs threads
+ */
+int index_update(const char *index_name, const char *list, int nvram_offset, int scan, int jobs);
+
+/* "gponsn=...", "basemac=..." (exact) or "mac=..." (inside basemac + mac_num range) */
+int index_lookup(const char *index_name, const char *query);
+
+/* mac ranges of valid entries (owner - image path) into pool, returns number of overlaps or -1 */
+int index_load_macs(const char *index_name, macpool_t *pool, int report_overlaps);
+
+/* images sharing basemac (overlapping mac ranges) or gponsn */
+int index_dups(const char *index_name);
+
+#endif
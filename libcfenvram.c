@@ -0,0 +1,225 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "cfe_nvram.h"
+#include "crc32.h"
+#include "libcfenvram.h"
+#include "partition.h"
+#include "scan.h"
+
+_Static_assert(sizeof(bcm68380_nvram_t) == CFENVRAM_SIZE, "public block size must match bcm68380_nvram_t");
+_Static_assert(NVRAM_VERSION == CFENVRAM_VERSION, "public version must match NVRAM_VERSION");
+#ifdef ENABLE_VENDOR_ELTX
+_Static_assert(VENDOR_TYPE_ELTX == CFENVRAM_VENDOR_ELTX, "vendor type mismatch");
+#endif
+#ifdef ENABLE_VENDOR_UBNT
+_Static_assert(VENDOR_TYPE_UBNT == CFENVRAM_VENDOR_UBNT, "vendor type mismatch");
+#endif
+
+#define CFENVRAM_NAME_MAX 64
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+static int init_failed;
+
+static void init_crc32(void)
+{
+    init_failed = crc32_init();
+}
+
+int cfenvram_init(void)
+{
+    pthread_once(&init_once, init_crc32);
+    return init_failed;
+}
+
+int cfenvram_find(const void *buf, size_t size, size_t *offset, int *vendor_type)
+{
+    nvram_hit_t hit;
+
+    if (!scan_cfe_nvram(buf, size, &hit, 1, NULL))
+	return CFENVRAM_ENOTFOUND;
+    if (offset)
+	*offset = hit.offset;
+    if (vendor_type)
+	*vendor_type = hit.vendor_type;
+    return CFENVRAM_OK;
+}
+
+int cfenvram_check(const void *nvram, size_t size)
+{
+    uint32_t version;
+
+    if (size < CFENVRAM_SIZE)
+	return CFENVRAM_ESIZE;
+    memcpy(&version, (const unsigned char *)nvram + offsetof(bcm68380_nvram_t, version), sizeof(version));
+    if (ntohl(version) != NVRAM_VERSION)
+	return CFENVRAM_EVERSION;
+    return check_cfe_nvram(nvram) ? CFENVRAM_ECRC : CFENVRAM_OK;
+}
+
+int cfenvram_verify(const void *nvram, size_t size, int vendor_type, cfenvram_verify_t *res)
+{
+    const unsigned char *src = nvram;
+    const bcm68380_nvram_t *bcm_nvram = nvram;	// only byte arrays are read through it, src may be unaligned
+    cfe_part_t parts[PART_NUM];
+
+    memset(res, 0, sizeof(*res));
+    if (size < CFENVRAM_SIZE)
+	return CFENVRAM_ESIZE;
+
+    memcpy(&res->version, src + offsetof(bcm68380_nvram_t, version), sizeof(res->version));
+    res->version = ntohl(res->version);
+    res->errors += res->version != NVRAM_VERSION;
+
+    if (memchr(bcm_nvram->bootline, 0, sizeof(bcm_nvram->bootline)))
+	res->bootline_end = CFENVRAM_STR_NUL;
+    else if (memchr(bcm_nvram->bootline, 0xFF, sizeof(bcm_nvram->bootline)))
+	res->bootline_end = CFENVRAM_STR_FF;
+    else {
+	res->bootline_end = CFENVRAM_STR_OPEN;
+	res->errors++;
+    }
+
+    // image size is not known here, only the table itself is checked
+    cfe_nvram_partitions(src, parts);
+    res->part_overlap = cfe_part_overlap(parts, &res->part_a, &res->part_b);
+    res->errors += res->part_overlap;
+
+    res->vendor_type = vendor_type >= 0 ? vendor_type : detect_cfe_nvram_vendor(src);
+
+    memcpy(&res->oldcksum, src + offsetof(bcm68380_nvram_t, oldcksum), sizeof(res->oldcksum));
+    if (res->oldcksum == 0xFFFFFFFF)
+	res->oldcksum_state = CFENVRAM_CKSUM_EMPTY;
+    else {
+	res->calc_oldcksum = htonl(calc_cfe_nvram_oldcksum(src));
+	res->oldcksum_state = res->calc_oldcksum == res->oldcksum ? CFENVRAM_CKSUM_OK : CFENVRAM_CKSUM_BAD;
+	res->errors += res->oldcksum_state == CFENVRAM_CKSUM_BAD;
+    }
+
+    memcpy(&res->crc, src + offsetof(bcm68380_nvram_t, crc), sizeof(res->crc));
+    res->calc_crc = htonl(calc_cfe_nvram_crc(src));
+    res->crc_ok = res->calc_crc == res->crc;
+    res->errors += !res->crc_ok;
+    return CFENVRAM_OK;
+}
+
+int cfenvram_vendor(const void *nvram, size_t size)
+{
+    return size < CFENVRAM_SIZE ? CFENVRAM_VENDOR_COMMON : detect_cfe_nvram_vendor(nvram);
+}
+
+const char *cfenvram_field(size_t i, int *vendor_type)
+{
+    if (i >= cfe_nvram_fields_num)
+	return NULL;
+    if (vendor_type)
+	*vendor_type = cfe_nvram_fields[i].vendor;
+    return cfe_nvram_fields[i].name;
+}
+
+int cfenvram_get(const void *nvram, size_t size, const char *name, char *buf, size_t buf_size)
+{
+    const cfe_field_t *field = cfe_nvram_field(name);
+
+    if (size < CFENVRAM_SIZE)
+	return CFENVRAM_ESIZE;
+    if (!field)
+	return CFENVRAM_EFIELD;
+    return cfe_nvram_get(nvram, field, buf, buf_size) < 0 ? CFENVRAM_ESIZE : CFENVRAM_OK;
+}
+
+int cfenvram_set(void *nvram, size_t size, const char *name, const char *value)
+{
+    const cfe_field_t *field = cfe_nvram_field(name);
+
+    if (size < CFENVRAM_SIZE)
+	return CFENVRAM_ESIZE;
+    if (!field)
+	return CFENVRAM_EFIELD;
+    if (field->flags & FIELD_F_READONLY)
+	return CFENVRAM_EREADONLY;
+    return cfe_nvram_set(nvram, field, value) ? CFENVRAM_EVALUE : CFENVRAM_OK;
+}
+
+/* "name=value" split into name buffer, no allocation */
+static int edit_apply(void *nvram, const cfenvram_edit_t *edit)
+{
+    char name[CFENVRAM_NAME_MAX];
+    const char *value;
+
+    if (edit->name)
+	return cfenvram_set(nvram, CFENVRAM_SIZE, edit->name, edit->value);
+    value = strchr(edit->value, '=');
+    if (!value || (size_t)(value - edit->value) >= sizeof(name))
+	return CFENVRAM_ESYNTAX;
+    memcpy(name, edit->value, value - edit->value);
+    name[value - edit->value] = 0;
+    return cfenvram_set(nvram, CFENVRAM_SIZE, name, value + 1);
+}
+
+int cfenvram_edit(void *nvram, size_t size, const cfenvram_edit_t *edits, size_t num, size_t *failed)
+{
+    unsigned char block[CFENVRAM_SIZE];
+    size_t i;
+    int err;
+
+    if (size < CFENVRAM_SIZE)
+	return CFENVRAM_ESIZE;
+    // changes go to a stack copy first, block stays untouched on error
+    memcpy(block, nvram, sizeof(block));
+    for (i = 0; i < num; i++)
+	if ((err = edit_apply(block, &edits[i]))) {
+	    if (failed)
+		*failed = i;
+	    return err;
+	}
+    memcpy(nvram, block, sizeof(block));
+    return CFENVRAM_OK;
+}
+
+int cfenvram_crc(const void *nvram, size_t size, uint32_t *crc)
+{
+    if (size < CFENVRAM_SIZE)
+	return CFENVRAM_ESIZE;
+    *crc = htonl(calc_cfe_nvram_crc(nvram));
+    return CFENVRAM_OK;
+}
+
+int cfenvram_update_crc(void *nvram, size_t size, uint32_t *old_crc, uint32_t *new_crc)
+{
+    unsigned char *p = nvram;
+    uint32_t version, crc;
+
+    if (size < CFENVRAM_SIZE)
+	return CFENVRAM_ESIZE;
+    memcpy(&version, p + offsetof(bcm68380_nvram_t, version), sizeof(version));
+    if (ntohl(version) != NVRAM_VERSION)
+	return CFENVRAM_EVERSION;
+    if (old_crc)
+	memcpy(old_crc, p + offsetof(bcm68380_nvram_t, crc), sizeof(*old_crc));
+    crc = htonl(calc_cfe_nvram_crc(p));
+    memcpy(p + offsetof(bcm68380_nvram_t, crc), &crc, sizeof(crc));
+    if (new_crc)
+	*new_crc = crc;
+    return CFENVRAM_OK;
+}
+
+const char *cfenvram_strerror(int err)
+{
+    static const char *messages[] = {
+	[CFENVRAM_OK]		= "success",
+	[CFENVRAM_ESIZE]	= "buffer too small",
+	[CFENVRAM_EVERSION]	= "NVRAM version is wrong",
+	[CFENVRAM_ECRC]		= "checksum mismatch",
+	[CFENVRAM_EFIELD]	= "unknown field",
+	[CFENVRAM_EREADONLY]	= "field is read-only",
+	[CFENVRAM_EVALUE]	= "value does not fit field",
+	[CFENVRAM_ESYNTAX]	= "expected name=value",
+	[CFENVRAM_ENOTFOUND]	= "no valid NVRAM found",
+    };
+
+    return err >= 0 && err < (int)(sizeof(messages) / sizeof(messages[0])) ? messages[err] : "unknown error";
+}
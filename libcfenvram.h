@@ -0,0 +1,117 @@
+#ifndef LIBCFENVRAM_H
+#define LIBCFENVRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * libcfenvram: bcm68380 cferom/fullflash nvram block (bcm68380_nvram_t) as
+ * a library. Every function works on caller buffers only: nothing is
+ * allocated, printed or kept between calls, src blocks are never written.
+ * Functions may be called from any number of threads; calls changing the
+ * same block need locking by the caller. cfenvram_init() selects the fastest
+ * crc32 engine once (without it the portable one is used).
+ */
+
+/* only these functions are exported by libcfenvram.so (built with -fvisibility=hidden) */
+#ifdef __GNUC__
+#define CFENVRAM_API __attribute__((visibility("default")))
+#else
+#define CFENVRAM_API
+#endif
+
+#define CFENVRAM_SIZE		1024	// sizeof(bcm68380_nvram_t)
+#define CFENVRAM_VERSION	6
+
+enum {
+    CFENVRAM_OK = 0,
+    CFENVRAM_ESIZE,		// buffer shorter than CFENVRAM_SIZE, or value buffer too small
+    CFENVRAM_EVERSION,		// nvram version is not 6
+    CFENVRAM_ECRC,		// crc or oldcksum mismatch
+    CFENVRAM_EFIELD,		// unknown field name
+    CFENVRAM_EREADONLY,		// header/checksum field, maintained by cfenvram_update_crc()
+    CFENVRAM_EVALUE,		// value does not fit field
+    CFENVRAM_ESYNTAX,		// assignment is not name=value
+    CFENVRAM_ENOTFOUND,		// no valid block in buffer
+};
+
+enum {
+    CFENVRAM_VENDOR_COMMON = 0,
+    CFENVRAM_VENDOR_ELTX,	// eltex vendor_params (firmware versions and crcs)
+    CFENVRAM_VENDOR_UBNT,	// ubiquiti vendor_params
+};
+
+enum {
+    CFENVRAM_CKSUM_OK = 0,
+    CFENVRAM_CKSUM_EMPTY,	// 0xFFFFFFFF, not verified
+    CFENVRAM_CKSUM_BAD,
+};
+
+enum {
+    CFENVRAM_STR_NUL = 0,	// null-terminated
+    CFENVRAM_STR_FF,		// terminated with 0xFF (erased flash)
+    CFENVRAM_STR_OPEN,		// no terminator
+};
+
+typedef struct cfenvram_verify {
+    uint32_t	version;
+    uint32_t	crc;		// as stored (flash byte order)
+    uint32_t	calc_crc;	// same byte order as crc
+    uint32_t	oldcksum;
+    uint32_t	calc_oldcksum;
+    int		crc_ok;
+    int		oldcksum_state;	// CFENVRAM_CKSUM_*
+    int		bootline_end;	// CFENVRAM_STR_*
+    int		vendor_type;	// given or detected CFENVRAM_VENDOR_*
+    int		part_overlap;	// nand partitions part_a and part_b (0 - boot .. 4 - bbt) overlap
+    int		part_a;
+    int		part_b;
+    int		errors;		// problems found, same count as cfe_edit -v
+} cfenvram_verify_t;
+
+/* one field change: name NULL - value is "name=value" */
+typedef struct cfenvram_edit {
+    const char	*name;
+    const char	*value;
+} cfenvram_edit_t;
+
+/* select crc32 engine, once per process (thread-safe); returns engines failing self-test */
+CFENVRAM_API int cfenvram_init(void);
+
+/* first valid block (version, crc and oldcksum ok) in buf, *offset from buf, *vendor_type detected */
+CFENVRAM_API int cfenvram_find(const void *buf, size_t size, size_t *offset, int *vendor_type);
+
+/* CFENVRAM_OK, CFENVRAM_EVERSION or CFENVRAM_ECRC */
+CFENVRAM_API int cfenvram_check(const void *nvram, size_t size);
+
+/* all checks of cfe_edit -v into res; vendor_type -1 - detect. Returns CFENVRAM_OK or CFENVRAM_ESIZE */
+CFENVRAM_API int cfenvram_verify(const void *nvram, size_t size, int vendor_type, cfenvram_verify_t *res);
+
+/* CFENVRAM_VENDOR_* guessed from board id, GPON SN and vendor_params */
+CFENVRAM_API int cfenvram_vendor(const void *nvram, size_t size);
+
+/* i-th field name (NULL past the last one), *vendor_type: 0 - common, else layout it belongs to */
+CFENVRAM_API const char *cfenvram_field(size_t i, int *vendor_type);
+
+/* text value of field into buf (null-terminated), same format as --get */
+CFENVRAM_API int cfenvram_get(const void *nvram, size_t size, const char *name, char *buf, size_t buf_size);
+
+/* parse value (integers: decimal or 0x-hex) into field; checksums are not updated */
+CFENVRAM_API int cfenvram_set(void *nvram, size_t size, const char *name, const char *value);
+
+/*
+ * apply edits in order, all or nothing: block is changed only if every edit
+ * succeeds, else *failed (if not NULL) is the index of the first failing one
+ */
+CFENVRAM_API int cfenvram_edit(void *nvram, size_t size, const cfenvram_edit_t *edits, size_t num, size_t *failed);
+
+/* crc of block with crc field treated as zero, in flash byte order (comparable with stored crc) */
+CFENVRAM_API int cfenvram_crc(const void *nvram, size_t size, uint32_t *crc);
+
+/* store recalculated crc; old/new (flash byte order) returned if not NULL */
+CFENVRAM_API int cfenvram_update_crc(void *nvram, size_t size, uint32_t *old_crc, uint32_t *new_crc);
+
+/* static message for CFENVRAM_* code */
+CFENVRAM_API const char *cfenvram_strerror(int err);
+
+#endif
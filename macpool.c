@@ -0,0 +1,387 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "macpool.h"
+
+#define N(pool, i) (&(pool)->nodes[(i) - 1])
+
+void macpool_init(macpool_t *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->seed = 2463534242u;
+}
+
+void macpool_free(macpool_t *pool)
+{
+    free(pool->nodes);
+    free(pool->owners);
+    macpool_init(pool);
+}
+
+uint32_t macpool_owner(macpool_t *pool, const char *name)
+{
+    size_t len = strlen(name) + 1;
+    uint32_t owner;
+
+    if (pool->owners_len + len > pool->owners_alloc) {
+	size_t alloc = pool->owners_alloc ? pool->owners_alloc : 65536;
+	char *owners;
+
+	while (alloc < pool->owners_len + len)
+	    alloc *= 2;
+	if (alloc > UINT32_MAX || !(owners = realloc(pool->owners, alloc)))
+	    return 0;
+	pool->owners = owners;
+	pool->owners_alloc = alloc;
+    }
+    owner = pool->owners_len;
+    memcpy(pool->owners + owner, name, len);
+    pool->owners_len += len;
+    return owner;
+}
+
+const char *macpool_owner_name(const macpool_t *pool, uint32_t owner)
+{
+    return owner < pool->owners_len ? pool->owners + owner : "?";
+}
+
+static uint32_t new_node(macpool_t *pool, uint64_t start, uint64_t end, uint32_t owner)
+{
+    uint32_t i;
+
+    if (pool->free_list) {
+	i = pool->free_list;
+	pool->free_list = N(pool, i)->left;
+    } else {
+	if (pool->count == pool->alloc) {
+	    uint32_t alloc = pool->alloc ? pool->alloc * 2 : 4096;
+	    macpool_node_t *nodes = realloc(pool->nodes, (size_t)alloc * sizeof(*nodes));
+	    if (!nodes)
+		return 0;
+	    pool->nodes = nodes;
+	    pool->alloc = alloc;
+	}
+	i = ++pool->count;
+    }
+
+    // xorshift32 priorities keep treap balanced for sorted input too
+    pool->seed ^= pool->seed << 13;
+    pool->seed ^= pool->seed >> 17;
+    pool->seed ^= pool->seed << 5;
+
+    macpool_node_t *n = N(pool, i);
+    n->start = n->min_start = start;
+    n->end = n->max_end = end;
+    n->max_gap = 0;
+    n->left = n->right = 0;
+    n->prio = pool->seed;
+    n->owner = owner;
+    return i;
+}
+
+static void free_subtree(macpool_t *pool, uint32_t t)
+{
+    while (t) {
+	macpool_node_t *n = N(pool, t);
+	uint32_t right = n->right;
+
+	free_subtree(pool, n->left);
+	n->left = pool->free_list;
+	pool->free_list = t;
+	t = right;
+    }
+}
+
+static void update(macpool_t *pool, uint32_t t)
+{
+    macpool_node_t *n = N(pool, t);
+
+    n->min_start = n->start;
+    n->max_end = n->end;
+    n->max_gap = 0;
+    if (n->left) {
+	macpool_node_t *l = N(pool, n->left);
+	n->min_start = l->min_start;
+	n->max_gap = l->max_gap;
+	if (n->start - l->max_end > n->max_gap)
+	    n->max_gap = n->start - l->max_end;
+    }
+    if (n->right) {
+	macpool_node_t *r = N(pool, n->right);
+	n->max_end = r->max_end;
+	if (r->max_gap > n->max_gap)
+	    n->max_gap = r->max_gap;
+	if (r->min_start - n->end > n->max_gap)
+	    n->max_gap = r->min_start - n->end;
+    }
+}
+
+/* intervals with start < key into *l, others into *r */
+static void split(macpool_t *pool, uint32_t t, uint64_t key, uint32_t *l, uint32_t *r)
+{
+    if (!t) {
+	*l = *r = 0;
+	return;
+    }
+    macpool_node_t *n = N(pool, t);
+    if (n->start < key) {
+	split(pool, n->right, key, &n->right, r);
+	*l = t;
+    } else {
+	split(pool, n->left, key, l, &n->left);
+	*r = t;
+    }
+    update(pool, t);
+}
+
+/* every interval of a is before every interval of b */
+static uint32_t merge(macpool_t *pool, uint32_t a, uint32_t b)
+{
+    if (!a || !b)
+	return a ? a : b;
+    if (N(pool, a)->prio > N(pool, b)->prio) {
+	N(pool, a)->right = merge(pool, N(pool, a)->right, b);
+	update(pool, a);
+	return a;
+    }
+    N(pool, b)->left = merge(pool, a, N(pool, b)->left);
+    update(pool, b);
+    return b;
+}
+
+static uint32_t leftmost(macpool_t *pool, uint32_t t)
+{
+    while (N(pool, t)->left)
+	t = N(pool, t)->left;
+    return t;
+}
+
+static uint32_t rightmost(macpool_t *pool, uint32_t t)
+{
+    while (N(pool, t)->right)
+	t = N(pool, t)->right;
+    return t;
+}
+
+/* last interval starting before key, 0 if none */
+static uint32_t predecessor(macpool_t *pool, uint64_t key)
+{
+    uint32_t t = pool->root, found = 0;
+
+    while (t) {
+	if (N(pool, t)->start < key) {
+	    found = t;
+	    t = N(pool, t)->right;
+	} else {
+	    t = N(pool, t)->left;
+	}
+    }
+    return found;
+}
+
+/* node goes where its priority fits, subtree below is split around it: one descent */
+static uint32_t insert(macpool_t *pool, uint32_t t, uint32_t i)
+{
+    macpool_node_t *n = N(pool, i);
+
+    if (!t)
+	return i;
+    if (n->prio > N(pool, t)->prio) {
+	split(pool, t, n->start, &n->left, &n->right);
+	update(pool, i);
+	return i;
+    }
+    if (n->start < N(pool, t)->start)
+	N(pool, t)->left = insert(pool, N(pool, t)->left, i);
+    else
+	N(pool, t)->right = insert(pool, N(pool, t)->right, i);
+    update(pool, t);
+    return t;
+}
+
+int macpool_add(macpool_t *pool, uint64_t base, uint64_t num, uint32_t owner, uint32_t *other)
+{
+    uint64_t start = base, end = base + (num ? num : 1);
+    uint32_t a, b, m, c, last, t;
+    int overlap = 0;
+
+    pool->ranges++;
+
+    // common case: no overlap, plain insert
+    t = predecessor(pool, end);
+    if (!t || N(pool, t)->end <= start) {
+	t = new_node(pool, start, end, owner);
+	if (!t)
+	    return -1;
+	pool->root = insert(pool, pool->root, t);
+	return 0;
+    }
+
+    split(pool, pool->root, start, &a, &b);
+
+    // last interval before range overlapping it is merged, adjacent ones keep their owners
+    if (a && N(pool, a)->max_end > start) {
+	last = rightmost(pool, a);
+	overlap = 1;
+	*other = N(pool, last)->owner;
+	start = N(pool, last)->start;
+	owner = N(pool, last)->owner;
+	if (N(pool, last)->end > end)
+	    end = N(pool, last)->end;
+	split(pool, a, start, &a, &last);
+	free_subtree(pool, last);
+    }
+
+    // intervals starting inside range
+    split(pool, b, end, &m, &c);
+    if (m) {
+	if (!overlap && N(pool, m)->min_start < base + (num ? num : 1)) {
+	    overlap = 1;
+	    *other = N(pool, leftmost(pool, m))->owner;
+	}
+	if (N(pool, m)->max_end > end)
+	    end = N(pool, m)->max_end;
+	if (start == N(pool, m)->min_start && start == base)
+	    owner = N(pool, leftmost(pool, m))->owner;
+	free_subtree(pool, m);
+    }
+
+    t = new_node(pool, start, end, owner);
+    if (!t) {
+	pool->root = merge(pool, a, c);
+	return -1;
+    }
+    pool->root = merge(pool, merge(pool, a, t), c);
+    pool->overlaps += overlap;
+    return overlap;
+}
+
+/* earliest gap of num macs after *prev inside subtree; *prev is advanced past subtree if none */
+static int first_fit(macpool_t *pool, uint32_t t, uint64_t *prev, uint64_t num)
+{
+    macpool_node_t *n = N(pool, t);
+
+    if (n->min_start >= *prev + num)
+	return 1;
+    if (n->max_gap < num) {
+	if (n->max_end > *prev)
+	    *prev = n->max_end;
+	return 0;
+    }
+    if (n->left && first_fit(pool, n->left, prev, num))
+	return 1;
+    if (n->start >= *prev + num)
+	return 1;
+    if (n->end > *prev)
+	*prev = n->end;
+    return n->right && first_fit(pool, n->right, prev, num);
+}
+
+int macpool_find_free(macpool_t *pool, uint64_t from, uint64_t to, uint64_t num, uint64_t *base)
+{
+    uint64_t prev = from;
+    uint32_t a, b;
+
+    if (!num || to > MAC_MAX || from >= to)
+	return 1;
+    split(pool, pool->root, from, &a, &b);
+    if (a && N(pool, a)->max_end > prev)
+	prev = N(pool, a)->max_end;
+    if (b)
+	first_fit(pool, b, &prev, num);
+    pool->root = merge(pool, a, b);
+
+    if (prev + num > to)
+	return 1;
+    *base = prev;
+    return 0;
+}
+
+size_t macpool_intervals(const macpool_t *pool)
+{
+    uint32_t i;
+    size_t free_nodes = 0;
+
+    for (i = pool->free_list; i; i = pool->nodes[i - 1].left)
+	free_nodes++;
+    return pool->count - free_nodes;
+}
+
+int macpool_parse_mac(const char *s, uint64_t *mac)
+{
+    unsigned char m[6];
+
+    if (strlen(s) != 12 || sscanf(s, "%2hhx%2hhx%2hhx%2hhx%2hhx%2hhx", &m[0], &m[1], &m[2], &m[3], &m[4], &m[5]) != 6)
+	return 1;
+    *mac = macpool_mac_value(m);
+    return 0;
+}
+
+int macpool_load_ledger(macpool_t *pool, const char *name, int report_overlaps)
+{
+    char *line = NULL, mac[32], owner[1024], tmp[64];
+    size_t line_size = 0, lineno = 0;
+    unsigned long long num;
+    int retcode = 0;
+
+    FILE *f = fopen(name, "r");
+    if (!f && errno == ENOENT)
+	return 0; // first allocation creates it
+    if (!f) {
+	perror("Cannot open ledger");
+	return 1;
+    }
+    while (getline(&line, &line_size, f) > 0) {
+	uint64_t base;
+	uint32_t other, id;
+	int fields;
+
+	lineno++;
+	if (line[0] == '#' || line[0] == '\n')
+	    continue;
+	fields = sscanf(line, "%31s %lli %1023s", mac, (long long *)&num, owner);
+	if (fields < 2 || macpool_parse_mac(mac, &base) || num > 0xFFFFFFFFULL || base + num > MAC_MAX) {
+	    fprintf(stderr, "%s:%zu: expected \"<basemac> <mac_num> [owner]\"\n", name, lineno);
+	    retcode++;
+	    continue;
+	}
+	if (fields < 3) {
+	    snprintf(tmp, sizeof(tmp), "%s:%zu", name, lineno);
+	    id = macpool_owner(pool, tmp);
+	} else {
+	    id = macpool_owner(pool, owner);
+	}
+	int ret = macpool_add(pool, base, num, id, &other);
+	if (ret < 0) {
+	    retcode++;
+	    break;
+	}
+	if (ret && report_overlaps)
+	    printf("OVERLAP %s (%s+%llu) with %s\n", macpool_owner_name(pool, id), mac, num, macpool_owner_name(pool, other));
+    }
+    free(line);
+    fclose(f);
+    return retcode;
+}
+
+int macpool_append_ledger(const char *name, uint64_t base, uint64_t num, const char *owner)
+{
+    FILE *f = fopen(name, "a");
+    int retcode = 0;
+
+    if (!f) {
+	perror("Cannot open ledger");
+	return 1;
+    }
+    fprintf(f, "%012llX %llu %s\n", (unsigned long long)base, (unsigned long long)num, owner);
+    if (fflush(f) || fsync(fileno(f)))
+	retcode++;
+    if (fclose(f))
+	retcode++;
+    return retcode;
+}
@@ -0,0 +1,78 @@
+#ifndef CFE_MACPOOL_H
+#define CFE_MACPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MAC_MAX 0x1000000000000ULL	// 48-bit mac space end
+
+/*
+ * assigned mac ranges [basemac, basemac + mac_num): overlapping ranges are
+ * merged, so intervals of the treap are disjoint (nodes in one array,
+ * 32-bit links), each subtree keeps its first start, last end and widest
+ * free gap, so overlap checks and first-fit allocation are O(log n)
+ */
+typedef struct macpool_node {
+    uint64_t	start;
+    uint64_t	end;		// exclusive
+    uint64_t	min_start;	// subtree
+    uint64_t	max_end;
+    uint64_t	max_gap;	// widest free gap between intervals inside subtree
+    uint32_t	left;		// node index + 1, 0 - none
+    uint32_t	right;
+    uint32_t	prio;
+    uint32_t	owner;		// owner of first range merged into interval
+} macpool_node_t;
+
+typedef struct macpool {
+    macpool_node_t	*nodes;
+    uint32_t		count;		// used slots (including freed ones on free list)
+    uint32_t		alloc;
+    uint32_t		root;
+    uint32_t		free_list;	// freed nodes linked through left
+    uint32_t		seed;
+    uint64_t		ranges;		// ranges added
+    uint64_t		overlaps;	// ranges overlapping earlier ones
+    char		*owners;	// NUL separated owner names, owner is offset
+    size_t		owners_len;
+    size_t		owners_alloc;
+} macpool_t;
+
+void macpool_init(macpool_t *pool);
+void macpool_free(macpool_t *pool);
+
+/* keep owner name, returns its id for macpool_add() */
+uint32_t macpool_owner(macpool_t *pool, const char *name);
+const char *macpool_owner_name(const macpool_t *pool, uint32_t owner);
+
+/*
+ * add assigned range, returns 1 if it overlaps already assigned mac(s):
+ * owner of (first) overlapped interval in *other; -1 on allocation error
+ */
+int macpool_add(macpool_t *pool, uint64_t base, uint64_t num, uint32_t owner, uint32_t *other);
+
+/* first free range of num macs inside [from, to), 0 on success; range is not added */
+int macpool_find_free(macpool_t *pool, uint64_t from, uint64_t to, uint64_t num, uint64_t *base);
+
+/* number of disjoint intervals */
+size_t macpool_intervals(const macpool_t *pool);
+
+/* 6 mac bytes (as in nvram basemac) as number */
+static inline uint64_t macpool_mac_value(const uint8_t *mac)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = 0; i < 6; i++)
+	v = (v << 8) | mac[i];
+    return v;
+}
+
+/* "A8F94B010203" */
+int macpool_parse_mac(const char *s, uint64_t *mac);
+
+/* ledger file: "<basemac> <mac_num> [owner]" per line, # comments; missing file is empty; 0 on success */
+int macpool_load_ledger(macpool_t *pool, const char *name, int report_overlaps);
+int macpool_append_ledger(const char *name, uint64_t base, uint64_t num, const char *owner);
+
+#endif
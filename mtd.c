@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <mtd/mtd-user.h>
+#endif
+
+#include "mtd.h"
+#include "stats.h"
+
+static int pread_full(int fd, void *buf, size_t size, off_t ofs)
+{
+    size_t done = 0;
+
+    while (done < size) {
+	ssize_t n = pread(fd, (char *)buf + done, size - done, ofs + done);
+	stats_io(STAT_BYTES_READ, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    return 0;
+}
+
+static int pwrite_full(int fd, const void *buf, size_t size, off_t ofs)
+{
+    size_t done = 0;
+
+    while (done < size) {
+	ssize_t n = pwrite(fd, (const char *)buf + done, size - done, ofs + done);
+	stats_io(STAT_BYTES_WRITTEN, n > 0 ? n : 0);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	done += n;
+    }
+    return 0;
+}
+
+int mtd_open(mtd_dev_t *mtd, const char *name, int writable, uint32_t erasesize)
+{
+    struct stat st;
+
+    memset(mtd, 0, sizeof(*mtd));
+    mtd->name = name;
+    mtd->fd = open(name, writable ? O_RDWR : O_RDONLY);
+    stats_syscall();
+    if (mtd->fd < 0) {
+	perror("Cannot open mtd device");
+	return 1;
+    }
+    if (fstat(mtd->fd, &st)) {
+	perror("Cannot stat mtd device");
+	goto error;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+	mtd->emulated = 1;
+	mtd->size = st.st_size;
+	mtd->erasesize = erasesize ? erasesize : MTD_EMU_ERASESIZE;
+	mtd->writesize = 1;
+	if (mtd->erasesize & (mtd->erasesize - 1) || mtd->size % mtd->erasesize) {
+	    fprintf(stderr, "Emulated mtd %s: size %#llx is not a multiple of erase size %#x\n",
+		name, (unsigned long long)mtd->size, mtd->erasesize);
+	    goto error;
+	}
+	return 0;
+    }
+
+#ifdef MEMGETINFO
+    struct mtd_info_user info;
+
+    if (S_ISCHR(st.st_mode) && !ioctl(mtd->fd, MEMGETINFO, &info)) {
+	mtd->size = info.size;
+	mtd->erasesize = info.erasesize;
+	mtd->writesize = info.writesize ? info.writesize : 1;
+	return 0;
+    }
+#endif
+
+    fprintf(stderr, "%s is not an mtd device or regular file\n", name);
+
+    error:
+    mtd_close(mtd);
+    return 1;
+}
+
+void mtd_close(mtd_dev_t *mtd)
+{
+    if (mtd->fd >= 0) {
+	close(mtd->fd);
+	stats_syscall();
+    }
+    mtd->fd = -1;
+}
+
+void mtd_block_span(const mtd_dev_t *mtd, uint64_t ofs, size_t len, uint64_t *start, size_t *span)
+{
+    uint64_t end = ofs + len;
+
+    *start = ofs - ofs % mtd->erasesize;
+    end = end + (mtd->erasesize - end % mtd->erasesize) % mtd->erasesize;
+    *span = end - *start;
+}
+
+static int mtd_bad_block(mtd_dev_t *mtd, uint64_t ofs)
+{
+#ifdef MEMGETBADBLOCK
+    if (!mtd->emulated) {
+	loff_t pos = ofs;
+	int ret = ioctl(mtd->fd, MEMGETBADBLOCK, &pos);
+	stats_syscall();
+
+	// NOR flash has no bad blocks and may return EOPNOTSUPP
+	if (ret > 0)
+	    return 1;
+    }
+#endif
+    (void)mtd; (void)ofs;
+    return 0;
+}
+
+int mtd_read(mtd_dev_t *mtd, uint64_t ofs, void *buf, size_t len)
+{
+    uint64_t block;
+
+    if (ofs + len > mtd->size) {
+	fprintf(stderr, "Read %#llx+%#zx is outside of %s (%#llx bytes)\n",
+	    (unsigned long long)ofs, len, mtd->name, (unsigned long long)mtd->size);
+	return 1;
+    }
+    for (block = ofs - ofs % mtd->erasesize; block < ofs + len; block += mtd->erasesize) {
+	if (mtd_bad_block(mtd, block)) {
+	    fprintf(stderr, "Erase block %#llx of %s is bad\n", (unsigned long long)block, mtd->name);
+	    return 1;
+	}
+    }
+    if (pread_full(mtd->fd, buf, len, ofs)) {
+	perror("Cannot read mtd");
+	return 1;
+    }
+    return 0;
+}
+
+int mtd_erase(mtd_dev_t *mtd, uint64_t ofs, size_t len)
+{
+    if (ofs % mtd->erasesize || len % mtd->erasesize || ofs + len > mtd->size) {
+	fprintf(stderr, "Erase %#llx+%#zx is not erase block aligned\n", (unsigned long long)ofs, len);
+	return 1;
+    }
+
+    if (mtd->emulated) {
+	unsigned char *ff = malloc(mtd->erasesize);
+	uint64_t block;
+	int retcode = 0;
+
+	if (!ff)
+	    return 1;
+	memset(ff, 0xFF, mtd->erasesize);
+	for (block = ofs; block < ofs + len && !retcode; block += mtd->erasesize)
+	    retcode = pwrite_full(mtd->fd, ff, mtd->erasesize, block);
+	free(ff);
+	if (retcode)
+	    perror("Cannot erase emulated mtd");
+	return retcode;
+    }
+
+#ifdef MEMERASE
+    struct erase_info_user erase;
+
+    for (erase.start = ofs; erase.start < ofs + len; erase.start += mtd->erasesize) {
+	erase.length = mtd->erasesize;
+	if (mtd_bad_block(mtd, erase.start)) {
+	    fprintf(stderr, "Erase block %#x of %s is bad, not erased\n", erase.start, mtd->name);
+	    return 1;
+	}
+	stats_syscall();
+	if (ioctl(mtd->fd, MEMERASE, &erase)) {
+	    perror("Cannot erase mtd");
+	    return 1;
+	}
+    }
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+int mtd_write(mtd_dev_t *mtd, uint64_t ofs, const void *buf, size_t len)
+{
+    if (ofs % mtd->writesize || len % mtd->writesize || ofs + len > mtd->size) {
+	fprintf(stderr, "Write %#llx+%#zx is not page aligned\n", (unsigned long long)ofs, len);
+	return 1;
+    }
+
+    if (mtd->emulated) {
+	// programming can only clear bits: catch writes over not erased data
+	unsigned char *cur = malloc(len);
+	const unsigned char *src = buf;
+	size_t i;
+
+	if (!cur || pread_full(mtd->fd, cur, len, ofs)) {
+	    free(cur);
+	    perror("Cannot read emulated mtd");
+	    return 1;
+	}
+	for (i = 0; i < len; i++) {
+	    if (src[i] & ~cur[i]) {
+		fprintf(stderr, "Emulated mtd: write to not erased byte at %#llx\n", (unsigned long long)(ofs + i));
+		free(cur);
+		return 1;
+	    }
+	}
+	free(cur);
+    }
+
+    if (pwrite_full(mtd->fd, buf, len, ofs)) {
+	perror("Cannot write mtd");
+	return 1;
+    }
+    if (mtd->emulated && fdatasync(mtd->fd)) {
+	perror("Cannot sync emulated mtd");
+	return 1;
+    }
+    return 0;
+}
+
+int mtd_update(mtd_dev_t *mtd, uint64_t ofs, const void *buf, size_t len)
+{
+    const unsigned char *src = buf;
+    unsigned char *cur;
+    size_t done;
+    int retcode = 0;
+
+    if (ofs % mtd->erasesize || len % mtd->erasesize)
+	return 1;
+    cur = malloc(mtd->erasesize);
+    if (!cur)
+	return 1;
+
+    for (done = 0; done < len && !retcode; done += mtd->erasesize) {
+	uint64_t block = ofs + done;
+
+	if (mtd_read(mtd, block, cur, mtd->erasesize)) {
+	    retcode++;
+	    break;
+	}
+	if (!memcmp(cur, src + done, mtd->erasesize))
+	    continue;
+
+	printf(">> rewriting erase block %#llx (%#x bytes) of %s\n", (unsigned long long)block, mtd->erasesize, mtd->name);
+	if (mtd_erase(mtd, block, mtd->erasesize) || mtd_write(mtd, block, src + done, mtd->erasesize) ||
+	    mtd_read(mtd, block, cur, mtd->erasesize)) {
+	    retcode++;
+	    break;
+	}
+	if (memcmp(cur, src + done, mtd->erasesize)) {
+	    fprintf(stderr, "Erase block %#llx read back mismatch\n", (unsigned long long)block);
+	    retcode++;
+	}
+    }
+    free(cur);
+    return retcode;
+}
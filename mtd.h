@@ -0,0 +1,41 @@
+#ifndef CFE_MTD_H
+#define CFE_MTD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MTD_EMU_ERASESIZE 0x20000
+
+/*
+ * raw flash partition: /dev/mtdX character device, or a regular file used as
+ * emulated mtd (erase sets 0xFF, program can only clear bits)
+ */
+typedef struct mtd_dev {
+    const char	*name;
+    int		fd;
+    int		emulated;
+    uint64_t	size;
+    uint32_t	erasesize;
+    uint32_t	writesize;	// program unit, 1 for NOR
+} mtd_dev_t;
+
+/* erasesize is used only for emulated mtd, 0 - MTD_EMU_ERASESIZE */
+int mtd_open(mtd_dev_t *mtd, const char *name, int writable, uint32_t erasesize);
+void mtd_close(mtd_dev_t *mtd);
+
+/* first erase block and length of erase blocks covering [ofs, ofs + len) */
+void mtd_block_span(const mtd_dev_t *mtd, uint64_t ofs, size_t len, uint64_t *start, size_t *span);
+
+int mtd_read(mtd_dev_t *mtd, uint64_t ofs, void *buf, size_t len);
+/* erase block aligned range */
+int mtd_erase(mtd_dev_t *mtd, uint64_t ofs, size_t len);
+/* writesize aligned range, must be erased before */
+int mtd_write(mtd_dev_t *mtd, uint64_t ofs, const void *buf, size_t len);
+
+/*
+ * rewrite erase block aligned range [ofs, ofs + len) with buf: unchanged
+ * blocks are skipped, changed ones erased, programmed and read back
+ */
+int mtd_update(mtd_dev_t *mtd, uint64_t ofs, const void *buf, size_t len);
+
+#endif
@@ -0,0 +1,151 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "crc32.h"
+#include "nand.h"
+
+#define NAND_IOV_MAX 1024
+
+int nand_parse_geom(nand_geom_t *geom, const char *spec)
+{
+    int n = 0;
+
+    memset(geom, 0, sizeof(*geom));
+    if (sscanf(spec, "%u+%u%n", &geom->page, &geom->oob, &n) != 2)
+	return 1;
+    if (spec[n] && sscanf(spec + n, ":ecc=%u+%u", &geom->ecc_ofs, &geom->ecc_len) != 2)
+	return 1;
+    if (!geom->page || geom->page & (geom->page - 1) || geom->page > 65536 || geom->oob > 4096)
+	return 1;
+    if (geom->ecc_len && geom->ecc_ofs + geom->ecc_len > geom->oob)
+	return 1;
+    return 0;
+}
+
+uint64_t nand_logical_size(const nand_geom_t *geom, uint64_t raw_size)
+{
+    uint64_t raw_page = geom->page + geom->oob;
+    uint64_t tail = raw_size % raw_page;
+
+    return raw_size / raw_page * geom->page + (tail < geom->page ? tail : geom->page);
+}
+
+uint64_t nand_raw_offset(const nand_geom_t *geom, uint64_t ofs)
+{
+    return ofs / geom->page * (geom->page + geom->oob) + ofs % geom->page;
+}
+
+void nand_raw_span(const nand_geom_t *geom, uint64_t ofs, uint64_t len, uint64_t *raw_ofs, uint64_t *raw_len)
+{
+    uint64_t first = ofs / geom->page, last = (ofs + len + geom->page - 1) / geom->page;
+
+    *raw_ofs = first * (geom->page + geom->oob);
+    *raw_len = (last - first) * (geom->page + geom->oob);
+}
+
+void nand_gather(const nand_geom_t *geom, const unsigned char *raw, uint64_t ofs, void *buf, size_t len)
+{
+    unsigned char *dst = buf;
+
+    while (len) {
+	size_t n = geom->page - ofs % geom->page;
+	if (n > len)
+	    n = len;
+	memcpy(dst, raw + nand_raw_offset(geom, ofs), n);
+	dst += n;
+	ofs += n;
+	len -= n;
+    }
+}
+
+void nand_scatter(const nand_geom_t *geom, unsigned char *raw, uint64_t ofs, const void *buf, size_t len)
+{
+    const unsigned char *src = buf;
+
+    while (len) {
+	size_t n = geom->page - ofs % geom->page;
+	if (n > len)
+	    n = len;
+	memcpy(raw + nand_raw_offset(geom, ofs), src, n);
+	src += n;
+	ofs += n;
+	len -= n;
+    }
+}
+
+uint32_t nand_crc32(const nand_geom_t *geom, const unsigned char *raw, uint64_t ofs, uint64_t len, uint32_t crc)
+{
+    while (len) {
+	uint64_t n = geom->page - ofs % geom->page;
+	if (n > len)
+	    n = len;
+	crc = cfe_crc32(raw + nand_raw_offset(geom, ofs), n, crc);
+	ofs += n;
+	len -= n;
+    }
+    return crc;
+}
+
+int nand_extract(const nand_geom_t *geom, cfe_image_t *img, const char *output_name, uint64_t ofs, uint64_t len)
+{
+    struct iovec iov[NAND_IOV_MAX];
+    int retcode = 0;
+
+    int out_fd = open(output_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+	perror("Cannot open file for write");
+	return 1;
+    }
+
+    while (len && !retcode) {
+	int cnt = 0;
+	size_t total = 0;
+
+	// one iovec per page data, spare areas are skipped
+	while (len && cnt < NAND_IOV_MAX) {
+	    uint64_t n = geom->page - ofs % geom->page;
+	    if (n > len)
+		n = len;
+	    iov[cnt].iov_base = img->mem + nand_raw_offset(geom, ofs);
+	    iov[cnt].iov_len = n;
+	    cnt++;
+	    total += n;
+	    ofs += n;
+	    len -= n;
+	}
+
+	struct iovec *v = iov;
+	while (total) {
+	    ssize_t n = writev(out_fd, v, cnt);
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    if (n <= 0) {
+		perror("Cannot write output file");
+		retcode++;
+		break;
+	    }
+	    total -= n;
+	    // short write: skip written iovecs
+	    while (cnt && (size_t)n >= v->iov_len) {
+		n -= v->iov_len;
+		v++;
+		cnt--;
+	    }
+	    if (cnt) {
+		v->iov_base = (char *)v->iov_base + n;
+		v->iov_len -= n;
+	    }
+	}
+    }
+
+    if (close(out_fd))
+	retcode++;
+    return retcode;
+}
@@ -0,0 +1,40 @@
+#ifndef CFE_NAND_H
+#define CFE_NAND_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+
+/*
+ * raw nand dump from programmer: every page of data is followed by its spare
+ * (oob) area. Offsets used by nvram and -p are logical ones (oob stripped),
+ * the raw image stays mapped, only requested ranges are gathered.
+ */
+typedef struct nand_geom {
+    uint32_t	page;		// data bytes per page
+    uint32_t	oob;		// spare bytes after each page
+    uint32_t	ecc_ofs;	// ecc bytes within spare area
+    uint32_t	ecc_len;	// 0 - ecc layout not given
+} nand_geom_t;
+
+/* "2048+64" or "2048+64:ecc=<ofs>+<len>", 0 on success */
+int nand_parse_geom(nand_geom_t *geom, const char *spec);
+
+/* logical size of raw image (partial last page counted up to page size) */
+uint64_t nand_logical_size(const nand_geom_t *geom, uint64_t raw_size);
+uint64_t nand_raw_offset(const nand_geom_t *geom, uint64_t ofs);
+/* whole raw pages (data and spare) holding logical [ofs, ofs + len) */
+void nand_raw_span(const nand_geom_t *geom, uint64_t ofs, uint64_t len, uint64_t *raw_ofs, uint64_t *raw_len);
+
+/* copy logical [ofs, ofs + len) from/to raw image, range must be inside of it */
+void nand_gather(const nand_geom_t *geom, const unsigned char *raw, uint64_t ofs, void *buf, size_t len);
+void nand_scatter(const nand_geom_t *geom, unsigned char *raw, uint64_t ofs, const void *buf, size_t len);
+
+/* cfe_crc32() of logical range, page by page */
+uint32_t nand_crc32(const nand_geom_t *geom, const unsigned char *raw, uint64_t ofs, uint64_t len, uint32_t crc);
+
+/* logical range into new file with writev() straight from mapped image, no intermediate buffer */
+int nand_extract(const nand_geom_t *geom, cfe_image_t *img, const char *output_name, uint64_t ofs, uint64_t len);
+
+#endif
@@ -0,0 +1,302 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <endian.h>
+#include <inttypes.h>
+
+#include "cfe_nvram.h"
+#include "crc32.h"
+#include "nand.h"
+#include "partition.h"
+
+#define CRC_CHUNK_MIN	(1 << 20)
+#define CRC_MAX_JOBS	256
+#define CRC_MAX_CHUNKS	(CRC_MAX_JOBS * 4)
+
+typedef struct extract_job {
+    cfe_image_t		*img;
+    const nand_geom_t	*geom;
+    const cfe_part_t	*part;
+    char		path[PATH_MAX];
+    int			retcode;
+} extract_job_t;
+
+static void *extract_worker(void *arg)
+{
+    extract_job_t *job = arg;
+
+    if (job->geom)
+	job->retcode = nand_extract(job->geom, job->img, job->path, job->part->offset, job->part->size);
+    else
+	job->retcode = image_extract(job->img, job->path, job->part->offset, job->part->size);
+    return NULL;
+}
+
+int extract_partitions(cfe_image_t *img, const nand_geom_t *geom, const unsigned char *nvram, const char *dir)
+{
+    cfe_part_t parts[PART_NUM];
+    extract_job_t jobs[PART_NUM];
+    pthread_t threads[PART_NUM];
+    int started[PART_NUM] = { 0 };
+    uint64_t size = geom ? nand_logical_size(geom, img->size) : img->size;
+    int retcode = 0, a, b, i;
+
+    cfe_nvram_partitions(nvram, parts);
+    if (cfe_part_overlap(parts, &a, &b))
+	fprintf(stderr, "Warning: partitions %s and %s overlap\n", parts[a].name, parts[b].name);
+
+    for (i = 0; i < PART_NUM; i++) {
+	jobs[i].img = img;
+	jobs[i].geom = geom;
+	jobs[i].part = &parts[i];
+	jobs[i].retcode = 0;
+	snprintf(jobs[i].path, sizeof(jobs[i].path), "%s/%s.bin", dir, parts[i].name);
+
+	if (!parts[i].size)
+	    continue;
+	if (!cfe_part_valid(&parts[i], size)) {
+	    fprintf(stderr, "Partition %s (offset %#" PRIx64 ", size %#" PRIx64 ") is outside of image (%" PRIu64 " bytes), skipped\n",
+		parts[i].name, parts[i].offset, parts[i].size, size);
+	    retcode++;
+	    continue;
+	}
+	// one thread per partition, run inline if thread cannot be created
+	if (!pthread_create(&threads[i], NULL, extract_worker, &jobs[i]))
+	    started[i] = 1;
+	else
+	    extract_worker(&jobs[i]);
+    }
+
+    for (i = 0; i < PART_NUM; i++) {
+	if (started[i])
+	    pthread_join(threads[i], NULL);
+	if (!parts[i].size || !cfe_part_valid(&parts[i], size))
+	    continue;
+	retcode += jobs[i].retcode;
+	printf(">> %-8s offset 0x%08" PRIx64 ", size 0x%08" PRIx64 " -> %s%s\n", parts[i].name, parts[i].offset, parts[i].size,
+	    jobs[i].path, jobs[i].retcode ? " FAILED" : "");
+    }
+    return retcode;
+}
+
+typedef struct crc_job {
+    const unsigned char	*buf;
+    const nand_geom_t	*geom;		// NULL - linear image
+    uint64_t		ofs;
+    uint64_t		chunk;
+    size_t		nchunks;
+    uint64_t		size;
+    uint32_t		crcs[CRC_MAX_CHUNKS];
+    size_t		next;		// next chunk, taken atomically by workers
+} crc_job_t;
+
+/* chunks are below 4G, cfe_crc32() takes 32-bit size */
+static uint32_t crc_range(const unsigned char *buf, const nand_geom_t *geom, uint64_t ofs, uint64_t size, uint32_t crc)
+{
+    if (geom)
+	return nand_crc32(geom, buf, ofs, size, crc);
+    buf += ofs;
+    while (size) {
+	uint32_t n = size > 0x40000000 ? 0x40000000 : size;
+	crc = cfe_crc32(buf, n, crc);
+	buf += n;
+	size -= n;
+    }
+    return crc;
+}
+
+static void *crc_worker(void *arg)
+{
+    crc_job_t *job = arg;
+    size_t i;
+
+    while ((i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->nchunks) {
+	uint64_t ofs = i * job->chunk;
+	uint64_t len = ofs + job->chunk > job->size ? job->size - ofs : job->chunk;
+
+	job->crcs[i] = crc_range(job->buf, job->geom, job->ofs + ofs, len, 0);
+    }
+    return NULL;
+}
+
+static uint32_t parallel_crc(const unsigned char *buf, const nand_geom_t *geom, uint64_t ofs, uint64_t size, uint32_t crc, int jobs)
+{
+    pthread_t threads[CRC_MAX_JOBS];
+    crc_job_t *job;
+    size_t i;
+    int started;
+
+    if (jobs <= 0)
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs > CRC_MAX_JOBS)
+	jobs = CRC_MAX_JOBS;
+    if (jobs <= 1 || size < 2 * CRC_CHUNK_MIN)
+	return crc_range(buf, geom, ofs, size, crc);
+
+    job = calloc(1, sizeof(*job));
+    if (!job)
+	return crc_range(buf, geom, ofs, size, crc);
+
+    // several chunks per thread to even out page faults of mapped input
+    job->buf = buf;
+    job->geom = geom;
+    job->ofs = ofs;
+    job->size = size;
+    job->chunk = size / (jobs * 4);
+    if (job->chunk < CRC_CHUNK_MIN)
+	job->chunk = CRC_CHUNK_MIN;
+    job->nchunks = (size + job->chunk - 1) / job->chunk;
+
+    for (started = 0; started < jobs && (size_t)started < job->nchunks; started++)
+	if (pthread_create(&threads[started], NULL, crc_worker, job))
+	    break;
+    crc_worker(job); // leftovers, or everything if no thread started
+    for (i = 0; i < (size_t)started; i++)
+	pthread_join(threads[i], NULL);
+
+    // no pre/post inversion: crc(A|B, c) = shift(crc(A, c), |B|) ^ crc(B, 0)
+    for (i = 0; i < job->nchunks; i++) {
+	uint64_t len = (i + 1) * job->chunk > size ? size - i * job->chunk : job->chunk;
+	crc = crc32_shift(crc, len) ^ job->crcs[i];
+    }
+    free(job);
+    return crc;
+}
+
+uint32_t parallel_crc32(const unsigned char *buf, uint64_t size, uint32_t crc, int jobs)
+{
+    return parallel_crc(buf, NULL, 0, size, crc, jobs);
+}
+
+/* crc (zero initial value) of len 0xFF bytes, by doubling */
+static uint32_t crc32_erased(uint64_t len)
+{
+    static const uint8_t ff = 0xFF;
+    uint32_t crc = 0, block = cfe_crc32(&ff, 1, 0);
+    uint64_t block_len = 1;
+
+    while (len) {
+	if (len & 1)
+	    crc = crc32_shift(crc, block_len) ^ block;
+	block = crc32_shift(block, block_len) ^ block;
+	block_len *= 2;
+	len >>= 1;
+    }
+    return crc;
+}
+
+/* bytes before trailing erased area */
+static uint64_t used_size_linear(const unsigned char *buf, uint64_t size)
+{
+    while (size >= 8) {
+	uint64_t w;
+
+	memcpy(&w, buf + size - 8, sizeof(w));
+	if (w != ~(uint64_t)0)
+	    break;
+	size -= 8;
+    }
+    while (size && buf[size - 1] == 0xFF)
+	size--;
+    return size;
+}
+
+static uint64_t used_size(const unsigned char *buf, const nand_geom_t *geom, uint64_t ofs, uint64_t size)
+{
+    if (!geom)
+	return used_size_linear(buf + ofs, size);
+
+    // page by page from the end, spare areas are not part of data
+    while (size) {
+	uint64_t last = ofs + size - 1;
+	uint64_t n = last % geom->page + 1, used;
+
+	if (n > size)
+	    n = size;
+	used = used_size_linear(buf + nand_raw_offset(geom, ofs + size - n), n);
+	size -= n - used;
+	if (used)
+	    break;
+    }
+    return size;
+}
+
+/*
+ * eltex does not document how primary_crc/backup_crc are computed and none of
+ * these has been confirmed on a fullflash dump, so a value is only accepted if
+ * it matches one of them exactly: cfe crc32 is the nvram crc (init 0xFFFFFFFF,
+ * no final xor, stored big-endian like nvram crc), crc-32 is the zlib one
+ * (final xor). A 32-bit match under one of 8 candidates is not chance (~2^-29),
+ * anything else is an unknown convention, not a proven mismatch.
+ */
+static const struct fwcrc_convention {
+    const char	*name;
+    uint32_t	xorout;
+    int		big_endian;
+} fwcrc_conventions[] = {
+    { "cfe crc32, big-endian",    0,          1 },
+    { "cfe crc32, little-endian", 0,          0 },
+    { "crc-32, big-endian",       0xFFFFFFFF, 1 },
+    { "crc-32, little-endian",    0xFFFFFFFF, 0 },
+};
+
+/* stored as is on flash (host order of raw bytes) */
+static const char *crc_convention(uint32_t stored, uint32_t calc)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(fwcrc_conventions) / sizeof(fwcrc_conventions[0]); i++) {
+	const struct fwcrc_convention *c = &fwcrc_conventions[i];
+	uint32_t v = calc ^ c->xorout;
+
+	if (stored == (c->big_endian ? htobe32(v) : htole32(v)))
+	    return c->name;
+    }
+    return NULL;
+}
+
+int check_firmware_crc(const unsigned char *image, uint64_t size, const nand_geom_t *geom, const unsigned char *nvram, int jobs, fwcrc_result_t res[2])
+{
+#ifdef ENABLE_VENDOR_ELTX
+    const vendor_params_eltx_t *eltx = (const vendor_params_eltx_t *)((const bcm68380_nvram_t *)nvram)->vendor_params;
+    cfe_part_t parts[PART_NUM];
+    int retcode = 0, i;
+
+    if (geom)
+	size = nand_logical_size(geom, size);
+    cfe_nvram_partitions(nvram, parts);
+    memset(res, 0, 2 * sizeof(*res));
+    res[0].name = "primary";
+    res[0].part = parts[PART_ROOTFS1];
+    memcpy(&res[0].stored, &eltx->primary_crc, sizeof(res[0].stored));
+    res[1].name = "backup";
+    res[1].part = parts[PART_ROOTFS2];
+    memcpy(&res[1].stored, &eltx->backup_crc, sizeof(res[1].stored));
+
+    for (i = 0; i < 2; i++) {
+	if (!res[i].part.size || !cfe_part_valid(&res[i].part, size)) {
+	    retcode++;
+	    continue;
+	}
+	res[i].used = used_size(image, geom, res[i].part.offset, res[i].part.size);
+	res[i].calc_used = parallel_crc(image, geom, res[i].part.offset, res[i].used, 0xFFFFFFFF, jobs);
+	res[i].calc = crc32_shift(res[i].calc_used, res[i].part.size - res[i].used) ^
+	    crc32_erased(res[i].part.size - res[i].used);
+
+	if ((res[i].convention = crc_convention(res[i].stored, res[i].calc)))
+	    res[i].match = FWCRC_FULL;
+	else if ((res[i].convention = crc_convention(res[i].stored, res[i].calc_used)))
+	    res[i].match = FWCRC_USED;
+	else
+	    retcode++;
+    }
+    return retcode;
+#else
+    (void)image; (void)size; (void)geom; (void)nvram; (void)jobs; (void)res;
+    return 2;
+#endif
+}
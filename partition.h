@@ -0,0 +1,75 @@
+#ifndef CFE_PARTITION_H
+#define CFE_PARTITION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "image.h"
+#include "nand.h"
+
+enum {
+    PART_BOOT = 0,
+    PART_ROOTFS1,
+    PART_ROOTFS2,
+    PART_DATA,
+    PART_BBT,
+    PART_NUM
+};
+
+/* nand partition from nvram table, in bytes from start of flash (fullflash dump) */
+typedef struct cfe_part {
+    const char	*name;
+    uint64_t	offset;
+    uint64_t	size;
+} cfe_part_t;
+
+/* nandpart_ofs/nandpart_size (kilobytes) of nvram */
+void cfe_nvram_partitions(const unsigned char *nvram, cfe_part_t parts[PART_NUM]);
+
+/* partition is empty or lies inside image of image_size bytes */
+int cfe_part_valid(const cfe_part_t *part, uint64_t image_size);
+
+/* first pair of overlapping non-empty partitions in *a, *b; 0 if none */
+int cfe_part_overlap(const cfe_part_t parts[PART_NUM], int *a, int *b);
+
+/*
+ * write every non-empty partition of fullflash image into <dir>/<name>.bin
+ * (oob stripped if geom is not NULL),
+ * concurrently and without copying data through userspace where the kernel
+ * allows it; partitions outside of image are reported and skipped.
+ * Returns number of failed partitions.
+ */
+int extract_partitions(cfe_image_t *img, const nand_geom_t *geom, const unsigned char *nvram, const char *dir);
+
+/*
+ * cfe_crc32() of buffer split into chunks hashed by jobs threads
+ * (0 - number of cpus), per-chunk crcs are combined with crc32_shift()
+ */
+uint32_t parallel_crc32(const unsigned char *buf, uint64_t size, uint32_t crc, int jobs);
+
+enum {
+    FWCRC_UNKNOWN = 0,	// no known convention matches: other convention or damaged partition
+    FWCRC_FULL,		// whole partition
+    FWCRC_USED,		// partition up to trailing erased (0xFF) area
+};
+
+/* eltex primary_crc/backup_crc check of rootfs1/rootfs2 */
+typedef struct fwcrc_result {
+    const char	*name;		// "primary" or "backup"
+    cfe_part_t	part;
+    uint32_t	stored;		// as in nvram (eltx_primary_crc/eltx_backup_crc)
+    uint32_t	calc;		// whole partition
+    uint32_t	calc_used;	// without trailing erased area
+    uint64_t	used;
+    int		match;		// FWCRC_*
+    const char	*convention;	// FWCRC_FULL/FWCRC_USED: crc convention of stored value
+} fwcrc_result_t;
+
+/*
+ * check both firmware crcs of eltex nvram against fullflash image
+ * (raw nand dump if geom is not NULL, size is raw size),
+ * returns number of crcs not matched (or partitions outside of image)
+ */
+int check_firmware_crc(const unsigned char *image, uint64_t size, const nand_geom_t *geom, const unsigned char *nvram, int jobs, fwcrc_result_t res[2]);
+
+#endif
@@ -0,0 +1,210 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "cfe_nvram.h"
+#include "libcfenvram.h"
+#include "report.h"
+
+static void emit_vendor(emit_t *e, int vendor_type)
+{
+    const char *name = cfe_nvram_vendor_name(vendor_type);
+
+    emit_str(e, "vendor", name, strlen(name));
+}
+
+int report_cfe_nvram(emit_t *e, const char *file, size_t offset, const unsigned char *src_mem, int vendor_type)
+{
+    cfenvram_verify_t v;
+    int vendor_done = 0, i;
+
+    // same checks and error count as cfe_edit -v
+    cfenvram_verify(src_mem, sizeof(bcm68380_nvram_t), vendor_type, &v);
+
+    emit_begin(e);
+    emit_str(e, "file", file, file ? strlen(file) : 0);
+    emit_uint(e, "offset", offset);
+    emit_bool(e, "valid", !v.errors);
+    emit_uint(e, "version", v.version);
+    emit_bool(e, "version_ok", v.version == NVRAM_VERSION);
+    // checksums shown like in text output
+    emit_hex32(e, "crc", v.crc);
+    emit_hex32(e, "crc_calc", v.calc_crc);
+    emit_bool(e, "crc_ok", v.crc_ok);
+    emit_hex32(e, "oldcksum", v.oldcksum);
+    emit_bool(e, "oldcksum_empty", v.oldcksum_state == CFENVRAM_CKSUM_EMPTY);
+    emit_bool(e, "oldcksum_ok", v.oldcksum_state != CFENVRAM_CKSUM_BAD);
+
+    for (i = 0; i < (int)cfe_nvram_fields_num; i++) {
+	const cfe_field_t *f = &cfe_nvram_fields[i];
+
+	// version and checksums are reported above with their check results
+	if (f->flags & FIELD_F_READONLY)
+	    continue;
+	// "vendor" column goes before the first vendor-specific field
+	if (f->vendor && !vendor_done) {
+	    emit_vendor(e, vendor_type);
+	    vendor_done = 1;
+	}
+	// vendor columns are always present, null when layout does not match
+	if (f->vendor && f->vendor != vendor_type) {
+	    emit_null(e, f->name);
+	    continue;
+	}
+
+	switch (f->type) {
+	    case FIELD_STR:
+		emit_str(e, f->name, (const char *)src_mem + f->offset, f->size);
+		break;
+	    case FIELD_MAC:
+	    case FIELD_BYTES:
+		emit_bytes(e, f->name, src_mem + f->offset, f->size);
+		break;
+	    case FIELD_U32:
+		emit_hex32(e, f->name, cfe_nvram_get_uint(src_mem, f));
+		break;
+	    default:
+		emit_uint(e, f->name, cfe_nvram_get_uint(src_mem, f));
+		break;
+	}
+    }
+    if (!vendor_done)
+	emit_vendor(e, vendor_type);
+    emit_end(e);
+
+    return v.errors;
+}
+
+void report_cfe_nvram_header(emit_t *e)
+{
+    static const unsigned char empty[sizeof(bcm68380_nvram_t)];
+
+    e->header = 1;
+    report_cfe_nvram(e, NULL, 0, empty, 0);
+    e->header = 0;
+}
+
+void report_flash_map(emit_t *e, const char *file, const flash_map_t *m, const flash_part_usage_t *usage)
+{
+    static const char *used_names[PART_NUM] = { "boot_used_pct", "rootfs1_used_pct", "rootfs2_used_pct", "data_used_pct", "bbt_used_pct" };
+    static const char *outside_names[PART_NUM] = { "boot_outside", "rootfs1_outside", "rootfs2_outside", "data_outside", "bbt_outside" };
+    int i;
+
+    emit_begin(e);
+    emit_str(e, "file", file, file ? strlen(file) : 0);
+    emit_uint(e, "size", m->size);
+    emit_uint(e, "erase_block", m->block);
+    emit_uint(e, "blocks", m->blocks);
+    emit_uint(e, "used_blocks", m->used_blocks);
+    emit_double(e, "used_pct", m->blocks ? 100.0 * m->used_blocks / m->blocks : 0.0);
+    emit_uint(e, "runs", m->runs_num);
+    emit_uint(e, "trailing_erased", flash_map_trailing_erased(m));
+    for (i = 0; i < PART_NUM; i++) {
+	if (!usage || !usage[i].blocks) {
+	    emit_null(e, used_names[i]);
+	    emit_null(e, outside_names[i]);
+	    continue;
+	}
+	emit_double(e, used_names[i], 100.0 * usage[i].used_blocks / usage[i].blocks);
+	emit_bool(e, outside_names[i], usage[i].outside);
+    }
+    emit_end(e);
+}
+
+void report_flash_map_header(emit_t *e)
+{
+    flash_map_t m = { 0 };
+
+    e->header = 1;
+    report_flash_map(e, NULL, &m, NULL);
+    e->header = 0;
+}
+
+void report_boot(emit_t *e, const char *file, const bootfs_result_t *res)
+{
+    static const char *fs_names[2] = { "rootfs1_fs", "rootfs2_fs" };
+    static const char *cferam_names[2] = { "rootfs1_cferam", "rootfs2_cferam" };
+    int i;
+
+    emit_begin(e);
+    emit_str(e, "file", file, file ? strlen(file) : 0);
+    emit_uint(e, "bootline_p", res ? res->previous : 0);
+    for (i = 0; i < 2; i++) {
+	const char *fs = res ? bootfs_name(res->rootfs[i].fs) : "";
+
+	emit_str(e, fs_names[i], fs, strlen(fs));
+	if (!res || res->rootfs[i].cferam < 0)
+	    emit_null(e, cferam_names[i]);
+	else
+	    emit_uint(e, cferam_names[i], res->rootfs[i].cferam);
+    }
+    if (!res || res->boot < 0) {
+	emit_null(e, "boot");
+	emit_null(e, "cferam");
+    } else {
+	emit_str(e, "boot", res->rootfs[res->boot].part.name, strlen(res->rootfs[res->boot].part.name));
+	emit_uint(e, "cferam", res->rootfs[res->boot].cferam);
+    }
+    emit_str(e, "reason", res ? res->reason : "", res ? strlen(res->reason) : 0);
+    emit_uint(e, "bytes_read", res ? res->rootfs[0].bytes_read + res->rootfs[1].bytes_read : 0);
+    emit_end(e);
+}
+
+void report_boot_header(emit_t *e)
+{
+    e->header = 1;
+    report_boot(e, NULL, NULL);
+    e->header = 0;
+}
+
+void report_secboot(emit_t *e, const char *file, const secboot_result_t *res)
+{
+    static const char *cferam_names[2] = { "rootfs1_cferam", "rootfs2_cferam" };
+    static const char *status_names[2] = { "rootfs1_secboot", "rootfs2_secboot" };
+    static const char *digest_names[2] = { "rootfs1_sha256", "rootfs2_sha256" };
+    const char *code, *error;
+    int i, boot = res ? res->boot.boot : -1;
+
+    emit_begin(e);
+    emit_str(e, "file", file, file ? strlen(file) : 0);
+    for (i = 0; i < 2; i++) {
+	if (!res || res->boot.rootfs[i].cferam < 0) {
+	    emit_null(e, cferam_names[i]);
+	    emit_null(e, status_names[i]);
+	    emit_null(e, digest_names[i]);
+	    continue;
+	}
+	code = secboot_code(res->rootfs[i].status);
+	emit_uint(e, cferam_names[i], res->boot.rootfs[i].cferam);
+	emit_str(e, status_names[i], code, strlen(code));
+	if (res->rootfs[i].status == SECBOOT_NOIMAGE)
+	    emit_null(e, digest_names[i]);
+	else
+	    emit_bytes(e, digest_names[i], res->rootfs[i].digest, sizeof(res->rootfs[i].digest));
+    }
+    if (boot < 0) {
+	emit_null(e, "boot");
+	emit_null(e, "cferam");
+	emit_null(e, "secboot");
+	error = res ? res->boot.reason : "";
+    } else {
+	const secboot_image_t *img = &res->rootfs[boot];
+
+	emit_str(e, "boot", res->boot.rootfs[boot].part.name, strlen(res->boot.rootfs[boot].part.name));
+	emit_uint(e, "cferam", res->boot.rootfs[boot].cferam);
+	code = secboot_code(img->status);
+	emit_str(e, "secboot", code, strlen(code));
+	error = img->status == SECBOOT_PASS ? "" : img->reason ? img->reason : secboot_desc(img->status);
+    }
+    emit_str(e, "error", error, strlen(error));
+    emit_uint(e, "errors", res ? res->errors : 0);
+    emit_end(e);
+}
+
+void report_secboot_header(emit_t *e)
+{
+    e->header = 1;
+    report_secboot(e, NULL, NULL);
+    e->header = 0;
+}
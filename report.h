@@ -0,0 +1,33 @@
+#ifndef CFE_REPORT_H
+#define CFE_REPORT_H
+
+#include <stddef.h>
+
+#include "bootfs.h"
+#include "emit.h"
+#include "flashmap.h"
+#include "secboot.h"
+
+/*
+ * emit one machine-readable record for nvram block at src_mem
+ * (stable field names, same columns for every vendor type),
+ * returns number of errors like verify_cfe_nvram()
+ */
+int report_cfe_nvram(emit_t *e, const char *file, size_t offset, const unsigned char *src_mem, int vendor_type);
+
+/* csv header line matching report_cfe_nvram() columns */
+void report_cfe_nvram_header(emit_t *e);
+
+/* --map summary record: usage NULL - no valid nvram, partition columns are empty */
+void report_flash_map(emit_t *e, const char *file, const flash_map_t *m, const flash_part_usage_t *usage);
+void report_flash_map_header(emit_t *e);
+
+/* --boot record: per-rootfs filesystem and cferam, booted rootfs (res NULL - header only) */
+void report_boot(emit_t *e, const char *file, const bootfs_result_t *res);
+void report_boot_header(emit_t *e);
+
+/* --secboot record: authentication result of both cferam.### and of booted one (res NULL - header only) */
+void report_secboot(emit_t *e, const char *file, const secboot_result_t *res);
+void report_secboot_header(emit_t *e);
+
+#endif
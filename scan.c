@@ -0,0 +1,130 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SCAN_X86 1
+#endif
+
+#include "cfe_nvram.h"
+#include "scan.h"
+
+/*
+ * Prefilter: every candidate starts with big-endian version 6 (00 00 00 06).
+ * Find functions return first offset in [from, end) where that pattern starts, or end.
+ * Caller guarantees that buf[end + 2] is readable.
+ */
+typedef size_t (*find_version_fn)(const unsigned char *buf, size_t from, size_t end);
+
+static size_t find_version_generic(const unsigned char *buf, size_t from, size_t end)
+{
+    while (from < end) {
+	const unsigned char *p = memchr(buf + from + 3, NVRAM_VERSION, end - from);
+	if (!p)
+	    break;
+	size_t pos = p - buf - 3;
+	if (!buf[pos] && !buf[pos + 1] && !buf[pos + 2])
+	    return pos;
+	from = pos + 1;
+    }
+    return end;
+}
+
+#ifdef HAVE_SCAN_X86
+/* SSE2 is baseline on x86-64 */
+static size_t find_version_sse2(const unsigned char *buf, size_t from, size_t end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ver = _mm_set1_epi8(NVRAM_VERSION);
+
+    while (from + 16 <= end) {
+	__m128i b0 = _mm_loadu_si128((const __m128i *)(buf + from));
+	__m128i b1 = _mm_loadu_si128((const __m128i *)(buf + from + 1));
+	__m128i b2 = _mm_loadu_si128((const __m128i *)(buf + from + 2));
+	__m128i b3 = _mm_loadu_si128((const __m128i *)(buf + from + 3));
+	__m128i m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)),
+				  _mm_and_si128(_mm_cmpeq_epi8(b2, zero), _mm_cmpeq_epi8(b3, ver)));
+	unsigned int mask = _mm_movemask_epi8(m);
+
+	if (mask)
+	    return from + __builtin_ctz(mask);
+	from += 16;
+    }
+    return find_version_generic(buf, from, end);
+}
+
+__attribute__((target("avx2")))
+static size_t find_version_avx2(const unsigned char *buf, size_t from, size_t end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ver = _mm256_set1_epi8(NVRAM_VERSION);
+
+    while (from + 32 <= end) {
+	__m256i b3 = _mm256_loadu_si256((const __m256i *)(buf + from + 3));
+	__m256i m = _mm256_cmpeq_epi8(b3, ver);
+
+	// erased/zero flash has no 0x06 at all, check the rest only on hit
+	if (_mm256_testz_si256(m, m)) {
+	    from += 32;
+	    continue;
+	}
+
+	__m256i b0 = _mm256_loadu_si256((const __m256i *)(buf + from));
+	__m256i b1 = _mm256_loadu_si256((const __m256i *)(buf + from + 1));
+	__m256i b2 = _mm256_loadu_si256((const __m256i *)(buf + from + 2));
+	m = _mm256_and_si256(m, _mm256_and_si256(_mm256_cmpeq_epi8(b0, zero),
+			     _mm256_and_si256(_mm256_cmpeq_epi8(b1, zero), _mm256_cmpeq_epi8(b2, zero))));
+	unsigned int mask = _mm256_movemask_epi8(m);
+
+	if (mask)
+	    return from + __builtin_ctz(mask);
+	from += 32;
+    }
+    return find_version_sse2(buf, from, end);
+}
+#endif
+
+static find_version_fn select_find_version(void)
+{
+#ifdef HAVE_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+	return find_version_avx2;
+    return find_version_sse2;
+#else
+    return find_version_generic;
+#endif
+}
+
+size_t scan_cfe_nvram(const unsigned char *buf, size_t size, nvram_hit_t *hits, size_t max_hits, size_t *rejected)
+{
+    find_version_fn find_version = select_find_version();
+    size_t found = 0, bad = 0;
+    size_t pos = 0, end;
+
+    if (size < sizeof(bcm68380_nvram_t))
+	goto exit;
+    end = size - sizeof(bcm68380_nvram_t) + 1;
+
+    while ((pos = find_version(buf, pos, end)) < end) {
+	if (check_cfe_nvram(buf + pos)) {
+	    bad++;
+	    pos++;
+	    continue;
+	}
+
+	if (found < max_hits) {
+	    hits[found].offset = pos;
+	    hits[found].vendor_type = detect_cfe_nvram_vendor(buf + pos);
+	}
+	found++;
+	// valid blocks do not overlap
+	pos += sizeof(bcm68380_nvram_t);
+    }
+
+    exit:
+    if (rejected)
+	*rejected = bad;
+    return found;
+}
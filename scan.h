@@ -0,0 +1,18 @@
+#ifndef CFE_SCAN_H
+#define CFE_SCAN_H
+
+#include <stddef.h>
+
+typedef struct nvram_hit {
+    size_t	offset;
+    int		vendor_type;
+} nvram_hit_t;
+
+/*
+ * find every valid bcm68380_nvram_t in buffer (version 6, crc and oldcksum ok).
+ * Up to max_hits results stored in hits, returns total number of found blocks;
+ * rejected (version matched, checksum not) candidates counted in *rejected.
+ */
+size_t scan_cfe_nvram(const unsigned char *buf, size_t size, nvram_hit_t *hits, size_t max_hits, size_t *rejected);
+
+#endif
@@ -0,0 +1,482 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "bootlog.h"
+#include "image.h"
+#include "secboot.h"
+
+#define MP_WORDS	(SECBOOT_KEY_MAX / 4)
+#define KEY_FILE_MAX	(64 << 10)
+#define RSA_E_DEFAULT	65537
+
+/* SHA-256 input limit (2^61 - 1 bytes), CFEROM ERRA */
+#define SHA256_MSG_MAX	((1ULL << 61) - 1)
+
+static const char *codes[] = {
+    "PASS", "ERRA", "ERRB", "ERRC", "ERRD", "ERRE", "ERRF", "ERRG", "ERRH", "ERRI", "ERRJ", "ERRK", "ERRL", "ERRM", "NONE",
+};
+
+const char *secboot_code(int status)
+{
+    return status >= SECBOOT_PASS && status <= SECBOOT_NOIMAGE ? codes[status] : "?";
+}
+
+const char *secboot_desc(int status)
+{
+    const bootlog_code_t *c;
+
+    if (status == SECBOOT_PASS)
+	return "CFE RAM bootloader authenticated (boot_secure)";
+    if (status == SECBOOT_NOIMAGE)
+	return "no cferam.### to authenticate";
+    c = bootlog_lookup(secboot_code(status));
+    return c ? c->desc : "?";
+}
+
+int secboot_init(void)
+{
+    return sha256_init() + bootlog_init();
+}
+
+/*
+ * key file parsing: PEM armor, DER of SubjectPublicKeyInfo
+ * (SEQUENCE { AlgorithmIdentifier, BIT STRING { RSAPublicKey } })
+ * or RSAPublicKey itself (SEQUENCE { INTEGER n, INTEGER e })
+ */
+static size_t base64_decode(const unsigned char *src, size_t len, unsigned char *dst)
+{
+    uint32_t acc = 0;
+    size_t i, out = 0;
+    int bits = 0;
+
+    for (i = 0; i < len; i++) {
+	int v, c = src[i];
+
+	if (c >= 'A' && c <= 'Z')
+	    v = c - 'A';
+	else if (c >= 'a' && c <= 'z')
+	    v = c - 'a' + 26;
+	else if (c >= '0' && c <= '9')
+	    v = c - '0' + 52;
+	else if (c == '+')
+	    v = 62;
+	else if (c == '/')
+	    v = 63;
+	else if (c == '=')
+	    break;
+	else
+	    continue; // line breaks
+	acc = acc << 6 | v;
+	bits += 6;
+	if (bits >= 8) {
+	    bits -= 8;
+	    dst[out++] = acc >> bits;
+	}
+    }
+    return out;
+}
+
+/* tag and length of DER element at *p, *p moved to its contents; 1 if malformed */
+static int der_item(const unsigned char **p, const unsigned char *end, int tag, size_t *len)
+{
+    const unsigned char *q = *p;
+    size_t n = 0;
+    int i, bytes;
+
+    if (end - q < 2 || q[0] != tag)
+	return 1;
+    q++;
+    if (*q < 0x80)
+	n = *q++;
+    else {
+	bytes = *q++ & 0x7F;
+	if (bytes < 1 || bytes > 4 || end - q < bytes)
+	    return 1;
+	for (i = 0; i < bytes; i++)
+	    n = n << 8 | *q++;
+    }
+    if (n > (size_t)(end - q))
+	return 1;
+    *p = q;
+    *len = n;
+    return 0;
+}
+
+static int der_rsa_key(const unsigned char *p, const unsigned char *end, secboot_key_t *key)
+{
+    size_t len, n_len, e_len;
+    const unsigned char *n;
+
+    if (der_item(&p, end, 0x30, &len))
+	return 1;
+    end = p + len;
+    if (der_item(&p, end, 0x02, &n_len))
+	return 1;
+    n = p;
+    p += n_len;
+    if (der_item(&p, end, 0x02, &e_len) || !e_len || e_len > 4 + (p[0] == 0))
+	return 1;
+    for (key->e = 0; e_len--; p++)
+	key->e = key->e << 8 | *p;
+    while (n_len && !*n) {
+	n++;
+	n_len--;
+    }
+    if (!n_len || n_len > sizeof(key->n))
+	return 1;
+    memcpy(key->n, n, n_len);
+    key->n_len = n_len;
+    return 0;
+}
+
+static int der_public_key(const unsigned char *p, const unsigned char *end, secboot_key_t *key)
+{
+    const unsigned char *q = p;
+    size_t len;
+
+    if (der_item(&q, end, 0x30, &len))
+	return 1;
+    if (len && q[0] == 0x02)
+	return der_rsa_key(p, end, key);
+    // SubjectPublicKeyInfo: algorithm (rsaEncryption or RSASSA-PSS) skipped, key is in bit string
+    end = q + len;
+    if (der_item(&q, end, 0x30, &len))
+	return 1;
+    q += len;
+    if (der_item(&q, end, 0x03, &len) || !len || q[0] != 0)
+	return 1;
+    return der_rsa_key(q + 1, q + len, key);
+}
+
+int secboot_load_key(const char *path, secboot_key_t *key)
+{
+    static const char pem_begin[] = "-----BEGIN ";
+    cfe_image_t f;
+    unsigned char *der = NULL;
+    const unsigned char *p;
+    size_t len;
+    unsigned b;
+    int retcode = 0;
+
+    memset(key, 0, sizeof(*key));
+    if (image_open(&f, path, 0))
+	return 1;
+    if (f.size > KEY_FILE_MAX) {
+	fprintf(stderr, "%s: too large for a public key\n", path);
+	image_close(&f);
+	return 1;
+    }
+    p = f.mem;
+    len = f.size;
+    if (len > sizeof(pem_begin) && !memcmp(p, pem_begin, sizeof(pem_begin) - 1)) {
+	// base64 between armor lines
+	const unsigned char *body = memchr(p, '\n', len), *stop;
+
+	stop = body ? memmem(body, p + len - body, "-----END ", 9) : NULL;
+	if (!stop || !(der = malloc(stop - body))) {
+	    fprintf(stderr, "%s: PEM armor is not complete\n", path);
+	    image_close(&f);
+	    return 1;
+	}
+	len = base64_decode(body, stop - body, der);
+	p = der;
+    }
+
+    if (len && p[0] == 0x30) {
+	if (der_public_key(p, p + len, key)) {
+	    fprintf(stderr, "%s: not an RSA public key (SubjectPublicKeyInfo or RSAPublicKey)\n", path);
+	    retcode++;
+	}
+    } else if (!der && len >= 64 && len <= sizeof(key->n) && p[0]) {
+	// modulus as stored in cferom
+	memcpy(key->n, p, len);
+	key->n_len = len;
+	key->e = RSA_E_DEFAULT;
+    } else {
+	fprintf(stderr, "%s: unknown public key format (PEM, DER or raw modulus expected)\n", path);
+	retcode++;
+    }
+    if (!retcode) {
+	for (b = 8; b && !(key->n[0] & (1 << (b - 1))); b--);
+	key->bits = (key->n_len - 1) * 8 + b;
+    }
+    free(der);
+    image_close(&f);
+    return retcode;
+}
+
+/*
+ * RSA public operation: Montgomery multiplication (CIOS) on 32-bit
+ * limbs, least significant first; R = 2^(32 * words)
+ */
+typedef struct mont {
+    uint32_t	n[MP_WORDS];
+    uint32_t	rr[MP_WORDS];	// R^2 mod n
+    uint32_t	n0;		// -n^-1 mod 2^32
+    int		words;
+} mont_t;
+
+static void mp_from_bytes(uint32_t *a, int words, const unsigned char *p, size_t len)
+{
+    size_t i;
+
+    memset(a, 0, words * sizeof(*a));
+    for (i = 0; i < len; i++)
+	a[i / 4] |= (uint32_t)p[len - 1 - i] << (8 * (i % 4));
+}
+
+static void mp_to_bytes(unsigned char *p, size_t len, const uint32_t *a)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	p[len - 1 - i] = a[i / 4] >> (8 * (i % 4));
+}
+
+/* a >= b */
+static int mp_ge(const uint32_t *a, const uint32_t *b, int words)
+{
+    while (words--)
+	if (a[words] != b[words])
+	    return a[words] > b[words];
+    return 1;
+}
+
+static uint32_t mp_sub(uint32_t *a, const uint32_t *b, int words)
+{
+    uint64_t borrow = 0;
+    int i;
+
+    for (i = 0; i < words; i++) {
+	uint64_t d = (uint64_t)a[i] - b[i] - borrow;
+	a[i] = d;
+	borrow = d >> 63;
+    }
+    return borrow;
+}
+
+/* r = a * b / R mod n, r may alias a or b */
+static void mont_mul(const mont_t *m, uint32_t *r, const uint32_t *a, const uint32_t *b)
+{
+    uint32_t t[MP_WORDS + 2] = { 0 };
+    int i, j, k = m->words;
+
+    for (i = 0; i < k; i++) {
+	uint64_t c = 0;
+	uint32_t u;
+
+	for (j = 0; j < k; j++) {
+	    c += (uint64_t)a[j] * b[i] + t[j];
+	    t[j] = c;
+	    c >>= 32;
+	}
+	c += t[k];
+	t[k] = c;
+	t[k + 1] = c >> 32;
+
+	u = t[0] * m->n0;
+	c = ((uint64_t)u * m->n[0] + t[0]) >> 32;
+	for (j = 1; j < k; j++) {
+	    c += (uint64_t)u * m->n[j] + t[j];
+	    t[j - 1] = c;
+	    c >>= 32;
+	}
+	c += t[k];
+	t[k - 1] = c;
+	t[k] = t[k + 1] + (c >> 32);
+    }
+    if (t[k] || mp_ge(t, m->n, k))
+	mp_sub(t, m->n, k);
+    memcpy(r, t, k * sizeof(*r));
+}
+
+/* 1 if n is even (no Montgomery form, CFEROM reports a failed MP division) */
+static int mont_init(mont_t *m, const secboot_key_t *key)
+{
+    uint32_t inv = 1;
+    int i, j, top;
+
+    m->words = (key->n_len + 3) / 4;
+    mp_from_bytes(m->n, m->words, key->n, key->n_len);
+    if (!(m->n[0] & 1))
+	return 1;
+    for (i = 0; i < 5; i++)
+	inv *= 2 - m->n[0] * inv;	// Newton, bits double every step
+    m->n0 = -inv;
+
+    // R^2 mod n by doubling 1 (2 * 32 * words times)
+    memset(m->rr, 0, sizeof(m->rr));
+    m->rr[0] = 1;
+    for (i = 0; i < 64 * m->words; i++) {
+	top = m->rr[m->words - 1] >> 31;
+	for (j = m->words - 1; j > 0; j--)
+	    m->rr[j] = m->rr[j] << 1 | m->rr[j - 1] >> 31;
+	m->rr[0] <<= 1;
+	if (top || mp_ge(m->rr, m->n, m->words))
+	    mp_sub(m->rr, m->n, m->words);
+    }
+    return 0;
+}
+
+/* r = s^e mod n */
+static void mont_exp(const mont_t *m, uint32_t *r, const uint32_t *s, uint32_t e)
+{
+    uint32_t sm[MP_WORDS], acc[MP_WORDS], one[MP_WORDS] = { 1 };
+    int bit;
+
+    mont_mul(m, sm, s, m->rr);
+    memcpy(acc, sm, sizeof(acc));
+    for (bit = 31; bit >= 0 && !(e >> bit & 1); bit--);
+    while (--bit >= 0) {
+	mont_mul(m, acc, acc, acc);
+	if (e >> bit & 1)
+	    mont_mul(m, acc, acc, sm);
+    }
+    mont_mul(m, r, acc, one);
+}
+
+/* MGF1 with SHA-256, mask xored into db */
+static void mgf1_xor(unsigned char *db, size_t len, const uint8_t *seed)
+{
+    uint8_t block[SHA256_DIGEST_LEN + 4], mask[SHA256_DIGEST_LEN];
+    uint32_t counter;
+    size_t i, done;
+
+    memcpy(block, seed, SHA256_DIGEST_LEN);
+    for (counter = 0, done = 0; done < len; counter++) {
+	block[SHA256_DIGEST_LEN] = counter >> 24;
+	block[SHA256_DIGEST_LEN + 1] = counter >> 16;
+	block[SHA256_DIGEST_LEN + 2] = counter >> 8;
+	block[SHA256_DIGEST_LEN + 3] = counter;
+	sha256(block, sizeof(block), mask);
+	for (i = 0; i < SHA256_DIGEST_LEN && done < len; i++)
+	    db[done++] ^= mask[i];
+    }
+}
+
+/* EMSA-PSS-VERIFY (RFC 8017 9.1.2) of message representative em, steps mapped to CFEROM codes */
+static int pss_verify(const unsigned char *em, size_t em_len, unsigned em_bits, const uint8_t *digest)
+{
+    unsigned char db[SECBOOT_KEY_MAX];
+    size_t db_len = em_len - SHA256_DIGEST_LEN - 1, ps_len, i;
+    const uint8_t *h = em + db_len;
+    uint8_t mprime[8 + 2 * SHA256_DIGEST_LEN], hash[SHA256_DIGEST_LEN];
+    unsigned top = 8 * em_len - em_bits;	// bits of first byte above em_bits
+
+    if (em_len < SHA256_DIGEST_LEN + SECBOOT_SALT_LEN + 2)
+	return SECBOOT_ERRE;
+    if (em[em_len - 1] != 0xbc)
+	return SECBOOT_ERRJ;
+    if (em[0] & (0xFF00 >> top))
+	return SECBOOT_ERRI;
+
+    memcpy(db, em, db_len);
+    mgf1_xor(db, db_len, h);
+    db[0] &= 0xFF >> top;
+
+    // PS zeros, 0x01, salt: 0x01 elsewhere means another salt length
+    ps_len = db_len - SECBOOT_SALT_LEN - 1;
+    for (i = 0; i < db_len && !db[i]; i++);
+    if (i != ps_len)
+	return i < db_len && db[i] == 0x01 ? SECBOOT_ERRF : SECBOOT_ERRK;
+    if (db[ps_len] != 0x01)
+	return SECBOOT_ERRK;
+
+    memset(mprime, 0, 8);
+    memcpy(mprime + 8, digest, SHA256_DIGEST_LEN);
+    memcpy(mprime + 8 + SHA256_DIGEST_LEN, db + db_len - SECBOOT_SALT_LEN, SECBOOT_SALT_LEN);
+    sha256(mprime, sizeof(mprime), hash);
+    return memcmp(hash, h, SHA256_DIGEST_LEN) ? SECBOOT_ERRL : SECBOOT_PASS;
+}
+
+int secboot_verify(const secboot_key_t *key, const unsigned char *file, uint64_t size, secboot_image_t *res)
+{
+    uint32_t s[MP_WORDS], m[MP_WORDS];
+    unsigned char em[SECBOOT_KEY_MAX + 1];
+    unsigned em_bits = key->bits - 1;
+    size_t em_len = (em_bits + 7) / 8;
+    mont_t mont;
+
+    res->size = size;
+    res->reason = NULL;
+    memset(res->digest, 0, sizeof(res->digest));
+    if (size < key->n_len)
+	return res->status = SECBOOT_ERRB;
+    if (size - key->n_len > SHA256_MSG_MAX)
+	return res->status = SECBOOT_ERRA;
+    // hash first: a key of wrong size still shows which image was looked at
+    sha256(file + key->n_len, size - key->n_len, res->digest);
+    if (key->n_len != SECBOOT_KEY_LEN)
+	return res->status = SECBOOT_ERRD;
+    if (mont_init(&mont, key))
+	return res->status = SECBOOT_ERRG;
+    mp_from_bytes(s, mont.words, file, key->n_len);
+    if (mp_ge(s, mont.n, mont.words))
+	return res->status = SECBOOT_ERRG;
+
+    mont_exp(&mont, m, s, key->e);
+    // modulus length minus em_len leading bytes must be zero (one byte when bits - 1 is a multiple of 8)
+    mp_to_bytes(em, key->n_len, m);
+    if (key->n_len > em_len && em[0])
+	return res->status = SECBOOT_ERRI;
+    return res->status = pss_verify(em + key->n_len - em_len, em_len, em_bits, res->digest);
+}
+
+/* one rootfs, own thread */
+typedef struct rootfs_check {
+    const secboot_key_t	*key;
+    const unsigned char	*image;
+    uint64_t		size;
+    const nand_geom_t	*geom;
+    uint64_t		block;
+    const bootfs_part_t	*part;
+    secboot_image_t	*res;
+} rootfs_check_t;
+
+static void *check_rootfs(void *arg)
+{
+    rootfs_check_t *c = arg;
+    unsigned char *data;
+    uint64_t len;
+
+    memset(c->res, 0, sizeof(*c->res));
+    if (bootfs_read_cferam(c->image, c->size, c->geom, c->block, c->part, &data, &len, &c->res->reason)) {
+	c->res->status = SECBOOT_NOIMAGE;
+	return NULL;
+    }
+    secboot_verify(c->key, data, len, c->res);
+    free(data);
+    return NULL;
+}
+
+int secboot_check(const secboot_key_t *key, const unsigned char *image, uint64_t size, const nand_geom_t *geom,
+    const unsigned char *nvram, uint64_t block, int parallel, secboot_result_t *res)
+{
+    rootfs_check_t checks[2];
+    pthread_t thread;
+    int i, threaded = 0;
+
+    memset(res, 0, sizeof(*res));
+    bootfs_analyze(image, size, geom, nvram, block, parallel, &res->boot);
+    for (i = 0; i < 2; i++)
+	checks[i] = (rootfs_check_t){ key, image, size, geom, block, &res->boot.rootfs[i], &res->rootfs[i] };
+
+    // cferam of each rootfs is read and hashed independently
+    if (parallel)
+	threaded = !pthread_create(&thread, NULL, check_rootfs, &checks[1]);
+    check_rootfs(&checks[0]);
+    if (threaded)
+	pthread_join(thread, NULL);
+    else
+	check_rootfs(&checks[1]);
+
+    // a rootfs without cferam is not an error as long as the other one boots
+    res->errors = res->boot.boot < 0;
+    for (i = 0; i < 2; i++)
+	res->errors += res->boot.rootfs[i].cferam >= 0 && res->rootfs[i].status != SECBOOT_PASS;
+    return res->errors;
+}
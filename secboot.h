@@ -0,0 +1,85 @@
+#ifndef CFE_SECBOOT_H
+#define CFE_SECBOOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bootfs.h"
+#include "nand.h"
+#include "sha256.h"
+
+#define SECBOOT_KEY_MAX		512	// longest modulus accepted by secboot_load_key() (4096 bits)
+#define SECBOOT_KEY_LEN		256	// CFEROM authenticates with RSA-2048 only
+#define SECBOOT_SALT_LEN	SHA256_DIGEST_LEN
+
+/* RSA public key, big-endian modulus without leading zero bytes */
+typedef struct secboot_key {
+    unsigned char	n[SECBOOT_KEY_MAX];
+    size_t		n_len;
+    unsigned		bits;
+    uint32_t		e;
+} secboot_key_t;
+
+/* authentication result, same classes as CFEROM console codes (cfe_debug_prints.txt) */
+enum {
+    SECBOOT_PASS = 0,
+    SECBOOT_ERRA,	// message larger than SHA-256 can sign
+    SECBOOT_ERRB,	// signature block wrong size
+    SECBOOT_ERRC,	// digest wrong size
+    SECBOOT_ERRD,	// public key modulus wrong size
+    SECBOOT_ERRE,	// encoded message too small for hash and salt
+    SECBOOT_ERRF,	// salt (seed) length is not SHA-256 digest length
+    SECBOOT_ERRG,	// MP division failed: signature not below modulus, even modulus
+    SECBOOT_ERRH,	// mask of requested length cannot be generated
+    SECBOOT_ERRI,	// message representative has bits above encoded message length
+    SECBOOT_ERRJ,	// message representative does not end with 0xbc
+    SECBOOT_ERRK,	// recovered MB' padding is not null
+    SECBOOT_ERRL,	// computed hash does not match recovered hash
+    SECBOOT_ERRM,	// unknown SHA-256 error
+    SECBOOT_NOIMAGE,	// no cferam.### to authenticate or it cannot be read
+};
+
+typedef struct secboot_image {
+    int		status;		// SECBOOT_*
+    const char	*reason;	// SECBOOT_NOIMAGE: why
+    uint64_t	size;		// cferam.### file size
+    uint8_t	digest[SHA256_DIGEST_LEN];	// of signed payload (after signature)
+} secboot_image_t;
+
+typedef struct secboot_result {
+    bootfs_result_t	boot;
+    secboot_image_t	rootfs[2];
+    int			errors;		// cferam.### failing authentication, nothing to boot
+} secboot_result_t;
+
+/* sha256 engine selection and bootlog code table, once before any thread uses them */
+int secboot_init(void);
+
+/*
+ * public key from PEM or DER (SubjectPublicKeyInfo or PKCS#1 RSAPublicKey),
+ * or raw big-endian modulus as kept in cferom (e = 65537). Prints why on error.
+ */
+int secboot_load_key(const char *path, secboot_key_t *key);
+
+/*
+ * authenticate cferam.### contents the way CFEROM does: RSA-PSS signature
+ * (modulus length) followed by the signed image, SHA-256 and MGF1-SHA-256,
+ * salt of digest length. Returns res->status.
+ */
+int secboot_verify(const secboot_key_t *key, const unsigned char *file, uint64_t size, secboot_image_t *res);
+
+/*
+ * boot search of fullflash dump (bootfs_analyze()), then cferam.### of both
+ * rootfs authenticated (second one in own thread if parallel).
+ * Returns res->errors.
+ */
+int secboot_check(const secboot_key_t *key, const unsigned char *image, uint64_t size, const nand_geom_t *geom,
+    const unsigned char *nvram, uint64_t block, int parallel, secboot_result_t *res);
+
+/* "PASS", "ERRA".."ERRM", "NONE" */
+const char *secboot_code(int status);
+
+/* CFEROM meaning of status (bootlog code table) */
+const char *secboot_desc(int status);
+
+#endif
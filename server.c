@@ -0,0 +1,579 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "cfe_nvram.h"
+#include "emit.h"
+#include "image.h"
+#include "libcfenvram.h"
+#include "report.h"
+#include "server.h"
+
+#define CACHE_MAX 256	// mapped images kept open (one fd each)
+
+/*
+ * nvram block lock of one path: entries of the same file (read-only one replaced
+ * by writable, stale or evicted ones still in use) map the same pages
+ */
+typedef struct path_lock {
+    struct path_lock	*next;
+    char		*path;
+    int			refs;		// entries using it
+    pthread_rwlock_t	rwlock;
+} path_lock_t;
+
+/* mapped image, shared by requests; nvram block is edited under write lock */
+typedef struct cache_entry {
+    struct cache_entry	*next;
+    char		*path;
+    cfe_image_t		image;
+    int			writable;
+    int			refs;		// requests using it, +1 while listed
+    dev_t		dev;
+    ino_t		ino;
+    off_t		size;
+    struct timespec	mtime;
+    path_lock_t		*lock;
+} cache_entry_t;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static cache_entry_t *cache;		// most recently used first
+static int cache_num;
+static path_lock_t *locks;		// of all entries, listed or still in use
+
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+static volatile sig_atomic_t stop;
+
+static int server_nvram_offset;
+static int server_vendor_type;
+
+static path_lock_t *lock_get_locked(const char *path)
+{
+    path_lock_t *l;
+
+    for (l = locks; l; l = l->next)
+	if (!strcmp(l->path, path)) {
+	    l->refs++;
+	    return l;
+	}
+    l = calloc(1, sizeof(*l));
+    if (!l || !(l->path = strdup(path))) {
+	free(l);
+	return NULL;
+    }
+    l->refs = 1;
+    pthread_rwlock_init(&l->rwlock, NULL);
+    l->next = locks;
+    locks = l;
+    return l;
+}
+
+static void lock_put_locked(path_lock_t *l)
+{
+    path_lock_t **prev;
+
+    if (--l->refs)
+	return;
+    for (prev = &locks; *prev != l; prev = &(*prev)->next);
+    *prev = l->next;
+    pthread_rwlock_destroy(&l->rwlock);
+    free(l->path);
+    free(l);
+}
+
+static void entry_put_locked(cache_entry_t *e)
+{
+    if (--e->refs)
+	return;
+    image_close(&e->image);
+    lock_put_locked(e->lock);
+    free(e->path);
+    free(e);
+}
+
+static void entry_put(cache_entry_t *e)
+{
+    pthread_mutex_lock(&cache_lock);
+    entry_put_locked(e);
+    pthread_mutex_unlock(&cache_lock);
+}
+
+static int entry_current(const cache_entry_t *e, const struct stat *st)
+{
+    return e->dev == st->st_dev && e->ino == st->st_ino && e->size == st->st_size &&
+	e->mtime.tv_sec == st->st_mtim.tv_sec && e->mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static void entry_stat(cache_entry_t *e, const struct stat *st)
+{
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->size = st->st_size;
+    e->mtime = st->st_mtim;
+}
+
+/* cached image for path, (re)opened if missing or changed on disk; NULL on error */
+static cache_entry_t *entry_get(const char *path, int writable)
+{
+    cache_entry_t *e, **prev;
+    struct stat st;
+
+    if (stat(path, &st))
+	return NULL;
+
+    pthread_mutex_lock(&cache_lock);
+    for (prev = &cache; (e = *prev); prev = &e->next) {
+	if (strcmp(e->path, path))
+	    continue;
+	*prev = e->next;
+	cache_num--;
+	if (entry_current(e, &st) && (e->writable || !writable))
+	    goto found;
+	entry_put_locked(e); // stale, requests still using it keep their mapping
+	break;
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (!e || !(e->path = strdup(path))) {
+	free(e);
+	e = NULL;
+	goto exit;
+    }
+    if (!(e->lock = lock_get_locked(path))) {
+	free(e->path);
+	free(e);
+	e = NULL;
+	goto exit;
+    }
+    if (image_open(&e->image, e->path, writable)) {
+	lock_put_locked(e->lock);
+	free(e->path);
+	free(e);
+	e = NULL;
+	goto exit;
+    }
+    e->writable = writable;
+    e->refs = 1;
+    entry_stat(e, &st);
+
+    found:
+    e->next = cache;
+    cache = e;
+    e->refs++;
+    if (++cache_num > CACHE_MAX) {
+	// drop least recently used
+	for (prev = &cache; (*prev)->next; prev = &(*prev)->next);
+	entry_put_locked(*prev);
+	*prev = NULL;
+	cache_num--;
+    }
+
+    exit:
+    pthread_mutex_unlock(&cache_lock);
+    return e;
+}
+
+static unsigned char *entry_nvram(cache_entry_t *e, char *err, size_t err_size)
+{
+    if (server_nvram_offset < 0 || e->image.size < sizeof(bcm68380_nvram_t) ||
+	(size_t)server_nvram_offset > e->image.size - sizeof(bcm68380_nvram_t)) {
+	snprintf(err, err_size, "NVRAM offset %#x is outside of %s (%zu bytes)", server_nvram_offset, e->path, e->image.size);
+	return NULL;
+    }
+    return e->image.mem + server_nvram_offset;
+}
+
+static int set_fields(unsigned char *nvram, char **assignments, int num, char *err, size_t err_size)
+{
+    int i, r;
+
+    for (i = 0; i < num; i++) {
+	const cfenvram_edit_t edit = { NULL, assignments[i] };
+
+	if ((r = cfenvram_edit(nvram, sizeof(bcm68380_nvram_t), &edit, 1, NULL))) {
+	    if (r == CFENVRAM_ESYNTAX)
+		snprintf(err, err_size, "Expected name=value: \"%s\"", assignments[i]);
+	    else
+		snprintf(err, err_size, "Cannot set \"%s\": %s", assignments[i], cfenvram_strerror(r));
+	    return 1;
+	}
+    }
+    if (cfenvram_update_crc(nvram, sizeof(bcm68380_nvram_t), NULL, NULL)) {
+	snprintf(err, err_size, "NVRAM version is wrong, dont know how to handle CRC");
+	return 1;
+    }
+    return 0;
+}
+
+static int request_verify(char **argv, int argc, emit_t *out, char *err, size_t err_size)
+{
+    unsigned char block[sizeof(bcm68380_nvram_t)], *nvram;
+    cache_entry_t *e;
+    int vendor_type;
+
+    if (argc != 2) {
+	snprintf(err, err_size, "Usage: verify <image>");
+	return 1;
+    }
+    if (!(e = entry_get(argv[1], 0))) {
+	snprintf(err, err_size, "Cannot open %s: %s", argv[1], strerror(errno));
+	return 1;
+    }
+    if (!(nvram = entry_nvram(e, err, err_size))) {
+	entry_put(e);
+	return 1;
+    }
+    pthread_rwlock_rdlock(&e->lock->rwlock);
+    memcpy(block, nvram, sizeof(block));
+    pthread_rwlock_unlock(&e->lock->rwlock);
+    entry_put(e);
+
+    vendor_type = server_vendor_type >= 0 ? server_vendor_type : detect_cfe_nvram_vendor(block);
+    if (report_cfe_nvram(out, argv[1], server_nvram_offset, block, vendor_type)) {
+	snprintf(err, err_size, "NVRAM is not valid");
+	return 1;
+    }
+    return 0;
+}
+
+static int request_get(char **argv, int argc, emit_t *out, char *err, size_t err_size)
+{
+    unsigned char block[sizeof(bcm68380_nvram_t)], *nvram;
+    char value[0x200];
+    cache_entry_t *e;
+    int vendor_type, i;
+    size_t k;
+
+    if (argc < 3) {
+	snprintf(err, err_size, "Usage: get <image> <name|all>...");
+	return 1;
+    }
+    if (!(e = entry_get(argv[1], 0))) {
+	snprintf(err, err_size, "Cannot open %s: %s", argv[1], strerror(errno));
+	return 1;
+    }
+    if (!(nvram = entry_nvram(e, err, err_size))) {
+	entry_put(e);
+	return 1;
+    }
+    pthread_rwlock_rdlock(&e->lock->rwlock);
+    memcpy(block, nvram, sizeof(block));
+    pthread_rwlock_unlock(&e->lock->rwlock);
+    entry_put(e);
+
+    vendor_type = server_vendor_type >= 0 ? server_vendor_type : detect_cfe_nvram_vendor(block);
+    for (i = 2; i < argc; i++) {
+	const cfe_field_t *field = cfe_nvram_field(argv[i]);
+
+	for (k = 0; k < cfe_nvram_fields_num; k++) {
+	    const cfe_field_t *f = &cfe_nvram_fields[k];
+
+	    if (strcmp(argv[i], "all") ? f != field : f->vendor && f->vendor != vendor_type)
+		continue;
+	    if (cfe_nvram_get(block, f, value, sizeof(value)) < 0)
+		continue;
+	    emit_bytes_raw(out, f->name, strlen(f->name));
+	    emit_bytes_raw(out, "=", 1);
+	    emit_bytes_raw(out, value, strlen(value));
+	    emit_bytes_raw(out, "\n", 1);
+	}
+	if (!field && strcmp(argv[i], "all")) {
+	    snprintf(err, err_size, "Unknown field \"%s\"", argv[i]);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+static void emit_crc(emit_t *out, const unsigned char *nvram)
+{
+    char line[32];
+    int n = snprintf(line, sizeof(line), "crc=%#08x\n", ((const bcm68380_nvram_t *)nvram)->crc);
+
+    emit_bytes_raw(out, line, n);
+}
+
+/* edit cached image in place, block is restored if it cannot be written */
+static int request_set(char **argv, int argc, emit_t *out, char *err, size_t err_size)
+{
+    unsigned char orig[sizeof(bcm68380_nvram_t)], *nvram;
+    cache_entry_t *e;
+    struct stat st;
+    int retcode = 0;
+
+    if (argc < 3) {
+	snprintf(err, err_size, "Usage: set <image> <name=value>...");
+	return 1;
+    }
+    if (!(e = entry_get(argv[1], 1))) {
+	snprintf(err, err_size, "Cannot open %s for write: %s", argv[1], strerror(errno));
+	return 1;
+    }
+    if (!(nvram = entry_nvram(e, err, err_size))) {
+	entry_put(e);
+	return 1;
+    }
+
+    pthread_rwlock_wrlock(&e->lock->rwlock);
+    memcpy(orig, nvram, sizeof(orig));
+    if (set_fields(nvram, argv + 2, argc - 2, err, err_size)) {
+	retcode++;
+    } else if (image_patch_in_place(&e->image, server_nvram_offset, sizeof(orig))) {
+	snprintf(err, err_size, "Cannot write %s", argv[1]);
+	retcode++;
+    }
+    if (retcode)
+	memcpy(nvram, orig, sizeof(orig));
+    else
+	emit_crc(out, nvram);
+
+    // own write must not invalidate cached mapping
+    pthread_mutex_lock(&cache_lock);
+    if (!fstat(e->image.fd, &st))
+	entry_stat(e, &st);
+    pthread_mutex_unlock(&cache_lock);
+    pthread_rwlock_unlock(&e->lock->rwlock);
+    entry_put(e);
+    return retcode;
+}
+
+/* new image from cached template, only nvram block passes through userspace */
+static int request_stamp(char **argv, int argc, emit_t *out, char *err, size_t err_size)
+{
+    unsigned char block[sizeof(bcm68380_nvram_t)], *nvram;
+    cache_entry_t *e;
+    int retcode = 0;
+
+    if (argc < 3) {
+	snprintf(err, err_size, "Usage: stamp <template> <output> [name=value]...");
+	return 1;
+    }
+    if (!(e = entry_get(argv[1], 0))) {
+	snprintf(err, err_size, "Cannot open %s: %s", argv[1], strerror(errno));
+	return 1;
+    }
+    if (!(nvram = entry_nvram(e, err, err_size))) {
+	entry_put(e);
+	return 1;
+    }
+
+    // template stays locked for reading while data is cloned/copied
+    pthread_rwlock_rdlock(&e->lock->rwlock);
+    memcpy(block, nvram, sizeof(block));
+    if (check_cfe_nvram(block)) {
+	snprintf(err, err_size, "Template nvram is not valid");
+	retcode++;
+    } else if (set_fields(block, argv + 3, argc - 3, err, err_size)) {
+	retcode++;
+    } else if (image_write_block(&e->image, argv[2], server_nvram_offset, block, sizeof(block))) {
+	snprintf(err, err_size, "Cannot write %s", argv[2]);
+	retcode++;
+    }
+    pthread_rwlock_unlock(&e->lock->rwlock);
+    entry_put(e);
+
+    if (!retcode)
+	emit_crc(out, block);
+    return retcode;
+}
+
+static const struct {
+    const char	*name;
+    int		(*handler)(char **argv, int argc, emit_t *out, char *err, size_t err_size);
+} requests[] = {
+    { "verify", request_verify },
+    { "get", request_get },
+    { "set", request_set },
+    { "stamp", request_stamp },
+};
+
+/* split line in place: spaces separate, "..." groups with \" and \\ escapes */
+static int split_args(char *line, char **argv, int max)
+{
+    char *src = line, *dst = line;
+    int argc = 0;
+
+    while (1) {
+	while (*src == ' ' || *src == '\t' || *src == '\r')
+	    src++;
+	if (!*src)
+	    return argc;
+	if (argc == max)
+	    return -1;
+	argv[argc++] = dst;
+	while (*src && *src != ' ' && *src != '\t' && *src != '\r') {
+	    if (*src != '"') {
+		*dst++ = *src++;
+		continue;
+	    }
+	    for (src++; *src && *src != '"'; src++) {
+		if (*src == '\\' && (src[1] == '"' || src[1] == '\\'))
+		    src++;
+		*dst++ = *src;
+	    }
+	    if (!*src)
+		return -1;
+	    src++;
+	}
+	if (*src)
+	    src++;
+	*dst++ = 0;
+    }
+}
+
+static void handle_line(char *line, emit_t *out)
+{
+    char *argv[SERVER_MAX_ARGS], err[512], status[64], cmd[16] = "";
+    struct timespec start, stop_time;
+    int argc, retcode = 1, n;
+    size_t i;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    err[0] = 0;
+    argc = split_args(line, argv, SERVER_MAX_ARGS);
+    if (argc <= 0) {
+	snprintf(err, sizeof(err), argc ? "Bad quoting or too many arguments" : "Empty request");
+    } else {
+	snprintf(cmd, sizeof(cmd), "%s", argv[0]);
+	for (i = 0; i < sizeof(requests) / sizeof(requests[0]) && strcmp(requests[i].name, argv[0]); i++);
+	if (i < sizeof(requests) / sizeof(requests[0]))
+	    retcode = requests[i].handler(argv, argc, out, err, sizeof(err));
+	else
+	    snprintf(err, sizeof(err), "Unknown request \"%s\"", cmd);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop_time);
+
+    long usec = (stop_time.tv_sec - start.tv_sec) * 1000000L + (stop_time.tv_nsec - start.tv_nsec) / 1000;
+    n = snprintf(status, sizeof(status), "%s %ld", retcode ? "ERR" : "OK", usec);
+    emit_bytes_raw(out, status, n);
+    if (retcode) {
+	emit_bytes_raw(out, " ", 1);
+	emit_bytes_raw(out, err, strlen(err));
+    }
+    emit_bytes_raw(out, "\n", 1);
+
+    pthread_mutex_lock(&log_lock);
+    printf("> %s %s: %s, %ld us%s%s\n", cmd, argc > 1 ? argv[1] : "", retcode ? "ERR" : "OK", usec,
+	retcode ? ", " : "", retcode ? err : "");
+    fflush(stdout);
+    pthread_mutex_unlock(&log_lock);
+}
+
+/* one thread per station connection, requests on it are answered in order */
+static void *connection_thread(void *arg)
+{
+    int fd = (int)(intptr_t)arg;
+    char *buf = malloc(SERVER_MAX_LINE);
+    size_t len = 0;
+    emit_t out;
+
+    emit_init(&out, FORMAT_JSON);
+    while (buf) {
+	ssize_t n = read(fd, buf + len, SERVER_MAX_LINE - len);
+	char *line = buf, *eol;
+
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    break;
+	len += n;
+
+	// replies to all complete (pipelined) lines go out with one write
+	while ((eol = memchr(line, '\n', buf + len - line))) {
+	    *eol = 0;
+	    handle_line(line, &out);
+	    line = eol + 1;
+	}
+	len -= line - buf;
+	memmove(buf, line, len);
+	if (len == SERVER_MAX_LINE) {
+	    emit_bytes_raw(&out, "ERR 0 Request line too long\n", 28);
+	    emit_flush(&out, fd);
+	    break;
+	}
+	if (emit_flush(&out, fd))
+	    break;
+    }
+    emit_free(&out);
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+static void stop_handler(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+int server_run(const char *socket_name, int nvram_offset, int vendor_type)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    struct sigaction sa;
+    pthread_attr_t attr;
+    int fd, retcode = 0;
+
+    server_nvram_offset = nvram_offset;
+    server_vendor_type = vendor_type;
+
+    if (strlen(socket_name) >= sizeof(addr.sun_path)) {
+	fprintf(stderr, "Socket path is too long\n");
+	return 1;
+    }
+    strcpy(addr.sun_path, socket_name);
+
+    // no SA_RESTART: accept() returns on signal
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN); // station went away, write() fails instead
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+	perror("Cannot create socket");
+	return 1;
+    }
+    unlink(socket_name); // stale socket of previous run
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || listen(fd, 64)) {
+	perror("Cannot listen on socket");
+	close(fd);
+	return 1;
+    }
+    printf("> serving %s, nvram offset %#x\n", socket_name, nvram_offset);
+    fflush(stdout);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (!stop) {
+	pthread_t thread;
+	int conn = accept(fd, NULL, NULL);
+
+	if (conn < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    perror("Cannot accept connection");
+	    retcode++;
+	    break;
+	}
+	if (pthread_create(&thread, &attr, connection_thread, (void *)(intptr_t)conn)) {
+	    fprintf(stderr, "Cannot create connection thread\n");
+	    close(conn);
+	}
+    }
+    pthread_attr_destroy(&attr);
+    close(fd);
+    unlink(socket_name);
+    printf("> server stopped\n");
+    return retcode;
+}
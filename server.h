@@ -0,0 +1,23 @@
+#ifndef CFE_SERVER_H
+#define CFE_SERVER_H
+
+/*
+ * provisioning server: line protocol over unix stream socket, one request per line,
+ * tokens separated by spaces ("..." with \" and \\ escapes for values with spaces):
+ *
+ *   verify <image>                          json record of nvram (as --format json)
+ *   get <image> <name|all>...               name=value lines
+ *   set <image> <name=value>...             edit nvram, update CRC, write block back into image
+ *   stamp <template> <output> <name=value>...  write new image: template with fields changed
+ *
+ * reply: payload lines, then "OK <usec>" or "ERR <usec> <message>", usec - server side latency.
+ * Images are mapped once and kept cached until their mtime/size changes.
+ */
+
+#define SERVER_MAX_LINE		8192
+#define SERVER_MAX_ARGS		64
+
+/* serve until SIGINT/SIGTERM, vendor_type -1 - detect; returns 0 on clean shutdown */
+int server_run(const char *socket_name, int nvram_offset, int vendor_type);
+
+#endif
@@ -0,0 +1,309 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_SHA256_SHANI 1
+#endif
+
+#if defined(__aarch64__) && defined(__linux__) && defined(__GNUC__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define HAVE_SHA256_ARMV8 1
+#endif
+
+#include "sha256.h"
+
+static const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t H0[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+#define ROR(x, n)	((x) >> (n) | (x) << (32 - (n)))
+
+/* FIPS 180-4 reference, all other engines must match it */
+static void sha256_generic(uint32_t state[8], const uint8_t *p, size_t nblocks)
+{
+    uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    while (nblocks--) {
+	for (i = 0; i < 16; i++, p += 4)
+	    w[i] = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+	for (; i < 64; i++)
+	    w[i] = w[i - 16] + (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ w[i - 15] >> 3) +
+		w[i - 7] + (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ w[i - 2] >> 10);
+
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (i = 0; i < 64; i++) {
+	    t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + K[i] + w[i];
+	    t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+	    h = g; g = f; f = e; e = d + t1;
+	    d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#ifdef HAVE_SHA256_SHANI
+static int sha256_shani_supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+}
+
+/*
+ * state is kept as ABEF/CDGH pairs, every sha256rnds2 does two rounds;
+ * message words for group i + 4 are scheduled while group i is hashed
+ */
+__attribute__((target("sha,sse4.1")))
+static void sha256_shani(uint32_t state[8], const uint8_t *p, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp, abef, cdgh, abef_save, cdgh_save, msg[4], wk;
+    int i;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);	// CDAB
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);	// EFGH
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+    while (nblocks--) {
+	abef_save = abef;
+	cdgh_save = cdgh;
+	for (i = 0; i < 4; i++)
+	    msg[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16 * i)), bswap);
+#pragma GCC unroll 16
+	for (i = 0; i < 16; i++) {
+	    wk = _mm_add_epi32(msg[i & 3], _mm_loadu_si128((const __m128i *)&K[4 * i]));
+	    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+	    if (i < 12)
+		msg[i & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg[i & 3], msg[(i + 1) & 3]),
+		    _mm_alignr_epi8(msg[(i + 3) & 3], msg[(i + 2) & 3], 4)), msg[(i + 3) & 3]);
+	    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0E));
+	}
+	abef = _mm_add_epi32(abef, abef_save);
+	cdgh = _mm_add_epi32(cdgh, cdgh_save);
+	p += SHA256_BLOCK_LEN;
+    }
+
+    tmp = _mm_shuffle_epi32(abef, 0x1B);	// FEBA
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);	// DCHG
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, cdgh, 0xF0));	// DCBA
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(cdgh, tmp, 8));	// HGFE
+}
+#endif
+
+#ifdef HAVE_SHA256_ARMV8
+static int sha256_armv8_supported(void)
+{
+    return (getauxval(AT_HWCAP) & HWCAP_SHA2) != 0;
+}
+
+__attribute__((target("arch=armv8-a+crypto")))
+static void sha256_armv8(uint32_t state[8], const uint8_t *p, size_t nblocks)
+{
+    uint32x4_t abcd = vld1q_u32(&state[0]), efgh = vld1q_u32(&state[4]);
+    uint32x4_t abcd_save, efgh_save, abcd_prev, msg[4], wk;
+    int i;
+
+    while (nblocks--) {
+	abcd_save = abcd;
+	efgh_save = efgh;
+	for (i = 0; i < 4; i++)
+	    msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(p + 16 * i)));
+#pragma GCC unroll 16
+	for (i = 0; i < 16; i++) {
+	    wk = vaddq_u32(msg[i & 3], vld1q_u32(&K[4 * i]));
+	    if (i < 12)
+		msg[i & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[i & 3], msg[(i + 1) & 3]), msg[(i + 2) & 3], msg[(i + 3) & 3]);
+	    abcd_prev = abcd;
+	    abcd = vsha256hq_u32(abcd, efgh, wk);
+	    efgh = vsha256h2q_u32(efgh, abcd_prev, wk);
+	}
+	abcd = vaddq_u32(abcd, abcd_save);
+	efgh = vaddq_u32(efgh, efgh_save);
+	p += SHA256_BLOCK_LEN;
+    }
+    vst1q_u32(&state[0], abcd);
+    vst1q_u32(&state[4], efgh);
+}
+#endif
+
+static sha256_engine_t engines[] = {
+    // best engine last
+    { "generic", sha256_generic, NULL, 0 },
+#ifdef HAVE_SHA256_ARMV8
+    { "armv8",   sha256_armv8,   sha256_armv8_supported, 0 },
+#endif
+#ifdef HAVE_SHA256_SHANI
+    { "shani",   sha256_shani,   sha256_shani_supported, 0 },
+#endif
+};
+
+#define ENGINES_NUM (int)(sizeof(engines) / sizeof(engines[0]))
+
+static sha256_fn_t sha256_impl = sha256_generic;
+static const char *sha256_impl_name = "generic";
+
+/* FIPS 180-4 "abc" example for the reference, then every engine against it on 1..SELFTEST_BLOCKS blocks */
+#define SELFTEST_BLOCKS 9
+
+static int sha256_selftest(sha256_fn_t fn)
+{
+    static const uint8_t abc[SHA256_DIGEST_LEN] = {
+	0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+	0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+    static uint8_t pattern[SELFTEST_BLOCKS * SHA256_BLOCK_LEN + 1];
+    uint32_t ref[8], state[8];
+    uint8_t block[SHA256_BLOCK_LEN] = { 'a', 'b', 'c', 0x80 };
+    size_t i, n;
+
+    block[SHA256_BLOCK_LEN - 1] = 24; // bit length
+    memcpy(state, H0, sizeof(state));
+    fn(state, block, 1);
+    for (i = 0; i < 8; i++)
+	if (state[i] != ((uint32_t)abc[4 * i] << 24 | abc[4 * i + 1] << 16 | abc[4 * i + 2] << 8 | abc[4 * i + 3]))
+	    return 1;
+
+    for (i = 0; i < sizeof(pattern); i++)
+	pattern[i] = (uint8_t)(i * 131 + (i >> 3) + 7);
+    for (n = 1; n <= SELFTEST_BLOCKS; n++) {
+	memcpy(ref, H0, sizeof(ref));
+	memcpy(state, H0, sizeof(state));
+	sha256_generic(ref, pattern + 1, n);	// unaligned input
+	fn(state, pattern + 1, n);
+	if (memcmp(ref, state, sizeof(ref)))
+	    return 1;
+    }
+    return 0;
+}
+
+int sha256_init(void)
+{
+    int i, failed = 0;
+
+    for (i = 0; i < ENGINES_NUM; i++) {
+	engines[i].usable = 0;
+	if (engines[i].supported && !engines[i].supported())
+	    continue;
+	if (sha256_selftest(engines[i].fn)) {
+	    fprintf(stderr, "sha256 engine \"%s\" failed self-test, disabled\n", engines[i].name);
+	    failed++;
+	    continue;
+	}
+	engines[i].usable = 1;
+	sha256_impl = engines[i].fn;
+	sha256_impl_name = engines[i].name;
+    }
+
+    return failed;
+}
+
+int sha256_select(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ENGINES_NUM; i++) {
+	if (strcmp(engines[i].name, name) || !engines[i].usable)
+	    continue;
+	sha256_impl = engines[i].fn;
+	sha256_impl_name = engines[i].name;
+	return 0;
+    }
+    return 1;
+}
+
+const char *sha256_engine_name(void)
+{
+    return sha256_impl_name;
+}
+
+const sha256_engine_t *sha256_engines(int *count)
+{
+    *count = ENGINES_NUM;
+    return engines;
+}
+
+void sha256_begin(sha256_ctx_t *ctx)
+{
+    memcpy(ctx->state, H0, sizeof(ctx->state));
+    ctx->len = 0;
+    ctx->buf_len = 0;
+}
+
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    size_t n;
+
+    ctx->len += len;
+    if (ctx->buf_len) {
+	n = SHA256_BLOCK_LEN - ctx->buf_len < len ? SHA256_BLOCK_LEN - ctx->buf_len : len;
+	memcpy(ctx->buf + ctx->buf_len, p, n);
+	ctx->buf_len += n;
+	p += n;
+	len -= n;
+	if (ctx->buf_len < SHA256_BLOCK_LEN)
+	    return;
+	sha256_impl(ctx->state, ctx->buf, 1);
+	ctx->buf_len = 0;
+    }
+    // whole blocks straight from input, no copy
+    if (len >= SHA256_BLOCK_LEN) {
+	n = len / SHA256_BLOCK_LEN;
+	sha256_impl(ctx->state, p, n);
+	p += n * SHA256_BLOCK_LEN;
+	len -= n * SHA256_BLOCK_LEN;
+    }
+    memcpy(ctx->buf, p, len);
+    ctx->buf_len = len;
+}
+
+void sha256_end(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_LEN])
+{
+    uint64_t bits = ctx->len * 8;
+    int i;
+
+    ctx->buf[ctx->buf_len++] = 0x80;
+    if (ctx->buf_len > SHA256_BLOCK_LEN - 8) {
+	memset(ctx->buf + ctx->buf_len, 0, SHA256_BLOCK_LEN - ctx->buf_len);
+	sha256_impl(ctx->state, ctx->buf, 1);
+	ctx->buf_len = 0;
+    }
+    memset(ctx->buf + ctx->buf_len, 0, SHA256_BLOCK_LEN - 8 - ctx->buf_len);
+    for (i = 0; i < 8; i++)
+	ctx->buf[SHA256_BLOCK_LEN - 1 - i] = bits >> (8 * i);
+    sha256_impl(ctx->state, ctx->buf, 1);
+    for (i = 0; i < 8; i++) {
+	digest[4 * i] = ctx->state[i] >> 24;
+	digest[4 * i + 1] = ctx->state[i] >> 16;
+	digest[4 * i + 2] = ctx->state[i] >> 8;
+	digest[4 * i + 3] = ctx->state[i];
+    }
+}
+
+void sha256(const void *data, size_t len, uint8_t digest[SHA256_DIGEST_LEN])
+{
+    sha256_ctx_t ctx;
+
+    sha256_begin(&ctx);
+    sha256_update(&ctx, data, len);
+    sha256_end(&ctx, digest);
+}
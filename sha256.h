@@ -0,0 +1,43 @@
+#ifndef CFE_SHA256_H
+#define CFE_SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_LEN	32
+#define SHA256_BLOCK_LEN	64
+
+/* compress nblocks 64-byte blocks into state */
+typedef void (*sha256_fn_t)(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+
+typedef struct sha256_engine {
+    const char	*name;
+    sha256_fn_t	fn;
+    int		(*supported)(void);	// NULL - always available
+    int		usable;			// set by sha256_init(): supported and passed self-test
+} sha256_engine_t;
+
+typedef struct sha256_ctx {
+    uint32_t	state[8];
+    uint64_t	len;			// bytes hashed so far
+    uint8_t	buf[SHA256_BLOCK_LEN];
+    size_t	buf_len;
+} sha256_ctx_t;
+
+/* select fastest usable engine, self-test every engine against portable one */
+int sha256_init(void);
+
+/* force engine by name ("generic", "shani", "armv8"), returns 0 on success */
+int sha256_select(const char *name);
+
+const char *sha256_engine_name(void);
+const sha256_engine_t *sha256_engines(int *count);
+
+void sha256_begin(sha256_ctx_t *ctx);
+void sha256_update(sha256_ctx_t *ctx, const void *data, size_t len);
+void sha256_end(sha256_ctx_t *ctx, uint8_t digest[SHA256_DIGEST_LEN]);
+
+/* one-shot digest with selected engine */
+void sha256(const void *data, size_t len, uint8_t digest[SHA256_DIGEST_LEN]);
+
+#endif
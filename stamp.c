@@ -0,0 +1,206 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <arpa/inet.h>
+
+#include "cfe_nvram.h"
+#include "crc32.h"
+#include "stamp.h"
+
+enum {
+    STAMP_BASEMAC = 0,
+    STAMP_GPONSN,
+    STAMP_GPONPASS,
+    STAMP_WPSPIN,
+    STAMP_FIELDS_NUM
+};
+
+/* per-device fields, everything else is shared with template */
+static const char *stamp_field_names[STAMP_FIELDS_NUM] = { "basemac", "gponsn", "gponpass", "wpspin" };
+
+typedef struct stamp_ctx {
+    cfe_image_t		*img;
+    size_t		nvram_offset;
+    const char		*output_dir;
+    const unsigned char	*tmpl;		// template nvram block
+    uint32_t		tmpl_crc;	// host order
+    unsigned char	block[sizeof(bcm68380_nvram_t)];
+    size_t		done;
+    int			checked;	// first delta crc compared with full calculation
+    const cfe_field_t	*fields[STAMP_FIELDS_NUM];
+} stamp_ctx_t;
+
+/* block has per-device fields set: delta crc against template, write image */
+static int stamp_one(stamp_ctx_t *ctx)
+{
+    bcm68380_nvram_t *bcm_nvram = (bcm68380_nvram_t *)ctx->block;
+    uint32_t crc = ctx->tmpl_crc;
+    char path[PATH_MAX];
+    int i;
+
+    for (i = 0; i < STAMP_FIELDS_NUM; i++)
+	crc = crc32_patch(crc, sizeof(bcm68380_nvram_t), ctx->fields[i]->offset,
+	    ctx->tmpl + ctx->fields[i]->offset, ctx->block + ctx->fields[i]->offset, ctx->fields[i]->size);
+
+    if (!ctx->checked) {
+	if (crc != calc_cfe_nvram_crc(ctx->block)) {
+	    fprintf(stderr, "Incremental CRC mismatch: %#08x, %#08x\n", crc, calc_cfe_nvram_crc(ctx->block));
+	    return 1;
+	}
+	ctx->checked = 1;
+    }
+    bcm_nvram->crc = htonl(crc);
+
+    snprintf(path, sizeof(path), "%s/%.12s_%02X%02X%02X%02X%02X%02X.bin", ctx->output_dir, bcm_nvram->gponsn,
+	bcm_nvram->basemac[0], bcm_nvram->basemac[1], bcm_nvram->basemac[2],
+	bcm_nvram->basemac[3], bcm_nvram->basemac[4], bcm_nvram->basemac[5]);
+
+    if (image_write_block(ctx->img, path, ctx->nvram_offset, ctx->block, sizeof(ctx->block)))
+	return 1;
+    ctx->done++;
+    return 0;
+}
+
+static int stamp_count(stamp_ctx_t *ctx, unsigned long count)
+{
+    bcm68380_nvram_t *bcm_nvram = (bcm68380_nvram_t *)ctx->block;
+    const bcm68380_nvram_t *tmpl = (const bcm68380_nvram_t *)ctx->tmpl;
+    uint64_t mac = 0, step = ntohl(tmpl->mac_num) ? ntohl(tmpl->mac_num) : 1;
+    unsigned int sn;
+    unsigned long i;
+    int k;
+
+    // GPON SN: 4 chars vendor id + 8 hex digits serial
+    if (strnlen(tmpl->gponsn, sizeof(tmpl->gponsn)) != sizeof(tmpl->gponsn) - 1 || sscanf(tmpl->gponsn + 4, "%8x", &sn) != 1) {
+	fprintf(stderr, "Template GPON SN \"%.12s\" is not VVVVxxxxxxxx\n", tmpl->gponsn);
+	return 1;
+    }
+    for (k = 0; k < 6; k++)
+	mac = (mac << 8) | tmpl->basemac[k];
+
+    for (i = 0; i < count; i++) {
+	uint64_t unit_mac = mac + i * step;
+
+	if (unit_mac + step - 1 > 0xFFFFFFFFFFFFULL || (uint64_t)sn + i > 0xFFFFFFFFULL) {
+	    fprintf(stderr, "MAC or GPON SN range overflow at device %lu\n", i);
+	    return 1;
+	}
+	for (k = 0; k < 6; k++)
+	    bcm_nvram->basemac[k] = unit_mac >> (8 * (5 - k));
+	snprintf(bcm_nvram->gponsn + 4, sizeof(bcm_nvram->gponsn) - 4, "%08X", (unsigned int)(sn + i));
+
+	if (stamp_one(ctx))
+	    return 1;
+    }
+    return 0;
+}
+
+static char *trim(char *s)
+{
+    size_t n;
+
+    while (*s == ' ' || *s == '\t')
+	s++;
+    n = strlen(s);
+    while (n && (s[n - 1] == '\n' || s[n - 1] == '\r' || s[n - 1] == ' ' || s[n - 1] == '\t'))
+	s[--n] = 0;
+    return s;
+}
+
+static int stamp_csv(stamp_ctx_t *ctx, const char *name)
+{
+    int columns[STAMP_FIELDS_NUM * 2], ncolumns = 0, retcode = 0;
+    char *line = NULL, *tok, *save;
+    size_t line_size = 0, lineno = 0;
+    int i;
+
+    FILE *f = fopen(name, "r");
+    if (!f) {
+	perror("Cannot open stamp csv");
+	return 1;
+    }
+
+    while (getline(&line, &line_size, f) > 0) {
+	lineno++;
+	if (!*trim(line) || line[0] == '#')
+	    continue;
+
+	if (!ncolumns) {
+	    // header: column names
+	    for (tok = strtok_r(line, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+		tok = trim(tok);
+		for (i = 0; i < STAMP_FIELDS_NUM && strcmp(tok, stamp_field_names[i]); i++);
+		if (i == STAMP_FIELDS_NUM || ncolumns == STAMP_FIELDS_NUM * 2) {
+		    fprintf(stderr, "%s:%zu: unknown column \"%s\"\n", name, lineno, tok);
+		    retcode++;
+		    goto exit;
+		}
+		columns[ncolumns++] = i;
+	    }
+	    continue;
+	}
+
+	memcpy(ctx->block, ctx->tmpl, sizeof(ctx->block));
+	// strtok_r would merge empty columns, split by hand
+	for (i = 0, tok = line; i < ncolumns && tok; i++) {
+	    char *next = strchr(tok, ',');
+	    if (next)
+		*next++ = 0;
+	    if (*trim(tok) && cfe_nvram_set(ctx->block, ctx->fields[columns[i]], trim(tok))) {
+		fprintf(stderr, "%s:%zu: bad %s \"%s\"\n", name, lineno, stamp_field_names[columns[i]], trim(tok));
+		retcode++;
+		goto exit;
+	    }
+	    tok = next;
+	}
+
+	if (stamp_one(ctx)) {
+	    retcode++;
+	    goto exit;
+	}
+    }
+
+    exit:
+    free(line);
+    fclose(f);
+    return retcode;
+}
+
+int stamp_run(cfe_image_t *img, size_t nvram_offset, const char *spec, const char *output_dir)
+{
+    stamp_ctx_t ctx;
+    struct timespec start, stop;
+    unsigned long count;
+    int retcode, i;
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.img = img;
+    ctx.nvram_offset = nvram_offset;
+    ctx.output_dir = output_dir;
+    ctx.tmpl = img->mem + nvram_offset;
+    for (i = 0; i < STAMP_FIELDS_NUM; i++)
+	ctx.fields[i] = cfe_nvram_field(stamp_field_names[i]);
+
+    if (check_cfe_nvram(ctx.tmpl)) {
+	fprintf(stderr, "Template nvram is not valid\n");
+	return 1;
+    }
+    ctx.tmpl_crc = ntohl(((const bcm68380_nvram_t *)ctx.tmpl)->crc);
+    memcpy(ctx.block, ctx.tmpl, sizeof(ctx.block));
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (sscanf(spec, "count:%lu", &count) == 1)
+	retcode = stamp_count(&ctx, count);
+    else
+	retcode = stamp_csv(&ctx, spec);
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    double elapsed = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+    printf("> stamped %zu images into %s, %.3f s (%.0f images/s)\n", ctx.done, output_dir, elapsed,
+	elapsed > 0 ? ctx.done / elapsed : 0.0);
+    return retcode;
+}
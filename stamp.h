@@ -0,0 +1,16 @@
+#ifndef CFE_STAMP_H
+#define CFE_STAMP_H
+
+#include <stddef.h>
+
+#include "image.h"
+
+/*
+ * write one image per device from template img (nvram at nvram_offset must be valid).
+ * spec: "count:<N>" - basemac += mac_num and hex part of gponsn += 1 per device,
+ *       or csv file with header naming columns basemac, gponsn, gponpass, wpspin.
+ * Outputs are <output_dir>/<gponsn>_<basemac>.bin, returns number of errors.
+ */
+int stamp_run(cfe_image_t *img, size_t nvram_offset, const char *spec, const char *output_dir);
+
+#endif
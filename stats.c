@@ -0,0 +1,110 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "stats.h"
+
+#define STATS_BUCKETS 40	// log2(ns): 1 ns .. ~18 min
+
+int stats_enabled;
+static int stats_histograms;
+static uint64_t stats_start;
+
+static const char *phase_names[STAT_PHASES_NUM] = {
+    "init", "open", "read", "edit", "check", "verify", "output", "write", "fwcrc", "file"
+};
+
+static const char *counter_names[STAT_COUNTERS_NUM] = {
+    "bytes read", "bytes mapped", "bytes written", "syscalls"
+};
+
+/* updated by batch workers concurrently */
+static struct {
+    uint64_t	calls;
+    uint64_t	ns;
+    uint64_t	max;
+    uint64_t	hist[STATS_BUCKETS];
+} phases[STAT_PHASES_NUM];
+
+static uint64_t counters[STAT_COUNTERS_NUM];
+
+uint64_t stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void stats_phase_add(int phase, uint64_t ns)
+{
+    uint64_t max = __atomic_load_n(&phases[phase].max, __ATOMIC_RELAXED);
+    int bucket = ns ? 63 - __builtin_clzll(ns) : 0;
+
+    __atomic_fetch_add(&phases[phase].calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phases[phase].ns, ns, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&phases[phase].hist[bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1], 1, __ATOMIC_RELAXED);
+    while (ns > max && !__atomic_compare_exchange_n(&phases[phase].max, &max, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void stats_count_add(int counter, uint64_t n)
+{
+    __atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+static void print_time(FILE *f, uint64_t ns)
+{
+    if (ns < 10000)
+	fprintf(f, "%6" PRIu64 " ns", ns);
+    else if (ns < 10000000)
+	fprintf(f, "%6.1f us", ns / 1e3);
+    else
+	fprintf(f, "%6.1f ms", ns / 1e6);
+}
+
+static void stats_print(void)
+{
+    uint64_t total = stats_clock() - stats_start;
+    int i, b;
+
+    fflush(stdout);
+    fprintf(stderr, "> stats: ");
+    print_time(stderr, total);
+    fprintf(stderr, " total\n");
+    for (i = 0; i < STAT_PHASES_NUM; i++) {
+	if (!phases[i].calls)
+	    continue;
+	fprintf(stderr, ">> %-7s %8" PRIu64 " calls, total ", phase_names[i], phases[i].calls);
+	print_time(stderr, phases[i].ns);
+	fprintf(stderr, ", avg ");
+	print_time(stderr, phases[i].ns / phases[i].calls);
+	fprintf(stderr, ", max ");
+	print_time(stderr, phases[i].max);
+	fprintf(stderr, " (%4.1f%%)\n", total ? 100.0 * phases[i].ns / total : 0.0);
+
+	if (!stats_histograms)
+	    continue;
+	for (b = 0; b < STATS_BUCKETS; b++) {
+	    if (!phases[i].hist[b])
+		continue;
+	    fprintf(stderr, ">>>   < ");
+	    print_time(stderr, 2ULL << b);
+	    fprintf(stderr, " %8" PRIu64 " ", phases[i].hist[b]);
+	    for (int k = 0; k < 40 && k < (int)(40 * phases[i].hist[b] / phases[i].calls + 1); k++)
+		fputc('#', stderr);
+	    fputc('\n', stderr);
+	}
+    }
+    for (i = 0; i < STAT_COUNTERS_NUM; i++)
+	fprintf(stderr, ">> %-13s %12" PRIu64 "\n", counter_names[i], counters[i]);
+}
+
+void stats_enable(int histograms)
+{
+    stats_enabled = 1;
+    stats_histograms = histograms;
+    stats_start = stats_clock();
+    atexit(stats_print);
+}
@@ -0,0 +1,64 @@
+#ifndef CFE_STATS_H
+#define CFE_STATS_H
+
+#include <stdint.h>
+
+/* --stats: phase timers and i/o counters, one branch per probe when disabled */
+enum {
+    STAT_INIT = 0,	// crc engine self-tests
+    STAT_OPEN,		// open, fstat, mmap (or read) of input
+    STAT_READ,		// pread of nvram block / erase blocks
+    STAT_EDIT,		// option parsing and field changes
+    STAT_CHECK,		// nvram checks (version, bootline, partitions, checksums), checksum update
+    STAT_VERIFY,	// verify/report formatting
+    STAT_OUTPUT,	// stdout flush
+    STAT_WRITE,		// output file, in-place patch, mtd program
+    STAT_FWCRC,		// firmware partition CRCs
+    STAT_FILE,		// whole file in batch mode
+    STAT_PHASES_NUM
+};
+
+enum {
+    STAT_BYTES_READ = 0,	// read()/pread()
+    STAT_BYTES_MAPPED,		// mmap()ed input
+    STAT_BYTES_WRITTEN,		// write()/pwrite() and kernel side copies
+    STAT_SYSCALLS,		// i/o syscalls issued by cfe_edit code (stdio excluded)
+    STAT_COUNTERS_NUM
+};
+
+extern int stats_enabled;
+
+uint64_t stats_clock(void);
+void stats_phase_add(int phase, uint64_t ns);
+void stats_count_add(int counter, uint64_t n);
+
+static inline uint64_t stats_begin(void)
+{
+    return __builtin_expect(stats_enabled, 0) ? stats_clock() : 0;
+}
+
+static inline void stats_end(int phase, uint64_t start)
+{
+    if (__builtin_expect(stats_enabled, 0))
+	stats_phase_add(phase, stats_clock() - start);
+}
+
+/* one syscall moving n bytes of counter kind */
+static inline void stats_io(int counter, uint64_t n)
+{
+    if (__builtin_expect(stats_enabled, 0)) {
+	stats_count_add(STAT_SYSCALLS, 1);
+	stats_count_add(counter, n);
+    }
+}
+
+static inline void stats_syscall(void)
+{
+    if (__builtin_expect(stats_enabled, 0))
+	stats_count_add(STAT_SYSCALLS, 1);
+}
+
+/* start collecting, summary (with per-phase latency histograms) is printed to stderr at exit */
+void stats_enable(int histograms);
+
+#endif
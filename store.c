@@ -0,0 +1,514 @@
+#define _GNU_SOURCE
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "crc32.h"
+#include "image.h"
+#include "scan.h"
+#include "stats.h"
+#include "store.h"
+
+#define STORE_NVRAM_SIZE sizeof(bcm68380_nvram_t)
+#define STORE_CRC_CHUNK (1u << 30)
+#define STORE_MAX_COLLISIONS 16
+
+_Static_assert(sizeof(store_unit_t) % 8 == 0, "store record must keep 8-byte alignment");
+
+/* bases mapped during one ingest run, compared instead of reopened */
+typedef struct store_base {
+    char	name[64];
+    cfe_image_t	img;
+} store_base_t;
+
+typedef struct store_ctx {
+    const char		*dir;
+    store_base_t	*bases;
+    size_t		bases_num;
+    size_t		bases_alloc;
+    size_t		new_bases;
+    uint64_t		bytes_in;
+    uint64_t		bytes_stored;
+    const store_unit_t	*units;		// records before this run, sorted by order
+    uint32_t		*order;
+    size_t		units_num;
+} store_ctx_t;
+
+static const unsigned char *erased_block(void)
+{
+    static unsigned char erased[STORE_NVRAM_SIZE];
+
+    if (erased[0] != 0xFF)
+	memset(erased, 0xFF, sizeof(erased));
+    return erased;
+}
+
+static int write_all(int fd, const void *buf, size_t size)
+{
+    const unsigned char *p = buf;
+
+    while (size) {
+	ssize_t n = write(fd, p, size);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return 1;
+	stats_io(STAT_BYTES_WRITTEN, n);
+	p += n;
+	size -= n;
+    }
+    return 0;
+}
+
+static uint32_t crc_range(const unsigned char *p, uint64_t len, uint32_t crc)
+{
+    while (len) {
+	uint32_t n = len > STORE_CRC_CHUNK ? STORE_CRC_CHUNK : len;
+
+	crc = cfe_crc32(p, n, crc);
+	p += n;
+	len -= n;
+    }
+    return crc;
+}
+
+/* crc32 of image with nvram block erased, i.e. of the base file */
+static uint32_t base_crc(const unsigned char *mem, uint64_t size, uint64_t ofs)
+{
+    uint32_t crc = crc_range(mem, ofs, 0xFFFFFFFF);
+
+    crc = cfe_crc32(erased_block(), STORE_NVRAM_SIZE, crc);
+    return crc_range(mem + ofs + STORE_NVRAM_SIZE, size - ofs - STORE_NVRAM_SIZE, crc);
+}
+
+/* same content outside of nvram block */
+static int base_equal(const cfe_image_t *base, const unsigned char *mem, uint64_t size, uint64_t ofs)
+{
+    return base->size == size && !memcmp(base->mem, mem, ofs) &&
+	!memcmp(base->mem + ofs + STORE_NVRAM_SIZE, mem + ofs + STORE_NVRAM_SIZE, size - ofs - STORE_NVRAM_SIZE);
+}
+
+static void base_path(char *path, size_t size, const char *dir, const char *name, const char *suffix)
+{
+    snprintf(path, size, "%s/base/%s.bin%s", dir, name, suffix);
+}
+
+static store_base_t *base_cached(store_ctx_t *ctx, const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ctx->bases_num; i++)
+	if (!strcmp(ctx->bases[i].name, name))
+	    return &ctx->bases[i];
+    return NULL;
+}
+
+static store_base_t *base_add(store_ctx_t *ctx, const char *name)
+{
+    if (ctx->bases_num == ctx->bases_alloc) {
+	size_t n = ctx->bases_alloc ? ctx->bases_alloc * 2 : 16;
+	store_base_t *bases = realloc(ctx->bases, n * sizeof(*bases));
+	if (!bases)
+	    return NULL;
+	ctx->bases = bases;
+	ctx->bases_alloc = n;
+    }
+    store_base_t *b = &ctx->bases[ctx->bases_num];
+    snprintf(b->name, sizeof(b->name), "%s", name);
+    return b;
+}
+
+/*
+ * find base holding image content or write a new one: name from size, offset
+ * and crc, every candidate is compared byte for byte. 0 on success, name set.
+ */
+static int base_store(store_ctx_t *ctx, cfe_image_t *img, uint64_t ofs, char name[64], int *created)
+{
+    uint32_t crc = base_crc(img->mem, img->size, ofs);
+    char path[PATH_MAX], tmp[PATH_MAX];
+    int n;
+
+    *created = 0;
+    for (n = 0; n < STORE_MAX_COLLISIONS; n++) {
+	store_base_t *b;
+
+	if (n)
+	    snprintf(name, 64, "%" PRIx64 "-%" PRIx64 "-%08x-%d", (uint64_t)img->size, ofs, crc, n);
+	else
+	    snprintf(name, 64, "%" PRIx64 "-%" PRIx64 "-%08x", (uint64_t)img->size, ofs, crc);
+
+	if ((b = base_cached(ctx, name))) {
+	    if (base_equal(&b->img, img->mem, img->size, ofs))
+		return 0;
+	    continue;
+	}
+	base_path(path, sizeof(path), ctx->dir, name, "");
+	if (!(b = base_add(ctx, name)))
+	    return 1;
+	if (!access(path, F_OK)) {
+	    if (image_open(&b->img, path, 0))
+		return 1;
+	    ctx->bases_num++;
+	    if (base_equal(&b->img, img->mem, img->size, ofs))
+		return 0;
+	    continue;
+	}
+
+	// new content: written under temporary name, visible only when complete
+	base_path(tmp, sizeof(tmp), ctx->dir, name, ".tmp");
+	if (image_write_block(img, tmp, ofs, erased_block(), STORE_NVRAM_SIZE) || rename(tmp, path)) {
+	    unlink(tmp);
+	    return 1;
+	}
+	if (image_open(&b->img, path, 0))
+	    return 1;
+	ctx->bases_num++;
+	ctx->new_bases++;
+	ctx->bytes_stored += img->size;
+	*created = 1;
+	return 0;
+    }
+    fprintf(stderr, "Too many crc32 collisions for base %s\n", name);
+    return 1;
+}
+
+static int store_create(const char *dir)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/base", dir);
+    if ((mkdir(dir, 0755) && errno != EEXIST) || (mkdir(path, 0755) && errno != EEXIST)) {
+	perror("Cannot create store directory");
+	return 1;
+    }
+    return 0;
+}
+
+/* units file for append, header written if new */
+static int units_open_append(const char *dir)
+{
+    store_header_t hdr = { .magic = STORE_MAGIC, .version = STORE_VERSION, .byte_order = 0x01020304,
+	.record_size = sizeof(store_unit_t) };
+    char path[PATH_MAX];
+    struct stat st;
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/units", dir);
+    fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0 || fstat(fd, &st)) {
+	perror("Cannot open store units");
+	if (fd >= 0)
+	    close(fd);
+	return -1;
+    }
+    if (!st.st_size && write_all(fd, &hdr, sizeof(hdr))) {
+	perror("Cannot write store units");
+	close(fd);
+	return -1;
+    }
+    if (st.st_size && (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || memcmp(hdr.magic, STORE_MAGIC, sizeof(hdr.magic)) ||
+	hdr.version != STORE_VERSION || hdr.byte_order != 0x01020304 || hdr.record_size != sizeof(store_unit_t))) {
+	fprintf(stderr, "%s is not a store of this version/byte order\n", path);
+	close(fd);
+	return -1;
+    }
+    // record cut by interrupted append: dropped, next one must stay aligned
+    if (st.st_size > (off_t)sizeof(hdr) && (st.st_size - sizeof(hdr)) % sizeof(store_unit_t) &&
+	ftruncate(fd, st.st_size - (st.st_size - sizeof(hdr)) % sizeof(store_unit_t))) {
+	perror("Cannot truncate store units");
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+/* mapped units file, *count records after header */
+static const store_unit_t *units_load(const char *dir, cfe_image_t *img, size_t *count)
+{
+    char path[PATH_MAX];
+    const store_header_t *hdr;
+
+    snprintf(path, sizeof(path), "%s/units", dir);
+    if (image_open(img, path, 0))
+	return NULL;
+    hdr = (const store_header_t *)img->mem;
+    if (img->size < sizeof(*hdr) || memcmp(hdr->magic, STORE_MAGIC, sizeof(hdr->magic)) || hdr->version != STORE_VERSION ||
+	hdr->byte_order != 0x01020304 || hdr->record_size != sizeof(store_unit_t)) {
+	fprintf(stderr, "%s is not a store of this version/byte order\n", path);
+	image_close(img);
+	return NULL;
+    }
+    // record cut by interrupted append is ignored
+    *count = (img->size - sizeof(*hdr)) / sizeof(store_unit_t);
+    return (const store_unit_t *)(img->mem + sizeof(*hdr));
+}
+
+static int unit_cmp(const void *a, const void *b, void *arg)
+{
+    const store_unit_t *units = arg;
+    uint32_t i = *(const uint32_t *)a, j = *(const uint32_t *)b;
+    int r = strncmp(units[i].name, units[j].name, sizeof(units[i].name));
+
+    return r ? r : (i > j) - (i < j);
+}
+
+/* latest record named name, NULL if none; order sorted by unit_cmp() */
+static const store_unit_t *unit_find(const store_unit_t *units, const uint32_t *order, size_t count, const char *name)
+{
+    size_t lo = 0, hi = count;
+
+    // first position past all records of name
+    while (lo < hi) {
+	size_t mid = lo + (hi - lo) / 2;
+
+	if (strncmp(units[order[mid]].name, name, sizeof(units->name)) <= 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo && !strncmp(units[order[lo - 1]].name, name, sizeof(units->name)) ? &units[order[lo - 1]] : NULL;
+}
+
+/* path below root (directory walked by --batch), file name if path is not under it */
+static const char *unit_name(const char *path, const char *root)
+{
+    size_t len = root ? strlen(root) : 0;
+
+    while (len > 1 && root[len - 1] == '/')
+	len--;
+    if (len && !strncmp(path, root, len) && path[len] == '/') {
+	for (path += len; *path == '/'; path++)
+	    ;
+	return path;
+    }
+    return strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+}
+
+static int name_cmp(const void *a, const void *b, void *arg)
+{
+    const char **names = arg;
+    uint32_t i = *(const uint32_t *)a, j = *(const uint32_t *)b;
+    int r = strcmp(names[i], names[j]);
+
+    return r ? r : (i > j) - (i < j);
+}
+
+/*
+ * first[i]: index of first dump named like dump i (i itself if it is the first),
+ * so two different dumps never end up as one unit. NULL on allocation failure.
+ */
+static uint32_t *names_first(const char **names, size_t count)
+{
+    uint32_t *order = malloc((count ? count : 1) * sizeof(*order));
+    uint32_t *first = malloc((count ? count : 1) * sizeof(*first));
+    size_t i;
+
+    if (!order || !first) {
+	free(order);
+	free(first);
+	return NULL;
+    }
+    for (i = 0; i < count; i++)
+	order[i] = i;
+    qsort_r(order, count, sizeof(*order), name_cmp, names);
+    for (i = 0; i < count; i++)
+	first[order[i]] = i && !strcmp(names[order[i]], names[order[i - 1]]) ? first[order[i - 1]] : order[i];
+    free(order);
+    return first;
+}
+
+static int ingest_one(store_ctx_t *ctx, int units_fd, const char *path, const char *name, int nvram_offset, int scan)
+{
+    const store_unit_t *prev = unit_find(ctx->units, ctx->order, ctx->units_num, name);
+    store_unit_t unit;
+    cfe_image_t img;
+    uint64_t ofs = nvram_offset;
+    int created;
+
+    if (strlen(name) >= sizeof(unit.name)) {
+	printf("BAD   %s: unit name too long\n", path);
+	return 1;
+    }
+    if (image_open(&img, path, 0)) {
+	printf("ERROR %s: cannot open\n", path);
+	return 1;
+    }
+    if (scan) {
+	nvram_hit_t hit;
+
+	if (!scan_cfe_nvram(img.mem, img.size, &hit, 1, NULL)) {
+	    printf("BAD   %s: no valid nvram found\n", path);
+	    image_close(&img);
+	    return 1;
+	}
+	ofs = hit.offset;
+    }
+    if (nvram_offset < 0 || img.size < STORE_NVRAM_SIZE || ofs > img.size - STORE_NVRAM_SIZE || check_cfe_nvram(img.mem + ofs)) {
+	printf("BAD   %s: nvram at %#" PRIx64 " is not valid\n", path, ofs);
+	image_close(&img);
+	return 1;
+    }
+
+    memset(&unit, 0, sizeof(unit));
+    snprintf(unit.name, sizeof(unit.name), "%s", name);
+    if (base_store(ctx, &img, ofs, unit.base, &created)) {
+	printf("ERROR %s: cannot store base image\n", path);
+	image_close(&img);
+	return 1;
+    }
+    unit.offset = ofs;
+    unit.size = img.size;
+    memcpy(unit.nvram, img.mem + ofs, STORE_NVRAM_SIZE);
+    if (write_all(units_fd, &unit, sizeof(unit))) {
+	printf("ERROR %s: cannot write unit record\n", path);
+	image_close(&img);
+	return 1;
+    }
+    ctx->bytes_in += img.size;
+    ctx->bytes_stored += sizeof(unit);
+    printf("OK    %s: unit %s, base %s%s%s\n", path, unit.name, unit.base, created ? " (new)" : "",
+	prev && memcmp(prev->nvram, unit.nvram, STORE_NVRAM_SIZE) ? ", replaces record with different nvram" : "");
+    image_close(&img);
+    return 0;
+}
+
+int store_ingest(const char *dir, char **paths, size_t count, const char *root, const char *unit, int nvram_offset, int scan)
+{
+    store_ctx_t ctx = { .dir = dir };
+    cfe_image_t units_img;
+    const char **names;
+    uint32_t *first;
+    size_t i, failed = 0;
+    int fd;
+
+    if (store_create(dir) || (fd = units_open_append(dir)) < 0)
+	return 1;
+    if (!(ctx.units = units_load(dir, &units_img, &ctx.units_num))) {
+	close(fd);
+	return 1;
+    }
+    names = malloc((count ? count : 1) * sizeof(*names));
+    ctx.order = malloc((ctx.units_num ? ctx.units_num : 1) * sizeof(*ctx.order));
+    for (i = 0; names && i < count; i++)
+	names[i] = unit ? unit : unit_name(paths[i], root);
+    if (!names || !ctx.order || !(first = names_first(names, count))) {
+	perror("Cannot allocate unit names");
+	free(names);
+	free(ctx.order);
+	image_close(&units_img);
+	close(fd);
+	return 1;
+    }
+    for (i = 0; i < ctx.units_num; i++)
+	ctx.order[i] = i;
+    qsort_r(ctx.order, ctx.units_num, sizeof(*ctx.order), unit_cmp, (void *)ctx.units);
+
+    for (i = 0; i < count; i++) {
+	if (first[i] != i) {
+	    printf("BAD   %s: unit name %s already used by %s\n", paths[i], names[i], paths[first[i]]);
+	    failed++;
+	    continue;
+	}
+	failed += ingest_one(&ctx, fd, paths[i], names[i], nvram_offset, scan);
+    }
+    if (fdatasync(fd)) {
+	perror("Cannot sync store units");
+	failed++;
+    }
+    close(fd);
+    free(first);
+    free(names);
+    free(ctx.order);
+    image_close(&units_img);
+
+    for (i = 0; i < ctx.bases_num; i++)
+	image_close(&ctx.bases[i].img);
+    free(ctx.bases);
+    printf("> store ingest: %zu files, %zu ok, %zu failed, %zu new base(s), %" PRIu64 " bytes in, %" PRIu64 " bytes stored\n",
+	count, count - failed, failed, ctx.new_bases, ctx.bytes_in, ctx.bytes_stored);
+    return failed;
+}
+
+int store_restore(const char *dir, const char *name, const char *output_name)
+{
+    const store_unit_t *units, *unit = NULL;
+    cfe_image_t units_img, base;
+    char path[PATH_MAX];
+    size_t count, i;
+    int retcode = 0;
+
+    if (!(units = units_load(dir, &units_img, &count)))
+	return 1;
+    for (i = count; i-- && !unit; )
+	if (!strncmp(units[i].name, name, sizeof(units[i].name)))
+	    unit = &units[i];
+    if (!unit) {
+	fprintf(stderr, "Unit %s is not in store %s\n", name, dir);
+	image_close(&units_img);
+	return 1;
+    }
+
+    base_path(path, sizeof(path), dir, unit->base, "");
+    if (image_open(&base, path, 0)) {
+	image_close(&units_img);
+	return 1;
+    }
+    if (base.size != unit->size || unit->offset > base.size - STORE_NVRAM_SIZE) {
+	fprintf(stderr, "Base %s does not match unit %s\n", path, name);
+	retcode++;
+    } else if (strcmp(output_name, "-")) {
+	retcode += image_write_block(&base, output_name, unit->offset, unit->nvram, STORE_NVRAM_SIZE);
+    } else {
+	// stream: unchanged ranges straight from mapped base
+	fflush(stdout);
+	if (write_all(STDOUT_FILENO, base.mem, unit->offset) || write_all(STDOUT_FILENO, unit->nvram, STORE_NVRAM_SIZE) ||
+	    write_all(STDOUT_FILENO, base.mem + unit->offset + STORE_NVRAM_SIZE, base.size - unit->offset - STORE_NVRAM_SIZE)) {
+	    perror("Cannot write output");
+	    retcode++;
+	}
+    }
+    image_close(&base);
+    image_close(&units_img);
+    return retcode;
+}
+
+int store_list(const char *dir)
+{
+    const store_unit_t *units;
+    cfe_image_t units_img;
+    uint32_t *order;
+    size_t count, i, listed = 0;
+
+    if (!(units = units_load(dir, &units_img, &count)))
+	return 1;
+    order = malloc((count ? count : 1) * sizeof(*order));
+    if (!order) {
+	image_close(&units_img);
+	return 1;
+    }
+    for (i = 0; i < count; i++)
+	order[i] = i;
+    qsort_r(order, count, sizeof(*order), unit_cmp, (void *)units);
+
+    printf("> store %s: %zu record(s)\n", dir, count);
+    for (i = 0; i < count; i++) {
+	const store_unit_t *u = &units[order[i]];
+
+	// last record of a name is the current one
+	if (i + 1 < count && !strncmp(u->name, units[order[i + 1]].name, sizeof(u->name)))
+	    continue;
+	printf(">> %-32.*s base %s, nvram at %#" PRIx64 ", %" PRIu64 " bytes\n", (int)sizeof(u->name), u->name, u->base, u->offset, u->size);
+	listed++;
+    }
+    printf(">> %zu unit(s)\n", listed);
+    free(order);
+    image_close(&units_img);
+    return 0;
+}
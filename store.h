@@ -0,0 +1,54 @@
+#ifndef CFE_STORE_H
+#define CFE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cfe_nvram.h"
+
+#define STORE_MAGIC	"CFESTO1"
+#define STORE_VERSION	1
+
+/*
+ * store directory layout:
+ * <dir>/base/<size>-<offset>-<crc32>[-n].bin - distinct images with nvram block erased (0xFF),
+ *     crc32 is over that erased form, -n suffix on crc collision of different contents
+ * <dir>/units - header, then one record per ingested dump (host byte order, append only,
+ *     last record of a unit name wins)
+ * unit name: path below the ingested directory, dump file name for file lists and -i,
+ * or given by caller
+ */
+typedef struct store_header {
+    char	magic[8];
+    uint32_t	version;
+    uint32_t	byte_order;	// 0x01020304 as written
+    uint32_t	record_size;
+    uint32_t	reserved;
+} store_header_t;
+
+typedef struct store_unit {
+    char		name[104];	// unique unit name (see above)
+    char		base[64];	// base file name without .bin
+    uint64_t		offset;		// nvram offset in image
+    uint64_t		size;		// image size
+    unsigned char	nvram[sizeof(bcm68380_nvram_t)];
+} store_unit_t;
+
+/*
+ * add dumps to store (created if missing): nvram block at nvram_offset (or first
+ * valid one if scan) becomes the unit record, rest of image is stored once per
+ * distinct content. Units are named by path relative to root (directory the paths
+ * were found in, NULL - file name only), or unit if one dump is given.
+ * Dumps mapping to the same name in one run are refused, replacing an existing
+ * unit with different nvram is reported. Prints one line per dump, returns
+ * number of failed dumps.
+ */
+int store_ingest(const char *dir, char **paths, size_t count, const char *root, const char *unit, int nvram_offset, int scan);
+
+/* rebuild image of unit into output_name (base cloned, nvram block written), "-" - stdout */
+int store_restore(const char *dir, const char *unit, const char *output_name);
+
+/* latest record of every unit, sorted by name */
+int store_list(const char *dir);
+
+#endif
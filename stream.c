@@ -0,0 +1,466 @@
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef ENABLE_GZIP
+#include <zlib.h>
+#endif
+#ifdef ENABLE_XZ
+#include <lzma.h>
+#endif
+#ifdef ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "cfe_nvram.h"
+#include "stats.h"
+#include "stream.h"
+
+#define STREAM_IN_CHUNK (64 << 10)
+
+/* decode step: 0 - more to come, 1 - end of stream, -1 - corrupt or truncated */
+typedef struct stream_codec {
+    int		type;
+    const char	*suffix;
+    const char	*name;
+    const unsigned char *magic;
+    size_t	magic_len;
+    int		(*init)(cfe_stream_t *s);
+    void	(*end)(cfe_stream_t *s);
+    int		(*decode)(cfe_stream_t *s, unsigned char *out, size_t out_size, size_t *produced, int input_eof);
+} stream_codec_t;
+
+#ifdef ENABLE_GZIP
+typedef struct gz_state {
+    z_stream	z;
+    int		boundary;	// between concatenated members (pigz, appended archives)
+} gz_state_t;
+
+static int gz_init(cfe_stream_t *s)
+{
+    gz_state_t *gz = calloc(1, sizeof(*gz));
+
+    if (!gz || inflateInit2(&gz->z, 15 + 32) != Z_OK) {
+	free(gz);
+	return 1;
+    }
+    s->dec = gz;
+    return 0;
+}
+
+static void gz_end(cfe_stream_t *s)
+{
+    gz_state_t *gz = s->dec;
+
+    inflateEnd(&gz->z);
+    free(gz);
+}
+
+static int gz_decode(cfe_stream_t *s, unsigned char *out, size_t out_size, size_t *produced, int input_eof)
+{
+    gz_state_t *gz = s->dec;
+    int ret;
+
+    *produced = 0;
+    if (gz->boundary && s->in_pos == s->in_len)
+	return input_eof ? 1 : 0;
+    gz->boundary = 0;
+
+    gz->z.next_in = s->in + s->in_pos;
+    gz->z.avail_in = s->in_len - s->in_pos;
+    gz->z.next_out = out;
+    gz->z.avail_out = out_size;
+    ret = inflate(&gz->z, Z_NO_FLUSH);
+    s->in_pos = s->in_len - gz->z.avail_in;
+    *produced = out_size - gz->z.avail_out;
+
+    if (ret == Z_STREAM_END) {
+	inflateReset(&gz->z);
+	gz->boundary = 1;
+	return 0;
+    }
+    return ret == Z_OK || ret == Z_BUF_ERROR ? 0 : -1;
+}
+
+static const unsigned char gz_magic[] = { 0x1f, 0x8b };
+#endif
+
+#ifdef ENABLE_XZ
+static int xz_init(cfe_stream_t *s)
+{
+    lzma_stream *strm = malloc(sizeof(*strm));
+    lzma_stream init = LZMA_STREAM_INIT;
+
+    if (!strm)
+	return 1;
+    *strm = init;
+    if (lzma_stream_decoder(strm, UINT64_MAX, LZMA_CONCATENATED) != LZMA_OK) {
+	free(strm);
+	return 1;
+    }
+    s->dec = strm;
+    return 0;
+}
+
+static void xz_end(cfe_stream_t *s)
+{
+    lzma_end(s->dec);
+    free(s->dec);
+}
+
+static int xz_decode(cfe_stream_t *s, unsigned char *out, size_t out_size, size_t *produced, int input_eof)
+{
+    lzma_stream *strm = s->dec;
+    lzma_ret ret;
+
+    strm->next_in = s->in + s->in_pos;
+    strm->avail_in = s->in_len - s->in_pos;
+    strm->next_out = out;
+    strm->avail_out = out_size;
+    ret = lzma_code(strm, input_eof ? LZMA_FINISH : LZMA_RUN);
+    s->in_pos = s->in_len - strm->avail_in;
+    *produced = out_size - strm->avail_out;
+
+    if (ret == LZMA_STREAM_END)
+	return 1;
+    return ret == LZMA_OK ? 0 : -1;
+}
+
+static const unsigned char xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+#endif
+
+#ifdef ENABLE_ZSTD
+typedef struct zstd_state {
+    ZSTD_DStream	*ds;
+    int			boundary;	// frame complete, next one (if any) starts with more input
+} zstd_state_t;
+
+static int zstd_init(cfe_stream_t *s)
+{
+    zstd_state_t *z = calloc(1, sizeof(*z));
+
+    if (!z || !(z->ds = ZSTD_createDStream())) {
+	free(z);
+	return 1;
+    }
+    ZSTD_initDStream(z->ds);
+    s->dec = z;
+    return 0;
+}
+
+static void zstd_end(cfe_stream_t *s)
+{
+    zstd_state_t *z = s->dec;
+
+    ZSTD_freeDStream(z->ds);
+    free(z);
+}
+
+static int zstd_decode(cfe_stream_t *s, unsigned char *out, size_t out_size, size_t *produced, int input_eof)
+{
+    zstd_state_t *z = s->dec;
+    ZSTD_inBuffer in = { s->in, s->in_len, s->in_pos };
+    ZSTD_outBuffer o = { out, out_size, 0 };
+    size_t ret;
+
+    *produced = 0;
+    if (z->boundary && s->in_pos == s->in_len)
+	return input_eof ? 1 : 0;
+
+    ret = ZSTD_decompressStream(z->ds, &o, &in);
+    s->in_pos = in.pos;
+    *produced = o.pos;
+    if (ZSTD_isError(ret))
+	return -1;
+    z->boundary = !ret;
+    // frame not complete, input exhausted and nothing buffered: truncated
+    if (input_eof && ret && in.pos == in.size && !o.pos)
+	return -1;
+    return 0;
+}
+
+static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+#endif
+
+static const stream_codec_t codecs[] = {
+#ifdef ENABLE_GZIP
+    { STREAM_GZIP, ".gz", "gzip", gz_magic, sizeof(gz_magic), gz_init, gz_end, gz_decode },
+#endif
+#ifdef ENABLE_XZ
+    { STREAM_XZ, ".xz", "xz", xz_magic, sizeof(xz_magic), xz_init, xz_end, xz_decode },
+#endif
+#ifdef ENABLE_ZSTD
+    { STREAM_ZSTD, ".zst", "zstd", zstd_magic, sizeof(zstd_magic), zstd_init, zstd_end, zstd_decode },
+#endif
+    { STREAM_NONE, NULL, NULL, NULL, 0, NULL, NULL, NULL },
+};
+
+/* suffixes are recognized even if support is not built in, open reports it */
+static const char *suffixes[] = { NULL, ".gz", ".xz", ".zst" };
+static const char *type_names[] = { "plain", "gzip", "xz", "zstd" };
+
+int stream_type(const char *name)
+{
+    size_t len = strlen(name);
+    int i;
+
+    for (i = STREAM_GZIP; i <= STREAM_ZSTD; i++) {
+	size_t n = strlen(suffixes[i]);
+	if (len > n && !strcmp(name + len - n, suffixes[i]))
+	    return i;
+    }
+    return STREAM_NONE;
+}
+
+const char *stream_type_name(int type)
+{
+    return type >= STREAM_NONE && type <= STREAM_ZSTD ? type_names[type] : "?";
+}
+
+static const stream_codec_t *stream_codec(int type)
+{
+    const stream_codec_t *c;
+
+    for (c = codecs; c->type != STREAM_NONE && c->type != type; c++);
+    return c->type != STREAM_NONE ? c : NULL;
+}
+
+static int stream_start(cfe_stream_t *s)
+{
+    s->in_len = s->in_pos = 0;
+    s->win_ofs = 0;
+    s->win_len = 0;
+    s->eof = 0;
+    s->error = 0;
+    s->in_total = 0;
+    if (lseek(s->fd, 0, SEEK_SET))
+	return 1;
+    stats_syscall();
+    return stream_codec(s->type)->init(s);
+}
+
+int stream_open(cfe_stream_t *s, const char *name)
+{
+    const stream_codec_t *codec;
+    unsigned char magic[8];
+
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    s->fd = -1;
+    s->type = stream_type(name);
+    codec = stream_codec(s->type);
+    if (!codec) {
+	fprintf(stderr, "%s: %s input is not supported by this build\n", name, stream_type_name(s->type));
+	return 1;
+    }
+
+    s->fd = open(name, O_RDONLY);
+    stats_syscall();
+    if (s->fd < 0) {
+	perror("Cannot open file for read");
+	return 1;
+    }
+    if (pread(s->fd, magic, codec->magic_len, 0) != (ssize_t)codec->magic_len || memcmp(magic, codec->magic, codec->magic_len)) {
+	fprintf(stderr, "%s: not %s data\n", name, codec->name);
+	goto error;
+    }
+    stats_io(STAT_BYTES_READ, codec->magic_len);
+
+    s->in = malloc(STREAM_IN_CHUNK);
+    s->win = malloc(STREAM_WINDOW);
+    if (!s->in || !s->win) {
+	perror("Cannot allocate stream buffers");
+	goto error;
+    }
+    if (stream_start(s)) {
+	fprintf(stderr, "%s: cannot start %s decoder\n", name, codec->name);
+	goto error;
+    }
+    return 0;
+
+    error:
+    free(s->in);
+    free(s->win);
+    close(s->fd);
+    s->in = s->win = NULL;
+    s->fd = -1;
+    return 1;
+}
+
+void stream_close(cfe_stream_t *s)
+{
+    if (s->dec)
+	stream_codec(s->type)->end(s);
+    s->dec = NULL;
+    free(s->in);
+    free(s->win);
+    s->in = s->win = NULL;
+    if (s->fd >= 0) {
+	close(s->fd);
+	stats_syscall();
+    }
+    s->fd = -1;
+}
+
+/* going back: decoder starts over from the beginning of file */
+static int stream_rewind(cfe_stream_t *s)
+{
+    stream_codec(s->type)->end(s);
+    s->dec = NULL;
+    return stream_start(s);
+}
+
+/* drop window data before ofs */
+static void stream_slide(cfe_stream_t *s, uint64_t ofs)
+{
+    size_t drop;
+
+    if (ofs <= s->win_ofs)
+	return;
+    drop = ofs - s->win_ofs < s->win_len ? ofs - s->win_ofs : s->win_len;
+    memmove(s->win, s->win + drop, s->win_len - drop);
+    s->win_len -= drop;
+    s->win_ofs += drop;
+}
+
+/* decompress into free space of window until some output or end, 0 on success */
+static int stream_decode(cfe_stream_t *s)
+{
+    const stream_codec_t *codec = stream_codec(s->type);
+
+    while (!s->eof && s->win_len < STREAM_WINDOW) {
+	int input_eof = 0, ret;
+	size_t produced;
+
+	if (s->in_pos == s->in_len) {
+	    ssize_t n = read(s->fd, s->in, STREAM_IN_CHUNK);
+	    stats_io(STAT_BYTES_READ, n > 0 ? n : 0);
+	    if (n < 0 && errno == EINTR)
+		continue;
+	    if (n < 0) {
+		perror("Cannot read compressed input");
+		s->error = 1;
+		return 1;
+	    }
+	    s->in_len = n;
+	    s->in_pos = 0;
+	    s->in_total += n;
+	    input_eof = !n;
+	}
+
+	ret = codec->decode(s, s->win + s->win_len, STREAM_WINDOW - s->win_len, &produced, input_eof);
+	s->win_len += produced;
+	if (ret > 0)
+	    s->eof = 1;
+	if (ret < 0 || (!ret && input_eof && !produced)) {
+	    fprintf(stderr, "%s: %s data is corrupt or truncated at %llu\n", s->name, codec->name,
+		(unsigned long long)(s->win_ofs + s->win_len));
+	    s->error = 1;
+	    return 1;
+	}
+	if (produced)
+	    return 0;
+    }
+    return 0;
+}
+
+int stream_read(cfe_stream_t *s, uint64_t ofs, void *buf, size_t len)
+{
+    if (len > STREAM_WINDOW / 2)
+	return 1;
+    if (ofs < s->win_ofs && stream_rewind(s))
+	return 1;
+
+    while (ofs + len > s->win_ofs + s->win_len) {
+	if (s->eof)
+	    return 1;
+	// only the requested range has to stay in window
+	if (s->win_len == STREAM_WINDOW)
+	    stream_slide(s, ofs);
+	if (stream_decode(s))
+	    return 1;
+    }
+    memcpy(buf, s->win + (ofs - s->win_ofs), len);
+    return 0;
+}
+
+size_t stream_scan(cfe_stream_t *s, nvram_hit_t *hits, unsigned char *blocks, size_t max_hits,
+    size_t *rejected, int first_only, uint64_t *size)
+{
+    nvram_hit_t window_hits[16];
+    uint64_t pos = 0, skip = 0;
+    size_t found = 0, bad = 0;
+
+    if (s->win_ofs && stream_rewind(s))
+	goto exit;
+
+    while (1) {
+	size_t n, rej, i;
+
+	// window from pos, filled as far as possible
+	stream_slide(s, pos);
+	while (!s->eof && s->win_len < STREAM_WINDOW)
+	    if (stream_decode(s))
+		goto exit;
+
+	n = scan_cfe_nvram(s->win, s->win_len, window_hits, sizeof(window_hits) / sizeof(window_hits[0]), &rej);
+	bad += rej;
+	for (i = 0; i < n; i++) {
+	    uint64_t ofs;
+
+	    if (i == sizeof(window_hits) / sizeof(window_hits[0])) {
+		// more blocks than hit slots in one window (unlikely): count only
+		found += n - i;
+		break;
+	    }
+	    ofs = s->win_ofs + window_hits[i].offset;
+	    if (ofs < skip)
+		continue; // block started in previous window
+	    if (found < max_hits) {
+		hits[found].offset = ofs;
+		hits[found].vendor_type = window_hits[i].vendor_type;
+		if (blocks)
+		    memcpy(blocks + found * sizeof(bcm68380_nvram_t), s->win + window_hits[i].offset, sizeof(bcm68380_nvram_t));
+	    }
+	    found++;
+	    skip = ofs + sizeof(bcm68380_nvram_t);
+	}
+
+	if (s->eof || (first_only && found))
+	    break;
+	// next window overlaps by one block minus a byte: every block is whole in exactly one window
+	pos = s->win_ofs + s->win_len - (sizeof(bcm68380_nvram_t) - 1);
+    }
+
+    exit:
+    if (rejected)
+	*rejected = bad;
+    if (size)
+	*size = s->win_ofs + s->win_len;
+    return found;
+}
+
+int stream_read_nvram(const char *name, int nvram_offset, int scan, unsigned char *block, size_t *offset)
+{
+    cfe_stream_t s;
+    nvram_hit_t hit;
+    int retcode = 0;
+
+    if (stream_open(&s, name))
+	return 1;
+    if (scan) {
+	if (stream_scan(&s, &hit, block, 1, NULL, 1, NULL))
+	    *offset = hit.offset;
+	else
+	    retcode++;
+    } else {
+	*offset = nvram_offset;
+	retcode += stream_read(&s, nvram_offset, block, sizeof(bcm68380_nvram_t));
+    }
+    stream_close(&s);
+    return retcode;
+}
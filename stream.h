@@ -0,0 +1,62 @@
+#ifndef CFE_STREAM_H
+#define CFE_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "scan.h"
+
+enum {
+    STREAM_NONE = 0,	// not compressed
+    STREAM_GZIP,	// .gz
+    STREAM_XZ,		// .xz
+    STREAM_ZSTD,	// .zst
+};
+
+#define STREAM_WINDOW (4 << 20)	// decompressed bytes kept in memory
+
+/*
+ * compressed dump decoded forward into a fixed-size sliding window:
+ * only the data up to the requested offset is decompressed, going back
+ * restarts the decoder
+ */
+typedef struct cfe_stream {
+    const char		*name;
+    int			fd;
+    int			type;
+    void		*dec;		// decoder state
+    unsigned char	*in;		// compressed input buffer
+    size_t		in_len;
+    size_t		in_pos;
+    unsigned char	*win;
+    uint64_t		win_ofs;	// decompressed offset of win[0]
+    size_t		win_len;
+    int			eof;
+    int			error;		// corrupt/truncated input or read error
+    uint64_t		in_total;	// compressed bytes read
+} cfe_stream_t;
+
+/* compression by file name suffix, STREAM_NONE for plain files */
+int stream_type(const char *name);
+const char *stream_type_name(int type);
+
+/* 0 on success; fails if compression is not supported by this build or magic does not match */
+int stream_open(cfe_stream_t *s, const char *name);
+void stream_close(cfe_stream_t *s);
+
+/* copy decompressed [ofs, ofs + len) into buf, len up to STREAM_WINDOW / 2; 0 on success */
+int stream_read(cfe_stream_t *s, uint64_t ofs, void *buf, size_t len);
+
+/*
+ * scan_cfe_nvram() over the whole stream (window by window), up to max_hits
+ * hits and their blocks (sizeof(bcm68380_nvram_t) each, if blocks is not NULL)
+ * are stored; first_only stops decompression at the first window with a hit.
+ * Returns number of blocks found, *size is decompressed size read.
+ */
+size_t stream_scan(cfe_stream_t *s, nvram_hit_t *hits, unsigned char *blocks, size_t max_hits,
+    size_t *rejected, int first_only, uint64_t *size);
+
+/* nvram block of compressed image at offset, or first valid one with scan; 0 on success */
+int stream_read_nvram(const char *name, int nvram_offset, int scan, unsigned char *block, size_t *offset);
+
+#endif